@@ -1,5 +1,6 @@
 #pragma once
 
+#include "cache_param.h"
 #include "inline_asm.h"
 #include "sugar.h"
 
@@ -75,20 +76,74 @@ static inline void flush_array(u8 **addrs, size_t size) {
     }
 }
 
+/* intrusive candidate links: each line keeps a pointer to the line
+CAND_LINK_WAYS entries before it in its array, in the first pointer-aligned
+slot of its line past the evchain pointers at the address (the
+CAND_LINK_OFFSET bytes there), or in the last slot before them if there is no
+room after. Addresses need not be line-aligned, and the slot never overlaps
+the evchain bytes. Walking the CAND_LINK_WAYS interleaved chains touches the
+lines in the same order as access_array_bwd, but reads only CAND_LINK_WAYS
+entries of the array instead of all of them. Walks are counted, so sub-arrays
+of a linked array can be walked as well.
+*/
+#define CAND_LINK_OFFSET 16
+#define CAND_LINK_WAYS 8
+
+static __always_inline u8 **_cand_link_slot(u8 *addr) {
+    const uintptr_t align = sizeof(u8 *) - 1;
+    uintptr_t a = (uintptr_t)addr, off = a & CL_MASK;
+    uintptr_t slot = (off + CAND_LINK_OFFSET + align) & ~align;
+    if (slot > CL_SIZE - sizeof(u8 *)) {
+        slot = (off & ~align) - sizeof(u8 *);
+    }
+    return (u8 **)((a & ~CL_MASK) | slot);
+}
+
+static __always_inline u8 *_cand_link(u8 *addr) {
+    return *(u8 *volatile *)_cand_link_slot(addr);
+}
+
+static __always_inline void access_links_bwd(u8 **addrs, size_t size) {
+    u8 *heads[CAND_LINK_WAYS];
+    size_t rounds = size / CAND_LINK_WAYS, rem = size % CAND_LINK_WAYS;
+    _Pragma("GCC unroll 8") for (size_t j = 0; j < CAND_LINK_WAYS; j++) {
+        heads[j] = addrs[size - 1 - j];
+    }
+
+    for (size_t r = 0; r < rounds; r++) {
+        _Pragma("GCC unroll 8") for (size_t j = 0; j < CAND_LINK_WAYS; j++) {
+            heads[j] = _cand_link(heads[j]);
+        }
+    }
+
+    for (size_t j = 0; j < rem; j++) {
+        _cand_link(heads[j]);
+    }
+}
+
+static __always_inline void access_cands_bwd(u8 **addrs, size_t size,
+                                             bool linked) {
+    if (linked && size >= CAND_LINK_WAYS) {
+        access_links_bwd(addrs, size);
+    } else {
+        access_array_bwd(addrs, size);
+    }
+}
+
 // eviction pattern from Daniel Gruss
 // Rowhammer.js: A Remote Software-Induced Fault Attack in JavaScript
 static __always_inline void prime_cands_daniel(u8 **cands, size_t cnt,
                                                size_t repeat, size_t stride,
-                                               size_t block) {
+                                               size_t block, bool linked) {
     block = _min(block, cnt);
     for (size_t s = 0; s < cnt; s += stride) {
         for (size_t c = 0; c < repeat; c++) {
             if (cnt >= block + s) {
-                access_array_bwd(&cands[s], block);
+                access_cands_bwd(&cands[s], block, linked);
             } else {
                 u32 rem = cnt - s;
-                access_array_bwd(&cands[s], rem);
-                access_array_bwd(cands, block - rem);
+                access_cands_bwd(&cands[s], rem, linked);
+                access_cands_bwd(cands, block - rem, linked);
             }
         }
     }
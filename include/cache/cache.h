@@ -4,6 +4,8 @@
 #include "cache_param.h"
 #include "evchain.h"
 #include "evset.h"
+#include "evset_store.h"
+#include "evset_health.h"
 #include "oracle.h"
 #include "latency.h"
 #include "monitor.h"
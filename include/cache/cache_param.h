@@ -4,9 +4,23 @@
 #include "libpt.h"
 
 extern bool __has_hugepage;
+extern u32 __hugepage_shift; // HUGE_PAGE_SHIFT or GIGA_PAGE_SHIFT
 
 static inline void cache_use_hugepage() {
     __has_hugepage = true;
+    __hugepage_shift = HUGE_PAGE_SHIFT;
+}
+
+// 1GB pages cut the pages (and TLB entries) a pool spans. They only shrink
+// pools of caches whose set index reaches past a 2MB page, which the L2 and
+// LLC of current Intel server parts do not
+static inline void cache_use_gigapage() {
+    __has_hugepage = true;
+    __hugepage_shift = GIGA_PAGE_SHIFT;
+}
+
+static inline size_t cache_hugepage_size() {
+    return 1ull << __hugepage_shift;
 }
 
 static inline void cache_disable_hugepage() {
@@ -65,8 +79,8 @@ void set_cache_num_slices(cache_param *param, u32 n_slices);
 
 void pprint_cache_param(cache_param *param);
 
-static __always_inline size_t cache_uncertainty(cache_param *param) {
-    size_t bits_under_ctrl = __has_hugepage ? HUGE_PAGE_SHIFT : PAGE_SHIFT;
+static __always_inline size_t cache_uncertainty_at(cache_param *param,
+                                                   size_t bits_under_ctrl) {
     size_t set_bits_under_ctrl = bits_under_ctrl - param->num_cl_bits;
     if (set_bits_under_ctrl >= param->num_set_idx_bits)
         return param->n_slices;
@@ -75,6 +89,13 @@ static __always_inline size_t cache_uncertainty(cache_param *param) {
                param->n_slices;
 }
 
+// assumes the preferred pages are available; a pool that fell back to 4KB
+// pages has more, so size per-pool structures with evcands_uncertainty()
+static __always_inline size_t cache_uncertainty(cache_param *param) {
+    return cache_uncertainty_at(
+        param, __has_hugepage ? __hugepage_shift : PAGE_SHIFT);
+}
+
 static __always_inline size_t cache_congruent_stride(cache_param *param) {
     return 1ull << (param->num_set_idx_bits + param->num_cl_bits);
 }
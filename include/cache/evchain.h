@@ -11,6 +11,10 @@ evchain *evchain_build(u8 *addrs[], size_t size);
 
 evchain *evchain_stride(u8 *start, ptrdiff_t stride, size_t size);
 
+// clear the links of a chain, so that none of its lines points into a chain
+// that is rebuilt from other lines
+void evchain_release(evchain *chain);
+
 static __always_inline evchain *evchain_next(evchain *chain) {
     evchain *next = NULL;
     __asm__ __volatile__("mov (%1), %0\n\t"
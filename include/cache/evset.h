@@ -2,11 +2,13 @@
 
 #include "cache_param.h"
 #include "access_seq.h"
+#include "hugepage.h"
 #include "helper_thread.h"
 #include "bitwise.h"
 #include "latency.h"
 #include "libpt.h"
 #include "misc.h"
+#include "evset_stats.h"
 
 typedef enum {
     EVSET_ALGO_NAIVE = 1,
@@ -21,171 +23,92 @@ typedef enum {
     EVSET_ALGO_INVALID = -1
 } evset_algorithm;
 
-#define MAX_RETRY_REC 22
-#define MAX_BACKTRACK_REC 102
-
-struct evset_stats {
-    u64 alloc_duration;
-    u64 population_duration;
-    u64 build_duration;
-    u64 pruning_duration;
-    u64 extension_duration;
-    u64 retries, backtracks, cands_tests, mem_accs;
-    u64 pure_mem_acc, pure_tests;
-    u64 pure_mem_acc2, pure_tests2;
-    u64 pos_unsure, neg_unsure, ooh, ooc; // out-of-history/candidates
-    u64 no_next, timeout, meet, retry_duration;
-    u32 retry_dist[MAX_RETRY_REC], useful_retry_dist[MAX_RETRY_REC];
-    u64 retry_duras[MAX_RETRY_REC], useful_retry_duras[MAX_RETRY_REC];
-    u32 bctr_dist[MAX_BACKTRACK_REC], useful_bctr_dist[MAX_BACKTRACK_REC];
-    u64 bctr_duras[MAX_BACKTRACK_REC], useful_bctr_duras[MAX_BACKTRACK_REC];
-};
-
-extern struct evset_stats _evset_stats;
-
-static inline void inc_retry(u64 retry) {
-    if (retry < MAX_RETRY_REC - 1) {
-        _evset_stats.retry_dist[retry] += 1;
-    } else {
-        _evset_stats.retry_dist[MAX_RETRY_REC - 1] += 1;
-    }
-}
-
-static inline void inc_retry_dura(u64 retry, u64 dura) {
-    if (retry < MAX_RETRY_REC - 1) {
-        _evset_stats.retry_duras[retry] += dura;
-    } else {
-        _evset_stats.retry_duras[MAX_RETRY_REC - 1] += dura;
-    }
-}
-
-static inline void inc_useful_retry(u64 retry) {
-    if (retry < MAX_RETRY_REC - 1) {
-        _evset_stats.useful_retry_dist[retry] += 1;
-    } else {
-        _evset_stats.useful_retry_dist[MAX_RETRY_REC - 1] += 1;
-    }
-}
-
-static inline void inc_useful_retry_dura(u64 retry, u64 dura) {
-    if (retry < MAX_RETRY_REC - 1) {
-        _evset_stats.useful_retry_duras[retry] += dura;
-    } else {
-        _evset_stats.useful_retry_duras[MAX_RETRY_REC - 1] += dura;
-    }
-}
-
-static inline void inc_bctr(u64 bctr) {
-    if (bctr < MAX_BACKTRACK_REC - 1) {
-        _evset_stats.bctr_dist[bctr] += 1;
-    } else {
-        _evset_stats.bctr_dist[MAX_BACKTRACK_REC - 1] += 1;
-    }
-}
-
-static inline void inc_useful_bctr(u64 bctr) {
-    if (bctr < MAX_BACKTRACK_REC - 1) {
-        _evset_stats.useful_bctr_dist[bctr] += 1;
-    } else {
-        _evset_stats.useful_bctr_dist[MAX_BACKTRACK_REC - 1] += 1;
-    }
-}
-
-static inline void inc_bctr_dura(u64 bctr, u64 dura) {
-    if (bctr < MAX_BACKTRACK_REC - 1) {
-        _evset_stats.bctr_duras[bctr] += dura;
-    } else {
-        _evset_stats.bctr_duras[MAX_BACKTRACK_REC - 1] += dura;
-    }
-}
-
-static inline void inc_useful_bctr_dura(u64 bctr, u64 dura) {
-    if (bctr < MAX_BACKTRACK_REC - 1) {
-        _evset_stats.useful_bctr_duras[bctr] += dura;
-    } else {
-        _evset_stats.useful_bctr_duras[MAX_BACKTRACK_REC - 1] += dura;
-    }
-}
-
-static inline void _pprint_dist(u32 *total, u32 *useful, u64 *total_dura,
-                                u64 *useful_dura, u32 max_cnt,
-                                const char *name) {
-    _info("%s:", name);
-    for (u32 i = 1; i < max_cnt; i++) {
-        if (total[i] || useful[i]) {
-            if (i == max_cnt - 1) {
-                fprintf(stderr, " >=%u:", i);
-            } else {
-                fprintf(stderr, " %u:", i);
-            }
-            fprintf(stderr, " %u/%u-%lu/%lums;", useful[i], total[i],
-                    useful_dura[i] / 1000000, total_dura[i] / 1000000);
-        }
-    }
-    fprintf(stderr, "\n");
-}
-
-static inline void pprint_evset_stats() {
-    _info("Alloc: %luus; Population: %luus; Build: %luus; Pruning: %luus; "
-          "Extension: %luus;\n"
-          "Retries: %lu; Backtracks: %lu; Tests: %lu; Mem Acc.: %lu;\n"
-          "Pos unsure: %lu; Neg unsure: %lu; OOH: %lu; OOC: %lu; NoNex: %lu; "
-          "Timeout: %lu\nPure acc: %lu; Pure tests: %lu; Pure acc 2: %lu; Pure "
-          "tests 2: %lu\n",
-          _evset_stats.alloc_duration / 1000,
-          _evset_stats.population_duration / 1000,
-          _evset_stats.build_duration / 1000,
-          _evset_stats.pruning_duration / 1000,
-          _evset_stats.extension_duration / 1000, _evset_stats.retries,
-          _evset_stats.backtracks, _evset_stats.cands_tests,
-          _evset_stats.mem_accs, _evset_stats.pos_unsure,
-          _evset_stats.neg_unsure, _evset_stats.ooh, _evset_stats.ooc,
-          _evset_stats.no_next, _evset_stats.timeout, _evset_stats.pure_mem_acc,
-          _evset_stats.pure_tests, _evset_stats.pure_mem_acc2,
-          _evset_stats.pure_tests2);
-
-    _pprint_dist(_evset_stats.retry_dist, _evset_stats.useful_retry_dist,
-                 _evset_stats.retry_duras, _evset_stats.useful_retry_duras,
-                 MAX_RETRY_REC, "Retry dist");
-    _pprint_dist(_evset_stats.bctr_dist, _evset_stats.useful_bctr_dist,
-                 _evset_stats.bctr_duras, _evset_stats.useful_bctr_duras,
-                 MAX_BACKTRACK_REC, "Backtrack dist");
-    _info("Meet: %lu; Retry: %luus\n", _evset_stats.meet,
-          _evset_stats.retry_duration / 1000);
-}
-
-static inline void reset_evset_stats() {
-    memset(&_evset_stats, 0, sizeof(_evset_stats));
-}
-
 struct _evset;
 struct _evtest_config;
+struct _cache_sim;
 
 /* Eviction candidates */
 typedef struct {
     // scaling: allocate floor(uncertainty * n_ways * scaling) candidates
     double scaling;
     struct _evset *filter_ev;
+    // group candidates by their physical set (and modelled slice) when
+    // physical addresses are available, which skips most timing tests.
+    // Off by default, so that the oracle still checks what timing built
+    bool pa_assist;
 } EVCandsConfig;
 
 // a memory buffer to choose candidate address from
 typedef struct {
     void *buf;
-    size_t n_pages, ref_cnt;
+    size_t n_pages, ref_cnt; // n_pages: of the size the buffer is sized for
+    size_t buf_size;
+    int fd; // backing file of a file-backed buffer, -1 otherwise
+    hugepage_buf hp; // the page backing of buf
 } EVBuffer;
 
+// in hugepage mode, falls back to THP and then to 4KB pages if no hugepages
+// are reserved; candidates are only laid out over the hugepage-backed regions
 EVBuffer *evbuffer_new(cache_param *cache, EVCandsConfig *config);
 
+// map a buffer backed by the file at "path", which is created if necessary.
+// The file outlives the process, so a buffer on hugetlbfs or tmpfs keeps its
+// physical pages across runs; "reused" tells whether an existing file of the
+// right size was mapped. Hugepage mode requires a file on hugetlbfs.
+EVBuffer *evbuffer_open(const char *path, cache_param *cache,
+                        EVCandsConfig *config, bool *reused);
+
 void evbuffer_free(EVBuffer *evb);
 
-// tracking eviction candidates
+// intrusive links are only written into lines of live EVBuffers. A test
+// links its candidates and registers the array for the calling thread;
+// traversals walk the links of (sub-arrays of) the registered array.
 typedef struct {
-    u8 **cands;
+    u8 **addrs;
+    size_t size;
+} cand_links;
+
+extern __thread cand_links _cand_links_cur;
+
+#define CAND_LINK_MIN_CNT (4 * CAND_LINK_WAYS)
+
+// link and register "cands"; returns false (and registers nothing) if a line
+// is outside all EVBuffers. The previous registration is saved to "saved"
+bool cand_links_begin(u8 **cands, size_t cnt, cand_links *saved);
+
+static inline void cand_links_end(cand_links *saved) {
+    _cand_links_cur = *saved;
+}
+
+static __always_inline bool cand_links_active(u8 **cands, size_t cnt) {
+    cand_links *cur = &_cand_links_cur;
+    return cur->addrs && cands >= cur->addrs &&
+           cands + cnt <= cur->addrs + cur->size;
+}
+
+// tracking eviction candidates
+typedef struct _evcands {
+    u8 **cands; // NULL in a shifted view until evcands_materialize()
     EVBuffer *evb;
     size_t size, ref_cnt;
     cache_param *cache;
+
+    // compact form: 32-bit page indices relative to evb->buf, created on the
+    // first shift and shared with every view of the same base; repopulating
+    // the base drops it
+    u32 *page_idxs;
+    size_t n_idxs, n_views;
+    u32 offset; // page offset of the candidates
+    struct _evcands *base; // the owner of page_idxs for views
+
+    u32 ctrl_bits; // low address bits all candidates share with the target
 } EVCands;
 
+// the number of congruence classes of "cache" the candidates spread over
+static inline size_t evcands_uncertainty(EVCands *cands, cache_param *cache) {
+    return cache_uncertainty_at(cache, cands->ctrl_bits);
+}
+
 void evcands_free(EVCands *cands);
 
 // allocate an EVCands structure. If evb is NULL, it will automatically allocate
@@ -193,13 +116,41 @@ void evcands_free(EVCands *cands);
 // EVCands.cands
 EVCands *evcands_new(cache_param *cache, EVCandsConfig *config, EVBuffer *evb);
 
-// shift each candidate address to a new page offset
+// an O(1) view of the candidates at a new page offset; views hold a reference
+// on their base and must be freed first. A base with live views cannot be
+// repopulated
 EVCands *evcands_shift(EVCands *cands, u32 offset);
 
+// expand the candidate array of a view; no-op if it already exists
+bool evcands_materialize(EVCands *cands);
+
+// drop the candidate array of a view; it is rebuilt on the next use
+void evcands_release(EVCands *cands);
+
+// keep only the candidates "filter_ev" evicts, e.g., to re-check a shifted
+// view against the shifted filter evset; the survivors keep no order
+bool evcands_filter(EVCands *cands, struct _evset *filter_ev);
+
+void evcands_shuffle(EVCands *cands);
+
 // populate EVCands.cands. If EVCandsConfig has filter_ev,
 // then candidate filtering is performed.
 bool evcands_populate(u32 offset, EVCands *cands, EVCandsConfig *config);
 
+// populate the candidates of several filter evsets (e.g., one per L2 color)
+// in one pass: every line is tested against every filter evset, with one
+// batched pass per evset. A line joins a color only if no other color claims
+// it and it passes that color's test again; lines several colors claim are
+// tested once more, and stay unclassified if they are still contested. The
+// lines are split into "n_threads" disjoint slices, each classified by a
+// thread on cores[t] (unpinned if "cores" is NULL); with filter evsets of a
+// private cache, the threads do not interfere.
+// Every cands[c] must share the buffer of cands[0].
+bool evcands_populate_colors(u32 offset, EVCands **cands,
+                             struct _evset **filter_evs, u32 n_colors,
+                             EVCandsConfig *config, u32 n_threads,
+                             const int *cores);
+
 // Test result with uncertainty info.
 // Algorithms may use the uncertainty info to improve its accuracy or speed.
 typedef enum {
@@ -233,12 +184,30 @@ typedef struct _evtest_config {
 
     u32 stride, block;
 
+    // for sprt_test_eviction: p0/p1 are the chances of an over-threshold
+    // trial without/with eviction; stop as soon as the false positive
+    // (alpha) or false negative (beta) rate is met, or after max_trials
+    // (0: trials * unsure_retry)
+    double sprt_p0, sprt_p1, sprt_alpha, sprt_beta;
+    u32 sprt_max_trials;
+
     // access an eviction set for a lower-level cache
     struct _evset *lower_ev;
 
     // whether the eviction requires a helper thread
     bool need_helper, flush_cands, foreign_evictor;
+
+    // link the candidates of each test in-line, so that traversals do not
+    // load (and cache) the pointer array; see access_seq.h
+    bool link_cands;
     helper_thread_ctrl *hctrl;
+    // if set, candidate traversals are striped across these helpers instead
+    // of hctrl, which still shares the targets
+    helper_thread_pool *hpool;
+
+    // run every trial in this simulated hierarchy instead of on the
+    // hardware; see sim.h
+    struct _cache_sim *sim;
 
     cand_traverse_func traverse;
     cand_test_func test;
@@ -251,6 +220,13 @@ typedef struct {
     u32 max_backtrack; // maximum number of backtracks
     u32 slack;
     u32 extra_cong; // extend the eviction set with extra congruent lines
+    // build_evsets_at: screen this many next-target candidates per
+    // traversal of the accumulated evsets (at most 64); 0 tests them one
+    // by one
+    u32 next_batch;
+    // build_evsets_at: partition the whole pool against each new evset
+    // instead of searching for uncovered targets (batch size: next_batch)
+    bool bulk;
     bool ret_partial, prelim_test, need_skx_sf_ext;
 } EVAlgoConfig;
 
@@ -259,24 +235,44 @@ typedef struct {
     EVTestConfig test_config, test_config_alt;
     EVAlgoConfig algo_config;
     evset_algorithm algorithm;
+
+    // builds record into this context if set, otherwise into the calling
+    // thread's current context
+    struct evset_stats *stats;
 } EVBuildConfig;
 
 extern EVBuildConfig def_l1d_ev_config, def_l2_ev_config;
 
 /* Eviction set related structures and functions */
 typedef struct _evset {
-    u8 **addrs; // storage for eviction sets
+    u8 **addrs; // storage for eviction sets; NULL in a view until materialized
     u32 size, cap; // size and the capacity of the evset
     EVCands *cands;
     EVBuildConfig *config;
     cache_param *target_cache;
+
+    // views only keep their page offset and their base
+    u32 offset;
+    struct _evset *base;
+    u32 n_views;   // live views of this evset
+    bool released; // freed while it had views; goes with the last one
 } EVSet;
 
 EVSet *evset_new(u32 offset, EVBuildConfig *config, cache_param *cache,
                  EVCands *evcands);
 
+// an empty evset on "evcands", which stays unexpanded until a build or a
+// repair needs it, e.g., to restore evsets of many views at once
+EVSet *evset_new_deferred(EVBuildConfig *config, cache_param *cache,
+                          EVCands *evcands);
+
+// an O(1) view of the evset at a new page offset. A view holds a reference
+// on its base, whose lines at the time of materialization it takes
 EVSet *evset_shift(EVSet *from, u32 offset);
 
+// expand a view from the current lines of its base; no-op if it already is
+bool evset_materialize(EVSet *evset);
+
 void evset_free(EVSet *evset);
 
 i64 evset_test_batch(u8 **targets, size_t cnt, EVSet *evset);
@@ -287,6 +283,16 @@ void generic_cands_traverse(u8 **cands, size_t cnt, EVTestConfig *tconf);
 EVTestRes generic_test_eviction(u8 *target, u8 **cands, size_t cnt,
                                 EVTestConfig *tconf);
 
+// sequential probability ratio test; falls back to generic_test_eviction if
+// the SPRT parameters are unset
+EVTestRes sprt_test_eviction(u8 *target, u8 **cands, size_t cnt,
+                             EVTestConfig *tconf);
+
+// estimate sprt_p0/p1 from the hit and (emulated) miss latencies of "target";
+// "ev_rate" is how often a real eviction set evicts in a single traversal
+bool sprt_calibrate(u8 *target, EVTestConfig *tconf, u32 n_samples,
+                    double ev_rate);
+
 static inline void generic_evset_traverse(EVSet *evset) {
     generic_cands_traverse(evset->addrs, evset->size,
                            &evset->config->test_config);
@@ -361,6 +367,13 @@ EVSet **build_evsets_at(u32 offset, EVBuildConfig *conf, cache_param *cache,
                         EVBuildConfig *lower_conf, EVSet **lower_evsets,
                         size_t n_lower_evsets);
 
+// self-test previously built evsets of a page offset (e.g., restored from
+// disk); failing evsets are freed and, together with missing (NULL) entries,
+// rebuilt from the candidates not used by the healthy ones.
+// Returns the number of rebuilt evsets
+size_t repair_evsets_at(EVSet **evsets, size_t n_evsets, EVBuildConfig *conf,
+                        cache_param *cache, EVCands *cands);
+
 /* more tests */
 static inline EVTestRes _evset_self_test(EVSet *evset, evset_test_func tfunc) {
     u8 *target = evset->addrs[0];
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "evset.h"
+#include "evset_stats.h"
+#include "sim.h"
+
+// One point of an eviction set parameter sweep, as osc-bench runs it: build
+// "reps" evsets with fixed-seed targets and count the ones that evict.
+
+typedef enum {
+    BENCH_TARGET_L2,
+    BENCH_TARGET_LLC,
+    BENCH_TARGET_SF
+} bench_target;
+
+typedef struct {
+    const char *algo_name;
+    evset_algorithm algo;
+    double scaling;
+    u32 max_backtrack, test_scale, ev_repeat;
+} bench_point;
+
+typedef struct {
+    bench_target target;
+    u32 reps;
+    u64 seed; // repetition r draws its target offset from seed + r
+    size_t max_tries, max_timeout;
+    bool l2_filter;
+    cache_sim *sim; // reset before each repetition if set
+    helper_thread_ctrl *hctrl;
+
+    // applied to the LLC/SF test config of each build if set, e.g., to switch
+    // to the SPRT test; returns true on error
+    bool (*tune_test)(u8 *target, EVTestConfig *tconf);
+} bench_config;
+
+typedef struct {
+    u32 succ;
+    u64 *duras; // build durations of every repetition, in ns
+    struct evset_stats *stats;
+} bench_result;
+
+// "res" holds "reps" durations and a stats context, which is reset first
+void bench_point_run(bench_config *bc, u8 *page, bench_point *pt,
+                     bench_result *res);
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "evset.h"
+#include <pthread.h>
+
+// A low-priority maintenance thread that periodically revalidates live
+// eviction sets and repairs them in place when pages migrate underneath
+// (e.g., compaction, NUMA balancing, or khugepaged).
+//
+// Tests share the cache (and the helper thread) with the monitor loop, so a
+// check only starts after the monitor loop has parked itself in
+// evset_health_poll(). Monitor loops must poll regularly, and re-prime (or
+// recalibrate) whenever the poll reports a change.
+
+typedef struct {
+    EVSet *evset;
+    u8 *target;   // NULL: self-test, i.e., addrs[0] is the target
+    bool precise; // use precise tests
+    u64 n_checks, n_failures, n_repairs, n_rebuilds;
+    bool broken;  // the last repair failed
+} evset_health_ent;
+
+typedef struct {
+    evset_health_ent *ents;
+    size_t n_ents, cap;
+    u64 period_us; // minimum interval between two checks
+    double duty;   // maximum fraction of time spent on checks
+    u32 max_grow;  // max number of candidate chunks tried before rebuilding
+
+    volatile bool pause_req, paused, running;
+    pthread_mutex_t lock; // the parked monitor loop sleeps on "cond"
+    pthread_cond_t cond;
+    volatile u64 generation; // bumped whenever an evset is modified
+    u64 seen_generation;     // last generation the monitor loop has seen
+    pthread_t pid;
+} evset_health;
+
+evset_health *evset_health_new(u64 period_us, double duty);
+
+void evset_health_free(evset_health *h);
+
+// register an evset to watch; the evset must be built from a candidate pool,
+// which is kept for repairs. Register lower-level evsets first.
+bool evset_health_watch(evset_health *h, EVSet *evset, u8 *target,
+                        bool precise);
+
+bool evset_health_start(evset_health *h);
+
+void evset_health_stop(evset_health *h);
+
+// test an entry and repair it if it is degraded; returns true if the evset
+// has been modified. Callers must have exclusive access to the cache
+bool evset_health_check(evset_health *h, evset_health_ent *ent);
+
+void _evset_health_park(evset_health *h);
+
+// call from the monitor loop; returns true if any evset has changed since
+// the last call
+static __always_inline bool evset_health_poll(evset_health *h) {
+    if (__builtin_expect(h->pause_req, 0)) {
+        _evset_health_park(h);
+    }
+
+    if (__builtin_expect(h->generation != h->seen_generation, 0)) {
+        h->seen_generation = h->generation;
+        return true;
+    }
+    return false;
+}
+
+void pprint_evset_health(evset_health *h);
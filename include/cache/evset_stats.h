@@ -0,0 +1,154 @@
+#pragma once
+
+#include "cache_param.h"
+#include "hist.h"
+#include "libc_compatibility.h"
+
+#define MAX_RETRY_REC 22
+#define MAX_BACKTRACK_REC 102
+
+#define EVSTATS_MAGIC 0x53535645u // "EVSS"
+#define EVSTATS_VERSION 1u
+
+// A statistics context. Each thread records into its own context, which is
+// allocated on first use, unless a build config carries an explicit one.
+// A context must not be written by two threads at the same time; contexts are
+// cache-line aligned so that per-thread contexts never share a line.
+struct evset_stats {
+    u64 alloc_duration;
+    u64 population_duration;
+    u64 build_duration;
+    u64 pruning_duration;
+    u64 extension_duration;
+    // the same, per build (or per call) in ns
+    log_hist alloc_hist, population_hist, build_hist, pruning_hist,
+        extension_hist;
+    u64 retries, backtracks, cands_tests, mem_accs, trials;
+    u64 pure_mem_acc, pure_tests;
+    u64 pure_mem_acc2, pure_tests2;
+    u64 pos_unsure, neg_unsure, ooh, ooc; // out-of-history/candidates
+    u64 no_next, timeout, meet, retry_duration;
+    u32 retry_dist[MAX_RETRY_REC], useful_retry_dist[MAX_RETRY_REC];
+    u64 retry_duras[MAX_RETRY_REC], useful_retry_duras[MAX_RETRY_REC];
+    u32 bctr_dist[MAX_BACKTRACK_REC], useful_bctr_dist[MAX_BACKTRACK_REC];
+    u64 bctr_duras[MAX_BACKTRACK_REC], useful_bctr_duras[MAX_BACKTRACK_REC];
+} __attribute__((aligned(CL_SIZE)));
+
+// allocate a zeroed context and register it for aggregation
+struct evset_stats *evset_stats_new();
+
+// unregister and free a context
+void evset_stats_free(struct evset_stats *stats);
+
+extern __thread struct evset_stats *_evset_stats_cur;
+
+struct evset_stats *_evset_stats_thread_init();
+
+// the context the calling thread currently records into
+static inline struct evset_stats *evset_stats_cur() {
+    struct evset_stats *stats = _evset_stats_cur;
+    if (!stats) {
+        stats = _evset_stats_thread_init();
+    }
+    return stats;
+}
+
+// make "stats" the calling thread's current context and return the previous
+// one; binding NULL restores the thread's own context
+struct evset_stats *evset_stats_bind(struct evset_stats *stats);
+
+// dst += src
+void evset_stats_merge(struct evset_stats *dst, const struct evset_stats *src);
+
+// reduce every registered context into "out"
+void evset_stats_aggregate(struct evset_stats *out);
+
+void pprint_evset_stats_ctx(const struct evset_stats *stats);
+
+// print the aggregation of all contexts
+void pprint_evset_stats();
+
+// reset all registered contexts
+void reset_evset_stats();
+
+// aggregate all contexts into "out", and reset them in the same critical
+// section if "reset" is set, so that consecutive snapshots cover disjoint
+// intervals
+void evset_stats_snapshot(struct evset_stats *out, bool reset);
+
+// one JSON object with every counter, distribution, and histogram; the
+// histograms carry their p50/p90/p99/p999 and their non-empty buckets
+bool evset_stats_write_json(const struct evset_stats *stats, FILE *out);
+
+// a compact, versioned binary form that only keeps non-empty buckets
+bool evset_stats_write_bin(const struct evset_stats *stats, FILE *out);
+
+bool evset_stats_read_bin(struct evset_stats *stats, FILE *in);
+
+static inline void inc_retry(struct evset_stats *stats, u64 retry) {
+    if (retry < MAX_RETRY_REC - 1) {
+        stats->retry_dist[retry] += 1;
+    } else {
+        stats->retry_dist[MAX_RETRY_REC - 1] += 1;
+    }
+}
+
+static inline void inc_retry_dura(struct evset_stats *stats, u64 retry,
+                                  u64 dura) {
+    if (retry < MAX_RETRY_REC - 1) {
+        stats->retry_duras[retry] += dura;
+    } else {
+        stats->retry_duras[MAX_RETRY_REC - 1] += dura;
+    }
+}
+
+static inline void inc_useful_retry(struct evset_stats *stats, u64 retry) {
+    if (retry < MAX_RETRY_REC - 1) {
+        stats->useful_retry_dist[retry] += 1;
+    } else {
+        stats->useful_retry_dist[MAX_RETRY_REC - 1] += 1;
+    }
+}
+
+static inline void inc_useful_retry_dura(struct evset_stats *stats, u64 retry,
+                                         u64 dura) {
+    if (retry < MAX_RETRY_REC - 1) {
+        stats->useful_retry_duras[retry] += dura;
+    } else {
+        stats->useful_retry_duras[MAX_RETRY_REC - 1] += dura;
+    }
+}
+
+static inline void inc_bctr(struct evset_stats *stats, u64 bctr) {
+    if (bctr < MAX_BACKTRACK_REC - 1) {
+        stats->bctr_dist[bctr] += 1;
+    } else {
+        stats->bctr_dist[MAX_BACKTRACK_REC - 1] += 1;
+    }
+}
+
+static inline void inc_useful_bctr(struct evset_stats *stats, u64 bctr) {
+    if (bctr < MAX_BACKTRACK_REC - 1) {
+        stats->useful_bctr_dist[bctr] += 1;
+    } else {
+        stats->useful_bctr_dist[MAX_BACKTRACK_REC - 1] += 1;
+    }
+}
+
+static inline void inc_bctr_dura(struct evset_stats *stats, u64 bctr,
+                                 u64 dura) {
+    if (bctr < MAX_BACKTRACK_REC - 1) {
+        stats->bctr_duras[bctr] += dura;
+    } else {
+        stats->bctr_duras[MAX_BACKTRACK_REC - 1] += dura;
+    }
+}
+
+static inline void inc_useful_bctr_dura(struct evset_stats *stats, u64 bctr,
+                                        u64 dura) {
+    if (bctr < MAX_BACKTRACK_REC - 1) {
+        stats->useful_bctr_duras[bctr] += dura;
+    } else {
+        stats->useful_bctr_duras[MAX_BACKTRACK_REC - 1] += dura;
+    }
+}
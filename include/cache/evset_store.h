@@ -0,0 +1,65 @@
+#pragma once
+
+#include "evset.h"
+
+// On-disk index of eviction sets and candidate pools. Addresses are stored as
+// offsets relative to the EVBuffer they come from, so that an index stays
+// valid as long as the (file-backed) buffers are mapped again.
+
+#define EVSTORE_MAGIC 0x54535645u // "EVST"
+#define EVSTORE_VERSION 1u
+
+typedef enum {
+    EVSTORE_EVSET = 1,
+    EVSTORE_CANDS = 2
+} evstore_kind;
+
+typedef struct {
+    u32 kind, buf_id;
+    u32 key[3]; // user-defined, e.g., page offset, color and index
+    u32 size;
+    u64 *offsets;
+} evstore_rec;
+
+typedef struct {
+    EVBuffer **bufs;
+    u32 n_bufs;
+    evstore_rec *recs;
+    size_t n_recs, cap;
+} evstore;
+
+evstore *evstore_new(EVBuffer **bufs, u32 n_bufs);
+
+void evstore_free(evstore *st);
+
+// record "cnt" addresses of buffer "buf_id"
+bool evstore_add(evstore *st, evstore_kind kind, u32 buf_id, u32 k0, u32 k1,
+                 u32 k2, u8 **addrs, size_t cnt);
+
+static inline bool evstore_add_evset(evstore *st, u32 buf_id, u32 k0, u32 k1,
+                                     u32 k2, EVSet *evset) {
+    return evset_materialize(evset) ||
+           evstore_add(st, EVSTORE_EVSET, buf_id, k0, k1, k2, evset->addrs,
+                       evset->size);
+}
+
+static inline bool evstore_add_cands(evstore *st, u32 buf_id, u32 k0, u32 k1,
+                                     u32 k2, EVCands *cands) {
+    return evcands_materialize(cands) ||
+           evstore_add(st, EVSTORE_CANDS, buf_id, k0, k1, k2, cands->cands,
+                       cands->size);
+}
+
+bool evstore_save(evstore *st, const char *path);
+
+// load an index whose buffers must match "bufs" in number and size
+evstore *evstore_load(const char *path, EVBuffer **bufs, u32 n_bufs);
+
+// rebuild an evset from a record; "cands" owns the new evset, and is not
+// expanded if it is a view
+EVSet *evstore_rec_evset(evstore *st, evstore_rec *rec, EVBuildConfig *config,
+                         cache_param *cache, EVCands *cands);
+
+// rebuild a candidate pool from a record
+EVCands *evstore_rec_cands(evstore *st, evstore_rec *rec, cache_param *cache,
+                           EVCandsConfig *config);
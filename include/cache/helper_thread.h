@@ -1,87 +1,257 @@
 #pragma once
 
 #include "access_seq.h"
+#include "topology.h"
+#include "trace.h"
 #include <pthread.h>
+#include <sched.h>
 
 typedef enum {
     HELPER_STOP,
     READ_SINGLE,
     TIME_SINGLE,
     READ_ARRAY,
-    TRAVERSE_CANDS
+    TRAVERSE_CANDS,
+    LOCATE // report where the helper runs
 } helper_thread_action;
 
+struct helper_thread_read_array {
+    u8 **addrs;
+    size_t cnt, repeat, stride, block;
+    bool bwd;
+    bool linked; // addrs holds intrusive links (see access_seq.h)
+};
+
+struct _evtest_config;
+
+struct helper_thread_traverse_cands {
+    void (*traverse)(u8 **cands, size_t cnt, struct _evtest_config *c);
+    u8 **cands;
+    size_t cnt;
+    struct _evtest_config *tconfig;
+};
+
 typedef struct {
-    bool running;
-    volatile bool waiting;
-    volatile helper_thread_action action;
-    void * volatile payload;
-    u64 lat;
-    pthread_t pid;
+    helper_thread_action action;
+    union {
+        u8 *addr; // READ_SINGLE and TIME_SINGLE
+        struct helper_thread_read_array arr;
+        struct helper_thread_traverse_cands trav;
+    };
+} helper_thread_cmd;
+
+#define HELPER_MAX_BATCH 16
+
+// A single-producer mailbox. The requester fills command slots and releases
+// a new batch by bumping "seq"; the helper runs the whole batch and releases
+// it back by setting "done" to the same number. The two counters live on
+// their own cache lines, so each handoff moves one line in each direction,
+// and the slots are only touched by the helper after a handoff.
+typedef struct {
+    // requester-owned, the helper only reads them
+    struct {
+        volatile u64 seq; // batches posted
+    } __attribute__((aligned(CL_SIZE))) req;
+    struct {
+        u32 n_cmds;
+        helper_thread_cmd cmds[HELPER_MAX_BATCH];
+    } __attribute__((aligned(CL_SIZE))) batch;
+    // helper-owned
+    struct {
+        volatile u64 done; // batches completed
+        u64 lat;           // of the last TIME_SINGLE
+        u32 aux;           // rdtscp aux of the last LOCATE
+    } __attribute__((aligned(CL_SIZE))) resp;
+    // private to the requester
+    struct {
+        bool running, claimed, misplaced;
+        int core, main_core; // negative: unpinned
+        u32 main_aux; // rdtscp aux of the requester's last eviction trial
+        pthread_t pid;
+        // the requester's affinity before claiming a helper pinned it
+        bool main_mask_saved;
+        cpu_set_t main_mask;
+    } __attribute__((aligned(CL_SIZE)));
 } helper_thread_ctrl;
 
 void *helper_thread_worker(void * _args);
 
+// release the staged commands to the helper without waiting for them
+static __always_inline void helper_thread_post(helper_thread_ctrl *ctrl) {
+    __atomic_store_n(&ctrl->req.seq, ctrl->req.seq + 1, __ATOMIC_RELEASE);
+}
+
+// wait until the helper has finished every posted batch
 static __always_inline void wait_helper_thread(helper_thread_ctrl *ctrl) {
-    while (!ctrl->waiting);
+    u64 seq = ctrl->req.seq;
+    while (__atomic_load_n(&ctrl->resp.done, __ATOMIC_ACQUIRE) != seq);
+    ctrl->batch.n_cmds = 0;
 }
 
-static __always_inline bool start_helper_thread(helper_thread_ctrl *ctrl) {
-    ctrl->waiting = false;
+static __always_inline void helper_thread_flush(helper_thread_ctrl *ctrl) {
+    helper_thread_post(ctrl);
+    wait_helper_thread(ctrl);
+}
+
+// stage a command slot for the next batch; a full batch is flushed first.
+// Only call it when no batch is in flight.
+static __always_inline helper_thread_cmd *
+helper_thread_push(helper_thread_ctrl *ctrl, helper_thread_action action) {
+    if (ctrl->batch.n_cmds == HELPER_MAX_BATCH) {
+        helper_thread_flush(ctrl);
+    }
+    helper_thread_cmd *cmd = &ctrl->batch.cmds[ctrl->batch.n_cmds++];
+    cmd->action = action;
+    return cmd;
+}
+
+static __always_inline bool
+_start_helper_thread(helper_thread_ctrl *ctrl, pthread_attr_t *attr) {
+    ctrl->req.seq = ctrl->resp.done = 0;
+    ctrl->batch.n_cmds = 0;
+    ctrl->main_aux = 0;
+    ctrl->claimed = ctrl->misplaced = false;
+    ctrl->main_core = -1;
     _barrier();
-    if (pthread_create(&ctrl->pid, NULL, helper_thread_worker, ctrl)) {
+    if (pthread_create(&ctrl->pid, attr, helper_thread_worker, ctrl)) {
         perror("Failed to start the helper thread!\n");
         return true;
     }
-    wait_helper_thread(ctrl);
+    helper_thread_flush(ctrl); // an empty batch, to know it is up
     ctrl->running = true;
     return false;
 }
 
+// start the helper thread on a specific core; a negative core means unpinned
+static __always_inline bool
+start_helper_thread_pinned(helper_thread_ctrl *ctrl, int core) {
+    ctrl->core = core;
+    if (core < 0) {
+        return _start_helper_thread(ctrl, NULL);
+    }
+
+    cpu_set_t set;
+    pthread_attr_t attr;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    pthread_attr_init(&attr);
+    pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+    bool err = _start_helper_thread(ctrl, &attr);
+    pthread_attr_destroy(&attr);
+    return err;
+}
+
+// cpu_topology_claim_helper() pins the caller; remember where it could run
+static __always_inline void
+_helper_thread_save_affinity(helper_thread_ctrl *ctrl) {
+    if (!ctrl->main_mask_saved) {
+        ctrl->main_mask_saved = !sched_getaffinity(0, sizeof(ctrl->main_mask),
+                                                   &ctrl->main_mask);
+    }
+}
+
+static __always_inline void
+_helper_thread_restore_affinity(helper_thread_ctrl *ctrl) {
+    if (ctrl->main_mask_saved) {
+        sched_setaffinity(0, sizeof(ctrl->main_mask), &ctrl->main_mask);
+        ctrl->main_mask_saved = false;
+    }
+}
+
+// start the helper thread on a core that shares the LLC with the caller but
+// not its physical core, and pin the caller where it is (see topology.h)
+// until stop_helper_thread(), which must then be called by the same thread
+static __always_inline bool start_helper_thread(helper_thread_ctrl *ctrl) {
+    _helper_thread_save_affinity(ctrl);
+    int main_core, core = cpu_topology_claim_helper(&main_core);
+    bool err = start_helper_thread_pinned(ctrl, core);
+    if (core >= 0 && err) {
+        cpu_topology_release(core);
+        cpu_topology_release(main_core);
+    } else if (core >= 0) {
+        ctrl->claimed = true;
+        ctrl->main_core = main_core;
+    }
+    if (err) {
+        _helper_thread_restore_affinity(ctrl);
+    }
+    return err;
+}
+
 static __always_inline void stop_helper_thread(helper_thread_ctrl *ctrl) {
     if (ctrl->running) {
-        ctrl->action = HELPER_STOP;
-        _barrier();
-        ctrl->waiting = false;
+        helper_thread_push(ctrl, HELPER_STOP);
+        helper_thread_post(ctrl);
         pthread_join(ctrl->pid, NULL);
+        ctrl->batch.n_cmds = 0;
         ctrl->running = false;
     }
+    if (ctrl->claimed) {
+        cpu_topology_release(ctrl->core);
+        cpu_topology_release(ctrl->main_core);
+        ctrl->claimed = false;
+    }
+    _helper_thread_restore_affinity(ctrl);
 }
 
+// the CPU the helper runs on, as its rdtscp reports
+int helper_thread_cpu(helper_thread_ctrl *ctrl);
+
+// check the CPUs the requester (as of its last eviction trial) and the
+// helper run on against the placement policy of topology.h; warns once and
+// moves the helper to a conforming core if it can. Returns true if misplaced
+bool helper_thread_check_placement(helper_thread_ctrl *ctrl);
+
 static __always_inline void
 helper_thread_read_single(u8 *target, helper_thread_ctrl *ctrl) {
     _assert(ctrl->running);
-    ctrl->action = READ_SINGLE;
-    ctrl->payload = target;
-    _barrier();
-    ctrl->waiting = false;
-    wait_helper_thread(ctrl);
+    u64 tr = evtrace_begin();
+    helper_thread_push(ctrl, READ_SINGLE)->addr = target;
+    helper_thread_flush(ctrl);
+    evtrace_end(EVTRACE_HELPER, tr, READ_SINGLE, 1, 0);
+}
+
+// have the helper read "cnt" targets, in order, with a single wakeup
+static __always_inline void
+helper_thread_read_batch(u8 **targets, u32 cnt, helper_thread_ctrl *ctrl) {
+    _assert(ctrl->running);
+    u64 tr = evtrace_begin();
+    for (u32 i = 0; i < cnt; i++) {
+        helper_thread_push(ctrl, READ_SINGLE)->addr = targets[i];
+    }
+    helper_thread_flush(ctrl);
+    evtrace_end(EVTRACE_HELPER, tr, READ_SINGLE, cnt, 0);
 }
 
 static __always_inline u64
 helper_thread_time_single(u8 *target, helper_thread_ctrl *ctrl) {
     _assert(ctrl->running);
-    ctrl->action = TIME_SINGLE;
-    ctrl->payload = target;
-    _barrier();
-    ctrl->waiting = false;
-    wait_helper_thread(ctrl);
+    u64 tr = evtrace_begin();
+    helper_thread_push(ctrl, TIME_SINGLE)->addr = target;
+    helper_thread_flush(ctrl);
+    evtrace_end(EVTRACE_HELPER, tr, TIME_SINGLE, 1, 0);
     _mfence();
     _lfence();
-    return ctrl->lat;
+    return ctrl->resp.lat;
 }
 
-struct helper_thread_read_array {
-    u8 ** volatile addrs;
-    volatile size_t cnt, repeat, stride, block;
-    volatile bool bwd;
-};
+// helper threads that split each candidate traversal into stripes
+typedef struct {
+    u32 n_helpers;
+    helper_thread_ctrl *ctrls; // cache-line aligned
+} helper_thread_pool;
 
-struct _evtest_config;
+// start "n_helpers" helpers, the h-th pinned to cores[h] (all unpinned if
+// "cores" is NULL); nothing is left running on failure
+bool start_helper_pool(helper_thread_pool *pool, u32 n_helpers,
+                       const int *cores);
 
-struct helper_thread_traverse_cands {
-    void (*volatile traverse)(u8 **cands, size_t cnt, struct _evtest_config *c);
-    u8 ** volatile cands;
-    size_t volatile cnt;
-    struct _evtest_config * volatile tconfig;
-};
+void stop_helper_pool(helper_thread_pool *pool);
+
+// the stripe [*lo, *hi) of "cnt" candidates that helper "h" traverses
+static __always_inline void helper_pool_stripe(helper_thread_pool *pool, u32 h,
+                                               size_t cnt, size_t *lo,
+                                               size_t *hi) {
+    *lo = cnt * h / pool->n_helpers;
+    *hi = cnt * (h + 1) / pool->n_helpers;
+}
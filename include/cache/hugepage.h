@@ -0,0 +1,49 @@
+#pragma once
+
+#include "libpt.h"
+#include "misc.h"
+
+// Anonymous buffers backed by the largest pages we can get without root:
+// reserved hugetlbfs pages first, then transparent hugepages (THP), then
+// plain 4KB pages. THP is best-effort, so which regions actually ended up on
+// a hugepage is detected after the buffer has been faulted in.
+
+typedef enum {
+    HUGEPAGE_NONE = 0,    // 4KB pages only
+    HUGEPAGE_THP = 1,     // madvise(MADV_HUGEPAGE), possibly partially backed
+    HUGEPAGE_HUGETLB = 2, // MAP_HUGETLB, every region is backed
+} hugepage_backing;
+
+typedef struct {
+    u8 *buf;
+    size_t size;
+    hugepage_backing backing;
+    u32 page_shift;  // region size; PAGE_SHIFT without hugepages
+    u8 *huge;        // THP only: per region, whether a hugepage backs it
+    size_t n_regions, n_huge;
+} hugepage_buf;
+
+// map "huge_size" bytes on hugetlbfs pages of 1 << shift bytes, or
+// "small_size" bytes with THP or 4KB pages if none are reserved. The buffer
+// is zeroed; returns true on error
+bool hugepage_alloc(hugepage_buf *hb, size_t huge_size, size_t small_size,
+                    u32 shift);
+
+void hugepage_free(hugepage_buf *hb);
+
+// re-detect the hugepage-backed regions of a THP buffer, e.g., after
+// khugepaged had the chance to collapse it
+void hugepage_scan(hugepage_buf *hb);
+
+static inline bool hugepage_region_huge(hugepage_buf *hb, size_t region) {
+    return hb->backing == HUGEPAGE_HUGETLB ||
+           (hb->huge && region < hb->n_regions && hb->huge[region]);
+}
+
+static inline const char *hugepage_backing_str(hugepage_backing backing) {
+    switch (backing) {
+        case HUGEPAGE_HUGETLB: return "hugetlb";
+        case HUGEPAGE_THP: return "THP";
+        default: return "4KB";
+    }
+}
@@ -23,82 +23,60 @@ static inline void pprint_cache_acc_recs(cache_acc_rec *recs, size_t n_recs) {
     }
 }
 
+typedef i64 (*probe_func)(EVSet *evset, u64 *end_tsc, u32 *aux);
+
+// Probe kernels are generated for every associativity we monitor (PROBE_WAYS)
+// so that all loads are fully unrolled:
+//   probe_sf_evset_para_asm_N: one mov pair per way, all loads in flight
+//   probe_sf_evset_para_loop_N: compiler-unrolled backward loop
+//   probe_sf_evset_gather_avx2_N/avx512_N: vpgatherqq, in monitor.c
+#define PROBE_WAYS(X) X(11) X(12) X(16) X(20)
+
+#define _PROBE_LD(off) "mov " #off "(%0), %%r10\n\tmov (%%r10), %%r11\n\t"
+#define _PROBE_LD4(a, b, c, d) _PROBE_LD(a) _PROBE_LD(b) _PROBE_LD(c) _PROBE_LD(d)
+#define _PROBE_LDS_8 _PROBE_LD4(0, 8, 16, 24) _PROBE_LD4(32, 40, 48, 56)
+#define _PROBE_LDS_11 _PROBE_LDS_8 _PROBE_LD(64) _PROBE_LD(72) _PROBE_LD(80)
+#define _PROBE_LDS_12 _PROBE_LDS_8 _PROBE_LD4(64, 72, 80, 88)
+#define _PROBE_LDS_16 _PROBE_LDS_12 _PROBE_LD4(96, 104, 112, 120)
+#define _PROBE_LDS_20 _PROBE_LDS_16 _PROBE_LD4(128, 136, 144, 152)
+
+#define _DEFINE_PROBE_PARA(N)                                                  \
+    static __always_inline i64 probe_sf_evset_para_asm_##N(                    \
+        EVSet *evset, u64 *end_tsc, u32 *aux) {                                \
+        u8 **addrs = evset->addrs;                                             \
+        _force_addr_calc(addrs);                                               \
+        u64 start = _timer_start();                                            \
+        __asm__ __volatile__(_PROBE_LDS_##N ::"r"(addrs)                       \
+                             : "r10", "r11", "memory");                        \
+        *end_tsc = _timer_end_aux(aux);                                        \
+        return *end_tsc - start;                                               \
+    }                                                                          \
+                                                                               \
+    static __always_inline i64 probe_sf_evset_para_loop_##N(                   \
+        EVSet *evset, u64 *end_tsc, u32 *aux) {                                \
+        u8 **addrs = evset->addrs;                                             \
+        _force_addr_calc(addrs);                                               \
+        u64 start = _timer_start();                                            \
+        _Pragma("GCC unroll 32") for (u32 i = N; i > 0; i--) {                 \
+            _maccess(addrs[i - 1]);                                            \
+        }                                                                      \
+        *end_tsc = _timer_end_aux(aux);                                        \
+        return *end_tsc - start;                                               \
+    }                                                                          \
+                                                                               \
+    i64 probe_sf_evset_gather_avx2_##N(EVSet *evset, u64 *end_tsc, u32 *aux);  \
+    i64 probe_sf_evset_gather_avx512_##N(EVSet *evset, u64 *end_tsc, u32 *aux);
+
+PROBE_WAYS(_DEFINE_PROBE_PARA)
+
 static __always_inline
 i64 probe_skx_sf_evset_para_asm(EVSet *evset, u64 *end_tsc, u32 *aux) {
-    u8 **addrs = evset->addrs;
-    _force_addr_calc(addrs);
-    u64 start = _timer_start();
-    __asm__ __volatile__("mov (%0), %%r10\n\t"
-                         "mov (%%r10), %%r11\n\t"
-                         "mov 8(%0), %%r10\n\t"
-                         "mov (%%r10), %%r11\n\t"
-                         "mov 16(%0), %%r10\n\t"
-                         "mov (%%r10), %%r11\n\t"
-                         "mov 24(%0), %%r10\n\t"
-                         "mov (%%r10), %%r11\n\t" // 4
-                         "mov 32(%0), %%r10\n\t"
-                         "mov (%%r10), %%r11\n\t"
-                         "mov 40(%0), %%r10\n\t"
-                         "mov (%%r10), %%r11\n\t"
-                         "mov 48(%0), %%r10\n\t"
-                         "mov (%%r10), %%r11\n\t"
-                         "mov 56(%0), %%r10\n\t"
-                         "mov (%%r10), %%r11\n\t" // 8
-                         "mov 64(%0), %%r10\n\t"
-                         "mov (%%r10), %%r11\n\t"
-                         "mov 72(%0), %%r10\n\t"
-                         "mov (%%r10), %%r11\n\t"
-                         "mov 80(%0), %%r10\n\t"
-                         "mov (%%r10), %%r11\n\t"
-                         "mov 88(%0), %%r10\n\t"
-                         "mov (%%r10), %%r11\n\t" // 12
-                         ::"r"(addrs)
-                         : "r10", "r11", "memory");
-    *end_tsc = _timer_end_aux(aux);
-    return *end_tsc - start;
+    return probe_sf_evset_para_asm_12(evset, end_tsc, aux);
 }
 
 static __always_inline
 i64 probe_icx_sf_evset_para_asm(EVSet *evset, u64 *end_tsc, u32 *aux) {
-    u8 **addrs = evset->addrs;
-    _force_addr_calc(addrs);
-    u64 start = _timer_start();
-    __asm__ __volatile__("mov (%0), %%r10\n\t"
-                         "mov (%%r10), %%r11\n\t"
-                         "mov 8(%0), %%r10\n\t"
-                         "mov (%%r10), %%r11\n\t"
-                         "mov 16(%0), %%r10\n\t"
-                         "mov (%%r10), %%r11\n\t"
-                         "mov 24(%0), %%r10\n\t"
-                         "mov (%%r10), %%r11\n\t" // 4
-                         "mov 32(%0), %%r10\n\t"
-                         "mov (%%r10), %%r11\n\t"
-                         "mov 40(%0), %%r10\n\t"
-                         "mov (%%r10), %%r11\n\t"
-                         "mov 48(%0), %%r10\n\t"
-                         "mov (%%r10), %%r11\n\t"
-                         "mov 56(%0), %%r10\n\t"
-                         "mov (%%r10), %%r11\n\t" // 8
-                         "mov 64(%0), %%r10\n\t"
-                         "mov (%%r10), %%r11\n\t"
-                         "mov 72(%0), %%r10\n\t"
-                         "mov (%%r10), %%r11\n\t"
-                         "mov 80(%0), %%r10\n\t"
-                         "mov (%%r10), %%r11\n\t"
-                         "mov 88(%0), %%r10\n\t"
-                         "mov (%%r10), %%r11\n\t" // 12
-                         "mov 96(%0), %%r10\n\t"
-                         "mov (%%r10), %%r11\n\t"
-                         "mov 104(%0), %%r10\n\t"
-                         "mov (%%r10), %%r11\n\t"
-                         "mov 112(%0), %%r10\n\t"
-                         "mov (%%r10), %%r11\n\t"
-                         "mov 120(%0), %%r10\n\t"
-                         "mov (%%r10), %%r11\n\t" // 16
-                         ::"r"(addrs)
-                         : "r10", "r11", "memory");
-    *end_tsc = _timer_end_aux(aux);
-    return *end_tsc - start;
+    return probe_sf_evset_para_asm_16(evset, end_tsc, aux);
 }
 
 static __always_inline
@@ -131,6 +109,23 @@ i64 probe_skx_sf_evset_para(EVSet *evset, u64 *end_tsc, u32 *aux) {
 #endif
 }
 
+typedef struct {
+    const char *name;
+    u32 ways;
+    probe_func probe;
+    bool (*supported)(); // NULL if it runs everywhere
+} probe_kernel;
+
+extern const probe_kernel probe_kernels[];
+extern const size_t n_probe_kernels;
+
+const probe_kernel *find_probe_kernel(const char *name);
+
+// Benchmark the kernels for "ways" ways that the host supports on a primed
+// "evset" and return the one with the lowest probe latency
+const probe_kernel *select_probe_kernel(EVSet *evset, u32 ways, u32 arr_repeat,
+                                        u32 l2_repeat);
+
 void prime_skx_sf_evset_para(EVSet *evset, u32 arr_repeat, u32 l2_repeat);
 
 void prime_evchain_prime_scope(evchain *ptr);
@@ -146,3 +141,7 @@ i64 calibrate_para_probe_lat(u8 *target, EVSet *evset, u32 arr_repeat,
 
 i64 calibrate_chase_probe_lat(u8 *target, EVSet *evset, u32 arr_repeat,
                               u32 l2_repeat, double bad_thresh_ratio);
+
+i64 calibrate_kernel_probe_lat(u8 *target, EVSet *evset, u32 arr_repeat,
+                               u32 l2_repeat, double bad_thresh_ratio,
+                               const probe_kernel *kernel);
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "cache_param.h"
+#include <pthread.h>
+
+// A bounded FIFO of page offset indices, from a thread that prepares offsets
+// to the threads that build evsets at them. Closing wakes every waiter: a
+// push fails from then on, and pops drain what is left.
+
+#define OFFSET_QUEUE_SLOTS (PAGE_SIZE / CL_SIZE)
+
+typedef struct {
+    u32 idxs[OFFSET_QUEUE_SLOTS];
+    u32 n_pushed, n_popped, cap;
+    bool closed;
+    pthread_mutex_t lock;
+    pthread_cond_t not_full, not_empty;
+} offset_queue;
+
+// "cap" is clamped to [1, OFFSET_QUEUE_SLOTS]
+void offset_queue_init(offset_queue *q, u32 cap);
+
+void offset_queue_destroy(offset_queue *q);
+
+// blocks while the queue is full; true if it was closed meanwhile
+bool offset_queue_push(offset_queue *q, u32 n);
+
+// blocks while the queue is empty; true once it is closed and drained
+bool offset_queue_pop(offset_queue *q, u32 *n);
+
+void offset_queue_close(offset_queue *q);
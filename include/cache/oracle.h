@@ -1,21 +1,52 @@
+#pragma once
+
 #include "cache/cache_param.h"
+#include "cache/slice_model.h"
 
+// physical addresses come from /proc/self/pagemap, or from PTEditor if
+// pagemap hides PFNs; slices need the CHA counters on top. Returns true
+// unless both are available
 bool cache_oracle_init();
 
 bool cache_oracle_inited();
 
+// enough for cache_set_idx() and the slice model, i.e., no CHAs needed
+bool cache_oracle_pa_inited();
+
 void cache_oracle_cleanup();
 
+// -1 if the page is not mapped
 uintptr_t cache_oracle_pa(void *addr);
 
+// -1 without a physical address
 i32 cache_set_idx(void *addr, cache_param *param);
 
+// slices are memoized per physical line, so repeated queries are free
 i32 cache_slice_idx(void *addr);
 
+// resolve the slices of many lines with the CHAs programmed once. Batches of
+// lines are accessed in a few counting windows, one with every line and one
+// per bit of the line index, so that a CHA serving a single line of a batch
+// spells out its index. Lines sharing a CHA are retried in other batches.
+// slices[i] is -1 if a line cannot be resolved
+void cache_slice_idx_batch(void **addrs, size_t cnt, i32 *slices);
+
+// the slice from the loaded slice model, falling back to the CHA oracle
+static inline i32 cache_slice_idx_model(void *addr) {
+    if (cache_slice_model) {
+        uintptr_t pa = cache_oracle_pa(addr);
+        i32 slice = pa == (uintptr_t)-1
+                        ? -1
+                        : slice_model_lookup(cache_slice_model, pa);
+        if (slice >= 0) return slice;
+    }
+    return cache_slice_idx(addr);
+}
+
 #define INVALID_ADDR_HASH (-1ul)
 
 static inline u64 llc_addr_hash(void *addr) {
-    i32 cha_id = cache_slice_idx(addr);
+    i32 cha_id = cache_slice_idx_model(addr);
     i32 set_id = cache_set_idx(addr, detected_l3);
     if (cha_id == -1 || set_id == -1) {
         return INVALID_ADDR_HASH;
@@ -23,3 +54,6 @@ static inline u64 llc_addr_hash(void *addr) {
         return ((u64)cha_id << 32) | (u64)set_id;
     }
 }
+
+// llc_addr_hash() of many lines at once
+void llc_addr_hash_batch(void **addrs, size_t cnt, u64 *hashes);
@@ -3,6 +3,11 @@
 
 #define NUM_OFFSETS (PAGE_SIZE / CL_SIZE)
 
-EVSet ***build_l2_evsets_all();
-
-EVCands ***build_evcands_all(EVBuildConfig *conf, EVSet ***l2evsets);
+// the L2 evsets of every page offset; "n_evsets" gets how many there are per
+// offset, one per L2 color of the pages the candidates got
+EVSet ***build_l2_evsets_all(size_t *n_evsets);
+
+// the SF candidates of every L2 color at every page offset; "n_colors" gets
+// the number of colors, which the L2 evsets bound
+EVCands ***build_evcands_all(EVBuildConfig *conf, EVSet ***l2evsets,
+                             size_t n_l2evsets, size_t *n_colors);
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "libpt.h"
+#include "misc.h"
+
+// Physical addresses from /proc/self/pagemap, which only needs root
+// (CAP_SYS_ADMIN) instead of a kernel module. Buffers registered with
+// pagemap_cache_range() have the PFNs of all their pages read with a single
+// pread on their first lookup; other addresses cost one pread each.
+
+#define PAGEMAP_PFN_MASK ((1ull << 55) - 1)
+#define PAGEMAP_PRESENT (1ull << 63)
+
+// returns true if pagemap is unreadable or hides PFNs, e.g., without root
+bool pagemap_init();
+
+bool pagemap_inited();
+
+// also forgets every registered range
+void pagemap_cleanup();
+
+// cache the PFNs of [buf, buf + size) until pagemap_uncache_range(buf); the
+// pages must not move in the meantime, i.e., be populated and not swapped.
+// Only missing pages are read again, so if khugepaged collapses the range into
+// a THP afterwards, lookups keep returning the old PFNs. Register buffers that
+// are either hugepage-backed from the start or madvise(MADV_NOHUGEPAGE)d, or
+// uncache and re-register them after a collapse
+bool pagemap_cache_range(void *buf, size_t size);
+
+void pagemap_uncache_range(void *buf);
+
+// -1 if the page is not present or pagemap is not inited
+uintptr_t pagemap_pa(void *addr);
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "cache_param.h"
+#include "evset.h"
+#include "latency.h"
+
+// A software model of the cache hierarchy for hardware-free runs. Eviction
+// tests whose EVTestConfig carries a simulator run every access, flush, and
+// timing in the model instead of on the hardware, so the evset builders run
+// unchanged, deterministically, and with exact ground truth.
+//
+// Each core has a private L1d and L2. Beyond them, there is either an
+// inclusive LLC that back-invalidates the private caches, or a non-inclusive
+// victim LLC plus a snoop filter (SF) that tracks private lines and
+// back-invalidates them on eviction, as on Skylake-SP. There, lines shared
+// by both cores are also kept in, and back-invalidated by, the LLC. Virtual
+// pages map to pseudo-random frames, so only the page offset of an address is
+// known to the builders, like on real hardware.
+//
+// Every traversal of candidates, whatever EVTestConfig.traverse is, is
+// modelled as ev_repeat backward passes over them, by both cores if the test
+// needs the helper thread. The oracle still reports real physical addresses,
+// so leave it uninitialized in simulation.
+
+#define SIM_MAX_CORES 2u
+#define SIM_MAX_SLICE_BITS 6u
+#define SIM_PA_BITS 40u
+
+typedef enum {
+    SIM_REPL_LRU = 0,
+    SIM_REPL_PLRU = 1, // tree-PLRU; needs a power-of-two associativity
+    SIM_REPL_QLRU = 2, // 2-bit ages, inserted at 2, promoted to 0 on hits
+    SIM_REPL_RANDOM = 3
+} sim_repl_policy;
+
+typedef struct {
+    u32 n_sets, n_ways; // n_sets per slice; a power of two
+    sim_repl_policy repl;
+    u32 lat; // hit latency in cycles
+} sim_level_config;
+
+typedef struct {
+    sim_level_config l1d, l2, llc, sf; // sf.n_ways == 0: no snoop filter
+    u32 n_slices;
+    // bit i of the slice is the parity of pa & slice_masks[i] if any mask is
+    // set; otherwise, a non-linear hash of the line address
+    u64 slice_masks[SIM_MAX_SLICE_BITS];
+    bool inclusive_llc;
+    u32 mem_lat, page_shift;
+
+    // chance of an access also evicting a random line of its LLC (or SF)
+    // set, and of a timed access reading as a miss
+    double evict_noise, lat_noise;
+    u64 seed;
+} cache_sim_config;
+
+typedef struct _cache_sim cache_sim;
+
+// a Skylake-SP-like hierarchy with "n_slices" slices on 4KB pages
+void cache_sim_config_skx(cache_sim_config *config, u32 n_slices);
+
+cache_sim *cache_sim_new(cache_sim_config *config);
+
+// a simulator with the configuration of "sim" but empty caches; it maps every
+// page to the same frame, so it can run the tests of another thread
+cache_sim *cache_sim_clone(cache_sim *sim);
+
+void cache_sim_free(cache_sim *sim);
+
+// invalidate every line and restart the random streams
+void cache_sim_reset(cache_sim *sim);
+
+// returns the latency of the access
+u32 cache_sim_access(cache_sim *sim, u32 core, void *addr);
+
+void cache_sim_flush(cache_sim *sim, void *addr);
+
+// the simulated physical address of "addr"
+u64 cache_sim_pa(cache_sim *sim, void *addr);
+
+u32 cache_sim_slice(cache_sim *sim, void *addr);
+
+// the set of "addr" in "cache" (1: L1d, 2: L2, 3: LLC) in the upper half and
+// its slice in the lower half; equal keys mean congruent lines
+u64 cache_sim_key(cache_sim *sim, u32 level, void *addr);
+
+// the cache_param of a simulated level, see cache_sim_key()
+void cache_sim_param(cache_sim *sim, u32 level, cache_param *param);
+
+void cache_sim_latencies(cache_sim *sim, cache_latencies *lats);
+
+// like cache_env_init(), but describes the simulated hierarchy instead of
+// the detected one, and makes every default build config test in "sim"
+void cache_sim_env_init(cache_sim *sim);
+
+/* Eviction trials, called by the eviction tests in evset.c */
+// the simulated counterpart of a single timed eviction trial
+u64 cache_sim_eviction_trial(cache_sim *sim, u8 *target, u8 **cands,
+                             size_t cnt, EVTestConfig *tconf, bool evict);
+
+// load "targets", traverse "addrs", and count the evicted targets in "otcs"
+void cache_sim_batch_trial(cache_sim *sim, u8 **targets, u32 sz, u8 **addrs,
+                           size_t acc_cnt, EVTestConfig *tconf, u32 *otcs);
+
+// ev_repeat backward passes over "cands" from "core"
+void cache_sim_traverse(cache_sim *sim, u32 core, u8 **cands, size_t cnt,
+                        EVTestConfig *tconf);
+
+// a timed access: the access latency, or the memory latency by chance
+u64 cache_sim_time_access(cache_sim *sim, u32 core, void *addr);
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "cache_param.h"
+
+// An offline model of the LLC slice hash, learnt from the CHA oracle and
+// saved per CPU model. Power-of-two slice counts have an XOR-linear hash, i.e.,
+// bit i of the slice id is the parity of (pa & masks[i]). Other counts have no
+// linear hash, so the model keeps a table of the physical lines it has seen.
+// The table stays valid on every processor of the same model, but it says
+// nothing about lines it has not seen, so it cannot group fresh candidates,
+// i.e., candidates are not grouped on most server parts (18-28 CHAs).
+
+#define SLICE_MODEL_MAGIC 0x4c444d53u // "SMDL"
+#define SLICE_MODEL_VERSION 1u
+#define SLICE_MODEL_MAX_BITS 8u
+#define SLICE_MODEL_PA_BITS 46u
+// a table of every line of 64GB, far beyond what sampling ever collects
+#define SLICE_MODEL_MAX_ENTS (1ul << 30)
+
+typedef enum {
+    SLICE_MODEL_LINEAR = 1,
+    SLICE_MODEL_TABLE = 2
+} slice_model_kind;
+
+typedef struct {
+    u64 line; // pa >> CL_SHIFT
+    u32 slice;
+} slice_model_ent;
+
+typedef struct {
+    u32 cpu_sig; // CPUID.1:EAX, i.e., family, model, and stepping
+    u32 n_slices;
+    slice_model_kind kind;
+    u32 n_bits;
+    u64 masks[SLICE_MODEL_MAX_BITS];
+    slice_model_ent *ents; // sorted by line
+    size_t n_ents, cap;
+} slice_model;
+
+// the model used by cache_slice_idx_model(), if any
+extern slice_model *cache_slice_model;
+
+slice_model *slice_model_new(u32 n_slices);
+
+void slice_model_free(slice_model *m);
+
+// fit the model to "n" (pa, slice) samples; samples of a table model are
+// merged into the table. Returns true on error
+bool slice_model_fit(slice_model *m, u64 *pas, u32 *slices, size_t n);
+
+// sample "n_samples" random lines of "buf" through the oracle and fit them
+bool slice_model_learn(slice_model *m, u8 *buf, size_t size, size_t n_samples);
+
+// -1 if a table model has not seen the line
+i32 slice_model_lookup(slice_model *m, u64 pa);
+
+// whether the model predicts the slice of lines it was not fit to, i.e., it is
+// usable for grouping fresh candidates
+static inline bool slice_model_generalizes(slice_model *m) {
+    return m && m->kind == SLICE_MODEL_LINEAR;
+}
+
+// the model file of this CPU model under "dir"
+void slice_model_path(char *path, size_t len, const char *dir, u32 n_slices);
+
+bool slice_model_save(slice_model *m, const char *dir);
+
+// NULL if there is no (compatible) model of this CPU model under "dir"
+slice_model *slice_model_load(const char *dir, u32 n_slices);
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "num_types.h"
+#include <sched.h>
+
+// CPU topology from sysfs, to place each main thread and its helpers on
+// distinct physical cores that share an LLC. A helper on the other socket or
+// on the SMT sibling of the main thread breaks SF eviction.
+
+typedef struct {
+    // the package, and the lowest CPU sharing the physical core and the L3;
+    // pkg is negative for CPUs that are offline or unknown
+    int pkg, core, l3;
+} cpu_place;
+
+typedef struct {
+    u32 n_cpus; // one more than the highest CPU
+    cpu_place *cpus;
+} cpu_topology;
+
+bool cpu_topology_detect(cpu_topology *topo);
+
+void cpu_topology_free(cpu_topology *topo);
+
+// the topology of this machine, detected on first use; NULL if sysfs does
+// not tell
+const cpu_topology *cpu_topology_get();
+
+static inline bool cpu_topology_known(const cpu_topology *topo, int cpu) {
+    return topo && cpu >= 0 && (u32)cpu < topo->n_cpus &&
+           topo->cpus[cpu].pkg >= 0;
+}
+
+// whether a helper on "b" can work for a main thread on "a": same LLC but a
+// different physical core
+static inline bool cpu_topology_pair_ok(const cpu_topology *topo, int a,
+                                        int b) {
+    if (!cpu_topology_known(topo, a) || !cpu_topology_known(topo, b)) {
+        return true; // nothing to say
+    }
+    return topo->cpus[a].l3 == topo->cpus[b].l3 &&
+           topo->cpus[a].core != topo->cpus[b].core;
+}
+
+// pick "n_groups" groups of "group_size" CPUs the process may run on, stored
+// group by group in "cores". Each group shares an LLC, and no two CPUs of any
+// groups share a physical core. Without a topology, CPUs are taken in order.
+bool cpu_topology_pick(u32 n_groups, u32 group_size, int *cores);
+
+// pin the calling thread to its current CPU ("main_cpu"), and claim both it
+// and a CPU for its helper under the policy above; -1 if there is none, and
+// then nothing is claimed
+int cpu_topology_claim_helper(int *main_cpu);
+
+// drop one claim of "cpu", from cpu_topology_pick() or a helper pair
+void cpu_topology_release(int cpu);
+
+// the logical CPU in an rdtscp aux value; Linux stores node << 12 | cpu
+static inline int tsc_aux_cpu(u32 aux) {
+    return aux & 0xfff;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "num_types.h"
+#include <stdio.h>
+#include <time.h>
+
+// Opt-in event tracing of eviction set construction. Each thread records
+// into its own ring buffer without locks, overwriting its oldest events when
+// full, and nothing is formatted until evtrace_write_chrome(), which emits
+// the Chrome trace JSON that chrome://tracing and Perfetto load. While
+// tracing is off, every hook costs a single predicted branch.
+//
+// Dump after the traced threads are done or paused; a dump that races with
+// a recording thread may show a few torn events of that thread.
+
+typedef enum {
+    EVTRACE_TEST,      // one eviction test: cands, result, OTC
+    EVTRACE_HELPER,    // a helper round-trip: action, cnt, helpers
+    EVTRACE_PHASE,     // a build phase, see evtrace_phase
+    EVTRACE_BACKTRACK  // an instant: upper, evset size
+} evtrace_kind;
+
+typedef enum {
+    EVTRACE_PH_ALLOC,
+    EVTRACE_PH_POPULATION,
+    EVTRACE_PH_BUILD,
+    EVTRACE_PH_ATTEMPT, // one retry of a build: retry, backtracks, evicts
+    EVTRACE_PH_PRUNING,
+    EVTRACE_PH_EXTENSION
+} evtrace_phase;
+
+typedef struct {
+    u64 ts, dur; // in ns; dur is 0 for instants
+    u16 kind, phase;
+    u32 core;
+    u64 args[3];
+} evtrace_event;
+
+extern volatile bool _evtrace_on;
+
+// start recording with rings of "cap" events (rounded up to a power of two)
+// per thread; rings of earlier runs are cleared
+bool evtrace_start(u32 cap);
+
+void evtrace_stop();
+
+// free every ring. Stopping does not wait for threads that are already past
+// evtrace_enabled() and writing their rings, so every traced thread must be
+// joined, or be known to be outside the hooks, before the cleanup
+void evtrace_cleanup();
+
+static __always_inline bool evtrace_enabled() {
+    return __builtin_expect(_evtrace_on, 0);
+}
+
+static __always_inline u64 evtrace_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_nsec + ts.tv_sec * 1000000000ull;
+}
+
+void _evtrace_record(evtrace_kind kind, evtrace_phase phase, u64 ts, u64 dur,
+                     u64 a0, u64 a1, u64 a2);
+
+// the start of a span; 0 if tracing is off
+static __always_inline u64 evtrace_begin() {
+    return evtrace_enabled() ? evtrace_now() : 0;
+}
+
+static __always_inline void evtrace_end(evtrace_kind kind, u64 start, u64 a0,
+                                        u64 a1, u64 a2) {
+    if (evtrace_enabled() && start) {
+        _evtrace_record(kind, 0, start, evtrace_now() - start, a0, a1, a2);
+    }
+}
+
+static __always_inline void evtrace_phase_end(evtrace_phase phase, u64 start,
+                                              u64 a0, u64 a1, u64 a2) {
+    if (evtrace_enabled() && start) {
+        _evtrace_record(EVTRACE_PHASE, phase, start, evtrace_now() - start, a0,
+                        a1, a2);
+    }
+}
+
+static __always_inline void evtrace_instant(evtrace_kind kind, u64 a0, u64 a1,
+                                            u64 a2) {
+    if (evtrace_enabled()) {
+        _evtrace_record(kind, 0, evtrace_now(), 0, a0, a1, a2);
+    }
+}
+
+// the number of events recorded by all threads, including overwritten ones
+u64 evtrace_count();
+
+// write every retained event as a Chrome trace JSON object
+bool evtrace_write_chrome(FILE *out);
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "attribs.h"
+#include "num_types.h"
+#include <string.h>
+
+// HDR-style histograms: values are bucketed by their leading bits, so every
+// bucket is within 1/HIST_SUB of its values, across the whole range of
+// [0, 2^HIST_MAX_BITS). Values below HIST_SUB have exact buckets.
+
+#define HIST_SUB_BITS 3u
+#define HIST_SUB (1u << HIST_SUB_BITS)
+#define HIST_MAX_BITS 48u // 2^48ns is about 78 hours
+#define HIST_BUCKETS ((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB)
+
+typedef struct {
+    u64 cnt, sum, min, max;
+    u32 buckets[HIST_BUCKETS];
+} log_hist;
+
+static __always_inline u32 hist_bucket(u64 val) {
+    if (val >> HIST_MAX_BITS) {
+        val = (1ull << HIST_MAX_BITS) - 1;
+    }
+    if (val < HIST_SUB) {
+        return val;
+    }
+
+    u32 shift = 63 - __builtin_clzll(val) - HIST_SUB_BITS;
+    return (shift + 1) * HIST_SUB + ((val >> shift) & (HIST_SUB - 1));
+}
+
+// the smallest value of bucket "b"
+static __always_inline u64 hist_bucket_low(u32 b) {
+    if (b < HIST_SUB) {
+        return b;
+    }
+    return (u64)(HIST_SUB + b % HIST_SUB) << (b / HIST_SUB - 1);
+}
+
+static __always_inline u64 hist_bucket_high(u32 b) {
+    return hist_bucket_low(b + 1) - 1;
+}
+
+static inline void hist_record(log_hist *h, u64 val) {
+    if (!h->cnt || val < h->min) h->min = val;
+    if (val > h->max) h->max = val;
+    h->cnt += 1;
+    h->sum += val;
+    h->buckets[hist_bucket(val)] += 1;
+}
+
+static inline void hist_merge(log_hist *dst, const log_hist *src) {
+    if (!src->cnt) return;
+    if (!dst->cnt || src->min < dst->min) dst->min = src->min;
+    if (src->max > dst->max) dst->max = src->max;
+    dst->cnt += src->cnt;
+    dst->sum += src->sum;
+    for (u32 b = 0; b < HIST_BUCKETS; b++) {
+        dst->buckets[b] += src->buckets[b];
+    }
+}
+
+static inline void hist_reset(log_hist *h) {
+    memset(h, 0, sizeof(*h));
+}
+
+// the value at quantile "q" in [0, 1], i.e., the upper bound of its bucket
+// clamped to the recorded range; 0 if empty
+static inline u64 hist_quantile(const log_hist *h, double q) {
+    if (!h->cnt) return 0;
+
+    u64 rank = q * h->cnt, seen = 0;
+    for (u32 b = 0; b < HIST_BUCKETS; b++) {
+        seen += h->buckets[b];
+        if (seen > rank) {
+            u64 val = hist_bucket_high(b);
+            return val < h->min ? h->min : val > h->max ? h->max : val;
+        }
+    }
+    return h->max;
+}
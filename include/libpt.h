@@ -14,6 +14,10 @@
 #define HUGE_PAGE_SIZE (1ull << HUGE_PAGE_SHIFT)
 #define HUGE_PAGE_MASK (HUGE_PAGE_SIZE - 1)
 
+#define GIGA_PAGE_SHIFT (30u)
+#define GIGA_PAGE_SIZE (1ull << GIGA_PAGE_SHIFT)
+#define GIGA_PAGE_MASK (GIGA_PAGE_SIZE - 1)
+
 #define PL_BITS 9
 #define PL_SIZE (1ull << PL_BITS)
 
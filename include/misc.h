@@ -101,6 +101,27 @@ static ALWAYS_INLINE u8 *mmap_huge_shared_init(void *addr, size_t size, u8 i) {
     return ptr;
 }
 
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+static ALWAYS_INLINE u8 *mmap_giga_shared(void *addr, size_t size) {
+    u8 *ptr = mmap((void *)addr, size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_1GB, -1,
+                   0);
+    if (ptr == MAP_FAILED)
+        return NULL;
+    return ptr;
+}
+
+static ALWAYS_INLINE u8 *mmap_giga_shared_init(void *addr, size_t size, u8 i) {
+    u8 *ptr = mmap_giga_shared(addr, size);
+    if (ptr) {
+        memset(ptr, i, size);
+    }
+    return ptr;
+}
+
 static __always_inline u8 *mmap_file(void *addr, const char *filename,
                                      bool writable) {
     int mask = writable ? O_RDWR : O_RDONLY;
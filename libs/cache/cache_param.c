@@ -2,6 +2,7 @@
 #include "cache/cache_param.h"
 
 bool __has_hugepage = false;
+u32 __hugepage_shift = HUGE_PAGE_SHIFT;
 cpu_caches detected_caches = {0};
 cache_param *detected_l1d, *detected_l1i, *detected_l2, *detected_l3;
 
@@ -38,3 +38,16 @@ evchain *evchain_stride(u8 *start, ptrdiff_t stride, size_t size) {
     head->prev = cur;
     return head;
 }
+
+void evchain_release(evchain *chain) {
+    evchain *cur = chain, *next;
+    if (!chain) {
+        return;
+    }
+
+    do {
+        next = cur->next;
+        cur->next = cur->prev = NULL;
+        cur = next;
+    } while (cur && cur != chain);
+}
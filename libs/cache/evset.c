@@ -1,8 +1,12 @@
 #include "cache/evset.h"
 #include "cache/oracle.h"
+#include "cache/pagemap.h"
+#include "cache/sim.h"
+#include "cache/trace.h"
 #include "sugar.h"
 #include "sync.h"
 #include "math.h"
+#include <sys/vfs.h>
 
 static const bool _dbg = false;
 
@@ -13,8 +17,6 @@ static const bool _dbg = false;
         }                                                                      \
     } while (0)
 
-struct evset_stats _evset_stats;
-
 EVBuildConfig def_l1d_ev_config, def_l2_ev_config;
 
 // batch test whether a group of addresses can be evicted by the evset;
@@ -34,14 +36,29 @@ i64 evset_test_batch(u8 **targets, size_t cnt, EVSet *evset) {
     for (size_t s = 0; s < cnt; s += batch_sz) {
         size_t cur_batch_sz = _min(batch_sz, cnt - s);
         memset(otcs, 0, sizeof(*otcs) * cur_batch_sz);
-        for (u32 t = 0; t < evset->config->test_config.trials; t++) {
+        EVTestConfig *tconf = &evset->config->test_config;
+        for (u32 t = 0; t < tconf->trials; t++) {
+            if (tconf->sim) {
+                for (size_t i = 0; i < cur_batch_sz; i++) {
+                    cache_sim_access(tconf->sim, 0, targets[s + i]);
+                }
+                cache_sim_traverse(tconf->sim, 0, evset->addrs, evset->size,
+                                   tconf);
+                for (size_t i = 0; i < cur_batch_sz; i++) {
+                    u64 lat = cache_sim_time_access(tconf->sim, 0,
+                                                    targets[s + i]);
+                    otcs[i] += lat > (u64)tconf->lat_thresh;
+                }
+                continue;
+            }
+
             access_array(&targets[s], cur_batch_sz);
             _lfence();
             generic_evset_traverse(evset);
             _lfence();
             for (size_t i = 0; i < cur_batch_sz; i++) {
                 u64 lat = _time_maccess(targets[s + i]);
-                otcs[i] += lat > evset->config->test_config.lat_thresh;
+                otcs[i] += lat > tconf->lat_thresh;
             }
         }
 
@@ -57,23 +74,103 @@ i64 evset_test_batch(u8 **targets, size_t cnt, EVSet *evset) {
     return n_pos;
 }
 
-EVBuffer *evbuffer_new(cache_param *cache, EVCandsConfig *config) {
-    size_t uncertainty = cache_uncertainty(cache);
-    size_t n_pages, buf_size;
-
-    if (__has_hugepage) {
+// the buffer size for candidates on pages of 1 << shift bytes
+static size_t evbuffer_size(cache_param *cache, EVCandsConfig *config,
+                            u32 shift, size_t *n_pages) {
+    size_t uncertainty = cache_uncertainty_at(cache, shift);
+    if (shift > PAGE_SHIFT) {
         u64 n_cands = uncertainty * cache->n_ways * config->scaling;
         u64 cands_per_page =
-            _max(1, HUGE_PAGE_SIZE / cache_congruent_stride(cache));
-        n_pages = n_cands / cands_per_page;
+            _max(1, (1ull << shift) / cache_congruent_stride(cache));
+        *n_pages = n_cands / cands_per_page;
         if (n_cands % cands_per_page) {
-            n_pages += 1;
+            *n_pages += 1;
         }
-        buf_size = n_pages * HUGE_PAGE_SIZE;
-        _info("Need to allocate %lu huge pages\n", n_pages);
+        return *n_pages << shift;
     } else {
-        n_pages = uncertainty * cache->n_ways * config->scaling;
-        buf_size = n_pages * PAGE_SIZE;
+        *n_pages = uncertainty * cache->n_ways * config->scaling;
+        return *n_pages * PAGE_SIZE;
+    }
+}
+
+/* Intrusive candidate links */
+#define MAX_LINKABLE_BUFS 64
+
+// ranges of live EVBuffers, the only memory links may be written into
+static struct {
+    u8 *volatile start, *volatile end;
+} linkable_bufs[MAX_LINKABLE_BUFS];
+static pthread_mutex_t linkable_lock = PTHREAD_MUTEX_INITIALIZER;
+
+__thread cand_links _cand_links_cur;
+
+static void evbuffer_set_linkable(EVBuffer *evb, bool linkable) {
+    pthread_mutex_lock(&linkable_lock);
+    for (u32 i = 0; i < MAX_LINKABLE_BUFS; i++) {
+        if (linkable && !linkable_bufs[i].start) {
+            linkable_bufs[i].end = (u8 *)evb->buf + evb->buf_size;
+            _barrier();
+            linkable_bufs[i].start = evb->buf;
+            break;
+        } else if (!linkable && linkable_bufs[i].start == evb->buf) {
+            linkable_bufs[i].start = NULL;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&linkable_lock);
+}
+
+bool cand_links_begin(u8 **cands, size_t cnt, cand_links *saved) {
+    *saved = _cand_links_cur;
+    if (cand_links_active(cands, cnt)) {
+        return true; // walks of sub-arrays reuse the outer links
+    }
+
+    u8 *start = NULL, *end = NULL;
+    for (u32 i = 0; i < MAX_LINKABLE_BUFS && cnt; i++) {
+        u8 *s = linkable_bufs[i].start;
+        if (s && cands[0] >= s && cands[0] < linkable_bufs[i].end) {
+            start = s;
+            end = linkable_bufs[i].end;
+            break;
+        }
+    }
+
+    if (!start) {
+        return false;
+    }
+
+    // lines linked before a foreign line is found are left as they are
+    for (size_t i = 0; i < cnt; i++) {
+        if (cands[i] < start || cands[i] >= end) {
+            return false;
+        }
+
+        // rewrite only stale links to not dirty lines needlessly
+        u8 **link = _cand_link_slot(cands[i]);
+        u8 *prev = i >= CAND_LINK_WAYS ? cands[i - CAND_LINK_WAYS] : cands[i];
+        if (*link != prev) {
+            *link = prev;
+        }
+    }
+
+    _cand_links_cur = (cand_links){.addrs = cands, .size = cnt};
+    return true;
+}
+
+EVBuffer *evbuffer_new(cache_param *cache, EVCandsConfig *config) {
+    u32 shift = __has_hugepage ? __hugepage_shift : PAGE_SHIFT;
+    size_t n_pages, n_small_pages, n_thp_pages;
+    size_t buf_size = evbuffer_size(cache, config, shift, &n_pages);
+    // THP may back only parts of the buffer, so it must also be large enough
+    // for candidates on 4KB pages
+    size_t small_size = evbuffer_size(cache, config, PAGE_SHIFT, &n_small_pages);
+    if (__has_hugepage) {
+        _info("Need to allocate %lu %s pages\n", n_pages,
+              __hugepage_shift == GIGA_PAGE_SHIFT ? "1GB" : "huge");
+        small_size = _max(small_size, evbuffer_size(cache, config,
+                                                    HUGE_PAGE_SHIFT,
+                                                    &n_thp_pages));
     }
 
     EVBuffer *evb = _calloc(1, sizeof(*evb));
@@ -82,23 +179,116 @@ EVBuffer *evbuffer_new(cache_param *cache, EVCandsConfig *config) {
         return NULL;
     }
 
-    void *pages = NULL;
-    if (__has_hugepage) {
-        pages = mmap_huge_shared_init(NULL, buf_size, 0);
-    } else {
-        pages = mmap_shared_init(NULL, buf_size, 0);
-    }
-    if (!pages) {
+    if (hugepage_alloc(&evb->hp, buf_size, small_size, shift)) {
         _error("Failed to mmap %lu bytes for eviction buffer\n", buf_size);
         goto err;
     }
+    _assert(_ALIGNED(evb->hp.buf, PAGE_SHIFT));
+
+    if (evb->hp.backing == HUGEPAGE_THP) {
+        _info("THP backs %lu of %lu regions\n", evb->hp.n_huge,
+              evb->hp.n_regions);
+    }
+
+    evb->buf = evb->hp.buf;
+    evb->n_pages =
+        evb->hp.backing == HUGEPAGE_HUGETLB ? n_pages : n_small_pages;
+    evb->buf_size = evb->hp.size;
+    evb->fd = -1;
+    evb->ref_cnt = 0;
+    evbuffer_set_linkable(evb, true);
+    pagemap_cache_range(evb->buf, evb->buf_size);
+    return evb;
+
+err:
+    _free(evb);
+    return NULL;
+}
+
+#define HUGETLBFS_MAGIC 0x958458f6
+
+EVBuffer *evbuffer_open(const char *path, cache_param *cache,
+                        EVCandsConfig *config, bool *reused) {
+    u32 shift = __has_hugepage ? __hugepage_shift : PAGE_SHIFT;
+    size_t n_pages, buf_size = evbuffer_size(cache, config, shift, &n_pages);
+    EVBuffer *evb = _calloc(1, sizeof(*evb));
+    if (!evb) {
+        _error("Failed to allocate EVBuffer\n");
+        return NULL;
+    }
+
+    int fd = open(path, O_RDWR | O_CREAT, 0600);
+    if (fd < 0) {
+        _error("Failed to open the buffer file %s\n", path);
+        goto err;
+    }
+
+    struct stat st;
+    struct statfs sfs;
+    if (fstat(fd, &st) || fstatfs(fd, &sfs)) {
+        _error("Failed to stat the buffer file %s\n", path);
+        goto err_close;
+    }
+
+    if (__has_hugepage != (sfs.f_type == HUGETLBFS_MAGIC)) {
+        _error("%s: hugepage buffers must be (and only be) on hugetlbfs\n",
+               path);
+        goto err_close;
+    }
+
+    if (__has_hugepage && (size_t)sfs.f_bsize != cache_hugepage_size()) {
+        _error("%s: the hugetlbfs mount has %lu-byte pages instead of %lu\n",
+               path, (size_t)sfs.f_bsize, cache_hugepage_size());
+        goto err_close;
+    }
+
+    *reused = (size_t)st.st_size == buf_size;
+    if (!*reused) {
+        if (st.st_size) {
+            _warn("%s has %lu bytes instead of %lu, recreating it\n", path,
+                  st.st_size, buf_size);
+        }
+
+        if (ftruncate(fd, 0) || ftruncate(fd, buf_size)) {
+            _error("Failed to resize %s to %lu bytes\n", path, buf_size);
+            goto err_close;
+        }
+    }
+
+    void *pages = mmap(NULL, buf_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, fd, 0);
+    if (pages == MAP_FAILED) {
+        _error("Failed to mmap %lu bytes of %s\n", buf_size, path);
+        goto err_close;
+    }
     _assert(_ALIGNED(pages, PAGE_SHIFT));
 
+    if (!*reused) {
+        memset(pages, 0, buf_size);
+    }
+
+    if (mlock(pages, buf_size)) {
+        _warn("Failed to lock %s; its pages may move between runs\n", path);
+    }
+
     evb->buf = pages;
     evb->n_pages = n_pages;
+    evb->buf_size = buf_size;
+    evb->fd = fd;
+    evb->hp = (hugepage_buf){
+        .buf = pages,
+        .size = buf_size,
+        .backing = __has_hugepage ? HUGEPAGE_HUGETLB : HUGEPAGE_NONE,
+        .page_shift = shift,
+        .n_regions = buf_size >> shift,
+        .n_huge = __has_hugepage ? buf_size >> shift : 0};
     evb->ref_cnt = 0;
+    evbuffer_set_linkable(evb, true);
+    pagemap_cache_range(evb->buf, evb->buf_size);
     return evb;
 
+err_close:
+    close(fd);
 err:
     _free(evb);
     return NULL;
@@ -106,14 +296,12 @@ err:
 
 void evbuffer_free(EVBuffer *evb) {
     if (evb && evb->ref_cnt == 0) {
-        size_t buf_sz;
-        if (__has_hugepage) {
-            buf_sz = evb->n_pages * HUGE_PAGE_SIZE;
-        } else {
-            buf_sz = evb->n_pages * PAGE_SIZE;
+        evbuffer_set_linkable(evb, false);
+        pagemap_uncache_range(evb->buf);
+        hugepage_free(&evb->hp);
+        if (evb->fd >= 0) {
+            close(evb->fd);
         }
-
-        munmap(evb->buf, buf_sz);
         _free(evb);
     }
 }
@@ -125,7 +313,7 @@ EVCands *evcands_new(cache_param *cache, EVCandsConfig *config, EVBuffer *evb) {
         return NULL;
     }
 
-    u64 start = time_ns();
+    u64 start = time_ns(), tr = evtrace_begin();
     cands->evb = evb;
     if (!cands->evb) {
         cands->evb = evbuffer_new(cache, config);
@@ -135,40 +323,103 @@ EVCands *evcands_new(cache_param *cache, EVCandsConfig *config, EVBuffer *evb) {
         }
     }
     u64 end = time_ns();
-    _evset_stats.alloc_duration = end - start;
+    evset_stats_cur()->alloc_duration = end - start;
+    hist_record(&evset_stats_cur()->alloc_hist, end - start);
+    evtrace_phase_end(EVTRACE_PH_ALLOC, tr, 0, 0, 0);
 
     cands->evb->ref_cnt += 1;
     cands->ref_cnt = 0;
     cands->cache = cache;
+    cands->ctrl_bits = cands->evb->hp.backing == HUGEPAGE_HUGETLB
+                           ? cands->evb->hp.page_shift
+                           : PAGE_SHIFT;
     return cands;
 }
 
+// page indices of "addrs" relative to "evb"; NULL if a line is outside of it
+static u32 *compact_addrs(u8 **addrs, size_t cnt, EVBuffer *evb) {
+    if (evb->buf_size >> PAGE_SHIFT > UINT32_MAX) {
+        return NULL;
+    }
+
+    u32 *idxs = _calloc(_max(cnt, 1), sizeof(*idxs));
+    if (!idxs) {
+        _error("Failed to allocate %lu page indices\n", cnt);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < cnt; i++) {
+        u8 *buf = evb->buf;
+        if (addrs[i] < buf || addrs[i] >= buf + evb->buf_size) {
+            _free(idxs);
+            return NULL;
+        }
+        idxs[i] = (addrs[i] - buf) >> PAGE_SHIFT;
+    }
+    return idxs;
+}
+
+static inline void expand_idxs(u8 **addrs, u32 *idxs, size_t cnt,
+                               EVBuffer *evb, u32 offset) {
+    for (size_t i = 0; i < cnt; i++) {
+        addrs[i] = (u8 *)evb->buf + ((size_t)idxs[i] << PAGE_SHIFT) + offset;
+    }
+}
+
 EVCands *evcands_shift(EVCands *from, u32 offset) {
+    EVCands *base = from->base ? from->base : from;
+    if (!base->page_idxs) {
+        base->page_idxs = compact_addrs(base->cands, base->size, base->evb);
+        base->n_idxs = base->size;
+        if (!base->page_idxs) {
+            _error("Failed to compact the candidates\n");
+            return NULL;
+        }
+    }
+
     EVCands *cands = _calloc(1, sizeof(*cands));
     if (!cands) {
         _error("Failed to allocate EVCands");
         return NULL;
     }
 
-    cands->cands = _calloc(from->size, sizeof(*from->cands));
-    cands->evb = from->evb;
+    cands->evb = base->evb;
     cands->evb->ref_cnt += 1;
-    cands->size = from->size;
+    cands->cache = base->cache;
+    cands->size = base->n_idxs;
     cands->ref_cnt = 0;
-    if (!cands->cands) {
-        _error("Failed to allocate the candidate array\n");
-        goto err;
+    cands->page_idxs = base->page_idxs;
+    cands->n_idxs = base->n_idxs;
+    cands->offset = offset;
+    cands->base = base;
+    cands->ctrl_bits = base->ctrl_bits;
+    base->ref_cnt += 1;
+    base->n_views += 1;
+    return cands;
+}
+
+bool evcands_materialize(EVCands *cands) {
+    if (cands->cands || !cands->base) {
+        return false;
     }
 
-    for (size_t i = 0; i < cands->size; i++) {
-        cands->cands[i] = _ALIGN_DOWN(from->cands[i], PAGE_SHIFT) + offset;
+    cands->cands = _calloc(_max(cands->n_idxs, 1), sizeof(*cands->cands));
+    if (!cands->cands) {
+        _error("Failed to allocate the candidate array\n");
+        return true;
     }
 
-    return cands;
+    expand_idxs(cands->cands, cands->page_idxs, cands->n_idxs, cands->evb,
+                cands->offset);
+    cands->size = cands->n_idxs;
+    return false;
+}
 
-err:
-    _free(cands);
-    return NULL;
+void evcands_release(EVCands *cands) {
+    if (cands->base) {
+        _free(cands->cands);
+        cands->cands = NULL;
+    }
 }
 
 static void shuffle_evset(u8 **addrs, u32 sz) {
@@ -183,52 +434,246 @@ static void shuffle_evset(u8 **addrs, u32 sz) {
     }
 }
 
-bool evcands_populate(u32 offset, EVCands *cands, EVCandsConfig *config) {
-    size_t n_cands_init = cands->evb->n_pages;
+void evcands_shuffle(EVCands *cands) {
+    shuffle_evset(cands->cands, cands->size);
+}
+
+// the number of hugepage-backed regions to lay candidates out on, 0 if there
+// are too few of them and candidates go on every 4KB page instead
+static size_t evbuffer_huge_regions(EVBuffer *evb, cache_param *cache,
+                                    EVCandsConfig *config) {
+    hugepage_buf *hp = &evb->hp;
+    if (hp->backing == HUGEPAGE_HUGETLB) {
+        return hp->n_regions;
+    }
+
+    size_t n_regions = 0;
+    if (hp->n_huge) {
+        u64 n_cands = cache_uncertainty_at(cache, hp->page_shift) *
+                      cache->n_ways * config->scaling;
+        u64 cands_per_region =
+            _max(1, (1ull << hp->page_shift) / cache_congruent_stride(cache));
+        n_regions = (n_cands + cands_per_region - 1) / cands_per_region;
+    }
+    return n_regions <= hp->n_huge ? n_regions : 0;
+}
+
+/* Physical address grouping */
+#define PA_KEY_NO_SLICE 0xffffffffu
+
+static inline bool pa_assisted(EVCandsConfig *config) {
+    return config->pa_assist && cache_oracle_pa_inited();
+}
+
+static inline bool slice_model_usable(EVCandsConfig *config) {
+    return slice_model_generalizes(cache_slice_model) && pa_assisted(config);
+}
+
+// the set of a line in "cache" in the upper half and, with the slice model,
+// its slice in the lower half, so lines of a set sort next to each other
+static u64 pa_cache_key(u8 *addr, cache_param *cache) {
+    uintptr_t pa = cache_oracle_pa(addr);
+    if (pa == (uintptr_t)-1) {
+        return INVALID_ADDR_HASH;
+    }
+
+    u64 set = (pa >> cache->num_cl_bits) % cache->n_sets;
+    if (cache->n_slices <= 1 || !slice_model_generalizes(cache_slice_model)) {
+        return set << 32;
+    }
+
+    i32 slice = slice_model_lookup(cache_slice_model, pa);
+    return set << 32 | (slice < 0 ? PA_KEY_NO_SLICE : (u32)slice);
+}
+
+// with physical addresses, the set index bits are all known
+static inline u32 pa_ctrl_bits(cache_param *cache) {
+    return cache->num_cl_bits + cache->num_set_idx_bits;
+}
+
+typedef struct {
+    u64 key;
+    u8 *addr;
+} keyed_cand;
+
+static int keyed_cand_cmp(const void *a, const void *b) {
+    u64 ka = ((keyed_cand *)a)->key, kb = ((keyed_cand *)b)->key;
+    return ka < kb ? -1 : ka > kb;
+}
+
+// drop the lines outside the filter's set and sort the rest by set (and
+// slice); lines without a physical address are kept at the end. Returns the
+// count
+static i64 group_cands(u8 **addrs, size_t cnt, cache_param *cache,
+                       EVSet *filter_ev) {
+    keyed_cand *keyed = _calloc(_max(cnt, 1), sizeof(*keyed));
+    if (!keyed) {
+        _error("Failed to allocate %lu keyed candidates\n", cnt);
+        return -1;
+    }
+
+    u64 filter_key = INVALID_ADDR_HASH;
+    if (filter_ev && filter_ev->size) {
+        filter_key = pa_cache_key(filter_ev->addrs[0], filter_ev->target_cache);
+    }
+
+    size_t n = 0;
+    for (size_t i = 0; i < cnt; i++) {
+        if (filter_key != INVALID_ADDR_HASH) {
+            u64 key = pa_cache_key(addrs[i], filter_ev->target_cache);
+            if (key != INVALID_ADDR_HASH && key != filter_key) continue;
+        }
+        keyed[n++] = (keyed_cand){pa_cache_key(addrs[i], cache), addrs[i]};
+    }
+
+    qsort(keyed, n, sizeof(*keyed), keyed_cand_cmp);
+    for (size_t i = 0; i < n; i++) {
+        addrs[i] = keyed[i].addr;
+    }
+    _free(keyed);
+    return n;
+}
+
+// move the lines in the set of "target" to the front; returns their count
+static size_t partition_pa_set(u8 *target, u8 **addrs, size_t cnt,
+                               cache_param *cache) {
+    u64 key = pa_cache_key(target, cache);
+    if (key == INVALID_ADDR_HASH) {
+        return 0;
+    }
+
+    size_t n = 0;
+    for (size_t i = 0; i < cnt; i++) {
+        u64 k = pa_cache_key(addrs[i], cache);
+        if (k != INVALID_ADDR_HASH && k >> 32 == key >> 32) {
+            _swap(addrs[n], addrs[i]);
+            n += 1;
+        }
+    }
+    return n;
+}
+
+// lay out every candidate line at "offset"; returns NULL on error
+static u8 **evcands_lines(u32 offset, EVCands *cands, EVCandsConfig *config,
+                          size_t *n_lines) {
+    EVBuffer *evb = cands->evb;
+    size_t n_regions = evbuffer_huge_regions(evb, cands->cache, config);
+    size_t n_cands_init = evb->n_pages, per_region = 1;
     u64 stride = PAGE_SIZE;
-    if (__has_hugepage) {
+    cands->ctrl_bits = PAGE_SHIFT;
+    if (n_regions) {
         stride = cache_congruent_stride(cands->cache);
-        n_cands_init *= HUGE_PAGE_SIZE / stride;
+        per_region = _max(1, (1ull << evb->hp.page_shift) / stride);
+        n_cands_init = n_regions * per_region;
+        cands->ctrl_bits = evb->hp.page_shift;
     }
 
     u8 **addrs = _calloc(n_cands_init, sizeof(*addrs));
     if (!addrs) {
         _error("Failed to allocate the candidate array; n_pages: %lu\n",
                n_cands_init);
-        goto err;
+        return NULL;
     }
+    cands->offset = offset;
 
-    for (size_t n = 0; n < n_cands_init; n++) {
-        addrs[n] = cands->evb->buf + n * stride + offset;
+    // skip the regions THP has not backed
+    for (size_t n = 0, r = 0; n < n_cands_init; n++) {
+        u8 *base = evb->buf;
+        if (n_regions) {
+            if (n % per_region == 0) {
+                while (!hugepage_region_huge(&evb->hp, r)) r++;
+                r++;
+            }
+            base += ((r - 1) << evb->hp.page_shift) + n % per_region * stride;
+        } else {
+            base += n * stride;
+        }
+        addrs[n] = base + offset;
         *addrs[n] = n;
     }
+    *n_lines = n_cands_init;
+    return addrs;
+}
 
-    // we do not have a filter evset or it's not worth filtering
-    if (!config->filter_ev ||
-        cache_uncertainty(config->filter_ev->target_cache) == 1) {
-        cands->cands = addrs;
-        cands->size = n_cands_init;
-        return false;
-    }
-
-    u64 start = time_ns();
+// move the lines "filter_ev" evicts to the front; returns their count
+static i64 filter_lines(u8 **addrs, size_t cnt, EVSet *filter_ev) {
 #ifndef ICELAKE
-    i64 n_cands = evset_test_batch(addrs, n_cands_init, config->filter_ev);
-    if (n_cands <= 0) {
-        _error("Failed to filter out candidate lines\n");
-        goto err;
-    }
+    return evset_test_batch(addrs, cnt, filter_ev);
 #else
     // the evset_test_batch gives unstable results on ICELAKE-SP for unknown reasons
-    i64 n_cands = 0;
-    for (size_t i = 0; i < n_cands_init; i++) {
-        if (generic_evset_test(addrs[i], config->filter_ev) == EV_POS) {
-            _swap(addrs[n_cands], addrs[i]);
-            n_cands += 1;
+    i64 n_pos = 0;
+    for (size_t i = 0; i < cnt; i++) {
+        if (generic_evset_test(addrs[i], filter_ev) == EV_POS) {
+            _swap(addrs[n_pos], addrs[i]);
+            n_pos += 1;
         }
     }
+    return n_pos;
 #endif
+}
+
+bool evcands_filter(EVCands *cands, EVSet *filter_ev) {
+    i64 n_pos = filter_lines(cands->cands, cands->size, filter_ev);
+    if (n_pos < 0) {
+        return true;
+    }
+    cands->size = n_pos;
+    return false;
+}
+
+// a repopulated base gets a new snapshot on its next shift; its views would
+// silently go stale, so it must have none
+static bool evcands_drop_snapshot(EVCands *cands) {
+    if (cands->base || cands->n_views) {
+        _error("Cannot populate a shifted view or candidates with views\n");
+        return true;
+    }
+    _free(cands->page_idxs);
+    cands->page_idxs = NULL;
+    cands->n_idxs = 0;
+    return false;
+}
+
+bool evcands_populate(u32 offset, EVCands *cands, EVCandsConfig *config) {
+    if (evcands_drop_snapshot(cands)) {
+        return true;
+    }
 
+    size_t n_cands_init;
+    u8 **addrs = evcands_lines(offset, cands, config, &n_cands_init);
+    if (!addrs) {
+        return true;
+    }
+
+    if (config->filter_ev && evset_materialize(config->filter_ev)) {
+        goto err;
+    }
+
+    // physical addresses partition the candidates without any timing
+    if (pa_assisted(config)) {
+        i64 n_cands = group_cands(addrs, n_cands_init, cands->cache,
+                                  config->filter_ev);
+        if (n_cands <= 0) {
+            _error("Failed to group candidate lines\n");
+            goto err;
+        }
+
+        _info("Grouped %lu lines to %ld candidates\n", n_cands_init, n_cands);
+        cands->cands = addrs;
+        cands->size = n_cands;
+        return false;
+    }
+
+    // we do not have a filter evset or it's not worth filtering
+    if (!config->filter_ev ||
+        evcands_uncertainty(cands, config->filter_ev->target_cache) == 1) {
+        cands->cands = addrs;
+        cands->size = n_cands_init;
+        return false;
+    }
+
+    u64 start = time_ns(), tr = evtrace_begin();
+    i64 n_cands = filter_lines(addrs, n_cands_init, config->filter_ev);
     if (n_cands <= 0) {
         _error("Failed to filter out candidate lines\n");
         goto err;
@@ -241,7 +686,9 @@ bool evcands_populate(u32 offset, EVCands *cands, EVCandsConfig *config) {
         goto err;
     }
     u64 end = time_ns();
-    _evset_stats.population_duration = end - start;
+    evset_stats_cur()->population_duration = end - start;
+    hist_record(&evset_stats_cur()->population_hist, end - start);
+    evtrace_phase_end(EVTRACE_PH_POPULATION, tr, n_cands, 0, 0);
 
     cands->cands = tmp;
     cands->size = n_cands;
@@ -252,8 +699,308 @@ err:
     return true;
 }
 
+typedef struct {
+    u8 **lines; // a disjoint slice of all lines
+    size_t cnt;
+    EVSet **filter_evs;
+    u32 n_colors;
+    int core; // negative: unpinned
+    size_t *n_per_color;
+    bool err;
+
+    // with a simulator, each thread tests in a clone of it with its own
+    // copies of the filter evsets
+    cache_sim *sim;
+    EVSet *sim_evs;
+    EVBuildConfig *sim_confs;
+} color_job;
+
+static bool color_job_clone_sim(color_job *job) {
+    u32 n = job->n_colors;
+    EVSet **own = _calloc(n, sizeof(*own));
+    job->sim = cache_sim_clone(job->filter_evs[0]->config->test_config.sim);
+    job->sim_evs = _calloc(n, sizeof(*job->sim_evs));
+    job->sim_confs = _calloc(n, sizeof(*job->sim_confs));
+    if (!own || !job->sim || !job->sim_evs || !job->sim_confs) {
+        _error("Failed to clone the simulator of a classifier\n");
+        _free(own);
+        return true;
+    }
+
+    for (u32 c = 0; c < n; c++) {
+        job->sim_evs[c] = *job->filter_evs[c];
+        job->sim_confs[c] = *job->filter_evs[c]->config;
+        job->sim_confs[c].test_config.sim = job->sim;
+        job->sim_evs[c].config = &job->sim_confs[c];
+        own[c] = &job->sim_evs[c];
+    }
+    job->filter_evs = own;
+    return false;
+}
+
+static void color_job_free_sim(color_job *job) {
+    if (job->sim_evs && job->filter_evs &&
+        job->filter_evs[0] == &job->sim_evs[0]) {
+        _free(job->filter_evs);
+    }
+    cache_sim_free(job->sim);
+    _free(job->sim_evs);
+    _free(job->sim_confs);
+}
+
+static int ptr_cmp(const void *a, const void *b) {
+    uintptr_t pa = *(const uintptr_t *)a, pb = *(const uintptr_t *)b;
+    return (pa > pb) - (pa < pb);
+}
+
+#define CLAIM_NONE UINT32_MAX // no evset evicts the line
+#define CLAIM_MANY (UINT32_MAX - 1) // several evsets do
+
+// claims[i] becomes the color whose evset evicts lines[i], CLAIM_NONE, or
+// CLAIM_MANY, with one batched pass over the lines per color; sorts "lines"
+static bool claim_lines(u8 **lines, size_t cnt, EVSet **filter_evs,
+                        u32 n_colors, u32 *claims) {
+    u8 **tested = _calloc(_max(cnt, 1), sizeof(*tested));
+    if (!tested) {
+        _error("Failed to allocate %lu lines to classify\n", cnt);
+        return true;
+    }
+
+    _sort(lines, cnt, sizeof(*lines), ptr_cmp);
+    for (size_t i = 0; i < cnt; i++) {
+        claims[i] = CLAIM_NONE;
+    }
+
+    bool err = false;
+    for (u32 c = 0; c < n_colors && !err; c++) {
+        memcpy(tested, lines, cnt * sizeof(*tested));
+        i64 n_pos = filter_lines(tested, cnt, filter_evs[c]);
+        err = n_pos < 0;
+        for (i64 i = 0; i < n_pos; i++) {
+            u8 **line = bsearch(&tested[i], lines, cnt, sizeof(*lines),
+                                ptr_cmp);
+            u32 *claim = &claims[line - lines];
+            *claim = *claim == CLAIM_NONE ? c : CLAIM_MANY;
+        }
+    }
+    _free(tested);
+    return err;
+}
+
+// test a slice against every evset; the lines of every color end up
+// contiguous and in color order, followed by the unclassified ones. Taking
+// the first color that evicts a line would hand it to a lower color on any
+// false positive, so a line only joins a color no other one claims. Lines
+// claimed by several colors are tested once more, and stay unclassified if
+// they are still contested. A color without an evset cannot contest its
+// lines, so each color confirms its lines with a second batched pass
+static void *classify_slice(void *arg) {
+    color_job *job = arg;
+    if (job->core >= 0 && !set_proc_affinity(job->core)) {
+        _warn("Failed to pin the classifier to core %d\n", job->core);
+    }
+
+    size_t cnt = job->cnt, n_contested = 0, n_out = 0, n_rejected = 0;
+    u32 *claims = _calloc(_max(cnt, 1), sizeof(*claims));
+    u32 *reclaims = _calloc(_max(cnt, 1), sizeof(*reclaims));
+    u8 **contested = _calloc(_max(cnt, 1), sizeof(*contested));
+    u8 **out = _calloc(_max(cnt, 1), sizeof(*out));
+    u8 **rejected = _calloc(_max(cnt, 1), sizeof(*rejected));
+    if (!claims || !reclaims || !contested || !out || !rejected) {
+        _error("Failed to allocate the claims of %lu lines\n", cnt);
+        job->err = true;
+        goto out;
+    }
+
+    if (claim_lines(job->lines, cnt, job->filter_evs, job->n_colors,
+                    claims)) {
+        job->err = true;
+        goto out;
+    }
+    for (size_t i = 0; i < cnt; i++) {
+        if (claims[i] == CLAIM_MANY) {
+            contested[n_contested++] = job->lines[i];
+        }
+    }
+    if (n_contested && claim_lines(contested, n_contested, job->filter_evs,
+                                   job->n_colors, reclaims)) {
+        job->err = true;
+        goto out;
+    }
+
+    for (u32 c = 0; c < job->n_colors; c++) {
+        size_t start = n_out;
+        for (size_t i = 0; i < cnt; i++) {
+            if (claims[i] == c) out[n_out++] = job->lines[i];
+        }
+        for (size_t i = 0; i < n_contested; i++) {
+            if (reclaims[i] == c) out[n_out++] = contested[i];
+        }
+
+        i64 n_pos = filter_lines(out + start, n_out - start,
+                                 job->filter_evs[c]);
+        if (n_pos < 0) {
+            job->err = true;
+            goto out;
+        }
+        memcpy(rejected + n_rejected, out + start + n_pos,
+               (n_out - start - n_pos) * sizeof(*out));
+        n_rejected += n_out - start - n_pos;
+        n_out = start + n_pos;
+        job->n_per_color[c] = n_pos;
+    }
+    for (size_t i = 0; i < cnt; i++) {
+        if (claims[i] == CLAIM_NONE) out[n_out++] = job->lines[i];
+    }
+    for (size_t i = 0; i < n_contested; i++) {
+        if (reclaims[i] >= job->n_colors) out[n_out++] = contested[i];
+    }
+    memcpy(out + n_out, rejected, n_rejected * sizeof(*out));
+    memcpy(job->lines, out, cnt * sizeof(*out));
+
+out:
+    _free(claims);
+    _free(reclaims);
+    _free(contested);
+    _free(out);
+    _free(rejected);
+    return NULL;
+}
+
+bool evcands_populate_colors(u32 offset, EVCands **cands, EVSet **filter_evs,
+                             u32 n_colors, EVCandsConfig *config,
+                             u32 n_threads, const int *cores) {
+    for (u32 c = 0; c < n_colors; c++) {
+        if (evcands_drop_snapshot(cands[c]) ||
+            evset_materialize(filter_evs[c])) {
+            return true;
+        }
+    }
+
+    // nothing to time with physical addresses
+    if (pa_assisted(config)) {
+        EVCandsConfig conf = *config;
+        for (u32 c = 0; c < n_colors; c++) {
+            conf.filter_ev = filter_evs[c];
+            if (evcands_populate(offset, cands[c], &conf)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    size_t n_lines;
+    u8 **addrs = evcands_lines(offset, cands[0], config, &n_lines);
+    if (!addrs) {
+        return true;
+    }
+
+    n_threads = _max(_min(n_threads, n_lines), 1u);
+
+    bool err = false;
+    u64 start = time_ns(), tr = evtrace_begin();
+    color_job *jobs = _calloc(n_threads, sizeof(*jobs));
+    size_t *counts = _calloc(n_threads * n_colors, sizeof(*counts));
+    pthread_t *pids = _calloc(n_threads, sizeof(*pids));
+    if (!jobs || !counts || !pids) {
+        _error("Failed to allocate %u classifier jobs\n", n_threads);
+        err = true;
+        goto out;
+    }
+
+    for (u32 t = 0; t < n_threads; t++) {
+        size_t lo = n_lines * t / n_threads, hi = n_lines * (t + 1) / n_threads;
+        jobs[t] = (color_job){.lines = addrs + lo,
+                              .cnt = hi - lo,
+                              .filter_evs = filter_evs,
+                              .n_colors = n_colors,
+                              .core = cores ? cores[t] : -1,
+                              .n_per_color = counts + t * n_colors};
+        // the simulator is not thread-safe
+        if (n_threads > 1 && filter_evs[0]->config->test_config.sim &&
+            color_job_clone_sim(&jobs[t])) {
+            err = true;
+            goto out;
+        }
+    }
+
+    if (n_threads == 1) {
+        classify_slice(&jobs[0]);
+    } else {
+        u32 n_started = 0;
+        for (; n_started < n_threads; n_started++) {
+            if (pthread_create(&pids[n_started], NULL, classify_slice,
+                               &jobs[n_started])) {
+                _error("Failed to start classifier %u\n", n_started);
+                err = true;
+                break;
+            }
+        }
+        for (u32 t = 0; t < n_started; t++) {
+            pthread_join(pids[t], NULL);
+        }
+    }
+
+    // gather each color from every slice
+    size_t total = 0;
+    for (u32 c = 0; c < n_colors && !err; c++) {
+        size_t n = 0;
+        for (u32 t = 0; t < n_threads; t++) {
+            err |= jobs[t].err;
+            n += jobs[t].n_per_color[c];
+        }
+
+        cands[c]->offset = offset;
+        cands[c]->ctrl_bits = cands[0]->ctrl_bits;
+        cands[c]->cands = _calloc(_max(n, 1), sizeof(u8 *));
+        cands[c]->size = n;
+        if (!n || !cands[c]->cands) {
+            _error("Failed to filter out candidate lines of color %u\n", c);
+            err = true;
+            break;
+        }
+
+        n = 0;
+        for (u32 t = 0; t < n_threads; t++) {
+            size_t skip = 0;
+            for (u32 p = 0; p < c; p++) {
+                skip += jobs[t].n_per_color[p];
+            }
+            memcpy(cands[c]->cands + n, jobs[t].lines + skip,
+                   jobs[t].n_per_color[c] * sizeof(u8 *));
+            n += jobs[t].n_per_color[c];
+        }
+        total += n;
+    }
+
+    if (!err) {
+        u64 end = time_ns();
+        _info("Classified %lu lines to %lu candidates of %u colors with %u "
+              "threads\n", n_lines, total, n_colors, n_threads);
+        evset_stats_cur()->population_duration = end - start;
+        hist_record(&evset_stats_cur()->population_hist, end - start);
+        evtrace_phase_end(EVTRACE_PH_POPULATION, tr, total, 0, 0);
+    }
+
+out:
+    for (u32 t = 0; jobs && t < n_threads; t++) {
+        color_job_free_sim(&jobs[t]);
+    }
+    _free(pids);
+    _free(counts);
+    _free(jobs);
+    _free(addrs);
+    return err;
+}
+
 void evcands_free(EVCands *cands) {
     if (cands && cands->ref_cnt == 0) {
+        if (cands->base) {
+            cands->base->ref_cnt -= 1;
+            cands->base->n_views -= 1;
+        } else {
+            _free(cands->page_idxs);
+        }
         cands->evb->ref_cnt -= 1;
         evbuffer_free(cands->evb);
         _free(cands->cands);
@@ -261,8 +1008,7 @@ void evcands_free(EVCands *cands) {
     }
 }
 
-EVSet *evset_new(u32 offset, EVBuildConfig *config, cache_param *cache,
-                 EVCands *evcands) {
+static EVSet *evset_alloc(EVBuildConfig *config, cache_param *cache) {
     EVSet *evset = _calloc(1, sizeof(*evset));
     if (!evset) {
         _error("Cannot allocate an eviction set.\n");
@@ -274,12 +1020,38 @@ EVSet *evset_new(u32 offset, EVBuildConfig *config, cache_param *cache,
     evset->addrs = _calloc(evset->cap, sizeof(*evset->addrs));
     if (!evset->addrs) {
         _error("Cannot allocate evset addrs buffer.\n");
-        goto err;
+        evset_free(evset);
+        return NULL;
     }
 
-    evset->cands = evcands;
     evset->config = config;
     evset->target_cache = cache;
+    return evset;
+}
+
+EVSet *evset_new_deferred(EVBuildConfig *config, cache_param *cache,
+                          EVCands *evcands) {
+    EVSet *evset = evset_alloc(config, cache);
+    if (evset) {
+        evset->cands = evcands;
+        evset->cands->ref_cnt += 1;
+    }
+    return evset;
+}
+
+EVSet *evset_new(u32 offset, EVBuildConfig *config, cache_param *cache,
+                 EVCands *evcands) {
+    EVSet *evset = evset_alloc(config, cache);
+    if (!evset) {
+        return NULL;
+    }
+
+    evset->cands = evcands;
+    if (evset->cands && evcands_materialize(evset->cands)) {
+        evset->cands = NULL;
+        goto err;
+    }
+
     if (!evset->cands) {
         evset->cands = evcands_new(cache, &config->cands_config, NULL);
         if (!evset->cands) {
@@ -302,69 +1074,170 @@ err:
 }
 
 EVSet *evset_shift(EVSet *from, u32 offset) {
+    EVSet *base = from->base ? from->base : from;
     EVSet *evset = _calloc(1, sizeof(*evset));
     if (!evset) {
         _error("Cannot allocate an eviction set\n");
         return NULL;
     }
 
-    memcpy(evset, from, sizeof(*evset));
-    evset->cands->ref_cnt += 1;
+    memcpy(evset, base, sizeof(*evset));
+    if (evset->cands) {
+        evset->cands->ref_cnt += 1;
+    }
+    evset->addrs = NULL;
+    evset->offset = offset;
+    evset->base = base;
+    evset->n_views = 0;
+    evset->released = false;
+    base->n_views += 1;
+    return evset;
+}
+
+bool evset_materialize(EVSet *evset) {
+    EVSet *base = evset->base;
+    if (evset->addrs || !base) {
+        return false;
+    }
+
     evset->addrs = _calloc(evset->cap, sizeof(*evset->addrs));
     if (!evset->addrs) {
         _error("Cannot allocate evset addrs buffer.\n");
-        goto err;
+        return true;
     }
 
-    for (size_t i = 0; i < evset->cap; i++) {
-        u8 *page = _ALIGN_DOWN(from->addrs[i], PAGE_SHIFT);
-        evset->addrs[i] = page + offset;
+    evset->size = _min(base->size, evset->cap);
+    for (u32 i = 0; i < evset->size; i++) {
+        u8 *page = _ALIGN_DOWN(base->addrs[i], PAGE_SHIFT);
+        evset->addrs[i] = page + evset->offset;
     }
-    return evset;
-
-err:
-    evset_free(evset);
-    return NULL;
+    return false;
 }
 
 void evset_free(EVSet *evset) {
-    if (evset) {
+    if (!evset) {
+        return;
+    }
+
+    if (evset->n_views) {
+        evset->released = true;
+        return;
+    }
+
+    EVSet *base = evset->base;
+    if (evset->cands) {
         evset->cands->ref_cnt -= 1;
-        _free(evset->addrs);
-        _free(evset);
+    }
+    _free(evset->addrs);
+    _free(evset);
+    if (base && --base->n_views == 0 && base->released) {
+        evset_free(base);
     }
 }
 
 /* Traverse functions */
 void generic_cands_traverse(u8 **cands, size_t cnt, EVTestConfig *tconf) {
     // traverse backwards to prevent speculative execution to overshoot
+    bool linked = cand_links_active(cands, cnt);
     for (size_t r = 0; r < tconf->ev_repeat; r++) {
-        access_array_bwd(cands, cnt);
+        access_cands_bwd(cands, cnt, linked);
     }
 }
 
 static inline void
 helper_thread_traverse_cands(u8 **cands, size_t cnt, EVTestConfig *conf) {
-    struct helper_thread_traverse_cands *tcands = _calloc(1, sizeof(*tcands));
-    assert(tcands);
+    helper_thread_pool *pool = conf->hpool;
+    u64 tr = evtrace_begin();
+    if (!pool || !pool->n_helpers) {
+        helper_thread_push(conf->hctrl, TRAVERSE_CANDS)->trav =
+            (struct helper_thread_traverse_cands){.traverse = conf->traverse,
+                                                  .cands = cands,
+                                                  .cnt = cnt,
+                                                  .tconfig = conf};
+        helper_thread_flush(conf->hctrl);
+        evtrace_end(EVTRACE_HELPER, tr, TRAVERSE_CANDS, cnt, 0);
+        return;
+    }
+
+    for (u32 h = 0; h < pool->n_helpers; h++) {
+        size_t lo, hi;
+        helper_pool_stripe(pool, h, cnt, &lo, &hi);
+        helper_thread_push(&pool->ctrls[h], TRAVERSE_CANDS)->trav =
+            (struct helper_thread_traverse_cands){.traverse = conf->traverse,
+                                                  .cands = cands + lo,
+                                                  .cnt = hi - lo,
+                                                  .tconfig = conf};
+        helper_thread_post(&pool->ctrls[h]);
+    }
+    for (u32 h = 0; h < pool->n_helpers; h++) {
+        wait_helper_thread(&pool->ctrls[h]);
+    }
+    evtrace_end(EVTRACE_HELPER, tr, TRAVERSE_CANDS, cnt, pool->n_helpers);
+}
+
+// one timed eviction trial; returns false if the sample is polluted by a
+// context switch or an interrupt. "evict" flushes the target right before
+// timing it instead, emulating a perfect eviction (for calibration)
+static __always_inline bool _eviction_trial(u8 *target, u8 *tlb_target,
+                                            u8 **cands, size_t cnt,
+                                            EVTestConfig *tconf, bool evict,
+                                            u64 *lat) {
+    if (tconf->sim) {
+        *lat = cache_sim_eviction_trial(tconf->sim, target, cands, cnt, tconf,
+                                        evict);
+        return true;
+    }
+
+    u32 aux_before, aux_after;
+    _rdtscp_aux(&aux_before);
+    if (tconf->need_helper) {
+        tconf->hctrl->main_aux = aux_before;
+    }
+
+    _clflush(target); // flush it so it gets an insertion age
+    if (tconf->flush_cands) {
+        flush_array(cands, cnt);
+    }
+    _lfence();
+    // load the target line
+    for (u32 j = 0; j < tconf->access_cnt; j++) {
+        // may use lower ev to causing repeated access to upper levels
+        if (tconf->lower_ev) {
+            generic_evset_traverse(tconf->lower_ev);
+        }
+        _lfence();
+        _maccess(target);
+        if (tconf->need_helper) {
+            helper_thread_read_single(target, tconf->hctrl);
+            _maccess(target);
+        }
+    }
 
-    *tcands = (struct helper_thread_traverse_cands){.traverse = conf->traverse,
-                                                    .cands = cands,
-                                                    .cnt = cnt,
-                                                    .tconfig = conf};
+    // traverse candidates
+    _lfence();
+    if (evict) {
+        _clflush(target);
+    } else if (tconf->foreign_evictor) {
+        helper_thread_traverse_cands(cands, cnt, tconf);
+    } else {
+        tconf->traverse(cands, cnt, tconf);
+    }
+    _lfence();
 
-    conf->hctrl->action = TRAVERSE_CANDS;
-    conf->hctrl->payload = tcands;
-    _barrier();
-    conf->hctrl->waiting = false;
-    wait_helper_thread(conf->hctrl);
-    _free(tcands);
+    // warmup TLB then time target
+    _maccess(tlb_target);
+    u64 UNUSED _tmp;
+    *lat = _time_maccess_aux(target, _tmp, aux_after);
+    return aux_before == aux_after &&
+           *lat < (u64)detected_cache_lats.interrupt_thresh;
 }
 
-EVTestRes generic_test_eviction(u8 *target, u8 **cands, size_t cnt,
-                                EVTestConfig *tconf) {
+static EVTestRes _generic_test_eviction(u8 *target, u8 **cands, size_t cnt,
+                                       EVTestConfig *tconf, u32 *otc_out) {
+    struct evset_stats *stats = evset_stats_cur();
     u8 *tlb_target = tlb_warmup_ptr(target);
-    u32 otc = 0, aux_before, aux_after;
+    u32 otc = 0;
+    *otc_out = 0;
     u32 trials = tconf->trials;
     u32 low_bnd = tconf->low_bnd;
     u32 upp_bnd = tconf->upp_bnd;
@@ -376,48 +1249,17 @@ EVTestRes generic_test_eviction(u8 *target, u8 **cands, size_t cnt,
 
     _dprintf("Lats:");
     for (u32 r = 0; r < tconf->unsure_retry; r++) {
-        _evset_stats.cands_tests += 1;
-        _evset_stats.mem_accs += cnt;
+        stats->cands_tests += 1;
+        stats->mem_accs += cnt;
 
         otc = 0;
         for (u32 i = 0; i < trials;) {
-            _rdtscp_aux(&aux_before);
-
-            _clflush(target); // flush it so it gets an insertion age
-            if (tconf->flush_cands) {
-                flush_array(cands, cnt);
-            }
-            _lfence();
-            // load the target line
-            for (u32 j = 0; j < tconf->access_cnt; j++) {
-                // may use lower ev to causing repeated access to upper levels
-                if (tconf->lower_ev) {
-                    generic_evset_traverse(tconf->lower_ev);
-                }
-                _lfence();
-                _maccess(target);
-                if (tconf->need_helper) {
-                    helper_thread_read_single(target, tconf->hctrl);
-                    _maccess(target);
-                }
-            }
-
-            // traverse candidates
-            _lfence();
-            if (tconf->foreign_evictor) {
-                helper_thread_traverse_cands(cands, cnt, tconf);
-            } else {
-                tconf->traverse(cands, cnt, tconf);
-            }
-            _lfence();
-
-            // warmup TLB then time target
-            _maccess(tlb_target);
-            u64 UNUSED _tmp;
-            u64 lat = _time_maccess_aux(target, _tmp, aux_after);
-            if (aux_before == aux_after &&
-                lat < detected_cache_lats.interrupt_thresh) {
+            u64 lat;
+            if (_eviction_trial(target, tlb_target, cands, cnt, tconf, false,
+                                &lat)) {
+                stats->trials += 1;
                 otc += (lat >= tconf->lat_thresh);
+                *otc_out = otc;
                 i += 1;
                 if (otc > upp_bnd) {
                     return EV_POS;
@@ -434,21 +1276,147 @@ EVTestRes generic_test_eviction(u8 *target, u8 **cands, size_t cnt,
     }
 
     if (otc >= (low_bnd + upp_bnd) / 2) {
-        _evset_stats.pos_unsure += 1;
+        stats->pos_unsure += 1;
         return EV_POS_UNSURE;
     } else {
-        _evset_stats.neg_unsure += 1;
+        stats->neg_unsure += 1;
         return EV_NEG_UNSURE;
     }
 }
 
+static inline bool sprt_usable(EVTestConfig *tconf) {
+    return tconf->sprt_p0 > 0 && tconf->sprt_p1 > tconf->sprt_p0 &&
+           tconf->sprt_p1 < 1 && tconf->sprt_alpha > 0 &&
+           tconf->sprt_beta > 0;
+}
+
+static EVTestRes _sprt_test_eviction(u8 *target, u8 **cands, size_t cnt,
+                                    EVTestConfig *tconf, u32 *otc) {
+    struct evset_stats *stats = evset_stats_cur();
+    u8 *tlb_target = tlb_warmup_ptr(target);
+    double p0 = tconf->sprt_p0, p1 = tconf->sprt_p1;
+    double llr_over = log(p1 / p0), llr_under = log((1 - p1) / (1 - p0));
+    // a precise test tightens both error rates
+    u32 scale = _max(tconf->test_scale, 1);
+    double upp = scale * log((1 - tconf->sprt_beta) / tconf->sprt_alpha);
+    double low = scale * log(tconf->sprt_beta / (1 - tconf->sprt_alpha));
+    u32 max_trials = tconf->sprt_max_trials * scale;
+    if (!max_trials) {
+        max_trials = tconf->trials * tconf->unsure_retry * scale;
+    }
+
+    stats->cands_tests += 1;
+    stats->mem_accs += cnt;
+
+    double llr = 0;
+    *otc = 0;
+    _dprintf("Lats:");
+    for (u32 i = 0; i < max_trials;) {
+        u64 lat;
+        if (_eviction_trial(target, tlb_target, cands, cnt, tconf, false,
+                            &lat)) {
+            stats->trials += 1;
+            llr += lat >= tconf->lat_thresh ? llr_over : llr_under;
+            *otc += lat >= tconf->lat_thresh;
+            i += 1;
+            if (llr >= upp) {
+                return EV_POS;
+            } else if (llr <= low) {
+                return EV_NEG;
+            }
+            _dprintf(" %lu", lat);
+        }
+    }
+
+    if (llr >= 0) {
+        stats->pos_unsure += 1;
+        return EV_POS_UNSURE;
+    } else {
+        stats->neg_unsure += 1;
+        return EV_NEG_UNSURE;
+    }
+}
+
+// links pay off over the repeated traversals of a test
+static inline void test_links_begin(u8 **cands, size_t cnt,
+                                    EVTestConfig *tconf, cand_links *saved) {
+    *saved = _cand_links_cur;
+    if (tconf->link_cands && cnt >= CAND_LINK_MIN_CNT) {
+        cand_links_begin(cands, cnt, saved);
+    }
+}
+
+EVTestRes generic_test_eviction(u8 *target, u8 **cands, size_t cnt,
+                                EVTestConfig *tconf) {
+    cand_links saved;
+    u32 otc;
+    u64 tr = evtrace_begin();
+    test_links_begin(cands, cnt, tconf, &saved);
+    EVTestRes res = _generic_test_eviction(target, cands, cnt, tconf, &otc);
+    cand_links_end(&saved);
+    evtrace_end(EVTRACE_TEST, tr, cnt, res, otc);
+    return res;
+}
+
+EVTestRes sprt_test_eviction(u8 *target, u8 **cands, size_t cnt,
+                             EVTestConfig *tconf) {
+    cand_links saved;
+    u32 otc;
+    u64 tr = evtrace_begin();
+    test_links_begin(cands, cnt, tconf, &saved);
+    EVTestRes res =
+        sprt_usable(tconf)
+            ? _sprt_test_eviction(target, cands, cnt, tconf, &otc)
+            : _generic_test_eviction(target, cands, cnt, tconf, &otc);
+    cand_links_end(&saved);
+    evtrace_end(EVTRACE_TEST, tr, cnt, res, otc);
+    return res;
+}
+
+bool sprt_calibrate(u8 *target, EVTestConfig *tconf, u32 n_samples,
+                    double ev_rate) {
+    u8 *tlb_target = tlb_warmup_ptr(target);
+    u32 hit_over = 0, miss_over = 0;
+    for (u32 i = 0; i < n_samples;) {
+        u64 lat;
+        if (_eviction_trial(target, tlb_target, NULL, 0, tconf, false, &lat)) {
+            hit_over += lat >= tconf->lat_thresh;
+            i += 1;
+        }
+    }
+
+    for (u32 i = 0; i < n_samples;) {
+        u64 lat;
+        if (_eviction_trial(target, tlb_target, NULL, 0, tconf, true, &lat)) {
+            miss_over += lat >= tconf->lat_thresh;
+            i += 1;
+        }
+    }
+
+    // keep both probabilities away from 0 and 1 so that no single trial
+    // decides a test
+    double p0 = _max((double)hit_over / n_samples, 0.01);
+    double p1 = _min((double)miss_over / n_samples * ev_rate, 0.99);
+    _info("SPRT calibration: P(over|hit): %.3f; P(over|miss): %.3f\n",
+          (double)hit_over / n_samples, (double)miss_over / n_samples);
+    if (p1 <= p0 + 0.1) {
+        _error("Hit and miss latencies are not separable\n");
+        return true;
+    }
+
+    tconf->sprt_p0 = p0;
+    tconf->sprt_p1 = p1;
+    return false;
+}
+
 void skx_sf_cands_traverse_st(u8 **cands, size_t cnt, EVTestConfig *tconfig) {
     _assert(tconfig->lower_ev);
     size_t repeat = tconfig->ev_repeat, block = tconfig->block,
            stride = tconfig->stride;
+    bool linked = cand_links_active(cands, cnt);
     for (size_t r = 0; r < 2; r++) {
         // access_array(cands, cnt);
-        prime_cands_daniel(cands, cnt, repeat, stride, block);
+        prime_cands_daniel(cands, cnt, repeat, stride, block, linked);
         _lfence();
         if (cnt < 16) {
             generic_evset_traverse(tconfig->lower_ev);
@@ -458,32 +1426,44 @@ void skx_sf_cands_traverse_st(u8 **cands, size_t cnt, EVTestConfig *tconfig) {
 }
 
 void skx_sf_cands_traverse_mt(u8 **cands, size_t cnt, EVTestConfig *tconfig) {
-    struct helper_thread_read_array *arr = _malloc(sizeof(*arr));
-    _assert(arr);
     size_t repeat = tconfig->ev_repeat, block = tconfig->block,
            stride = tconfig->stride;
-
-    *arr = (struct helper_thread_read_array){.addrs = cands,
-                                             .cnt = cnt,
-                                             .repeat = repeat,
-                                             .block = block,
-                                             .stride = stride,
-                                             .bwd = true};
-    tconfig->hctrl->action = READ_ARRAY;
-    tconfig->hctrl->payload = arr;
-    _barrier();
-    tconfig->hctrl->waiting = false;
+    bool linked = cand_links_active(cands, cnt);
+    helper_thread_pool *pool = tconfig->hpool;
+    u32 n_helpers = pool ? pool->n_helpers : 0;
+
+    // every helper primes its own stripe, so more lines stay in private
+    // caches at once
+    u64 tr = evtrace_begin();
+    for (u32 h = 0; h < _max(n_helpers, 1u); h++) {
+        helper_thread_ctrl *ctrl = n_helpers ? &pool->ctrls[h] : tconfig->hctrl;
+        size_t lo = 0, hi = cnt;
+        if (n_helpers) {
+            helper_pool_stripe(pool, h, cnt, &lo, &hi);
+        }
+        helper_thread_push(ctrl, READ_ARRAY)->arr =
+            (struct helper_thread_read_array){.addrs = cands + lo,
+                                              .cnt = hi - lo,
+                                              .repeat = repeat,
+                                              .block = block,
+                                              .stride = stride,
+                                              .bwd = true,
+                                              .linked = linked};
+        helper_thread_post(ctrl);
+    }
 
     // access_array(cands, cnt);
-    prime_cands_daniel(cands, cnt, repeat, stride, block);
+    prime_cands_daniel(cands, cnt, repeat, stride, block, linked);
     if (cnt < detected_l2->n_ways && tconfig->lower_ev) {
         generic_evset_traverse(tconfig->lower_ev);
         _lfence();
-        access_array_bwd(cands, cnt);
+        access_cands_bwd(cands, cnt, linked);
     }
 
-    wait_helper_thread(tconfig->hctrl);
-    _free(arr);
+    for (u32 h = 0; h < _max(n_helpers, 1u); h++) {
+        wait_helper_thread(n_helpers ? &pool->ctrls[h] : tconfig->hctrl);
+    }
+    evtrace_end(EVTRACE_HELPER, tr, READ_ARRAY, cnt, n_helpers);
 }
 
 EVTestRes skx_evset_test_l3_st(u8 *target, EVSet *evset) {
@@ -503,6 +1483,16 @@ EVTestRes skx_evset_test_l3_st(u8 *target, EVSet *evset) {
 }
 
 /* Algorithms */
+// congruence classes among the candidates that pass the filter evset
+static u32 evset_cands_uncertainty(EVSet *evset) {
+    u32 uncertainty = evcands_uncertainty(evset->cands, evset->target_cache);
+    if (evset->config->cands_config.filter_ev) {
+        uncertainty /= evcands_uncertainty(
+            evset->cands, evset->config->cands_config.filter_ev->target_cache);
+    }
+    return uncertainty;
+}
+
 bool evset_builder_naive(u8 *target, EVSet *evset) {
     u8 **cands = evset->cands->cands;
     size_t n_cands = evset->cands->size, evsz = 0;
@@ -528,16 +1518,21 @@ bool evset_builder_naive(u8 *target, EVSet *evset) {
 }
 
 static void print_congruents(u8 *target, u8 **cands, size_t cnt) {
-    if (cache_oracle_inited()) {
-        u64 target_hash = llc_addr_hash(target), match = 0;
+    u64 *hashes = NULL;
+    if (cache_oracle_inited() && (hashes = _calloc(cnt + 1, sizeof(*hashes)))) {
+        u64 match = 0;
+        llc_addr_hash_batch((void **)cands, cnt, hashes + 1);
+        hashes[0] = llc_addr_hash(target);
         for (size_t n = 0; n < cnt; n++) {
-            match += target_hash == llc_addr_hash(cands[n]);
+            match += hashes[0] == hashes[n + 1];
         }
         _dprintf("Included %lu congruent lines in the test\n", match);
     }
+    _free(hashes);
 }
 
 bool evset_builder_last_straw(u8 *target, EVSet *evset) {
+    struct evset_stats *stats = evset_stats_cur();
     u8 **cands = evset->cands->cands;
     size_t n_cands = evset->cands->size, evsz = 0;
     EVTestConfig *test_config = &evset->config->test_config;
@@ -551,11 +1546,7 @@ bool evset_builder_last_straw(u8 *target, EVSet *evset) {
         return true;
     }
 
-    u32 uncertainty = cache_uncertainty(target_cache);
-    if (evset->config->cands_config.filter_ev) {
-        uncertainty /= cache_uncertainty(
-            evset->config->cands_config.filter_ev->target_cache);
-    }
+    u32 uncertainty = evset_cands_uncertainty(evset);
 
     u64 migrated = n_cands - 1, n_ways = target_cache->n_ways;
     u64 max_bctr = algo_config->max_backtrack;
@@ -592,12 +1583,12 @@ bool evset_builder_last_straw(u8 *target, EVSet *evset) {
             // assert(cnt > offset);
             _dprintf("---\n");
             if (evsz < n_ways) {
-                _evset_stats.pure_tests2 += 1;
-                _evset_stats.pure_mem_acc2 += (cnt - offset);
+                stats->pure_tests2 += 1;
+                stats->pure_mem_acc2 += (cnt - offset);
             }
 
-            _evset_stats.pure_tests += 1;
-            _evset_stats.pure_mem_acc += (cnt - offset);
+            stats->pure_tests += 1;
+            stats->pure_mem_acc += (cnt - offset);
             EVTestRes res = testev(target, cands_o, cnt - offset, test_config);
             _dprintf("\n%ld: Upper: %lu; Lower: %lu; Cnt: %lu has_pos: %d; "
                      "has_neg: %d; offset: %u; evsz: %lu\n",
@@ -634,6 +1625,7 @@ bool evset_builder_last_straw(u8 *target, EVSet *evset) {
             testev(target, cands_o, upper - offset, test_config) < 0) {
             n_bctr += 1;
             is_reset = true;
+            evtrace_instant(EVTRACE_BACKTRACK, upper, evsz, 0);
             _dprintf("POS: backtrack\n");
         } else {
             _swap(cands[evsz], cands[upper - 1]);
@@ -647,6 +1639,7 @@ bool evset_builder_last_straw(u8 *target, EVSet *evset) {
                 break;
             }
             n_bctr += 1;
+            evtrace_instant(EVTRACE_BACKTRACK, upper, evsz, 0);
         }
 
         lower = evsz;
@@ -655,8 +1648,8 @@ bool evset_builder_last_straw(u8 *target, EVSet *evset) {
             if (upper >= migrated) {
                 // shuffle_evset(&cands[upper], n_cands - upper);
                 migrated = n_cands - 1;
-                _evset_stats.meet += 1;
-                // _evset_stats.ooh += 1;
+                stats->meet += 1;
+                // stats->ooh += 1;
                 // break;
             }
 
@@ -674,13 +1667,13 @@ bool evset_builder_last_straw(u8 *target, EVSet *evset) {
             if (upper > n_cands) {
                 _error("Upper goes below lower and lower + 1 > n_cands %lu\n",
                        n_cands);
-                _evset_stats.ooc += 1;
+                stats->ooc += 1;
                 break;
             }
         }
     }
 
-    _evset_stats.backtracks += n_bctr;
+    stats->backtracks += n_bctr;
     evset->size = evsz;
     memcpy(evset->addrs, cands, sizeof(*cands) * evsz);
     return false;
@@ -691,6 +1684,7 @@ bool evset_builder_last_straw(u8 *target, EVSet *evset) {
 // an implementation with an alternative backtracking mechanism;
 // it has higher performance in local env and lower performance in cloud;
 bool evset_builder_last_straw_dev(u8 *target, EVSet *evset) {
+    struct evset_stats *stats = evset_stats_cur();
     u8 **cands = evset->cands->cands;
     size_t n_cands = evset->cands->size, evsz = 0;
     EVTestConfig *test_config = &evset->config->test_config;
@@ -704,11 +1698,7 @@ bool evset_builder_last_straw_dev(u8 *target, EVSet *evset) {
         return true;
     }
 
-    u32 uncertainty = cache_uncertainty(target_cache);
-    if (evset->config->cands_config.filter_ev) {
-        uncertainty /= cache_uncertainty(
-            evset->config->cands_config.filter_ev->target_cache);
-    }
+    u32 uncertainty = evset_cands_uncertainty(evset);
 
     i64 upper_hists[MAX_UPPER_HIST] = {0}, uh_idx = 0;
 
@@ -740,11 +1730,11 @@ bool evset_builder_last_straw_dev(u8 *target, EVSet *evset) {
         // i64 upper_before = upper;
         while (upper - lower > 1) {
             if (evsz < n_ways) {
-                _evset_stats.pure_tests2 += 1;
-                _evset_stats.pure_mem_acc2 += (cnt - offset);
+                stats->pure_tests2 += 1;
+                stats->pure_mem_acc2 += (cnt - offset);
             }
-            _evset_stats.pure_tests += 1;
-            _evset_stats.pure_mem_acc += (cnt - offset);
+            stats->pure_tests += 1;
+            stats->pure_mem_acc += (cnt - offset);
             EVTestRes res = testev(target, cands_o, cnt - offset, test_config);
             if (res > 0) {
                 upper = cnt;
@@ -815,7 +1805,7 @@ bool evset_builder_last_straw_dev(u8 *target, EVSet *evset) {
                 upper = upper_hists[uh_idx];
                 upper_hists[uh_idx] = 0;
             } else {
-                _evset_stats.ooh += 1;
+                stats->ooh += 1;
                 upper = n_cands;
             }
             // if (upper > n_cands / 2) {
@@ -856,19 +1846,20 @@ bool evset_builder_last_straw_dev(u8 *target, EVSet *evset) {
             if (upper > n_cands) {
                 _error("Upper goes below lower and lower + 1 > n_cands %lu\n",
                        n_cands);
-                _evset_stats.ooc += 1;
+                stats->ooc += 1;
                 break;
             }
         }
     }
 
-    _evset_stats.backtracks += n_bctr;
+    stats->backtracks += n_bctr;
     evset->size = evsz;
     memcpy(evset->addrs, cands, sizeof(*cands) * evsz);
     return false;
 }
 
 bool evset_builder_group_test(u8 *target, EVSet *evset, bool early_terminate) {
+    struct evset_stats *stats = evset_stats_cur();
     u8 **cands = evset->cands->cands;
     size_t n_cands = evset->cands->size, evsz = 0;
     EVTestConfig *test_config = &evset->config->test_config;
@@ -901,10 +1892,10 @@ bool evset_builder_group_test(u8 *target, EVSet *evset, bool early_terminate) {
                 }
             }
 
-            _evset_stats.pure_tests += 1;
-            _evset_stats.pure_tests2 += 1;
-            _evset_stats.pure_mem_acc += (n_cands - grp_sz);
-            _evset_stats.pure_mem_acc2 += (n_cands - grp_sz);
+            stats->pure_tests += 1;
+            stats->pure_tests2 += 1;
+            stats->pure_mem_acc += (n_cands - grp_sz);
+            stats->pure_mem_acc2 += (n_cands - grp_sz);
             EVTestRes res =
                 test_config->test(target, cands, n_cands - grp_sz, test_config);
             if (res > 0) {
@@ -926,7 +1917,7 @@ bool evset_builder_group_test(u8 *target, EVSet *evset, bool early_terminate) {
                     bt_idx = (bt_idx + n_backup - 1) % n_backup;
                     if (sz_backup[bt_idx] == 0) {
                         ooh = true;
-                        _evset_stats.ooh += 1;
+                        stats->ooh += 1;
                     } else {
                         n_cands += sz_backup[bt_idx];
                         sz_backup[bt_idx] = 0;
@@ -945,7 +1936,7 @@ bool evset_builder_group_test(u8 *target, EVSet *evset, bool early_terminate) {
         }
     }
 
-    _evset_stats.backtracks += n_bctr;
+    stats->backtracks += n_bctr;
 
     evsz = _min(evset->cap, n_cands);
     evset->size = evsz;
@@ -955,6 +1946,7 @@ bool evset_builder_group_test(u8 *target, EVSet *evset, bool early_terminate) {
 }
 
 bool evset_builder_group_test_random(u8 *target, EVSet *evset) {
+    struct evset_stats *stats = evset_stats_cur();
     u8 **cands = evset->cands->cands;
     size_t n_cands = evset->cands->size, evsz = 0;
     EVTestConfig *test_config = &evset->config->test_config;
@@ -983,10 +1975,10 @@ bool evset_builder_group_test_random(u8 *target, EVSet *evset) {
 
             shuffle_evset(cands, n_cands);
 
-            _evset_stats.pure_tests += 1;
-            _evset_stats.pure_tests2 += 1;
-            _evset_stats.pure_mem_acc += (n_cands - grp_sz);
-            _evset_stats.pure_mem_acc2 += (n_cands - grp_sz);
+            stats->pure_tests += 1;
+            stats->pure_tests2 += 1;
+            stats->pure_mem_acc += (n_cands - grp_sz);
+            stats->pure_mem_acc2 += (n_cands - grp_sz);
 
             EVTestRes res =
                 test_config->test(target, cands, n_cands - grp_sz, test_config);
@@ -1009,7 +2001,7 @@ bool evset_builder_group_test_random(u8 *target, EVSet *evset) {
                     bt_idx = (bt_idx + n_backup - 1) % n_backup;
                     if (sz_backup[bt_idx] == 0) {
                         ooh = true;
-                        _evset_stats.ooh += 1;
+                        stats->ooh += 1;
                     } else {
                         n_cands += sz_backup[bt_idx];
                         sz_backup[bt_idx] = 0;
@@ -1020,7 +2012,7 @@ bool evset_builder_group_test_random(u8 *target, EVSet *evset) {
         }
     }
 
-    _evset_stats.backtracks += n_bctr;
+    stats->backtracks += n_bctr;
 
     evsz = _min(evset->cap, n_cands);
     evset->size = evsz;
@@ -1031,7 +2023,28 @@ bool evset_builder_group_test_random(u8 *target, EVSet *evset) {
 
 #define MAX_ITERS 10000
 
+// an access by this thread and the helper
+static inline void scope_access(u8 *addr, EVTestConfig *tconf) {
+    if (tconf->sim) {
+        cache_sim_access(tconf->sim, 0, addr);
+        cache_sim_access(tconf->sim, 1, addr);
+        return;
+    }
+    _maccess(addr);
+    helper_thread_read_single(addr, tconf->hctrl);
+}
+
+static inline u64 scope_time(u8 *target, u8 *tlb_target, EVTestConfig *tconf) {
+    if (tconf->sim) {
+        return cache_sim_time_access(tconf->sim, 0, target);
+    }
+    _lfence();
+    _maccess(tlb_target);
+    return _time_maccess(target);
+}
+
 bool skx_sf_evset_builder_prime_scope(u8 *target, EVSet *evset, bool migrate) {
+    struct evset_stats *stats = evset_stats_cur();
     u8 **cands = evset->cands->cands, *tlb_target = tlb_warmup_ptr(target);
     size_t n_cands = evset->cands->size, evsz = 0, iters = 0;
     EVTestConfig *test_config = &evset->config->test_config;
@@ -1042,11 +2055,7 @@ bool skx_sf_evset_builder_prime_scope(u8 *target, EVSet *evset, bool migrate) {
     u32 extra_cong = algo_config->extra_cong;
     u32 exp_evsz = target_cache->n_ways + extra_cong;
     u64 migrated_lb = 0, migrated_ub = n_cands - 1, last_idx = 0;
-    u32 uncertainty = cache_uncertainty(target_cache);
-    if (evset->config->cands_config.filter_ev) {
-        uncertainty /= cache_uncertainty(
-            evset->config->cands_config.filter_ev->target_cache);
-    }
+    u32 uncertainty = evset_cands_uncertainty(evset);
 
     u32 n_ways = target_cache->n_ways;
     while (evsz < evset->cap && iters < MAX_ITERS) {
@@ -1062,23 +2071,19 @@ bool skx_sf_evset_builder_prime_scope(u8 *target, EVSet *evset, bool migrate) {
                 _swap(cands[migrated_lb], cands[migrated_ub]);
             }
         }
-        _evset_stats.pure_tests += 1;
+        stats->pure_tests += 1;
         if (evsz < n_ways) {
-            _evset_stats.pure_tests2 += 1;
+            stats->pure_tests2 += 1;
         }
 
-        _maccess(target);
-        helper_thread_read_single(target, test_config->hctrl);
+        scope_access(target, test_config);
 
         bool found = false;
         u32 local_iters = 0;
         while (!found && iters < MAX_ITERS && local_iters < 5) {
             for (u32 idx = init_idx; idx < n_cands; idx++) {
-                _maccess(cands[idx]);
-                helper_thread_read_single(cands[idx], test_config->hctrl);
-                _lfence();
-                _maccess(tlb_target);
-                u64 lat = _time_maccess(target);
+                scope_access(cands[idx], test_config);
+                u64 lat = scope_time(target, tlb_target, test_config);
                 if (lat > test_config->lat_thresh &&
                     lat < detected_cache_lats.interrupt_thresh) {
                     found = true;
@@ -1087,9 +2092,9 @@ bool skx_sf_evset_builder_prime_scope(u8 *target, EVSet *evset, bool migrate) {
                     evsz += 1;
                     break;
                 }
-                _evset_stats.pure_mem_acc += 1;
+                stats->pure_mem_acc += 1;
                 if (evsz < n_ways) {
-                    _evset_stats.pure_mem_acc2 += 1;
+                    stats->pure_mem_acc2 += 1;
                 }
             }
             iters += 1;
@@ -1125,6 +2130,7 @@ void default_l1d_evset_build_config(EVBuildConfig *config) {
                        .need_helper = false,
                        .flush_cands = false,
                        .foreign_evictor = false,
+                       .link_cands = true,
                        .hctrl = NULL,
                        .traverse = generic_cands_traverse,
                        .test = generic_test_eviction};
@@ -1156,6 +2162,7 @@ void default_l2_evset_build_config(EVBuildConfig *config) {
                        .need_helper = false,
                        .flush_cands = false,
                        .foreign_evictor = false,
+                       .link_cands = true,
                        .hctrl = NULL,
                        .traverse = generic_cands_traverse,
                        .test = generic_test_eviction};
@@ -1191,6 +2198,7 @@ void default_skx_sf_evset_build_config(EVBuildConfig *config, EVSet *l1d_ev,
                        .need_helper = true,
                        .flush_cands = false,
                        .foreign_evictor = false,
+                       .link_cands = true,
                        .hctrl = hctrl,
                        .traverse = skx_sf_cands_traverse_mt,
                        .test = generic_test_eviction};
@@ -1208,6 +2216,7 @@ void default_skx_sf_evset_build_config(EVBuildConfig *config, EVSet *l1d_ev,
                        .need_helper = false,
                        .flush_cands = true,
                        .foreign_evictor = false,
+                       .link_cands = true,
                        .hctrl = hctrl,
                        .traverse = generic_cands_traverse,
                        .test = generic_test_eviction};
@@ -1225,7 +2234,7 @@ void default_skx_sf_evset_build_config(EVBuildConfig *config, EVSet *l1d_ev,
 }
 
 size_t prune_evcands(u8 *target, u8 **cands, size_t cnt, EVTestConfig *tconf) {
-    u64 start_ns = time_ns();
+    u64 start_ns = time_ns(), tr = evtrace_begin();
     for (size_t i = 0; i < cnt;) {
         _swap(target, cands[i]);
         EVTestRes tres = tconf->test(target, cands, cnt, tconf);
@@ -1238,7 +2247,9 @@ size_t prune_evcands(u8 *target, u8 **cands, size_t cnt, EVTestConfig *tconf) {
         }
     }
     u64 end_ns = time_ns();
-    _evset_stats.pruning_duration += (end_ns - start_ns);
+    evset_stats_cur()->pruning_duration += (end_ns - start_ns);
+    hist_record(&evset_stats_cur()->pruning_hist, end_ns - start_ns);
+    evtrace_phase_end(EVTRACE_PH_PRUNING, tr, cnt, 0, 0);
     return cnt;
 }
 
@@ -1251,6 +2262,7 @@ EVSet *prune_EVSet(u8 *target, EVSet *evset) {
 
 EVSet *extend_skx_sf_EVSet(EVSet *evset) {
     u64 start = time_ns(), n_ways = evset->target_cache->n_ways;
+    u64 tr = evtrace_begin();
     u64 exp = n_ways + evset->config->algo_config.extra_cong;
 
     if (evset->size == evset->cap) return evset;
@@ -1269,28 +2281,49 @@ EVSet *extend_skx_sf_EVSet(EVSet *evset) {
             }
         }
     }
-    _evset_stats.extension_duration += time_ns() - start;
+    u64 dura = time_ns() - start;
+    evset_stats_cur()->extension_duration += dura;
+    hist_record(&evset_stats_cur()->extension_hist, dura);
+    evtrace_phase_end(EVTRACE_PH_EXTENSION, tr, evset->size, 0, 0);
     return evset;
 }
 
-static bool _copy_test_config = true;
-
-EVSet *build_evset_generic(u8 *target, EVBuildConfig *config,
-                           cache_param *cache, EVCands *evcands) {
-    EVSet *evset = evset_new(page_offset(target), config, cache, evcands);
-    if (!evset) return NULL;
+// take the candidates the slice model puts into the target's set; true if
+// they evict the target
+static bool build_evset_model(u8 *target, EVSet *evset) {
+    cache_param *cache = evset->target_cache;
+    u64 key = pa_cache_key(target, cache);
+    if (key == INVALID_ADDR_HASH || (u32)key == PA_KEY_NO_SLICE) {
+        return false;
+    }
 
-    if (_copy_test_config) {
-        EVBuildConfig *_conf = _calloc(1, sizeof(*_conf));
-        if (!_conf) {
-            return NULL;
+    EVCands *cands = evset->cands;
+    u32 exp = cache->n_ways + evset->config->algo_config.extra_cong, sz = 0;
+    exp = _min(exp, evset->cap);
+    for (size_t i = 0; i < cands->size && sz < exp; i++) {
+        u8 *ptr = cands->cands[i];
+        if (ptr != target && pa_cache_key(ptr, cache) == key) {
+            evset->addrs[sz++] = ptr;
         }
-        memcpy(_conf, evset->config, sizeof(*_conf));
-        evset->config = _conf;
-        config = _conf;
     }
 
-    if (cache_uncertainty(cache) == 1) {
+    evset->size = sz;
+    if (sz >= cache->n_ways && generic_evset_test(target, evset) == EV_POS) {
+        return true;
+    }
+    evset->size = 0;
+    return false;
+}
+
+static bool _copy_test_config = true;
+
+// run the configured algorithm on the candidates of a new evset
+static EVSet *build_evset_from(u8 *target, EVSet *evset) {
+    struct evset_stats *stats = evset_stats_cur();
+    EVBuildConfig *config = evset->config;
+    cache_param *cache = evset->target_cache;
+
+    if (evcands_uncertainty(evset->cands, cache) == 1) {
         u8 **cands = evset->cands->cands;
         size_t nlines = cache->n_ways;
         memcpy(evset->addrs, cands, nlines * sizeof(*cands));
@@ -1298,10 +2331,15 @@ EVSet *build_evset_generic(u8 *target, EVBuildConfig *config,
         return evset;
     }
 
+    if (slice_model_usable(&config->cands_config) &&
+        build_evset_model(target, evset)) {
+        return evset;
+    }
+
     if (evset->config->algo_config.prelim_test &&
         generic_test_eviction(target, evset->cands->cands, evset->cands->size,
                               &evset->config->test_config) < 0) {
-        _evset_stats.ooc += 1;
+        stats->ooc += 1;
         return NULL;
     }
 
@@ -1324,11 +2362,12 @@ EVSet *build_evset_generic(u8 *target, EVBuildConfig *config,
         start_helper_thread(config->test_config.hctrl);
     }
 
-    u64 old_retry = _evset_stats.retries;
+    u64 retry = 0;
     u64 start_ns = time_ns(), timeout = config->algo_config.retry_timeout;
-    u64 retry_ns = 0;
+    u64 retry_ns = 0, tr_build = evtrace_begin();
     for (u32 r = 0; r < config->algo_config.verify_retry; r++) {
-        u64 old_bctr = _evset_stats.backtracks, iter_ns = time_ns();
+        u64 old_bctr = stats->backtracks, iter_ns = time_ns();
+        u64 tr_attempt = evtrace_begin();
         switch (config->algorithm) {
             case EVSET_ALGO_NAIVE: {
                 err = evset_builder_naive(target, evset);
@@ -1367,12 +2406,13 @@ EVSet *build_evset_generic(u8 *target, EVBuildConfig *config,
                 return NULL;
             }
         }
-        u64 bctr = _evset_stats.backtracks - old_bctr;
-        inc_bctr(bctr);
-        inc_bctr_dura(bctr, time_ns() - iter_ns);
+        u64 bctr = stats->backtracks - old_bctr;
+        inc_bctr(stats, bctr);
+        inc_bctr_dura(stats, bctr, time_ns() - iter_ns);
 
         if (err) {
             _info("Err\n");
+            evtrace_phase_end(EVTRACE_PH_ATTEMPT, tr_attempt, r, bctr, 0);
             break;
         }
 
@@ -1389,14 +2429,16 @@ EVSet *build_evset_generic(u8 *target, EVBuildConfig *config,
                                          &config->test_config) == EV_POS) {
 
                 can_evict = true;
-                inc_useful_bctr(bctr);
-                inc_useful_bctr_dura(bctr, time_ns() - iter_ns);
+                inc_useful_bctr(stats, bctr);
+                inc_useful_bctr_dura(stats, bctr, time_ns() - iter_ns);
+                evtrace_phase_end(EVTRACE_PH_ATTEMPT, tr_attempt, r, bctr, 1);
                 break;
             }
         }
+        evtrace_phase_end(EVTRACE_PH_ATTEMPT, tr_attempt, r, bctr, 0);
 
         if (timeout && (time_ns() - start_ns) > timeout * 1000000) {
-            _evset_stats.timeout += 1;
+            stats->timeout += 1;
             _error("Timeout! Target level: %u; cands: %lu\n", cache->level,
                    evset->cands->size);
             break;
@@ -1404,28 +2446,34 @@ EVSet *build_evset_generic(u8 *target, EVBuildConfig *config,
         if (r == 0) {
             retry_ns = time_ns();
         }
-        _evset_stats.retries += 1;
+        // a helper on the wrong core fails every attempt
+        if (config->test_config.need_helper && !config->test_config.sim) {
+            helper_thread_check_placement(config->test_config.hctrl);
+        }
+        stats->retries += 1;
+        retry += 1;
         _dprintf("--- EVSet Retry ---\n");
     }
     u64 build_dura = time_ns() - start_ns;
-    _evset_stats.build_duration += build_dura;
+    evtrace_phase_end(EVTRACE_PH_BUILD, tr_build, evset->size, 0, 0);
+    stats->build_duration += build_dura;
+    hist_record(&stats->build_hist, build_dura);
     if (retry_ns) {
-        _evset_stats.retry_duration += time_ns() - retry_ns;
+        stats->retry_duration += time_ns() - retry_ns;
     }
 
-    u64 retry = _evset_stats.retries - old_retry;
-    inc_retry(retry);
-    inc_retry_dura(retry, build_dura);
+    inc_retry(stats, retry);
+    inc_retry_dura(stats, retry, build_dura);
     if (can_evict) {
-        inc_useful_retry(retry);
-        inc_useful_retry_dura(retry, build_dura);
+        inc_useful_retry(stats, retry);
+        inc_useful_retry_dura(stats, retry, build_dura);
     }
 
     // if (config->algo_config.need_skx_sf_ext) {
     //     u64 start = time_ns();
     //     extend_skx_sf_EVSet(evset);
     //     prune_EVSet(target, evset);
-    //     _evset_stats.build_duration += time_ns() - start;
+    //     evset_stats_cur()->build_duration += time_ns() - start;
     // }
 
     if (start_helper) {
@@ -1441,6 +2489,69 @@ err:
     return NULL;
 }
 
+static EVSet *_build_evset_generic(u8 *target, EVBuildConfig *config,
+                                   cache_param *cache, EVCands *evcands) {
+    EVSet *evset = evset_new(page_offset(target), config, cache, evcands);
+    if (!evset) return NULL;
+
+    if (_copy_test_config) {
+        EVBuildConfig *_conf = _calloc(1, sizeof(*_conf));
+        if (!_conf) {
+            return NULL;
+        }
+        memcpy(_conf, evset->config, sizeof(*_conf));
+        evset->config = _conf;
+        config = _conf;
+    }
+
+    // with physical addresses only the lines in the target's set remain
+    // candidates, which leaves nothing but the slice unknown
+    EVCands *cands = evset->cands;
+    size_t size_backup = cands->size;
+    u32 ctrl_bits_backup = cands->ctrl_bits;
+    if (pa_assisted(&config->cands_config) &&
+        evcands_uncertainty(cands, cache) > cache->n_slices) {
+        size_t n = partition_pa_set(target, cands->cands, cands->size, cache);
+        if (n >= cache->n_ways) {
+            _dprintf("Narrowed %lu candidates to %lu in the target's set\n",
+                     cands->size, n);
+            cands->size = n;
+            cands->ctrl_bits = pa_ctrl_bits(cache);
+        }
+    }
+
+    evset = build_evset_from(target, evset);
+    cands->size = size_backup;
+    cands->ctrl_bits = ctrl_bits_backup;
+    return evset;
+}
+
+// expand views used by a build; the lower evset is traversed in every test
+static bool materialize_build_inputs(EVBuildConfig *conf, EVCands *cands) {
+    EVSet *lower_ev = conf->test_config.lower_ev;
+    return (cands && evcands_materialize(cands)) ||
+           (lower_ev && evset_materialize(lower_ev));
+}
+
+EVSet *build_evset_generic(u8 *target, EVBuildConfig *config,
+                           cache_param *cache, EVCands *evcands) {
+    if (materialize_build_inputs(config, evcands)) {
+        return NULL;
+    }
+
+    struct evset_stats *prev_stats = NULL;
+    if (config->stats) {
+        prev_stats = evset_stats_bind(config->stats);
+    }
+
+    EVSet *evset = _build_evset_generic(target, config, cache, evcands);
+
+    if (prev_stats) {
+        evset_stats_bind(prev_stats);
+    }
+    return evset;
+}
+
 EVSet *build_l1d_EVSet(u8 *target, EVBuildConfig *config, EVCands *evcands) {
     return build_evset_generic(target, config, detected_l1d, evcands);
 }
@@ -1453,20 +2564,167 @@ EVSet *build_skx_sf_EVSet(u8 *target, EVBuildConfig *config, EVCands *evcands) {
     return build_evset_generic(target, config, detected_l3, evcands);
 }
 
-EVSet **build_evsets_at(u32 offset, EVBuildConfig *conf, cache_param *cache,
-                        EVCands *_cands, size_t *ev_cnt,
-                        cache_param *lower_cache, EVBuildConfig *lower_conf,
-                        EVSet **lower_evsets, size_t n_lower_evsets) {
+// the first entry is the target
+static void evset_prepend_target(EVSet *evset, u8 *target) {
+    if (evset->size < evset->cap) {
+        _swap(evset->addrs[0], evset->addrs[evset->size]);
+        evset->addrs[0] = target;
+        evset->size += 1;
+    }
+}
+
+#define NEXT_SCREEN_TRIALS 2
+// batches live on the stack
+#define NEXT_BATCH_MAX 64
+
+// One batched trial: load all "targets", traverse "addrs" once, then time
+// each target and count over-threshold ones into "otcs". Returns false if the
+// trial is polluted by a context switch or an interrupt.
+static bool _batch_eviction_trial(u8 **targets, u32 sz, u8 **addrs,
+                                  size_t acc_cnt, EVTestConfig *tconf,
+                                  u32 *otcs) {
+    struct evset_stats *stats = evset_stats_cur();
+    u32 aux_before, aux_after = 0;
+    bool noisy = false;
+    _rdtscp_aux(&aux_before);
+    stats->cands_tests += 1;
+    stats->mem_accs += acc_cnt;
+
+    if (tconf->sim) {
+        cache_sim_batch_trial(tconf->sim, targets, sz, addrs, acc_cnt, tconf,
+                              otcs);
+        stats->trials += sz;
+        return true;
+    }
+
+    flush_array(targets, sz);
+    if (tconf->flush_cands) {
+        flush_array(addrs, acc_cnt);
+    }
+    _lfence();
+    for (u32 j = 0; j < tconf->access_cnt; j++) {
+        if (tconf->lower_ev) {
+            generic_evset_traverse(tconf->lower_ev);
+        }
+        _lfence();
+        for (u32 i = 0; i < sz; i++) {
+            _maccess(targets[i]);
+        }
+        // one helper wakeup shares every target
+        if (tconf->need_helper) {
+            helper_thread_read_batch(targets, sz, tconf->hctrl);
+            for (u32 i = 0; i < sz; i++) {
+                _maccess(targets[i]);
+            }
+        }
+    }
+
+    _lfence();
+    if (tconf->foreign_evictor) {
+        helper_thread_traverse_cands(addrs, acc_cnt, tconf);
+    } else {
+        tconf->traverse(addrs, acc_cnt, tconf);
+    }
+    _lfence();
+
+    u32 overs[sz];
+    for (u32 i = 0; i < sz; i++) {
+        _maccess(tlb_warmup_ptr(targets[i]));
+        u64 UNUSED _tmp;
+        u64 lat = _time_maccess_aux(targets[i], _tmp, aux_after);
+        noisy |= lat >= (u64)detected_cache_lats.interrupt_thresh;
+        overs[i] = lat >= (u64)tconf->lat_thresh;
+    }
+
+    if (aux_before != aux_after || noisy) {
+        return false;
+    }
+
+    for (u32 i = 0; i < sz; i++) {
+        otcs[i] += overs[i];
+    }
+    stats->trials += sz;
+    return true;
+}
+
+// Screen "batch" candidates with a single traversal of "addrs" per trial.
+// Candidates that are never evicted are confirmed with a full eviction test;
+// returns the index of the first confirmed one, or -1 if none.
+static i64 find_next_target_batched(u8 **cands, size_t n_cands, u8 **addrs,
+                                    size_t acc_cnt, EVTestConfig *tconf,
+                                    u32 batch) {
+    batch = _min(batch, NEXT_BATCH_MAX);
+    u32 otcs[batch];
+    for (size_t s = 0; s < n_cands; s += batch) {
+        u8 **targets = &cands[s];
+        u32 sz = _min(batch, n_cands - s);
+        memset(otcs, 0, sizeof(otcs));
+        for (u32 t = 0; t < NEXT_SCREEN_TRIALS;) {
+            t += _batch_eviction_trial(targets, sz, addrs, acc_cnt, tconf,
+                                       otcs);
+        }
+
+        for (u32 i = 0; i < sz; i++) {
+            if (otcs[i] == 0 &&
+                generic_test_eviction(targets[i], addrs, acc_cnt, tconf) ==
+                    EV_NEG) {
+                return s + i;
+            }
+        }
+    }
+    return -1;
+}
+
+// move the candidates that "evset" evicts to the front of "cands"; returns
+// their number
+static size_t partition_congruent(u8 **cands, size_t n_cands, EVSet *evset,
+                                  u32 batch) {
+    EVTestConfig *tconf = &evset->config->test_config;
+    u32 trials = tconf->trials, upp_bnd = tconf->upp_bnd;
+    batch = _min(batch, NEXT_BATCH_MAX);
+    u32 otcs[batch];
+    size_t n_pos = 0;
+    for (size_t s = 0; s < n_cands; s += batch) {
+        u32 sz = _min(batch, n_cands - s);
+        memset(otcs, 0, sizeof(otcs));
+        for (u32 t = 0; t < trials;) {
+            t += _batch_eviction_trial(&cands[s], sz, evset->addrs,
+                                       evset->size, tconf, otcs);
+        }
+
+        for (u32 i = 0; i < sz; i++) {
+            if (otcs[i] > upp_bnd) {
+                _swap(cands[n_pos], cands[s + i]);
+                n_pos += 1;
+            }
+        }
+    }
+    return n_pos;
+}
+
+// pick the lower-level evset that evicts "target"
+static void select_lower_ev(u8 *target, EVBuildConfig *conf,
+                            EVSet **lower_evsets, size_t n_lower_evsets) {
+    conf->test_config.lower_ev = NULL;
+    for (u32 i = 0; i < n_lower_evsets; i++) {
+        if (generic_evset_test(target, lower_evsets[i]) > 0) {
+            conf->test_config.lower_ev = lower_evsets[i];
+            break;
+        }
+    }
+}
+
+static EVSet **_build_evsets_at(u32 offset, EVBuildConfig *conf,
+                                cache_param *cache, EVCands *_cands,
+                                size_t *ev_cnt, cache_param *lower_cache,
+                                EVBuildConfig *lower_conf,
+                                EVSet **lower_evsets, size_t n_lower_evsets) {
     EVCands *cands = _cands;
     u8 **cands_backup = NULL;
     size_t cands_sz_backup = 0;
     EVSet **evsets = NULL;
-    size_t n_evsets = cache_uncertainty(cache), lower_skipped = 0;;
-    if (conf->cands_config.filter_ev) {
-        cache_param *lower = conf->cands_config.filter_ev->target_cache;
-        n_evsets /= cache_uncertainty(lower);
-    }
-    *ev_cnt = n_evsets;
+    size_t n_evsets = 0, lower_skipped = 0;
+    *ev_cnt = 0;
 
     u8 **addrs = NULL;
     size_t acc_cnt = 0;
@@ -1484,6 +2742,13 @@ EVSet **build_evsets_at(u32 offset, EVBuildConfig *conf, cache_param *cache,
     }
     cands_backup = cands->cands;
     cands_sz_backup = cands->size;
+    // the candidates decide how many sets they spread over
+    n_evsets = evcands_uncertainty(cands, cache);
+    if (conf->cands_config.filter_ev) {
+        cache_param *lower = conf->cands_config.filter_ev->target_cache;
+        n_evsets /= evcands_uncertainty(cands, lower);
+    }
+    *ev_cnt = n_evsets;
 
     evsets = _calloc(n_evsets, sizeof(EVSet *));
     if (!evsets || cands->size == 0) {
@@ -1532,13 +2797,7 @@ EVSet **build_evsets_at(u32 offset, EVBuildConfig *conf, cache_param *cache,
 
         if (n_lower_evsets) {
             u64 start = time_ns();
-            conf->test_config.lower_ev = NULL;
-            for (u32 i = 0; i < n_lower_evsets; i++) {
-                if (generic_evset_test(target, lower_evsets[i]) > 0) {
-                    conf->test_config.lower_ev = lower_evsets[i];
-                    break;
-                }
-            }
+            select_lower_ev(target, conf, lower_evsets, n_lower_evsets);
             l2_time_ns += (time_ns() - start);
 
             if (!conf->test_config.lower_ev) {
@@ -1556,12 +2815,7 @@ EVSet **build_evsets_at(u32 offset, EVBuildConfig *conf, cache_param *cache,
         if (evset) {
             cands->cands += evset->size;
             cands->size -= evset->size;
-            if (evset->size < evset->cap) {
-                // the first entry is the target
-                _swap(evset->addrs[0], evset->addrs[evset->size]);
-                evset->addrs[0] = target;
-                evset->size += 1;
-            }
+            evset_prepend_target(evset, target);
 
             evsets[i] = evset;
             if (!addrs) {
@@ -1580,7 +2834,22 @@ l2_ev_fail:
         // find the next target
         if (addrs) {
             bool found = false;
-            for (size_t j = 0; j < cands->size && cands->size > 0; j++) {
+            if (conf->algo_config.next_batch > 1) {
+                i64 j = find_next_target_batched(
+                    cands->cands, cands->size, addrs, acc_cnt,
+                    &conf->test_config, conf->algo_config.next_batch);
+                if (j >= 0) {
+                    target = cands->cands[j];
+                    _swap(cands->cands[j], cands->cands[cands->size - 1]);
+                    cands->size -= 1;
+                    found = true;
+                } else {
+                    _info("Batched screening found no next target; testing "
+                          "%lu candidates one by one\n", cands->size);
+                }
+            }
+
+            for (size_t j = 0; !found && j < cands->size; j++) {
                 EVTestRes res = generic_test_eviction(
                     cands->cands[j], addrs, acc_cnt, &conf->test_config);
                 if (res == EV_NEG) {
@@ -1602,7 +2871,7 @@ l2_ev_fail:
                 }
                 _error("Cannot find the next target: cands size: %lu; addr: %lu\n",
                        cands->size, acc_cnt);
-                _evset_stats.no_next += (n_evsets - (i + 1));
+                evset_stats_cur()->no_next += (n_evsets - (i + 1));
                 break;
             }
         } else {
@@ -1631,3 +2900,341 @@ err:
     evsets = NULL;
     goto cleanup;
 }
+
+// Build one evset, classify the whole remaining pool against it in batched
+// tests, drop its congruent lines, and continue on the rest. Every line is
+// classified once per evset instead of being traversed by later builds.
+static EVSet **_build_evsets_at_bulk(u32 offset, EVBuildConfig *conf,
+                                     cache_param *cache, EVCands *_cands,
+                                     size_t *ev_cnt, cache_param *lower_cache,
+                                     EVBuildConfig *lower_conf,
+                                     EVSet **lower_evsets,
+                                     size_t n_lower_evsets) {
+    struct evset_stats *stats = evset_stats_cur();
+    EVCands *cands = _cands;
+    u8 **cands_backup = NULL, **addrs = NULL;
+    size_t cands_sz_backup = 0, acc_cnt = 0, lower_skipped = 0;
+    EVSet **evsets = NULL;
+    size_t n_evsets = 0;
+    *ev_cnt = 0;
+
+    if (!cands) {
+        cands = evcands_new(cache, &conf->cands_config, NULL);
+        if (!cands || evcands_populate(offset, cands, &conf->cands_config)) {
+            _error("Failed to allocate or populate evcands\n");
+            goto err;
+        }
+    }
+    cands_backup = cands->cands;
+    cands_sz_backup = cands->size;
+    n_evsets = evcands_uncertainty(cands, cache);
+    if (conf->cands_config.filter_ev) {
+        cache_param *lower = conf->cands_config.filter_ev->target_cache;
+        n_evsets /= evcands_uncertainty(cands, lower);
+    }
+    *ev_cnt = n_evsets;
+
+    u32 batch = conf->algo_config.next_batch;
+    if (batch < 1) {
+        batch = _max(cache->n_ways - 1, 1);
+    }
+
+    evsets = _calloc(n_evsets, sizeof(EVSet *));
+    size_t cap = conf->algo_config.cap_scaling * cache->n_ways + 1;
+    addrs = _calloc(cap * n_evsets, sizeof(*addrs));
+    if (!evsets || !addrs) {
+        goto err;
+    }
+
+    for (size_t i = 0; i < n_evsets && cands->size > 0; i++) {
+        // lines congruent with earlier evsets have been dropped, but noisy
+        // ones may slip through the partitioning
+        u8 *target = NULL;
+        while (cands->size > 0 && !target) {
+            target = cands->cands[--cands->size];
+            if (acc_cnt && generic_test_eviction(target, addrs, acc_cnt,
+                                                 &conf->test_config) > 0) {
+                target = NULL;
+            }
+        }
+
+        if (!target) {
+            stats->no_next += n_evsets - i;
+            break;
+        }
+
+        if (n_lower_evsets) {
+            select_lower_ev(target, conf, lower_evsets, n_lower_evsets);
+            if (!conf->test_config.lower_ev) {
+                lower_skipped += 1;
+                continue;
+            }
+        }
+
+        EVSet *evset = build_evset_generic(target, conf, cache, cands);
+        if (lower_cache && lower_conf) {
+            printf("\rProgress: %lu/%lu", i, n_evsets);
+        }
+        if (!evset) {
+            continue;
+        }
+
+        cands->cands += evset->size;
+        cands->size -= evset->size;
+        size_t n_cong = partition_congruent(cands->cands, cands->size, evset,
+                                            batch);
+        cands->cands += n_cong;
+        cands->size -= n_cong;
+
+        evset_prepend_target(evset, target);
+        evsets[i] = evset;
+        size_t n_copy = _min(evset->size, cap);
+        memcpy(&addrs[acc_cnt], evset->addrs, n_copy * sizeof(*addrs));
+        acc_cnt += n_copy;
+    }
+
+cleanup:
+    if (lower_skipped) {
+        _info("Skipped due to lower evset fail: %lu\n", lower_skipped);
+    }
+
+    if (cands_backup) {
+        cands->cands = cands_backup;
+        cands->size = cands_sz_backup;
+    }
+    _free(addrs);
+    return evsets;
+
+err:
+    _free(evsets);
+    evsets = NULL;
+    goto cleanup;
+}
+
+static EVSet **_build_evsets_any(u32 offset, EVBuildConfig *conf,
+                                 cache_param *cache, EVCands *cands,
+                                 size_t *ev_cnt, cache_param *lower_cache,
+                                 EVBuildConfig *lower_conf,
+                                 EVSet **lower_evsets, size_t n_lower_evsets) {
+    if (conf->algo_config.bulk) {
+        return _build_evsets_at_bulk(offset, conf, cache, cands, ev_cnt,
+                                     lower_cache, lower_conf, lower_evsets,
+                                     n_lower_evsets);
+    }
+    return _build_evsets_at(offset, conf, cache, cands, ev_cnt, lower_cache,
+                            lower_conf, lower_evsets, n_lower_evsets);
+}
+
+// with physical addresses, sort the candidates by set and build the evsets of
+// each set from its own lines; only the slices are left to timing
+static EVSet **_build_evsets_grouped(u32 offset, EVBuildConfig *conf,
+                                     cache_param *cache, EVCands *cands,
+                                     size_t *ev_cnt, cache_param *lower_cache,
+                                     EVBuildConfig *lower_conf,
+                                     EVSet **lower_evsets,
+                                     size_t n_lower_evsets) {
+    u8 **base = cands->cands;
+    size_t size = cands->size, n_evsets = evcands_uncertainty(cands, cache);
+    u32 ctrl_bits = cands->ctrl_bits;
+    if (conf->cands_config.filter_ev) {
+        cache_param *lower = conf->cands_config.filter_ev->target_cache;
+        n_evsets /= evcands_uncertainty(cands, lower);
+    }
+    *ev_cnt = n_evsets;
+
+    EVSet **evsets = _calloc(_max(n_evsets, 1), sizeof(*evsets));
+    if (!evsets || group_cands(base, size, cache, NULL) < 0) {
+        _free(evsets);
+        return NULL;
+    }
+
+    cands->ctrl_bits = pa_ctrl_bits(cache);
+    size_t n = 0, n_groups = 0;
+    for (size_t lo = 0, hi; lo < size && n < n_evsets; lo = hi) {
+        u64 key = pa_cache_key(base[lo], cache);
+        if (key == INVALID_ADDR_HASH) {
+            break; // lines without a physical address are sorted last
+        }
+
+        for (hi = lo + 1; hi < size; hi++) {
+            u64 k = pa_cache_key(base[hi], cache);
+            if (k == INVALID_ADDR_HASH || k >> 32 != key >> 32) break;
+        }
+
+        size_t cnt = 0;
+        cands->cands = base + lo;
+        cands->size = hi - lo;
+        EVSet **group = _build_evsets_any(offset, conf, cache, cands, &cnt,
+                                          lower_cache, lower_conf,
+                                          lower_evsets, n_lower_evsets);
+        for (size_t i = 0; group && i < cnt; i++) {
+            if (n < n_evsets) {
+                evsets[n++] = group[i];
+            } else {
+                evset_free(group[i]);
+            }
+        }
+        _free(group);
+        n_groups += 1;
+    }
+    _info("Built evsets of %lu sets grouped by physical address\n", n_groups);
+
+    cands->cands = base;
+    cands->size = size;
+    cands->ctrl_bits = ctrl_bits;
+    return evsets;
+}
+
+EVSet **build_evsets_at(u32 offset, EVBuildConfig *conf, cache_param *cache,
+                        EVCands *cands, size_t *ev_cnt,
+                        cache_param *lower_cache, EVBuildConfig *lower_conf,
+                        EVSet **lower_evsets, size_t n_lower_evsets) {
+    if (materialize_build_inputs(conf, cands)) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < n_lower_evsets; i++) {
+        if (lower_evsets[i] && evset_materialize(lower_evsets[i])) {
+            return NULL;
+        }
+    }
+
+    struct evset_stats *prev_stats = NULL;
+    if (conf->stats) {
+        prev_stats = evset_stats_bind(conf->stats);
+    }
+
+    EVSet **evsets = NULL;
+    if (cands && pa_assisted(&conf->cands_config) &&
+        evcands_uncertainty(cands, cache) > cache->n_slices) {
+        evsets = _build_evsets_grouped(offset, conf, cache, cands, ev_cnt,
+                                       lower_cache, lower_conf, lower_evsets,
+                                       n_lower_evsets);
+    } else {
+        evsets = _build_evsets_any(offset, conf, cache, cands, ev_cnt,
+                                   lower_cache, lower_conf, lower_evsets,
+                                   n_lower_evsets);
+    }
+
+    if (prev_stats) {
+        evset_stats_bind(prev_stats);
+    }
+    return evsets;
+}
+
+static size_t _repair_evsets_at(EVSet **evsets, size_t n_evsets,
+                                EVBuildConfig *conf, cache_param *cache,
+                                EVCands *cands) {
+    size_t n_missing = 0, acc_cnt = 0, n_repaired = 0, n_pool = 0;
+    for (size_t i = 0; i < n_evsets; i++) {
+        if (evsets[i] && evset_self_test(evsets[i]) != EV_POS) {
+            evset_free(evsets[i]);
+            evsets[i] = NULL;
+        }
+
+        if (evsets[i]) {
+            acc_cnt += evsets[i]->size;
+        } else {
+            n_missing += 1;
+        }
+    }
+
+    if (!n_missing) {
+        return 0;
+    }
+
+    size_t cap = conf->algo_config.cap_scaling * cache->n_ways;
+    u8 **addrs = _calloc(acc_cnt + n_missing * cap, sizeof(*addrs));
+    u8 **used = _calloc(acc_cnt + 1, sizeof(*used));
+    u8 **pool = _calloc(_max(cands->size, 1), sizeof(*pool));
+    // the pool stands in for the candidates of "cands" while repairing, so
+    // the rebuilt evsets refer to "cands"; an EVCands of its own would take
+    // a reference on a buffer other workers may be repairing on too
+    u8 **cands_backup = cands->cands;
+    size_t size_backup = cands->size;
+    if (!addrs || !used || !pool) {
+        _error("Failed to allocate buffers for evset repair\n");
+        goto cleanup;
+    }
+
+    acc_cnt = 0;
+    for (size_t i = 0; i < n_evsets; i++) {
+        if (evsets[i]) {
+            memcpy(&addrs[acc_cnt], evsets[i]->addrs,
+                   evsets[i]->size * sizeof(*addrs));
+            acc_cnt += evsets[i]->size;
+        }
+    }
+
+    // candidates already in healthy evsets cannot be targets or members
+    memcpy(used, addrs, acc_cnt * sizeof(*used));
+    _sort(used, acc_cnt, sizeof(*used), ptr_cmp);
+    for (size_t i = 0; i < cands->size; i++) {
+        if (!bsearch(&cands->cands[i], used, acc_cnt, sizeof(*used), ptr_cmp)) {
+            pool[n_pool++] = cands->cands[i];
+        }
+    }
+    cands->cands = pool;
+    cands->size = n_pool;
+
+    for (size_t i = 0; i < n_evsets && cands->size > 1; i++) {
+        if (evsets[i]) continue;
+
+        u8 *target = NULL;
+        for (size_t j = 0; j < cands->size; j++) {
+            u8 *cand = cands->cands[j];
+            if (!acc_cnt || generic_test_eviction(cand, addrs, acc_cnt,
+                                                  &conf->test_config) == EV_NEG) {
+                target = cand;
+                _swap(cands->cands[j], cands->cands[cands->size - 1]);
+                cands->size -= 1;
+                break;
+            }
+        }
+
+        if (!target) {
+            _error("Cannot find a target to repair; cands size: %lu\n",
+                   cands->size);
+            evset_stats_cur()->no_next += 1;
+            break;
+        }
+
+        EVSet *evset = build_evset_generic(target, conf, cache, cands);
+        if (!evset) continue;
+
+        cands->cands += evset->size;
+        cands->size -= evset->size;
+        evset_prepend_target(evset, target);
+        evsets[i] = evset;
+        memcpy(&addrs[acc_cnt], evset->addrs, evset->size * sizeof(*addrs));
+        acc_cnt += evset->size;
+        n_repaired += 1;
+    }
+
+cleanup:
+    cands->cands = cands_backup;
+    cands->size = size_backup;
+    _free(pool);
+    _free(addrs);
+    _free(used);
+    return n_repaired;
+}
+
+size_t repair_evsets_at(EVSet **evsets, size_t n_evsets, EVBuildConfig *conf,
+                        cache_param *cache, EVCands *cands) {
+    if (materialize_build_inputs(conf, cands)) {
+        return 0;
+    }
+
+    struct evset_stats *prev_stats = NULL;
+    if (conf->stats) {
+        prev_stats = evset_stats_bind(conf->stats);
+    }
+
+    size_t n_repaired = _repair_evsets_at(evsets, n_evsets, conf, cache, cands);
+
+    if (prev_stats) {
+        evset_stats_bind(prev_stats);
+    }
+    return n_repaired;
+}
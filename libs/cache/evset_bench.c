@@ -0,0 +1,105 @@
+#include "cache/evset_bench.h"
+#include "sync.h"
+
+static void apply_point(bench_config *bc, EVBuildConfig *config,
+                        bench_point *pt) {
+    config->algorithm = pt->algo;
+    config->cands_config.scaling = pt->scaling;
+    config->algo_config.verify_retry = bc->max_tries;
+    config->algo_config.max_backtrack = pt->max_backtrack;
+    config->algo_config.retry_timeout = bc->max_timeout;
+    config->algo_config.ret_partial = true;
+    config->test_config.test_scale = pt->test_scale;
+    config->test_config.ev_repeat = pt->ev_repeat;
+}
+
+// the L2 evset that filters the LLC candidates of "target"; not measured
+static EVSet *filter_l2_evset(u8 *target, EVCands **l2_cands) {
+    *l2_cands = evcands_new(detected_l2, &def_l2_ev_config.cands_config, NULL);
+    if (!*l2_cands || evcands_populate(page_offset(target), *l2_cands,
+                                       &def_l2_ev_config.cands_config)) {
+        return NULL;
+    }
+
+    for (u32 r = 0; r < 10; r++) {
+        EVSet *l2_evset = build_l2_EVSet(target, &def_l2_ev_config, *l2_cands);
+        if (l2_evset && l2_evset->size == detected_l2->n_ways &&
+            generic_evset_test(target, l2_evset) == EV_POS) {
+            return l2_evset;
+        }
+        evset_free(l2_evset);
+    }
+    return NULL;
+}
+
+// build one evset; returns true if it evicts the target
+static bool bench_once(bench_config *bc, u8 *target, bench_point *pt,
+                       struct evset_stats *stats, u64 *dura) {
+    EVBuildConfig config;
+    EVSet *l2_evset = NULL, *evset = NULL;
+    EVCands *l2_cands = NULL, *cands = NULL;
+    bool ok = false;
+    *dura = 0;
+
+    if (bc->target == BENCH_TARGET_L2) {
+        config = def_l2_ev_config;
+    } else {
+        if (!(l2_evset = filter_l2_evset(target, &l2_cands))) {
+            _error("Failed to build an L2 evset\n");
+            goto err;
+        }
+        default_skx_sf_evset_build_config(&config, NULL, l2_evset, bc->hctrl);
+        config.test_config.sim = bc->sim;
+        config.test_config_alt.sim = bc->sim;
+        config.algo_config.extra_cong =
+            bc->target == BENCH_TARGET_SF ? SF_ASSOC - detected_l3->n_ways : 0;
+        if (!bc->l2_filter) {
+            config.cands_config.filter_ev = NULL;
+        }
+    }
+    apply_point(bc, &config, pt);
+
+    cache_param *cache =
+        bc->target == BENCH_TARGET_L2 ? detected_l2 : detected_l3;
+    cands = evcands_new(cache, &config.cands_config, NULL);
+    if (!cands ||
+        evcands_populate(page_offset(target), cands, &config.cands_config)) {
+        _error("Failed to populate evcands\n");
+        goto err;
+    }
+
+    if (bc->tune_test && bc->target != BENCH_TARGET_L2 &&
+        bc->tune_test(target, &config.test_config)) {
+        _error("Failed to tune the eviction test\n");
+        goto err;
+    }
+
+    config.stats = stats;
+    u64 start = time_ns();
+    evset = bc->target == BENCH_TARGET_L2
+                ? build_l2_EVSet(target, &config, cands)
+                : build_skx_sf_EVSet(target, &config, cands);
+    *dura = time_ns() - start;
+    ok = evset && evset->size && precise_evset_test(target, evset) == EV_POS;
+
+err:
+    evset_free(evset);
+    evcands_free(cands);
+    evset_free(l2_evset);
+    evcands_free(l2_cands);
+    return ok;
+}
+
+void bench_point_run(bench_config *bc, u8 *page, bench_point *pt,
+                     bench_result *res) {
+    res->succ = 0;
+    memset(res->stats, 0, sizeof(*res->stats));
+    for (u32 r = 0; r < bc->reps; r++) {
+        srand(bc->seed + r);
+        u8 *target = page + rand() % (PAGE_SIZE / CL_SIZE) * CL_SIZE;
+        if (bc->sim) {
+            cache_sim_reset(bc->sim);
+        }
+        res->succ += bench_once(bc, target, pt, res->stats, &res->duras[r]);
+    }
+}
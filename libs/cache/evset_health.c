@@ -0,0 +1,271 @@
+#include "cache/evset_health.h"
+#include "sync.h"
+#include <sched.h>
+#include <unistd.h>
+
+#define HEALTH_SLEEP_SLICE_US 10000
+
+evset_health *evset_health_new(u64 period_us, double duty) {
+    evset_health *h = _calloc(1, sizeof(*h));
+    if (!h) {
+        _error("Failed to allocate evset health monitor\n");
+        return NULL;
+    }
+
+    h->period_us = period_us;
+    h->duty = duty > 0 && duty <= 1 ? duty : 0.01;
+    h->max_grow = 8;
+    pthread_mutex_init(&h->lock, NULL);
+    pthread_cond_init(&h->cond, NULL);
+    return h;
+}
+
+void evset_health_free(evset_health *h) {
+    if (h) {
+        evset_health_stop(h);
+        pthread_cond_destroy(&h->cond);
+        pthread_mutex_destroy(&h->lock);
+        _free(h->ents);
+        _free(h);
+    }
+}
+
+bool evset_health_watch(evset_health *h, EVSet *evset, u8 *target,
+                        bool precise) {
+    if (h->running) {
+        _error("Cannot watch new evsets while the monitor is running\n");
+        return true;
+    }
+
+    if (!evset || !evset->cands) {
+        _error("Only evsets with a candidate pool can be watched\n");
+        return true;
+    }
+
+    if (h->n_ents == h->cap) {
+        size_t cap = h->cap ? h->cap * 2 : 4;
+        evset_health_ent *ents = realloc(h->ents, cap * sizeof(*ents));
+        if (!ents) {
+            _error("Failed to grow the watch list to %lu\n", cap);
+            return true;
+        }
+        h->ents = ents;
+        h->cap = cap;
+    }
+
+    h->ents[h->n_ents++] =
+        (evset_health_ent){.evset = evset, .target = target, .precise = precise};
+    return false;
+}
+
+static EVTestRes health_test(u8 *target, EVSet *evset, bool precise) {
+    return precise ? precise_evset_test(target, evset)
+                   : generic_evset_test(target, evset);
+}
+
+static bool evset_contains(EVSet *evset, u32 size, u8 *ptr) {
+    for (u32 i = 0; i < size; i++) {
+        if (evset->addrs[i] == ptr) return true;
+    }
+    return false;
+}
+
+// grow the surviving members with chunks of unused candidates until the
+// target is evicted again, then prune and extend back to the expected size
+static bool regrow_evset(u8 *target, EVSet *evset, u32 max_grow, bool precise) {
+    u32 base = evset->size;
+    EVCands *cands = evset->cands;
+    size_t cursor = 0;
+    if (evcands_materialize(cands)) {
+        return false;
+    }
+
+    for (u32 g = 0; g < max_grow && base < evset->cap; g++) {
+        u32 sz = base;
+        for (; cursor < cands->size && sz < evset->cap; cursor++) {
+            u8 *ptr = cands->cands[cursor];
+            if (ptr != target && !evset_contains(evset, base, ptr)) {
+                evset->addrs[sz++] = ptr;
+            }
+        }
+
+        if (sz == base) break; // out of candidates
+
+        evset->size = sz;
+        if (generic_evset_test(target, evset) == EV_POS) {
+            prune_EVSet(target, evset);
+            if (evset->config->algo_config.need_skx_sf_ext) {
+                extend_skx_sf_EVSet(evset);
+            }
+            if (health_test(target, evset, precise) == EV_POS) {
+                return true;
+            }
+            base = evset->size;
+        } else {
+            evset->size = base;
+        }
+    }
+    return false;
+}
+
+static bool rebuild_evset(u8 *target, EVSet *evset, bool precise) {
+    EVSet *fresh = build_evset_generic(target, evset->config,
+                                       evset->target_cache, evset->cands);
+    if (!fresh) {
+        return false;
+    }
+
+    bool ok = false;
+    if (fresh->size <= evset->cap) {
+        memcpy(evset->addrs, fresh->addrs, fresh->size * sizeof(*fresh->addrs));
+        evset->size = fresh->size;
+        ok = health_test(target, evset, precise) == EV_POS;
+    }
+    evset_free(fresh);
+    return ok;
+}
+
+bool evset_health_check(evset_health *h, evset_health_ent *ent) {
+    EVSet *evset = ent->evset, view = *evset;
+    u8 *target = ent->target;
+    if (!target) {
+        // self-test: work on a view without the leading target
+        target = evset->addrs[0];
+        view.addrs += 1;
+        view.size -= 1;
+        view.cap -= 1;
+    }
+
+    ent->n_checks += 1;
+    // re-test once to not repair on noise
+    if (health_test(target, &view, ent->precise) == EV_POS ||
+        health_test(target, &view, ent->precise) == EV_POS) {
+        ent->broken = false;
+        return false;
+    }
+
+    ent->n_failures += 1;
+    u8 **saved = _calloc(view.cap, sizeof(*saved));
+    u32 saved_size = view.size;
+    if (!saved) {
+        _error("Failed to allocate buffers for evset repair\n");
+        return false;
+    }
+    memcpy(saved, view.addrs, view.cap * sizeof(*saved));
+
+    bool repaired = regrow_evset(target, &view, h->max_grow, ent->precise);
+    if (repaired) {
+        ent->n_repairs += 1;
+    } else {
+        repaired = rebuild_evset(target, &view, ent->precise);
+        ent->n_rebuilds += repaired;
+    }
+
+    if (!repaired) {
+        // keep the old evset, it may recover (e.g., transient noise)
+        memcpy(view.addrs, saved, view.cap * sizeof(*saved));
+        view.size = saved_size;
+    }
+    _free(saved);
+
+    ent->broken = !repaired;
+    evset->size = view.size + (ent->target ? 0 : 1);
+    return repaired;
+}
+
+void _evset_health_park(evset_health *h) {
+    pthread_mutex_lock(&h->lock);
+    h->paused = true;
+    pthread_cond_broadcast(&h->cond);
+    while (h->pause_req) {
+        pthread_cond_wait(&h->cond, &h->lock);
+    }
+    h->paused = false;
+    pthread_cond_broadcast(&h->cond);
+    pthread_mutex_unlock(&h->lock);
+}
+
+static void health_sleep(evset_health *h, u64 us) {
+    while (us > 0 && h->running) {
+        u64 slice = _min(us, HEALTH_SLEEP_SLICE_US);
+        usleep(slice);
+        us -= slice;
+    }
+}
+
+static void *evset_health_worker(void *arg) {
+    evset_health *h = arg;
+    struct sched_param sp = {.sched_priority = 0};
+    if (pthread_setschedparam(pthread_self(), SCHED_IDLE, &sp)) {
+        _warn("Failed to lower the priority of the evset health monitor\n");
+    }
+
+    size_t next = 0;
+    u64 sleep_us = h->period_us;
+    while (h->running) {
+        health_sleep(h, sleep_us);
+        if (!h->running || !h->n_ents) continue;
+
+        // take over the cache from the monitor loop
+        pthread_mutex_lock(&h->lock);
+        h->pause_req = true;
+        while (!h->paused && h->running) {
+            pthread_cond_wait(&h->cond, &h->lock);
+        }
+        pthread_mutex_unlock(&h->lock);
+        if (!h->running) break;
+
+        u64 start = time_ns();
+        if (evset_health_check(h, &h->ents[next])) {
+            h->generation += 1;
+        }
+        u64 dura_us = (time_ns() - start) / 1000;
+
+        pthread_mutex_lock(&h->lock);
+        h->pause_req = false;
+        pthread_cond_broadcast(&h->cond);
+        while (h->paused && h->running) {
+            pthread_cond_wait(&h->cond, &h->lock);
+        }
+        pthread_mutex_unlock(&h->lock);
+
+        next = (next + 1) % h->n_ents;
+        sleep_us = _max(h->period_us, (u64)(dura_us * (1 - h->duty) / h->duty));
+    }
+    pthread_mutex_lock(&h->lock);
+    h->pause_req = false;
+    pthread_cond_broadcast(&h->cond);
+    pthread_mutex_unlock(&h->lock);
+    return NULL;
+}
+
+bool evset_health_start(evset_health *h) {
+    h->running = true;
+    h->seen_generation = h->generation;
+    if (pthread_create(&h->pid, NULL, evset_health_worker, h)) {
+        _error("Failed to start the evset health monitor\n");
+        h->running = false;
+        return true;
+    }
+    return false;
+}
+
+void evset_health_stop(evset_health *h) {
+    if (h->running) {
+        pthread_mutex_lock(&h->lock);
+        h->running = false;
+        pthread_cond_broadcast(&h->cond);
+        pthread_mutex_unlock(&h->lock);
+        pthread_join(h->pid, NULL);
+    }
+}
+
+void pprint_evset_health(evset_health *h) {
+    for (size_t i = 0; i < h->n_ents; i++) {
+        evset_health_ent *ent = &h->ents[i];
+        _info("Evset %lu: checks: %lu; failures: %lu; repaired: %lu; "
+              "rebuilt: %lu%s\n",
+              i, ent->n_checks, ent->n_failures, ent->n_repairs,
+              ent->n_rebuilds, ent->broken ? "; BROKEN" : "");
+    }
+}
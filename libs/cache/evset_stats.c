@@ -0,0 +1,428 @@
+#include "cache/evset_stats.h"
+#include "sugar.h"
+#include <pthread.h>
+#include <stddef.h>
+
+__thread struct evset_stats *_evset_stats_cur;
+
+// the calling thread's own context, created on first use
+static __thread struct evset_stats *_evset_stats_own;
+
+// every live context, for aggregation
+static struct evset_stats **_stats_reg;
+static size_t _stats_reg_cnt, _stats_reg_cap;
+static pthread_mutex_t _stats_reg_lock = PTHREAD_MUTEX_INITIALIZER;
+
+struct evset_stats *evset_stats_new() {
+    struct evset_stats *stats = NULL;
+    if (posix_memalign((void **)&stats, CL_SIZE, sizeof(*stats))) {
+        _error("Failed to allocate an evset stats context\n");
+        return NULL;
+    }
+    memset(stats, 0, sizeof(*stats));
+
+    pthread_mutex_lock(&_stats_reg_lock);
+    if (_stats_reg_cnt == _stats_reg_cap) {
+        size_t cap = _stats_reg_cap ? _stats_reg_cap * 2 : 16;
+        struct evset_stats **reg = realloc(_stats_reg, cap * sizeof(*reg));
+        if (!reg) {
+            pthread_mutex_unlock(&_stats_reg_lock);
+            _error("Failed to register an evset stats context\n");
+            _free(stats);
+            return NULL;
+        }
+        _stats_reg = reg;
+        _stats_reg_cap = cap;
+    }
+    _stats_reg[_stats_reg_cnt++] = stats;
+    pthread_mutex_unlock(&_stats_reg_lock);
+    return stats;
+}
+
+void evset_stats_free(struct evset_stats *stats) {
+    if (!stats) return;
+
+    pthread_mutex_lock(&_stats_reg_lock);
+    for (size_t i = 0; i < _stats_reg_cnt; i++) {
+        if (_stats_reg[i] == stats) {
+            _stats_reg[i] = _stats_reg[--_stats_reg_cnt];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&_stats_reg_lock);
+
+    if (_evset_stats_own == stats) _evset_stats_own = NULL;
+    if (_evset_stats_cur == stats) _evset_stats_cur = _evset_stats_own;
+    _free(stats);
+}
+
+struct evset_stats *_evset_stats_thread_init() {
+    if (!_evset_stats_own) {
+        _evset_stats_own = evset_stats_new();
+        _assert(_evset_stats_own);
+    }
+    _evset_stats_cur = _evset_stats_own;
+    return _evset_stats_cur;
+}
+
+struct evset_stats *evset_stats_bind(struct evset_stats *stats) {
+    struct evset_stats *prev = evset_stats_cur();
+    if (stats) {
+        _evset_stats_cur = stats;
+    } else {
+        _evset_stats_thread_init();
+    }
+    return prev;
+}
+
+void evset_stats_merge(struct evset_stats *dst, const struct evset_stats *src) {
+    dst->alloc_duration += src->alloc_duration;
+    dst->population_duration += src->population_duration;
+    dst->build_duration += src->build_duration;
+    dst->pruning_duration += src->pruning_duration;
+    dst->extension_duration += src->extension_duration;
+    dst->retries += src->retries;
+    dst->backtracks += src->backtracks;
+    dst->cands_tests += src->cands_tests;
+    dst->mem_accs += src->mem_accs;
+    dst->trials += src->trials;
+    dst->pure_mem_acc += src->pure_mem_acc;
+    dst->pure_tests += src->pure_tests;
+    dst->pure_mem_acc2 += src->pure_mem_acc2;
+    dst->pure_tests2 += src->pure_tests2;
+    dst->pos_unsure += src->pos_unsure;
+    dst->neg_unsure += src->neg_unsure;
+    dst->ooh += src->ooh;
+    dst->ooc += src->ooc;
+    dst->no_next += src->no_next;
+    dst->timeout += src->timeout;
+    dst->meet += src->meet;
+    dst->retry_duration += src->retry_duration;
+
+    hist_merge(&dst->alloc_hist, &src->alloc_hist);
+    hist_merge(&dst->population_hist, &src->population_hist);
+    hist_merge(&dst->build_hist, &src->build_hist);
+    hist_merge(&dst->pruning_hist, &src->pruning_hist);
+    hist_merge(&dst->extension_hist, &src->extension_hist);
+
+    for (u32 i = 0; i < MAX_RETRY_REC; i++) {
+        dst->retry_dist[i] += src->retry_dist[i];
+        dst->useful_retry_dist[i] += src->useful_retry_dist[i];
+        dst->retry_duras[i] += src->retry_duras[i];
+        dst->useful_retry_duras[i] += src->useful_retry_duras[i];
+    }
+
+    for (u32 i = 0; i < MAX_BACKTRACK_REC; i++) {
+        dst->bctr_dist[i] += src->bctr_dist[i];
+        dst->useful_bctr_dist[i] += src->useful_bctr_dist[i];
+        dst->bctr_duras[i] += src->bctr_duras[i];
+        dst->useful_bctr_duras[i] += src->useful_bctr_duras[i];
+    }
+}
+
+void evset_stats_aggregate(struct evset_stats *out) {
+    memset(out, 0, sizeof(*out));
+    pthread_mutex_lock(&_stats_reg_lock);
+    for (size_t i = 0; i < _stats_reg_cnt; i++) {
+        evset_stats_merge(out, _stats_reg[i]);
+    }
+    pthread_mutex_unlock(&_stats_reg_lock);
+}
+
+void reset_evset_stats() {
+    pthread_mutex_lock(&_stats_reg_lock);
+    for (size_t i = 0; i < _stats_reg_cnt; i++) {
+        memset(_stats_reg[i], 0, sizeof(*_stats_reg[i]));
+    }
+    pthread_mutex_unlock(&_stats_reg_lock);
+}
+
+void evset_stats_snapshot(struct evset_stats *out, bool reset) {
+    memset(out, 0, sizeof(*out));
+    pthread_mutex_lock(&_stats_reg_lock);
+    for (size_t i = 0; i < _stats_reg_cnt; i++) {
+        evset_stats_merge(out, _stats_reg[i]);
+        if (reset) {
+            memset(_stats_reg[i], 0, sizeof(*_stats_reg[i]));
+        }
+    }
+    pthread_mutex_unlock(&_stats_reg_lock);
+}
+
+/* Serialization */
+#define STATS_FIELD(f) {#f, offsetof(struct evset_stats, f)}
+#define STATS_DIST(f, len)                                                     \
+    {#f, offsetof(struct evset_stats, f),                                      \
+     sizeof(((struct evset_stats *)0)->f[0]), len}
+
+static const struct {
+    const char *name;
+    size_t off;
+} counters[] = {
+    STATS_FIELD(alloc_duration), STATS_FIELD(population_duration),
+    STATS_FIELD(build_duration), STATS_FIELD(pruning_duration),
+    STATS_FIELD(extension_duration), STATS_FIELD(retries),
+    STATS_FIELD(backtracks), STATS_FIELD(cands_tests), STATS_FIELD(mem_accs),
+    STATS_FIELD(trials), STATS_FIELD(pure_mem_acc), STATS_FIELD(pure_tests),
+    STATS_FIELD(pure_mem_acc2), STATS_FIELD(pure_tests2),
+    STATS_FIELD(pos_unsure), STATS_FIELD(neg_unsure), STATS_FIELD(ooh),
+    STATS_FIELD(ooc), STATS_FIELD(no_next), STATS_FIELD(timeout),
+    STATS_FIELD(meet), STATS_FIELD(retry_duration)};
+
+static const struct {
+    const char *name;
+    size_t off;
+} hists[] = {{"alloc", offsetof(struct evset_stats, alloc_hist)},
+             {"population", offsetof(struct evset_stats, population_hist)},
+             {"build", offsetof(struct evset_stats, build_hist)},
+             {"pruning", offsetof(struct evset_stats, pruning_hist)},
+             {"extension", offsetof(struct evset_stats, extension_hist)}};
+
+// the retry and backtrack distributions, of u32 counts or u64 durations
+static const struct {
+    const char *name;
+    size_t off;
+    u32 elem_sz, len;
+} dists[] = {
+    STATS_DIST(retry_dist, MAX_RETRY_REC),
+    STATS_DIST(useful_retry_dist, MAX_RETRY_REC),
+    STATS_DIST(retry_duras, MAX_RETRY_REC),
+    STATS_DIST(useful_retry_duras, MAX_RETRY_REC),
+    STATS_DIST(bctr_dist, MAX_BACKTRACK_REC),
+    STATS_DIST(useful_bctr_dist, MAX_BACKTRACK_REC),
+    STATS_DIST(bctr_duras, MAX_BACKTRACK_REC),
+    STATS_DIST(useful_bctr_duras, MAX_BACKTRACK_REC)};
+
+static inline u64 *counter_of(const struct evset_stats *stats, u32 i) {
+    return (u64 *)((u8 *)stats + counters[i].off);
+}
+
+static inline log_hist *hist_of(const struct evset_stats *stats, u32 i) {
+    return (log_hist *)((u8 *)stats + hists[i].off);
+}
+
+static inline u64 dist_get(const struct evset_stats *stats, u32 d, u32 i) {
+    const u8 *p = (const u8 *)stats + dists[d].off + i * dists[d].elem_sz;
+    return dists[d].elem_sz == sizeof(u32) ? *(const u32 *)p
+                                           : *(const u64 *)p;
+}
+
+static inline void dist_set(struct evset_stats *stats, u32 d, u32 i, u64 v) {
+    u8 *p = (u8 *)stats + dists[d].off + i * dists[d].elem_sz;
+    if (dists[d].elem_sz == sizeof(u32)) {
+        *(u32 *)p = v;
+    } else {
+        *(u64 *)p = v;
+    }
+}
+
+bool evset_stats_write_json(const struct evset_stats *stats, FILE *out) {
+    fprintf(out, "{\"counters\": {");
+    for (u32 i = 0; i < _array_size(counters); i++) {
+        fprintf(out, "%s\"%s\": %lu", i ? ", " : "", counters[i].name,
+                *counter_of(stats, i));
+    }
+
+    fprintf(out, "}, \"dists\": {");
+    for (u32 d = 0; d < _array_size(dists); d++) {
+        fprintf(out, "%s\"%s\": [", d ? ", " : "", dists[d].name);
+        for (u32 i = 0; i < dists[d].len; i++) {
+            fprintf(out, "%s%lu", i ? ", " : "", dist_get(stats, d, i));
+        }
+        fprintf(out, "]");
+    }
+
+    fprintf(out, "}, \"histograms\": {");
+    for (u32 i = 0; i < _array_size(hists); i++) {
+        log_hist *h = hist_of(stats, i);
+        fprintf(out,
+                "%s\"%s\": {\"count\": %lu, \"sum\": %lu, \"min\": %lu, "
+                "\"max\": %lu, \"p50\": %lu, \"p90\": %lu, \"p99\": %lu, "
+                "\"p999\": %lu, \"buckets\": [",
+                i ? ", " : "", hists[i].name, h->cnt, h->sum, h->min, h->max,
+                hist_quantile(h, 0.5), hist_quantile(h, 0.9),
+                hist_quantile(h, 0.99), hist_quantile(h, 0.999));
+        bool first = true;
+        for (u32 b = 0; b < HIST_BUCKETS; b++) {
+            if (h->buckets[b]) {
+                fprintf(out, "%s[%lu, %lu, %u]", first ? "" : ", ",
+                        hist_bucket_low(b), hist_bucket_high(b),
+                        h->buckets[b]);
+                first = false;
+            }
+        }
+        fprintf(out, "]}");
+    }
+    fprintf(out, "}}\n");
+    return ferror(out);
+}
+
+// non-zero entries as a count, then (u32 index, u64 value) pairs
+static bool write_sparse(FILE *out, const struct evset_stats *stats, u32 d) {
+    u32 n = 0;
+    for (u32 i = 0; i < dists[d].len; i++) {
+        n += dist_get(stats, d, i) != 0;
+    }
+    bool err = fwrite(&n, sizeof(n), 1, out) != 1;
+    for (u32 i = 0; !err && i < dists[d].len; i++) {
+        u64 v = dist_get(stats, d, i);
+        if (v) {
+            err = fwrite(&i, sizeof(i), 1, out) != 1 ||
+                  fwrite(&v, sizeof(v), 1, out) != 1;
+        }
+    }
+    return err;
+}
+
+static bool write_hist(FILE *out, const log_hist *h) {
+    u64 hdr[4] = {h->cnt, h->sum, h->min, h->max};
+    u32 n = 0;
+    for (u32 b = 0; b < HIST_BUCKETS; b++) {
+        n += h->buckets[b] != 0;
+    }
+
+    bool err = fwrite(hdr, sizeof(hdr), 1, out) != 1 ||
+               fwrite(&n, sizeof(n), 1, out) != 1;
+    for (u32 b = 0; !err && b < HIST_BUCKETS; b++) {
+        if (h->buckets[b]) {
+            err = fwrite(&b, sizeof(b), 1, out) != 1 ||
+                  fwrite(&h->buckets[b], sizeof(h->buckets[b]), 1, out) != 1;
+        }
+    }
+    return err;
+}
+
+bool evset_stats_write_bin(const struct evset_stats *stats, FILE *out) {
+    u32 hdr[5] = {EVSTATS_MAGIC, EVSTATS_VERSION, _array_size(counters),
+                  _array_size(dists), _array_size(hists)};
+    bool err = fwrite(hdr, sizeof(hdr), 1, out) != 1;
+    for (u32 i = 0; !err && i < _array_size(counters); i++) {
+        err = fwrite(counter_of(stats, i), sizeof(u64), 1, out) != 1;
+    }
+    for (u32 d = 0; !err && d < _array_size(dists); d++) {
+        err = write_sparse(out, stats, d);
+    }
+    for (u32 i = 0; !err && i < _array_size(hists); i++) {
+        err = write_hist(out, hist_of(stats, i));
+    }
+
+    if (err) {
+        _error("Failed to write evset stats\n");
+    }
+    return err;
+}
+
+static bool read_sparse(FILE *in, struct evset_stats *stats, u32 d) {
+    u32 n, idx;
+    u64 v;
+    if (fread(&n, sizeof(n), 1, in) != 1) {
+        return true;
+    }
+    for (u32 j = 0; j < n; j++) {
+        if (fread(&idx, sizeof(idx), 1, in) != 1 ||
+            fread(&v, sizeof(v), 1, in) != 1 || idx >= dists[d].len) {
+            return true;
+        }
+        dist_set(stats, d, idx, v);
+    }
+    return false;
+}
+
+static bool read_hist(FILE *in, log_hist *h) {
+    u64 hdr[4];
+    u32 n, b;
+    if (fread(hdr, sizeof(hdr), 1, in) != 1 ||
+        fread(&n, sizeof(n), 1, in) != 1) {
+        return true;
+    }
+    h->cnt = hdr[0], h->sum = hdr[1], h->min = hdr[2], h->max = hdr[3];
+    for (u32 j = 0; j < n; j++) {
+        if (fread(&b, sizeof(b), 1, in) != 1 || b >= HIST_BUCKETS ||
+            fread(&h->buckets[b], sizeof(h->buckets[b]), 1, in) != 1) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool evset_stats_read_bin(struct evset_stats *stats, FILE *in) {
+    u32 hdr[5];
+    memset(stats, 0, sizeof(*stats));
+    if (fread(hdr, sizeof(hdr), 1, in) != 1 || hdr[0] != EVSTATS_MAGIC ||
+        hdr[1] != EVSTATS_VERSION || hdr[2] != _array_size(counters) ||
+        hdr[3] != _array_size(dists) || hdr[4] != _array_size(hists)) {
+        _error("Not an evset stats snapshot of this version\n");
+        return true;
+    }
+
+    bool err = false;
+    for (u32 i = 0; !err && i < _array_size(counters); i++) {
+        err = fread(counter_of(stats, i), sizeof(u64), 1, in) != 1;
+    }
+    for (u32 d = 0; !err && d < _array_size(dists); d++) {
+        err = read_sparse(in, stats, d);
+    }
+    for (u32 i = 0; !err && i < _array_size(hists); i++) {
+        err = read_hist(in, hist_of(stats, i));
+    }
+
+    if (err) {
+        _error("Truncated or corrupted evset stats\n");
+    }
+    return err;
+}
+
+static void _pprint_dist(const u32 *total, const u32 *useful,
+                         const u64 *total_dura, const u64 *useful_dura,
+                         u32 max_cnt, const char *name) {
+    _info("%s:", name);
+    for (u32 i = 1; i < max_cnt; i++) {
+        if (total[i] || useful[i]) {
+            if (i == max_cnt - 1) {
+                fprintf(stderr, " >=%u:", i);
+            } else {
+                fprintf(stderr, " %u:", i);
+            }
+            fprintf(stderr, " %u/%u-%lu/%lums;", useful[i], total[i],
+                    useful_dura[i] / 1000000, total_dura[i] / 1000000);
+        }
+    }
+    fprintf(stderr, "\n");
+}
+
+void pprint_evset_stats_ctx(const struct evset_stats *stats) {
+    _info("Alloc: %luus; Population: %luus; Build: %luus; Pruning: %luus; "
+          "Extension: %luus;\n"
+          "Retries: %lu; Backtracks: %lu; Tests: %lu; Trials: %lu; "
+          "Mem Acc.: %lu;\n"
+          "Pos unsure: %lu; Neg unsure: %lu; OOH: %lu; OOC: %lu; NoNex: %lu; "
+          "Timeout: %lu\nPure acc: %lu; Pure tests: %lu; Pure acc 2: %lu; Pure "
+          "tests 2: %lu\n",
+          stats->alloc_duration / 1000, stats->population_duration / 1000,
+          stats->build_duration / 1000, stats->pruning_duration / 1000,
+          stats->extension_duration / 1000, stats->retries, stats->backtracks,
+          stats->cands_tests, stats->trials, stats->mem_accs,
+          stats->pos_unsure, stats->neg_unsure, stats->ooh, stats->ooc, stats->no_next,
+          stats->timeout, stats->pure_mem_acc, stats->pure_tests,
+          stats->pure_mem_acc2, stats->pure_tests2);
+
+    _pprint_dist(stats->retry_dist, stats->useful_retry_dist,
+                 stats->retry_duras, stats->useful_retry_duras, MAX_RETRY_REC,
+                 "Retry dist");
+    _pprint_dist(stats->bctr_dist, stats->useful_bctr_dist, stats->bctr_duras,
+                 stats->useful_bctr_duras, MAX_BACKTRACK_REC, "Backtrack dist");
+    _info("Meet: %lu; Retry: %luus\n", stats->meet,
+          stats->retry_duration / 1000);
+    _info("Build p50/p90/p99: %lu/%lu/%luus; Population p50/p99: %lu/%luus\n",
+          hist_quantile(&stats->build_hist, 0.5) / 1000,
+          hist_quantile(&stats->build_hist, 0.9) / 1000,
+          hist_quantile(&stats->build_hist, 0.99) / 1000,
+          hist_quantile(&stats->population_hist, 0.5) / 1000,
+          hist_quantile(&stats->population_hist, 0.99) / 1000);
+}
+
+void pprint_evset_stats() {
+    struct evset_stats agg;
+    evset_stats_aggregate(&agg);
+    pprint_evset_stats_ctx(&agg);
+}
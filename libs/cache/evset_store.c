@@ -0,0 +1,229 @@
+#include "cache/evset_store.h"
+
+evstore *evstore_new(EVBuffer **bufs, u32 n_bufs) {
+    evstore *st = _calloc(1, sizeof(*st));
+    if (!st) {
+        _error("Failed to allocate evstore\n");
+        return NULL;
+    }
+
+    st->bufs = bufs;
+    st->n_bufs = n_bufs;
+    return st;
+}
+
+void evstore_free(evstore *st) {
+    if (st) {
+        for (size_t i = 0; i < st->n_recs; i++) {
+            _free(st->recs[i].offsets);
+        }
+        _free(st->recs);
+        _free(st);
+    }
+}
+
+static evstore_rec *evstore_append(evstore *st) {
+    if (st->n_recs == st->cap) {
+        size_t cap = st->cap ? st->cap * 2 : 256;
+        evstore_rec *recs = realloc(st->recs, cap * sizeof(*recs));
+        if (!recs) {
+            _error("Failed to grow evstore to %lu records\n", cap);
+            return NULL;
+        }
+        st->recs = recs;
+        st->cap = cap;
+    }
+    return &st->recs[st->n_recs++];
+}
+
+bool evstore_add(evstore *st, evstore_kind kind, u32 buf_id, u32 k0, u32 k1,
+                 u32 k2, u8 **addrs, size_t cnt) {
+    if (buf_id >= st->n_bufs) {
+        _error("Invalid evstore buffer id: %u\n", buf_id);
+        return true;
+    }
+
+    EVBuffer *evb = st->bufs[buf_id];
+    u64 *offsets = _calloc(cnt, sizeof(*offsets));
+    if (cnt && !offsets) {
+        _error("Failed to allocate %lu evstore offsets\n", cnt);
+        return true;
+    }
+
+    for (size_t i = 0; i < cnt; i++) {
+        u8 *base = evb->buf;
+        if (addrs[i] < base || addrs[i] >= base + evb->buf_size) {
+            _error("%p is not in buffer %u\n", addrs[i], buf_id);
+            _free(offsets);
+            return true;
+        }
+        offsets[i] = addrs[i] - base;
+    }
+
+    evstore_rec *rec = evstore_append(st);
+    if (!rec) {
+        _free(offsets);
+        return true;
+    }
+
+    *rec = (evstore_rec){.kind = kind,
+                         .buf_id = buf_id,
+                         .key = {k0, k1, k2},
+                         .size = cnt,
+                         .offsets = offsets};
+    return false;
+}
+
+bool evstore_save(evstore *st, const char *path) {
+    // write to a temporary file first so that a crash never leaves a
+    // truncated index behind
+    char tmp_path[4096];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE *fp = fopen(tmp_path, "wb");
+    if (!fp) {
+        _error("Failed to open %s\n", tmp_path);
+        return true;
+    }
+
+    u32 hdr[3] = {EVSTORE_MAGIC, EVSTORE_VERSION, st->n_bufs};
+    u64 n_recs = st->n_recs;
+    bool err = fwrite(hdr, sizeof(hdr), 1, fp) != 1 ||
+               fwrite(&n_recs, sizeof(n_recs), 1, fp) != 1;
+    for (u32 b = 0; b < st->n_bufs && !err; b++) {
+        u64 buf_size = st->bufs[b]->buf_size;
+        err = fwrite(&buf_size, sizeof(buf_size), 1, fp) != 1;
+    }
+
+    for (size_t i = 0; i < st->n_recs && !err; i++) {
+        evstore_rec *rec = &st->recs[i];
+        u32 rec_hdr[6] = {rec->kind,   rec->buf_id, rec->key[0],
+                          rec->key[1], rec->key[2], rec->size};
+        err = fwrite(rec_hdr, sizeof(rec_hdr), 1, fp) != 1 ||
+              fwrite(rec->offsets, sizeof(*rec->offsets), rec->size, fp) !=
+                  rec->size;
+    }
+
+    err |= fclose(fp) != 0;
+    if (err || rename(tmp_path, path)) {
+        _error("Failed to write evstore %s\n", path);
+        unlink(tmp_path);
+        return true;
+    }
+    return false;
+}
+
+evstore *evstore_load(const char *path, EVBuffer **bufs, u32 n_bufs) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        return NULL;
+    }
+
+    evstore *st = NULL;
+    u32 hdr[3];
+    u64 n_recs;
+    if (fread(hdr, sizeof(hdr), 1, fp) != 1 ||
+        fread(&n_recs, sizeof(n_recs), 1, fp) != 1) {
+        goto corrupted;
+    }
+
+    if (hdr[0] != EVSTORE_MAGIC || hdr[1] != EVSTORE_VERSION ||
+        hdr[2] != n_bufs) {
+        _warn("%s is not a compatible evstore\n", path);
+        goto err;
+    }
+
+    for (u32 b = 0; b < n_bufs; b++) {
+        u64 buf_size;
+        if (fread(&buf_size, sizeof(buf_size), 1, fp) != 1) {
+            goto corrupted;
+        }
+
+        if (buf_size != bufs[b]->buf_size) {
+            _warn("%s: buffer %u has changed its size\n", path, b);
+            goto err;
+        }
+    }
+
+    st = evstore_new(bufs, n_bufs);
+    if (!st) goto err;
+
+    for (u64 i = 0; i < n_recs; i++) {
+        u32 rec_hdr[6];
+        if (fread(rec_hdr, sizeof(rec_hdr), 1, fp) != 1 ||
+            rec_hdr[1] >= n_bufs) {
+            goto corrupted;
+        }
+
+        evstore_rec *rec = evstore_append(st);
+        if (!rec) goto err;
+
+        *rec = (evstore_rec){.kind = rec_hdr[0],
+                             .buf_id = rec_hdr[1],
+                             .key = {rec_hdr[2], rec_hdr[3], rec_hdr[4]},
+                             .size = rec_hdr[5]};
+        rec->offsets = _calloc(rec->size, sizeof(*rec->offsets));
+        if (rec->size && !rec->offsets) {
+            st->n_recs -= 1;
+            goto err;
+        }
+
+        if (fread(rec->offsets, sizeof(*rec->offsets), rec->size, fp) !=
+            rec->size) {
+            goto corrupted;
+        }
+
+        for (u32 j = 0; j < rec->size; j++) {
+            if (rec->offsets[j] >= bufs[rec->buf_id]->buf_size) {
+                goto corrupted;
+            }
+        }
+    }
+
+    fclose(fp);
+    return st;
+
+corrupted:
+    _warn("%s is corrupted\n", path);
+err:
+    evstore_free(st);
+    fclose(fp);
+    return NULL;
+}
+
+EVSet *evstore_rec_evset(evstore *st, evstore_rec *rec, EVBuildConfig *config,
+                         cache_param *cache, EVCands *cands) {
+    _assert(cands);
+    u8 *base = st->bufs[rec->buf_id]->buf;
+    EVSet *evset = evset_new_deferred(config, cache, cands);
+    if (!evset) {
+        return NULL;
+    }
+
+    evset->size = _min(rec->size, evset->cap);
+    for (u32 i = 0; i < evset->size; i++) {
+        evset->addrs[i] = base + rec->offsets[i];
+    }
+    return evset;
+}
+
+EVCands *evstore_rec_cands(evstore *st, evstore_rec *rec, cache_param *cache,
+                           EVCandsConfig *config) {
+    EVBuffer *evb = st->bufs[rec->buf_id];
+    EVCands *cands = evcands_new(cache, config, evb);
+    if (!cands) {
+        return NULL;
+    }
+
+    cands->cands = _calloc(rec->size, sizeof(*cands->cands));
+    if (rec->size && !cands->cands) {
+        _error("Failed to allocate %u candidates\n", rec->size);
+        evcands_free(cands);
+        return NULL;
+    }
+
+    for (u32 i = 0; i < rec->size; i++) {
+        cands->cands[i] = (u8 *)evb->buf + rec->offsets[i];
+    }
+    cands->size = rec->size;
+    return cands;
+}
@@ -1,36 +1,132 @@
 #include "cache/helper_thread.h"
 #include "sugar.h"
+#include <stdlib.h>
+#include <string.h>
 
 void *helper_thread_worker(void * _args) {
     helper_thread_ctrl *ctrl = _args;
+    u64 seen = 0;
     while (true) {
-        ctrl->waiting = true;
-        while (ctrl->waiting);
-        switch (ctrl->action) {
-            case HELPER_STOP: {
-                return NULL;
-            }
-            case READ_SINGLE: {
-                _maccess((u8 *)ctrl->payload);
-                break;
-            }
-            case TIME_SINGLE: {
-                u8 *ptr = (u8 *)ctrl->payload;
-                ctrl->lat = _time_maccess(ptr);
-                break;
-            }
-            case READ_ARRAY: {
-                struct helper_thread_read_array *arr = ctrl->payload;
+        u64 seq;
+        while ((seq = __atomic_load_n(&ctrl->req.seq, __ATOMIC_ACQUIRE)) ==
+               seen);
+        seen = seq;
 
-                prime_cands_daniel(arr->addrs, arr->cnt, arr->repeat,
-                                   arr->stride, arr->block);
-                break;
+        for (u32 i = 0; i < ctrl->batch.n_cmds; i++) {
+            helper_thread_cmd *cmd = &ctrl->batch.cmds[i];
+            switch (cmd->action) {
+                case HELPER_STOP: {
+                    __atomic_store_n(&ctrl->resp.done, seen, __ATOMIC_RELEASE);
+                    return NULL;
+                }
+                case READ_SINGLE: {
+                    _maccess(cmd->addr);
+                    break;
+                }
+                case TIME_SINGLE: {
+                    ctrl->resp.lat = _time_maccess(cmd->addr);
+                    break;
+                }
+                case READ_ARRAY: {
+                    struct helper_thread_read_array *arr = &cmd->arr;
+                    prime_cands_daniel(arr->addrs, arr->cnt, arr->repeat,
+                                       arr->stride, arr->block, arr->linked);
+                    break;
+                }
+                case TRAVERSE_CANDS: {
+                    struct helper_thread_traverse_cands *trav = &cmd->trav;
+                    trav->traverse(trav->cands, trav->cnt, trav->tconfig);
+                    break;
+                }
+                case LOCATE: {
+                    _rdtscp_aux(&ctrl->resp.aux);
+                    break;
+                }
             }
-            case TRAVERSE_CANDS: {
-                struct helper_thread_traverse_cands *cmd = ctrl->payload;
-                cmd->traverse(cmd->cands, cmd->cnt, cmd->tconfig);
-                break;
+        }
+        __atomic_store_n(&ctrl->resp.done, seen, __ATOMIC_RELEASE);
+    }
+}
+
+int helper_thread_cpu(helper_thread_ctrl *ctrl) {
+    helper_thread_push(ctrl, LOCATE);
+    helper_thread_flush(ctrl);
+    return tsc_aux_cpu(ctrl->resp.aux);
+}
+
+bool helper_thread_check_placement(helper_thread_ctrl *ctrl) {
+    const cpu_topology *topo = cpu_topology_get();
+    if (!topo || !ctrl->running) {
+        return false;
+    }
+
+    u32 aux = ctrl->main_aux;
+    if (!aux) {
+        _rdtscp_aux(&aux);
+    }
+    int main_cpu = tsc_aux_cpu(aux), helper_cpu = helper_thread_cpu(ctrl);
+    if (cpu_topology_pair_ok(topo, main_cpu, helper_cpu)) {
+        return false;
+    }
+
+    if (!ctrl->misplaced) {
+        _warn("The helper thread runs on CPU %d, which does not work for "
+              "CPU %d\n", helper_cpu, main_cpu);
+        ctrl->misplaced = true;
+    }
+
+    // a pinned helper stays put; only move one picked for us
+    if (ctrl->core < 0 || ctrl->claimed) {
+        _helper_thread_save_affinity(ctrl);
+        int main_core, core = cpu_topology_claim_helper(&main_core);
+        bool moved = false;
+        if (core >= 0) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(core, &set);
+            moved = !pthread_setaffinity_np(ctrl->pid, sizeof(set), &set);
+        }
+        if (moved) {
+            if (ctrl->claimed) {
+                cpu_topology_release(ctrl->core);
+                cpu_topology_release(ctrl->main_core);
             }
+            ctrl->core = core;
+            ctrl->main_core = main_core;
+            ctrl->claimed = true;
+        } else if (core >= 0) {
+            cpu_topology_release(core);
+            cpu_topology_release(main_core);
         }
     }
+    return true;
+}
+
+bool start_helper_pool(helper_thread_pool *pool, u32 n_helpers,
+                       const int *cores) {
+    size_t sz = n_helpers * sizeof(*pool->ctrls);
+    pool->n_helpers = 0;
+    if (posix_memalign((void **)&pool->ctrls, CL_SIZE, sz)) {
+        pool->ctrls = NULL;
+        return true;
+    }
+    memset(pool->ctrls, 0, sz);
+
+    for (u32 h = 0; h < n_helpers; h++) {
+        if (start_helper_thread_pinned(&pool->ctrls[h], cores ? cores[h] : -1)) {
+            stop_helper_pool(pool);
+            return true;
+        }
+        pool->n_helpers += 1;
+    }
+    return false;
+}
+
+void stop_helper_pool(helper_thread_pool *pool) {
+    for (u32 h = 0; h < pool->n_helpers; h++) {
+        stop_helper_thread(&pool->ctrls[h]);
+    }
+    free(pool->ctrls);
+    pool->ctrls = NULL;
+    pool->n_helpers = 0;
 }
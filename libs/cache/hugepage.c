@@ -0,0 +1,185 @@
+#include "cache/hugepage.h"
+#include "bitwise.h"
+#include "sugar.h"
+#include <stdio.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+
+#ifndef PAGEMAP_SCAN
+// the pagemap scan ioctl is available since linux 6.7
+struct page_region {
+    u64 start, end, categories;
+};
+
+struct pm_scan_arg {
+    u64 size, flags, start, end, walk_end, vec, vec_len, max_pages;
+    u64 category_inverted, category_mask, category_anyof_mask, return_mask;
+};
+
+#define PAGEMAP_SCAN _IOWR('f', 16, struct pm_scan_arg)
+#define PAGE_IS_HUGE (1 << 6)
+#endif
+
+#define PAGEMAP_SCAN_VEC_LEN 64
+
+// a 2MB-aligned private mapping; THP only backs aligned anonymous regions
+static u8 *mmap_thp(size_t size) {
+    size_t len = size + HUGE_PAGE_SIZE;
+    u8 *ptr = mmap_private(NULL, len);
+    if (!ptr) {
+        return NULL;
+    }
+
+    u8 *start = _ALIGN_UP(ptr, HUGE_PAGE_SHIFT);
+    if (start > ptr) {
+        munmap(ptr, start - ptr);
+    }
+    munmap(start + size, ptr + len - (start + size));
+
+    if (madvise(start, size, MADV_HUGEPAGE)) {
+        munmap(start, size);
+        return NULL;
+    }
+    return start;
+}
+
+// mark the regions entirely within [start, end)
+static void mark_huge(hugepage_buf *hb, u64 start, u64 end) {
+    u64 base = (u64)hb->buf;
+    start = _ALIGN_UP(_max(start, base), hb->page_shift);
+    end = _min(end, base + hb->size);
+    for (u64 p = start; p + (1ull << hb->page_shift) <= end;
+         p += 1ull << hb->page_shift) {
+        hb->huge[(p - base) >> hb->page_shift] = 1;
+    }
+}
+
+// exact, but needs a recent kernel; returns true if unsupported
+static bool scan_pagemap(hugepage_buf *hb) {
+    int fd = open("/proc/self/pagemap", O_RDONLY);
+    if (fd < 0) {
+        return true;
+    }
+
+    struct page_region regs[PAGEMAP_SCAN_VEC_LEN];
+    struct pm_scan_arg arg = {.size = sizeof(arg),
+                              .start = (u64)hb->buf,
+                              .end = (u64)hb->buf + hb->size,
+                              .vec = (u64)regs,
+                              .vec_len = PAGEMAP_SCAN_VEC_LEN,
+                              .category_mask = PAGE_IS_HUGE,
+                              .return_mask = PAGE_IS_HUGE};
+    bool err = false;
+    while (arg.start < arg.end) {
+        long n = ioctl(fd, PAGEMAP_SCAN, &arg);
+        if (n < 0) {
+            err = true;
+            break;
+        }
+
+        for (long i = 0; i < n; i++) {
+            mark_huge(hb, regs[i].start, regs[i].end);
+        }
+
+        if (arg.walk_end <= arg.start) break;
+        arg.start = arg.walk_end;
+    }
+    close(fd);
+    return err;
+}
+
+// smaps only reports per-VMA totals, so a partially backed buffer is treated
+// as not backed at all; returns true if unsupported
+static bool scan_smaps(hugepage_buf *hb) {
+    FILE *fp = fopen("/proc/self/smaps", "r");
+    if (!fp) {
+        return true;
+    }
+
+    u64 lo = (u64)hb->buf, hi = lo + hb->size, start, end, kb, huge_kb = 0;
+    bool in_buf = false, exclusive = true;
+    char line[256];
+    while (fgets(line, sizeof(line), fp)) {
+        if (sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+            in_buf = start < hi && end > lo;
+            exclusive &= !in_buf || (start >= lo && end <= hi);
+        } else if (in_buf && sscanf(line, "AnonHugePages: %lu kB", &kb) == 1) {
+            huge_kb += kb;
+        }
+    }
+    fclose(fp);
+
+    if (exclusive && (huge_kb << 10) == hb->size) {
+        mark_huge(hb, lo, hi);
+    }
+    return false;
+}
+
+void hugepage_scan(hugepage_buf *hb) {
+    if (!hb->huge) return;
+
+    memset(hb->huge, 0, hb->n_regions);
+    if (scan_pagemap(hb) && scan_smaps(hb)) {
+        _warn("Cannot tell which regions are backed by hugepages\n");
+    }
+
+    hb->n_huge = 0;
+    for (size_t i = 0; i < hb->n_regions; i++) {
+        hb->n_huge += hb->huge[i];
+    }
+}
+
+bool hugepage_alloc(hugepage_buf *hb, size_t huge_size, size_t small_size,
+                    u32 shift) {
+    *hb = (hugepage_buf){.page_shift = PAGE_SHIFT};
+    if (shift > PAGE_SHIFT) {
+        u8 *buf = shift == GIGA_PAGE_SHIFT
+                      ? mmap_giga_shared_init(NULL, huge_size, 0)
+                      : mmap_huge_shared_init(NULL, huge_size, 0);
+        if (buf) {
+            hb->buf = buf;
+            hb->size = huge_size;
+            hb->backing = HUGEPAGE_HUGETLB;
+            hb->page_shift = shift;
+            hb->n_regions = hb->n_huge = huge_size >> shift;
+            return false;
+        }
+
+        size_t size = _ALIGN_UP(small_size, HUGE_PAGE_SHIFT);
+        buf = mmap_thp(size);
+        if (buf) {
+            hb->huge = _calloc(size >> HUGE_PAGE_SHIFT, sizeof(*hb->huge));
+            if (!hb->huge) {
+                munmap(buf, size);
+                return true;
+            }
+
+            // fault in every region so that the scan sees the final backing
+            memset(buf, 0, size);
+            hb->buf = buf;
+            hb->size = size;
+            hb->backing = HUGEPAGE_THP;
+            hb->page_shift = HUGE_PAGE_SHIFT;
+            hb->n_regions = size >> HUGE_PAGE_SHIFT;
+            hugepage_scan(hb);
+            return false;
+        }
+        _warn("No hugepages available, falling back to 4KB pages\n");
+    }
+
+    hb->buf = mmap_shared_init(NULL, small_size, 0);
+    if (!hb->buf) {
+        return true;
+    }
+    hb->size = small_size;
+    hb->n_regions = small_size >> PAGE_SHIFT;
+    return false;
+}
+
+void hugepage_free(hugepage_buf *hb) {
+    if (hb->buf) {
+        munmap(hb->buf, hb->size);
+    }
+    _free(hb->huge);
+    *hb = (hugepage_buf){0};
+}
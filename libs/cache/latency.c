@@ -52,7 +52,8 @@ err:
 
 static i64 _detect_mid_level_latency(cache_param *c, u32 repeats) {
     u32 aux_before, aux_after, i, j, n_rep_offset = repeats / N_OFFSETS;
-    size_t ev_sz = 2 * c->n_ways * cache_uncertainty(c);
+    // the lines are on 4KB pages, whatever the hugepage mode
+    size_t ev_sz = 2 * c->n_ways * cache_uncertainty_at(c, PAGE_SHIFT);
     // two extra pages, one for target, one for alignment
     size_t buf_sz = (ev_sz + 2) * PAGE_SIZE;
     u8 *buf = _calloc(buf_sz, 1), *page, *target, *tlb_target, *ev_start;
@@ -138,8 +138,6 @@ static void skx_sf_prime_ps(evchain *ptr) {
                          : "cc", "memory");
 }
 
-typedef i64 (*probe_func)(EVSet *evset, u64 *end_tsc, u32 *aux);
-
 static i64 calibrate_probe_lat(u8 *target, EVSet *evset, u32 arr_repeat,
                                u32 l2_repeat, double bad_thresh_ratio,
                                const char *name, probe_func pfunc) {
@@ -225,3 +223,169 @@ i64 calibrate_chase_probe_lat(u8 *target, EVSet *evset, u32 arr_repeat,
                                bad_thresh_ratio, "Ptr-Chase Probe",
                                probe_skx_sf_evset_ptr_chase);
 }
+
+i64 calibrate_kernel_probe_lat(u8 *target, EVSet *evset, u32 arr_repeat,
+                               u32 l2_repeat, double bad_thresh_ratio,
+                               const probe_kernel *kernel) {
+    return calibrate_probe_lat(target, evset, arr_repeat, l2_repeat,
+                               bad_thresh_ratio, kernel->name, kernel->probe);
+}
+
+// gather kernels; vector lanes past "n" are masked off. Every gather merges
+// into zeros so that none waits for another. immintrin.h clashes with
+// inline_asm.h, so use the GCC builtins behind the intrinsics directly
+typedef long long v4di __attribute__((vector_size(32)));
+typedef long long v8di __attribute__((vector_size(64)));
+typedef long long v4di_u __attribute__((vector_size(32), aligned(1)));
+typedef long long v8di_u __attribute__((vector_size(64), aligned(1)));
+
+static volatile u64 _gather_sink;
+
+static __attribute__((target("avx2"))) __always_inline i64
+_probe_gather_avx2(u8 **addrs, u32 n, u64 *end_tsc, u32 *aux) {
+    v4di idx[(n + 3) / 4], res[(n + 3) / 4], all = {~0, ~0, ~0, ~0};
+    v4di zero = {0}, acc = {0};
+    for (u32 i = 0; i + 4 <= n; i += 4) {
+        idx[i / 4] = *(v4di_u *)&addrs[i];
+    }
+    if (n % 4) {
+        // do not read past the end of "addrs"
+        idx[n / 4] = zero;
+        for (u32 i = n / 4 * 4; i < n; i++) {
+            idx[n / 4][i % 4] = (long long)addrs[i];
+        }
+    }
+    v4di tail = (v4di){0, 1, 2, 3} < (long long)(n % 4);
+
+    u64 start = _timer_start();
+    for (u32 i = 0; i + 4 <= n; i += 4) {
+        res[i / 4] =
+            __builtin_ia32_gatherdiv4di(zero, NULL, idx[i / 4], all, 1);
+    }
+    if (n % 4) {
+        res[n / 4] =
+            __builtin_ia32_gatherdiv4di(zero, NULL, idx[n / 4], tail, 1);
+    }
+    *end_tsc = _timer_end_aux(aux);
+
+    for (u32 i = 0; i < (n + 3) / 4; i++) {
+        acc |= res[i];
+    }
+    _gather_sink = acc[0];
+    return *end_tsc - start;
+}
+
+static __attribute__((target("avx512f"))) __always_inline i64
+_probe_gather_avx512(u8 **addrs, u32 n, u64 *end_tsc, u32 *aux) {
+    v8di idx[(n + 7) / 8], res[(n + 7) / 8], zero = {0}, acc = {0};
+    for (u32 i = 0; i + 8 <= n; i += 8) {
+        idx[i / 8] = *(v8di_u *)&addrs[i];
+    }
+    if (n % 8) {
+        // do not read past the end of "addrs"
+        idx[n / 8] = zero;
+        for (u32 i = n / 8 * 8; i < n; i++) {
+            idx[n / 8][i % 8] = (long long)addrs[i];
+        }
+    }
+
+    u64 start = _timer_start();
+    for (u32 i = 0; i + 8 <= n; i += 8) {
+        res[i / 8] =
+            __builtin_ia32_gatherdiv8di(zero, NULL, idx[i / 8], 0xff, 1);
+    }
+    if (n % 8) {
+        u8 tail = (1u << (n % 8)) - 1;
+        res[n / 8] =
+            __builtin_ia32_gatherdiv8di(zero, NULL, idx[n / 8], tail, 1);
+    }
+    *end_tsc = _timer_end_aux(aux);
+
+    for (u32 i = 0; i < (n + 7) / 8; i++) {
+        acc |= res[i];
+    }
+    _gather_sink = acc[0];
+    return *end_tsc - start;
+}
+
+#define _DEFINE_PROBE_GATHER(N)                                                \
+    __attribute__((target("avx2"))) i64 probe_sf_evset_gather_avx2_##N(        \
+        EVSet *evset, u64 *end_tsc, u32 *aux) {                                \
+        return _probe_gather_avx2(evset->addrs, N, end_tsc, aux);              \
+    }                                                                          \
+                                                                               \
+    __attribute__((target("avx512f"))) i64 probe_sf_evset_gather_avx512_##N(  \
+        EVSet *evset, u64 *end_tsc, u32 *aux) {                                \
+        return _probe_gather_avx512(evset->addrs, N, end_tsc, aux);            \
+    }                                                                          \
+                                                                               \
+    static i64 _probe_sf_evset_para_asm_##N(EVSet *evset, u64 *end_tsc,        \
+                                            u32 *aux) {                        \
+        return probe_sf_evset_para_asm_##N(evset, end_tsc, aux);               \
+    }                                                                          \
+                                                                               \
+    static i64 _probe_sf_evset_para_loop_##N(EVSet *evset, u64 *end_tsc,       \
+                                             u32 *aux) {                       \
+        return probe_sf_evset_para_loop_##N(evset, end_tsc, aux);              \
+    }
+
+PROBE_WAYS(_DEFINE_PROBE_GATHER)
+
+static bool has_avx2() { return __builtin_cpu_supports("avx2"); }
+
+static bool has_avx512() { return __builtin_cpu_supports("avx512f"); }
+
+#define _PROBE_KERNELS(N)                                                      \
+    {"asm-" #N, N, _probe_sf_evset_para_asm_##N, NULL},                        \
+    {"loop-" #N, N, _probe_sf_evset_para_loop_##N, NULL},                      \
+    {"avx2-" #N, N, probe_sf_evset_gather_avx2_##N, has_avx2},                 \
+    {"avx512-" #N, N, probe_sf_evset_gather_avx512_##N, has_avx512},
+
+const probe_kernel probe_kernels[] = {PROBE_WAYS(_PROBE_KERNELS)};
+const size_t n_probe_kernels = _array_size(probe_kernels);
+
+const probe_kernel *find_probe_kernel(const char *name) {
+    for (size_t i = 0; i < n_probe_kernels; i++) {
+        if (strcmp(probe_kernels[i].name, name) == 0) {
+            return &probe_kernels[i];
+        }
+    }
+    return NULL;
+}
+
+#define PROBE_SELECT_REPEAT 10000
+
+const probe_kernel *select_probe_kernel(EVSet *evset, u32 ways, u32 arr_repeat,
+                                        u32 l2_repeat) {
+    const probe_kernel *best = NULL;
+    u64 best_lat = UINT64_MAX, end_tsc;
+    u32 aux;
+    if (evset->size < ways) {
+        _error("Cannot select a %u-way probe for an evset of %u lines\n", ways,
+               evset->size);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < n_probe_kernels; i++) {
+        const probe_kernel *k = &probe_kernels[i];
+        if (k->ways != ways || (k->supported && !k->supported())) {
+            continue;
+        }
+
+        // same measurement as the resolution reported by the tools
+        prime_skx_sf_evset_para(evset, arr_repeat, l2_repeat);
+        k->probe(evset, &end_tsc, &aux);
+        u64 start = _timer_start();
+        for (u32 r = 0; r < PROBE_SELECT_REPEAT; r++) {
+            k->probe(evset, &end_tsc, &aux);
+        }
+        u64 lat = (_timer_end() - start) / PROBE_SELECT_REPEAT;
+        _info("Probe kernel %s: %lu cycles\n", k->name, lat);
+
+        if (lat < best_lat) {
+            best_lat = lat;
+            best = k;
+        }
+    }
+    return best;
+}
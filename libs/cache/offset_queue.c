@@ -0,0 +1,54 @@
+#include "cache/offset_queue.h"
+#include "sugar.h"
+
+void offset_queue_init(offset_queue *q, u32 cap) {
+    q->n_pushed = 0;
+    q->n_popped = 0;
+    q->cap = _max(_min(cap, OFFSET_QUEUE_SLOTS), 1u);
+    q->closed = false;
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->not_full, NULL);
+    pthread_cond_init(&q->not_empty, NULL);
+}
+
+void offset_queue_destroy(offset_queue *q) {
+    pthread_cond_destroy(&q->not_empty);
+    pthread_cond_destroy(&q->not_full);
+    pthread_mutex_destroy(&q->lock);
+}
+
+bool offset_queue_push(offset_queue *q, u32 n) {
+    pthread_mutex_lock(&q->lock);
+    while (q->n_pushed - q->n_popped >= q->cap && !q->closed) {
+        pthread_cond_wait(&q->not_full, &q->lock);
+    }
+    bool closed = q->closed;
+    if (!closed) {
+        q->idxs[q->n_pushed++ % q->cap] = n;
+        pthread_cond_signal(&q->not_empty);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return closed;
+}
+
+bool offset_queue_pop(offset_queue *q, u32 *n) {
+    pthread_mutex_lock(&q->lock);
+    while (q->n_popped == q->n_pushed && !q->closed) {
+        pthread_cond_wait(&q->not_empty, &q->lock);
+    }
+    bool empty = q->n_popped == q->n_pushed;
+    if (!empty) {
+        *n = q->idxs[q->n_popped++ % q->cap];
+        pthread_cond_signal(&q->not_full);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return empty;
+}
+
+void offset_queue_close(offset_queue *q) {
+    pthread_mutex_lock(&q->lock);
+    q->closed = true;
+    pthread_cond_broadcast(&q->not_full);
+    pthread_cond_broadcast(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+}
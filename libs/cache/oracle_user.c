@@ -1,8 +1,10 @@
 #ifndef __KERNEL__
 
 #include "cache/oracle.h"
+#include "cache/pagemap.h"
 #include "pmu/intel.h"
 #include "ptedit_header.h"
+#include "sugar.h"
 #include <sched.h>
 
 static msr_op msr;
@@ -10,8 +12,80 @@ static intel_cha_pmon cha;
 static intel_uncore_glb_ctrl unc_ctrl;
 static bool msr_inited = false, cha_inited = false, ptedit_inited = false;
 
+/* Slice memo */
+#define SLICE_MEMO_INIT_CAP 4096
+
+// open addressing over physical line numbers; slices never change for a line
+static struct {
+    u64 line; // pa >> CL_SHIFT plus one, 0 if empty
+    i32 slice;
+} *slice_memo;
+static size_t memo_cap, memo_cnt;
+
+static inline size_t memo_slot(u64 line) {
+    return (line * 0x9e3779b97f4a7c15ull) & (memo_cap - 1);
+}
+
+static i32 memo_get(uintptr_t pa) {
+    u64 line = (pa >> CL_SHIFT) + 1;
+    if (pa == (uintptr_t)-1 || !memo_cap) {
+        return -1;
+    }
+
+    for (size_t i = memo_slot(line); slice_memo[i].line;
+         i = (i + 1) & (memo_cap - 1)) {
+        if (slice_memo[i].line == line) {
+            return slice_memo[i].slice;
+        }
+    }
+    return -1;
+}
+
+static void memo_put(uintptr_t pa, i32 slice) {
+    if (pa == (uintptr_t)-1 || slice < 0) {
+        return;
+    }
+
+    if ((memo_cnt + 1) * 2 > memo_cap) {
+        size_t old_cap = memo_cap;
+        typeof(slice_memo) old = slice_memo;
+        memo_cap = old_cap ? old_cap * 2 : SLICE_MEMO_INIT_CAP;
+        slice_memo = _calloc(memo_cap, sizeof(*slice_memo));
+        if (!slice_memo) {
+            slice_memo = old;
+            memo_cap = old_cap;
+            return;
+        }
+
+        memo_cnt = 0;
+        for (size_t i = 0; i < old_cap; i++) {
+            if (old[i].line) {
+                memo_put((old[i].line - 1) << CL_SHIFT, old[i].slice);
+            }
+        }
+        _free(old);
+    }
+
+    u64 line = (pa >> CL_SHIFT) + 1;
+    size_t i = memo_slot(line);
+    while (slice_memo[i].line && slice_memo[i].line != line) {
+        i = (i + 1) & (memo_cap - 1);
+    }
+    memo_cnt += !slice_memo[i].line;
+    slice_memo[i].line = line;
+    slice_memo[i].slice = slice;
+}
+
 bool cache_oracle_init() {
     bool err = false;
+    // physical addresses only need root, so they survive a missing uncore PMU
+    if (!cache_oracle_pa_inited() && pagemap_init()) {
+        ptedit_inited = !ptedit_init();
+        if (!ptedit_inited) {
+            _error("Failed to initialized pteditor\n");
+        }
+    }
+
     if (!err && !msr_inited) {
         msr_inited = !msr_op_init(&msr, sched_getcpu());
         err = !msr_inited;
@@ -30,22 +104,19 @@ bool cache_oracle_init() {
         }
     }
 
-    if (!err && !ptedit_inited) {
-        ptedit_inited = !ptedit_init();
-        err = !ptedit_inited;
-        if (err) {
-            _error("Failed to initialized pteditor\n");
-        }
-    }
-
-    if (err) {
-        cache_oracle_cleanup();
+    if (err && msr_inited) {
+        msr_op_cleanup(&msr);
+        msr_inited = false;
     }
-    return err;
+    return err || !cache_oracle_pa_inited();
 }
 
 bool cache_oracle_inited() {
-    return msr_inited && cha_inited && ptedit_inited;
+    return msr_inited && cha_inited && cache_oracle_pa_inited();
+}
+
+bool cache_oracle_pa_inited() {
+    return pagemap_inited() || ptedit_inited;
 }
 
 void cache_oracle_cleanup() {
@@ -56,11 +127,21 @@ void cache_oracle_cleanup() {
     if (ptedit_inited) {
         ptedit_cleanup();
     }
+    pagemap_cleanup();
+    msr_inited = cha_inited = ptedit_inited = false;
+
+    _free(slice_memo);
+    slice_memo = NULL;
+    memo_cap = memo_cnt = 0;
 }
 
 uintptr_t cache_oracle_pa(void *addr) {
     ptedit_entry_t entry;
     uintptr_t pfn = 0, pa, offset_shift = PAGE_SHIFT, offset;
+    if (pagemap_inited()) {
+        return pagemap_pa(addr);
+    }
+
     if (!ptedit_inited) {
         return -1;
     }
@@ -85,6 +166,9 @@ uintptr_t cache_oracle_pa(void *addr) {
 
 i32 cache_set_idx(void *addr, cache_param *param) {
     uintptr_t pa = cache_oracle_pa(addr);
+    if (pa == (uintptr_t)-1) {
+        return -1;
+    }
     return (pa >> param->num_cl_bits) % param->n_sets;
 }
 
@@ -95,6 +179,12 @@ i32 cache_slice_idx(void *addr) {
         return -1;
     }
 
+    uintptr_t pa = cache_oracle_pa(addr);
+    i32 memo = memo_get(pa);
+    if (memo >= 0) {
+        return memo;
+    }
+
     intel_uncore_stop_pmon(&unc_ctrl);
     intel_cha_pmon_reset_all(&cha);
     intel_cha_pmon_set_event(&cha, 0, 0x50, 0x3, "Reads");
@@ -122,7 +212,194 @@ i32 cache_slice_idx(void *addr) {
               top, scd);
         return -1;
     }
+    memo_put(pa, cha_id);
     return cha_id;
 }
 
+/* Batched slice resolution */
+#define SLICE_BATCH_LINES 16 // keeps most CHAs at no more than one line
+#define SLICE_BATCH_REPS 200 // accesses per line and window
+#define SLICE_BATCH_ROUNDS 8
+
+static void read_cha_counters(u64 *cnts) {
+    for (u32 i = 0; i < cha.num_chas; i++) {
+        cnts[i] = intel_uncore_ctr_read(&cha.active_chas[i].base.counters[0]);
+    }
+}
+
+// access the lines whose index has "bit" set (all lines if bit < 0), and
+// count the reads every CHA has seen in units of SLICE_BATCH_REPS; -1 if a
+// count is too far off a multiple of it
+static void count_window(void **lines, u32 n, i32 bit, i32 *units) {
+    u64 before[INTEL_CHA_MAX_NUM_BLOCKS], after[INTEL_CHA_MAX_NUM_BLOCKS];
+    read_cha_counters(before);
+    for (u32 r = 0; r < SLICE_BATCH_REPS; r++) {
+        for (u32 j = 0; j < n; j++) {
+            if (bit >= 0 && !_TEST_BIT(j, bit)) continue;
+            _clflush(lines[j]);
+            _lfence();
+            _maccess((u8 *)lines[j]);
+            _lfence();
+        }
+    }
+    read_cha_counters(after);
+
+    for (u32 i = 0; i < cha.num_chas; i++) {
+        u64 cnt = (after[i] - before[i]) & INTEL_UNCORE_CTR_BIT_MASK;
+        u64 unit = (cnt + SLICE_BATCH_REPS / 2) / SLICE_BATCH_REPS;
+        u64 err = cnt > unit * SLICE_BATCH_REPS ? cnt - unit * SLICE_BATCH_REPS
+                                                : unit * SLICE_BATCH_REPS - cnt;
+        units[i] = err <= SLICE_BATCH_REPS / 4 ? (i32)unit : -1;
+    }
+}
+
+// one window tells how many of the lines each CHA serves; for a CHA with a
+// single line, one window per index bit spells out the index of that line
+static void resolve_round(void **lines, u32 n, i32 *slices) {
+    i32 total[INTEL_CHA_MAX_NUM_BLOCKS], units[INTEL_CHA_MAX_NUM_BLOCKS];
+    u32 idx[INTEL_CHA_MAX_NUM_BLOCKS] = {0}, n_bits = log2_ceil(n);
+    bool valid[INTEL_CHA_MAX_NUM_BLOCKS];
+
+    count_window(lines, n, -1, total);
+    for (u32 i = 0; i < cha.num_chas; i++) {
+        valid[i] = total[i] == 1;
+    }
+
+    for (u32 b = 0; b < n_bits; b++) {
+        count_window(lines, n, b, units);
+        for (u32 i = 0; i < cha.num_chas; i++) {
+            valid[i] &= units[i] == 0 || units[i] == 1;
+            idx[i] |= (units[i] == 1) << b;
+        }
+    }
+
+    for (u32 j = 0; j < n; j++) {
+        slices[j] = -1;
+    }
+
+    for (u32 i = 0; i < cha.num_chas; i++) {
+        if (!valid[i] || idx[i] >= n) continue;
+        // two CHAs claiming the same line means noise
+        slices[idx[i]] = slices[idx[i]] == -1 ? (i32)i : -2;
+    }
+}
+
+void cache_slice_idx_batch(void **addrs, size_t cnt, i32 *slices) {
+    uintptr_t *pas = _calloc(_max(cnt, 1), sizeof(*pas));
+    u32 *pending = _calloc(_max(cnt, 1), sizeof(*pending));
+    size_t n_pending = 0;
+    for (size_t i = 0; i < cnt; i++) {
+        slices[i] = -1;
+    }
+
+    if (!pas || !pending || !msr_inited || !cha_inited) {
+        goto out;
+    }
+
+    for (size_t i = 0; i < cnt; i++) {
+        pas[i] = cache_oracle_pa(addrs[i]);
+        slices[i] = memo_get(pas[i]);
+        if (slices[i] < 0) {
+            pending[n_pending++] = i;
+        }
+    }
+
+    if (!n_pending) {
+        goto out;
+    }
+
+    // program the CHAs once for all rounds
+    intel_uncore_stop_pmon(&unc_ctrl);
+    intel_cha_pmon_reset_all(&cha);
+    intel_cha_pmon_set_event(&cha, 0, 0x50, 0x3, "Reads");
+    intel_cha_pmon_write_control(&cha);
+    intel_uncore_start_pmon(&unc_ctrl);
+
+    // unresolved lines are retried along with the next batch
+    for (u32 round = 0; n_pending && round < SLICE_BATCH_ROUNDS; round++) {
+        size_t n_left = 0;
+        for (size_t start = 0; start < n_pending; start += SLICE_BATCH_LINES) {
+            u32 n = _min(n_pending - start, SLICE_BATCH_LINES);
+            void *lines[SLICE_BATCH_LINES];
+            i32 res[SLICE_BATCH_LINES];
+            for (u32 j = 0; j < n; j++) {
+                lines[j] = addrs[pending[start + j]];
+            }
+
+            resolve_round(lines, n, res);
+            for (u32 j = 0; j < n; j++) {
+                u32 k = pending[start + j];
+                if (res[j] >= 0) {
+                    slices[k] = res[j];
+                    memo_put(pas[k], res[j]);
+                } else {
+                    pending[n_left++] = k;
+                }
+            }
+        }
+
+        // shuffle to not group the same colliding lines again
+        for (size_t i = n_left; i > 1; i--) {
+            size_t j = rand() % i;
+            _swap(pending[i - 1], pending[j]);
+        }
+        n_pending = n_left;
+    }
+    intel_uncore_stop_pmon(&unc_ctrl);
+
+    for (size_t i = 0; i < n_pending; i++) {
+        slices[pending[i]] = cache_slice_idx(addrs[pending[i]]);
+    }
+
+out:
+    _free(pas);
+    _free(pending);
+}
+
+void llc_addr_hash_batch(void **addrs, size_t cnt, u64 *hashes) {
+    i32 *slices = _calloc(_max(cnt, 1), sizeof(*slices));
+    if (!slices) {
+        for (size_t i = 0; i < cnt; i++) {
+            hashes[i] = llc_addr_hash(addrs[i]);
+        }
+        return;
+    }
+
+    // the slice model answers without any counting
+    size_t n_left = 0;
+    void **left = (void **)_calloc(_max(cnt, 1), sizeof(*left));
+    for (size_t i = 0; i < cnt; i++) {
+        slices[i] = -1;
+        uintptr_t pa = cache_oracle_pa(addrs[i]);
+        if (cache_slice_model && pa != (uintptr_t)-1) {
+            slices[i] = slice_model_lookup(cache_slice_model, pa);
+        }
+        if (slices[i] < 0 && left) {
+            left[n_left++] = addrs[i];
+        }
+    }
+
+    if (left) {
+        i32 *res = _calloc(_max(n_left, 1), sizeof(*res));
+        if (res) {
+            cache_slice_idx_batch(left, n_left, res);
+            for (size_t i = 0, k = 0; i < cnt && k < n_left; i++) {
+                if (slices[i] < 0) {
+                    slices[i] = res[k++];
+                }
+            }
+        }
+        _free(res);
+    }
+    _free(left);
+
+    for (size_t i = 0; i < cnt; i++) {
+        i32 set_id = cache_set_idx(addrs[i], detected_l3);
+        hashes[i] = slices[i] == -1 || set_id == -1
+                        ? INVALID_ADDR_HASH
+                        : ((u64)slices[i] << 32) | (u64)set_id;
+    }
+    _free(slices);
+}
+
 #endif
@@ -2,7 +2,7 @@
 #include "cache/oracle.h"
 #include "sync.h"
 
-EVSet ***build_l2_evsets_all() {
+EVSet ***build_l2_evsets_all(size_t *n_evsets) {
     u64 start = time_ns();
     size_t l2_cnt;
     EVCands *l2_evcands =
@@ -39,7 +39,7 @@ EVSet ***build_l2_evsets_all() {
             l2_test += evset_self_test(evsets[i]) == EV_POS;
         }
 
-        if (l2_test != cache_uncertainty(detected_l2)) {
+        if (l2_test != l2_cnt) {
             goto l2_err;
         }
 
@@ -65,15 +65,18 @@ EVSet ***build_l2_evsets_all() {
         return NULL;
     }
 
-    if (cache_oracle_inited()) {
-        u32 cnts[16] = {0};
-        for (u32 i = 0; i < 16; i++) {
-            u32 l2_set = cache_set_idx(evsets[i]->addrs[0], detected_l2) >> 6;
-            cnts[l2_set] += 1;
+    if (cache_oracle_pa_inited()) {
+        // one evset per color, the set bits above the candidates' control
+        u32 cnts[l2_cnt], shift = l2_evcands->ctrl_bits - CL_SHIFT;
+        memset(cnts, 0, sizeof(cnts));
+        for (u32 i = 0; i < l2_cnt; i++) {
+            u32 l2_set = cache_set_idx(evsets[i]->addrs[0], detected_l2) >>
+                         shift;
+            if (l2_set < l2_cnt) cnts[l2_set] += 1;
         }
 
         bool succ = true;
-        for (u32 i = 0; i < 16; i++) {
+        for (u32 i = 0; i < l2_cnt; i++) {
             if (cnts[i] != 1) {
                 printf("No or multiple evset at set %#x (%u)\n", i, cnts[i]);
                 succ = false;
@@ -94,14 +97,17 @@ EVSet ***build_l2_evsets_all() {
     }
     u64 end = time_ns();
     _info("L2 Complex: %luus;\n", (end - start) / 1000);
+    *n_evsets = l2_cnt;
     return l2evset_complex;
 }
 
-EVCands ***build_evcands_all(EVBuildConfig *conf, EVSet ***l2evsets) {
-    u64 start, end, num_l2sets = cache_uncertainty(detected_l2);
+EVCands ***build_evcands_all(EVBuildConfig *conf, EVSet ***l2evsets,
+                             size_t n_l2evsets, size_t *n_colors) {
+    u64 start, end;
     start = time_ns();
     EVCands *base_cands = evcands_new(detected_l3, &conf->cands_config, NULL);
-    if (!base_cands) {
+    EVCands **colors = calloc(_max(n_l2evsets, 1), sizeof(*colors));
+    if (!base_cands || !colors) {
         _error("Failed to allocate EVB\n");
         return NULL;
     }
@@ -109,30 +115,44 @@ EVCands ***build_evcands_all(EVBuildConfig *conf, EVSet ***l2evsets) {
     _info("EVCands Complex Alloc: %luus;\n", (end - start) / 1000);
 
     start = time_ns();
+    size_t num_l2sets = n_l2evsets;
+    for (u32 i = 0; i < num_l2sets; i++) {
+        conf->cands_config.filter_ev = l2evsets[0][i];
+        colors[i] =
+            evcands_new(detected_l3, &conf->cands_config, base_cands->evb);
+        if (!colors[i] ||
+            evcands_populate(0x0, colors[i], &conf->cands_config)) {
+            return NULL;
+        }
+
+        // the L2 colors of the pages the pool actually got; population
+        // decides how the lines are laid out
+        if (i == 0) {
+            num_l2sets = evcands_uncertainty(colors[0], detected_l2);
+            if (num_l2sets > n_l2evsets) {
+                _warn("%lu L2 colors but %lu L2 evsets\n", num_l2sets,
+                      n_l2evsets);
+                num_l2sets = n_l2evsets;
+            }
+        }
+    }
+
     EVCands ***cands_complex = calloc(NUM_OFFSETS, sizeof(*cands_complex));
-    for (u32 n = 0; n < NUM_OFFSETS; n++) {
-        u32 offset = n * CL_SIZE;
-        cands_complex[n] = calloc(num_l2sets, sizeof(EVCands *));
+    if (!cands_complex) {
+        return NULL;
+    }
+    cands_complex[0] = colors;
+    for (u32 n = 1; n < NUM_OFFSETS; n++) {
+        cands_complex[n] = calloc(_max(num_l2sets, 1), sizeof(EVCands *));
+        if (!cands_complex[n]) {
+            return NULL;
+        }
         for (u32 i = 0; i < num_l2sets; i++) {
-            if (n == 0) {
-                conf->cands_config.filter_ev = l2evsets[n][i];
-                EVCands *cands = evcands_new(detected_l3, &conf->cands_config,
-                                             base_cands->evb);
-                if (!cands) {
-                    return NULL;
-                }
-
-                if (evcands_populate(offset, cands, &conf->cands_config)) {
-                    return NULL;
-                }
-                cands_complex[n][i] = cands;
-            } else {
-                cands_complex[n][i] =
-                    evcands_shift(cands_complex[0][i], offset);
-            }
+            cands_complex[n][i] = evcands_shift(colors[i], n * CL_SIZE);
         }
     }
     end = time_ns();
     _info("EVCands Complex Populate: %luus;\n", (end - start) / 1000);
+    *n_colors = num_l2sets;
     return cands_complex;
 }
@@ -0,0 +1,157 @@
+#include "cache/pagemap.h"
+#include "bitwise.h"
+#include "sugar.h"
+#include <pthread.h>
+
+#define MAX_PAGEMAP_RANGES 64
+
+static int pagemap_fd = -1;
+
+// registered buffers; pfns holds raw pagemap entries, read on the first lookup
+static struct {
+    u8 *start;
+    size_t n_pages;
+    u64 *pfns;
+} ranges[MAX_PAGEMAP_RANGES];
+static pthread_mutex_t ranges_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static bool read_entries(uintptr_t vaddr, u64 *ents, size_t cnt) {
+    size_t len = cnt * sizeof(*ents), done = 0;
+    off_t off = (vaddr >> PAGE_SHIFT) * sizeof(*ents);
+    while (done < len) {
+        ssize_t n = pread(pagemap_fd, (u8 *)ents + done, len - done, off + done);
+        if (n <= 0) {
+            return true;
+        }
+        done += n;
+    }
+    return false;
+}
+
+bool pagemap_init() {
+    if (pagemap_fd >= 0) {
+        return false;
+    }
+
+    pagemap_fd = open("/proc/self/pagemap", O_RDONLY);
+    if (pagemap_fd < 0) {
+        _error("Failed to open /proc/self/pagemap\n");
+        return true;
+    }
+
+    // the stack is present, so a zero PFN means that they are hidden from us
+    volatile u64 probe = 0;
+    u64 ent = 0;
+    if (read_entries((uintptr_t)&probe, &ent, 1) ||
+        !(ent & PAGEMAP_PRESENT) || !(ent & PAGEMAP_PFN_MASK)) {
+        _error("pagemap hides PFNs; it needs CAP_SYS_ADMIN\n");
+        pagemap_cleanup();
+        return true;
+    }
+    return false;
+}
+
+bool pagemap_inited() {
+    return pagemap_fd >= 0;
+}
+
+void pagemap_cleanup() {
+    pthread_mutex_lock(&ranges_lock);
+    for (u32 i = 0; i < MAX_PAGEMAP_RANGES; i++) {
+        _free(ranges[i].pfns);
+        ranges[i].start = NULL;
+        ranges[i].n_pages = 0;
+        ranges[i].pfns = NULL;
+    }
+    pthread_mutex_unlock(&ranges_lock);
+
+    if (pagemap_fd >= 0) {
+        close(pagemap_fd);
+        pagemap_fd = -1;
+    }
+}
+
+bool pagemap_cache_range(void *buf, size_t size) {
+    bool err = true;
+    pthread_mutex_lock(&ranges_lock);
+    for (u32 i = 0; i < MAX_PAGEMAP_RANGES; i++) {
+        if (!ranges[i].start) {
+            ranges[i].start = _ALIGN_DOWN((u8 *)buf, PAGE_SHIFT);
+            ranges[i].n_pages =
+                (_ALIGN_UP((u8 *)buf + size, PAGE_SHIFT) - ranges[i].start) >>
+                PAGE_SHIFT;
+            ranges[i].pfns = NULL;
+            err = false;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&ranges_lock);
+
+    if (err) {
+        _warn("Too many pagemap ranges, %p is resolved page by page\n", buf);
+    }
+    return err;
+}
+
+void pagemap_uncache_range(void *buf) {
+    u8 *start = _ALIGN_DOWN((u8 *)buf, PAGE_SHIFT);
+    pthread_mutex_lock(&ranges_lock);
+    for (u32 i = 0; i < MAX_PAGEMAP_RANGES; i++) {
+        if (ranges[i].start == start) {
+            _free(ranges[i].pfns);
+            ranges[i].start = NULL;
+            ranges[i].pfns = NULL;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&ranges_lock);
+}
+
+// the cached entry of "addr"; 0 if it is not in a range or the read failed
+static u64 cached_entry(uintptr_t addr) {
+    u64 ent = 0;
+    pthread_mutex_lock(&ranges_lock);
+    for (u32 i = 0; i < MAX_PAGEMAP_RANGES; i++) {
+        uintptr_t start = (uintptr_t)ranges[i].start;
+        if (!start || addr < start ||
+            addr >= start + (ranges[i].n_pages << PAGE_SHIFT)) {
+            continue;
+        }
+
+        if (!ranges[i].pfns) {
+            u64 *pfns = _calloc(ranges[i].n_pages, sizeof(*pfns));
+            if (!pfns || read_entries(start, pfns, ranges[i].n_pages)) {
+                _free(pfns);
+                break;
+            }
+            ranges[i].pfns = pfns;
+        }
+
+        // pages faulted in after the range was read are read again
+        u64 *slot = &ranges[i].pfns[(addr - start) >> PAGE_SHIFT];
+        if (!(*slot & PAGEMAP_PRESENT) && read_entries(addr, slot, 1)) {
+            *slot = 0;
+        }
+        ent = *slot;
+        break;
+    }
+    pthread_mutex_unlock(&ranges_lock);
+    return ent;
+}
+
+uintptr_t pagemap_pa(void *addr) {
+    if (pagemap_fd < 0) {
+        return -1;
+    }
+
+    u64 ent = cached_entry((uintptr_t)addr);
+    if (!(ent & PAGEMAP_PRESENT) && read_entries((uintptr_t)addr, &ent, 1)) {
+        return -1;
+    }
+
+    if (!(ent & PAGEMAP_PRESENT) || !(ent & PAGEMAP_PFN_MASK)) {
+        return -1;
+    }
+    return ((ent & PAGEMAP_PFN_MASK) << PAGE_SHIFT) |
+           ((uintptr_t)addr & (PAGE_SIZE - 1));
+}
@@ -0,0 +1,585 @@
+#include "cache/sim.h"
+#include "bitwise.h"
+#include "sugar.h"
+
+typedef struct {
+    sim_level_config cfg;
+    u32 n_slices;
+    u64 *lines; // line number plus one per way, 0 if invalid
+    u32 *meta;  // LRU stamps or QLRU ages per way
+    u64 *plru;  // tree bits per set, node i at bit i
+    u32 clock;
+} sim_cache;
+
+struct _cache_sim {
+    cache_sim_config cfg;
+    sim_cache l1d[SIM_MAX_CORES], l2[SIM_MAX_CORES], llc, sf;
+    bool linear_hash;
+    u64 rng;
+};
+
+static inline u64 mix64(u64 x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+static inline u64 sim_rand(cache_sim *sim) {
+    sim->rng ^= sim->rng >> 12;
+    sim->rng ^= sim->rng << 25;
+    sim->rng ^= sim->rng >> 27;
+    return sim->rng * 0x2545f4914f6cdd1dull;
+}
+
+static inline bool sim_chance(cache_sim *sim, double p) {
+    return p > 0 && (sim_rand(sim) >> 11) * 0x1.0p-53 < p;
+}
+
+/* A single set-associative cache */
+static bool sim_cache_init(sim_cache *c, sim_level_config *cfg, u32 n_slices) {
+    c->cfg = *cfg;
+    c->n_slices = n_slices;
+    if (!check_power_of_two(cfg->n_sets)) {
+        _error("Simulated caches need a power-of-two number of sets\n");
+        return true;
+    }
+
+    if (cfg->repl == SIM_REPL_PLRU &&
+        (!check_power_of_two(cfg->n_ways) || cfg->n_ways > 64)) {
+        _warn("Tree-PLRU needs 2^n ways, using LRU for %u ways\n",
+              cfg->n_ways);
+        c->cfg.repl = SIM_REPL_LRU;
+    }
+
+    size_t n_sets = (size_t)cfg->n_sets * n_slices;
+    c->lines = _calloc(n_sets * cfg->n_ways, sizeof(*c->lines));
+    c->meta = _calloc(n_sets * cfg->n_ways, sizeof(*c->meta));
+    c->plru = _calloc(n_sets, sizeof(*c->plru));
+    if (!c->lines || !c->meta || !c->plru) {
+        _error("Failed to allocate a simulated cache of %lu sets\n", n_sets);
+        return true;
+    }
+    return false;
+}
+
+static void sim_cache_release(sim_cache *c) {
+    _free(c->lines);
+    _free(c->meta);
+    _free(c->plru);
+}
+
+static void sim_cache_clear(sim_cache *c) {
+    size_t n_sets = (size_t)c->cfg.n_sets * c->n_slices;
+    if (c->lines) {
+        memset(c->lines, 0, n_sets * c->cfg.n_ways * sizeof(*c->lines));
+        memset(c->meta, 0, n_sets * c->cfg.n_ways * sizeof(*c->meta));
+        memset(c->plru, 0, n_sets * sizeof(*c->plru));
+    }
+    c->clock = 0;
+}
+
+static i32 sim_cache_find(sim_cache *c, u32 set, u64 line) {
+    u64 *lines = &c->lines[(size_t)set * c->cfg.n_ways];
+    for (u32 w = 0; w < c->cfg.n_ways; w++) {
+        if (lines[w] == line) {
+            return w;
+        }
+    }
+    return -1;
+}
+
+static void sim_cache_touch(sim_cache *c, u32 set, u32 way, bool insert) {
+    size_t idx = (size_t)set * c->cfg.n_ways + way;
+    switch (c->cfg.repl) {
+        case SIM_REPL_LRU: c->meta[idx] = ++c->clock; break;
+        case SIM_REPL_QLRU: c->meta[idx] = insert ? 2 : 0; break;
+        case SIM_REPL_PLRU: {
+            // point every node on the path away from the accessed way
+            u32 levels = log2_ceil(c->cfg.n_ways), node = 1;
+            for (i32 l = levels - 1; l >= 0; l--) {
+                u32 b = (way >> l) & 1;
+                if (b) {
+                    c->plru[set] &= ~(1ull << node);
+                } else {
+                    c->plru[set] |= 1ull << node;
+                }
+                node = node * 2 + b;
+            }
+            break;
+        }
+        default: break;
+    }
+}
+
+static u32 sim_cache_victim(cache_sim *sim, sim_cache *c, u32 set) {
+    u32 n_ways = c->cfg.n_ways;
+    size_t base = (size_t)set * n_ways;
+    for (u32 w = 0; w < n_ways; w++) {
+        if (!c->lines[base + w]) {
+            return w;
+        }
+    }
+
+    switch (c->cfg.repl) {
+        case SIM_REPL_LRU: {
+            u32 victim = 0;
+            for (u32 w = 1; w < n_ways; w++) {
+                if (c->meta[base + w] < c->meta[base + victim]) {
+                    victim = w;
+                }
+            }
+            return victim;
+        }
+        case SIM_REPL_QLRU:
+            while (true) {
+                for (u32 w = 0; w < n_ways; w++) {
+                    if (c->meta[base + w] >= 3) {
+                        return w;
+                    }
+                }
+                for (u32 w = 0; w < n_ways; w++) {
+                    c->meta[base + w] += 1;
+                }
+            }
+        case SIM_REPL_PLRU: {
+            u32 node = 1;
+            while (node < n_ways) {
+                node = node * 2 + _TEST_BIT(c->plru[set], node);
+            }
+            return node - n_ways;
+        }
+        default: return sim_rand(sim) % n_ways;
+    }
+}
+
+// returns the evicted line, 0 if none
+static u64 sim_cache_insert(cache_sim *sim, sim_cache *c, u32 set, u64 line) {
+    u32 way = sim_cache_victim(sim, c, set);
+    size_t idx = (size_t)set * c->cfg.n_ways + way;
+    u64 victim = c->lines[idx];
+    c->lines[idx] = line;
+    sim_cache_touch(c, set, way, true);
+    return victim;
+}
+
+static bool sim_cache_remove(sim_cache *c, u32 set, u64 line) {
+    i32 way = sim_cache_find(c, set, line);
+    if (way >= 0) {
+        c->lines[(size_t)set * c->cfg.n_ways + way] = 0;
+    }
+    return way >= 0;
+}
+
+/* Address mapping */
+static inline u64 line_of(u64 pa) {
+    return (pa >> CL_SHIFT) + 1;
+}
+
+static inline u64 pa_of(u64 line) {
+    return (line - 1) << CL_SHIFT;
+}
+
+u64 cache_sim_pa(cache_sim *sim, void *addr) {
+    u32 shift = sim->cfg.page_shift, frame_bits = SIM_PA_BITS - shift;
+    u64 va = (u64)addr;
+    u64 frame = mix64((va >> shift) ^ sim->cfg.seed) & _SHIFT_MASK(frame_bits);
+    return frame << shift | (va & _SHIFT_MASK(shift));
+}
+
+static u32 slice_of(cache_sim *sim, u64 pa) {
+    if (sim->cfg.n_slices <= 1) {
+        return 0;
+    }
+
+    if (!sim->linear_hash) {
+        return mix64((pa >> CL_SHIFT) ^ ~sim->cfg.seed) % sim->cfg.n_slices;
+    }
+
+    u32 slice = 0;
+    for (u32 b = 0; b < SIM_MAX_SLICE_BITS; b++) {
+        slice |= (_count_ones(pa & sim->cfg.slice_masks[b]) & 1) << b;
+    }
+    return slice % sim->cfg.n_slices;
+}
+
+u32 cache_sim_slice(cache_sim *sim, void *addr) {
+    return slice_of(sim, cache_sim_pa(sim, addr));
+}
+
+static inline u32 set_of(cache_sim *sim, sim_cache *c, u64 pa) {
+    u32 set = (pa >> CL_SHIFT) & (c->cfg.n_sets - 1);
+    return c->n_slices > 1 ? slice_of(sim, pa) * c->cfg.n_sets + set : set;
+}
+
+/* The hierarchy */
+static inline bool has_sf(cache_sim *sim) {
+    return sim->cfg.sf.n_ways > 0;
+}
+
+static void invalidate_private(cache_sim *sim, u64 pa) {
+    for (u32 c = 0; c < SIM_MAX_CORES; c++) {
+        sim_cache_remove(&sim->l1d[c], set_of(sim, &sim->l1d[c], pa),
+                         line_of(pa));
+        sim_cache_remove(&sim->l2[c], set_of(sim, &sim->l2[c], pa),
+                         line_of(pa));
+    }
+}
+
+static bool in_private(cache_sim *sim, u64 pa) {
+    for (u32 c = 0; c < SIM_MAX_CORES; c++) {
+        if (sim_cache_find(&sim->l2[c], set_of(sim, &sim->l2[c], pa),
+                           line_of(pa)) >= 0 ||
+            sim_cache_find(&sim->l1d[c], set_of(sim, &sim->l1d[c], pa),
+                           line_of(pa)) >= 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void fill_llc(cache_sim *sim, u64 pa) {
+    u32 set = set_of(sim, &sim->llc, pa);
+    i32 way = sim_cache_find(&sim->llc, set, line_of(pa));
+    if (way >= 0) {
+        sim_cache_touch(&sim->llc, set, way, false);
+        return;
+    }
+
+    // the LLC is inclusive of shared lines, see cache_sim_access()
+    u64 victim = sim_cache_insert(sim, &sim->llc, set, line_of(pa));
+    if (victim && (sim->cfg.inclusive_llc || in_private(sim, pa_of(victim)))) {
+        invalidate_private(sim, pa_of(victim));
+        if (has_sf(sim)) {
+            sim_cache_remove(&sim->sf, set_of(sim, &sim->sf, pa_of(victim)),
+                             victim);
+        }
+    }
+}
+
+// a snoop filter victim is back-invalidated; clean lines are not written
+// back, so the next access goes to memory
+static void sf_evict(cache_sim *sim, u64 victim) {
+    invalidate_private(sim, pa_of(victim));
+}
+
+static void l2_evict(cache_sim *sim, u32 core, u64 victim) {
+    u64 pa = pa_of(victim);
+    sim_cache_remove(&sim->l1d[core], set_of(sim, &sim->l1d[core], pa),
+                     victim);
+    if (sim->cfg.inclusive_llc || in_private(sim, pa)) {
+        return;
+    }
+
+    if (has_sf(sim)) {
+        sim_cache_remove(&sim->sf, set_of(sim, &sim->sf, pa), victim);
+    }
+    fill_llc(sim, pa);
+}
+
+// another agent evicts a random line of the set of "pa"
+static void inject_noise(cache_sim *sim, u64 pa) {
+    sim_cache *c = has_sf(sim) ? &sim->sf : &sim->llc;
+    u32 set = set_of(sim, c, pa);
+    size_t idx = (size_t)set * c->cfg.n_ways + sim_rand(sim) % c->cfg.n_ways;
+    u64 victim = c->lines[idx];
+    if (!victim) return;
+
+    c->lines[idx] = 0;
+    if (has_sf(sim)) {
+        sf_evict(sim, victim);
+    } else if (sim->cfg.inclusive_llc) {
+        invalidate_private(sim, pa_of(victim));
+    }
+}
+
+u32 cache_sim_access(cache_sim *sim, u32 core, void *addr) {
+    u64 pa = cache_sim_pa(sim, addr), line = line_of(pa);
+    sim_cache *l1d = &sim->l1d[core], *l2 = &sim->l2[core];
+    if (sim_chance(sim, sim->cfg.evict_noise)) {
+        inject_noise(sim, pa);
+    }
+
+    u32 set = set_of(sim, l1d, pa);
+    i32 way = sim_cache_find(l1d, set, line);
+    if (way >= 0) {
+        sim_cache_touch(l1d, set, way, false);
+        return l1d->cfg.lat;
+    }
+
+    u32 lat = sim->cfg.mem_lat;
+    u32 l2_set = set_of(sim, l2, pa);
+    way = sim_cache_find(l2, l2_set, line);
+    if (way >= 0) {
+        sim_cache_touch(l2, l2_set, way, false);
+        lat = l2->cfg.lat;
+    } else {
+        u32 sf_set = has_sf(sim) ? set_of(sim, &sim->sf, pa) : 0;
+        u32 llc_set = set_of(sim, &sim->llc, pa);
+        i32 sf_way = has_sf(sim) ? sim_cache_find(&sim->sf, sf_set, line) : -1;
+        if (sf_way >= 0) {
+            // forwarded from another core; shared lines are also kept in
+            // the LLC, which back-invalidates them on eviction
+            sim_cache_touch(&sim->sf, sf_set, sf_way, false);
+            fill_llc(sim, pa);
+            lat = sim->llc.cfg.lat;
+        } else {
+            i32 llc_way = sim_cache_find(&sim->llc, llc_set, line);
+            if (llc_way >= 0) {
+                lat = sim->llc.cfg.lat;
+                if (sim->cfg.inclusive_llc) {
+                    sim_cache_touch(&sim->llc, llc_set, llc_way, false);
+                } else {
+                    sim_cache_remove(&sim->llc, llc_set, line);
+                }
+            } else if (sim->cfg.inclusive_llc) {
+                fill_llc(sim, pa);
+            }
+
+            if (has_sf(sim)) {
+                u64 victim = sim_cache_insert(sim, &sim->sf, sf_set, line);
+                if (victim) sf_evict(sim, victim);
+            }
+        }
+
+        u64 victim = sim_cache_insert(sim, l2, l2_set, line);
+        if (victim) l2_evict(sim, core, victim);
+    }
+
+    sim_cache_insert(sim, l1d, set, line);
+    return lat;
+}
+
+void cache_sim_flush(cache_sim *sim, void *addr) {
+    u64 pa = cache_sim_pa(sim, addr);
+    invalidate_private(sim, pa);
+    if (has_sf(sim)) {
+        sim_cache_remove(&sim->sf, set_of(sim, &sim->sf, pa), line_of(pa));
+    }
+    sim_cache_remove(&sim->llc, set_of(sim, &sim->llc, pa), line_of(pa));
+}
+
+u64 cache_sim_time_access(cache_sim *sim, u32 core, void *addr) {
+    u64 lat = cache_sim_access(sim, core, addr);
+    return sim_chance(sim, sim->cfg.lat_noise) ? sim->cfg.mem_lat : lat;
+}
+
+/* Setup */
+void cache_sim_config_skx(cache_sim_config *config, u32 n_slices) {
+    *config = (cache_sim_config){
+        .l1d = {.n_sets = 64, .n_ways = 8, .repl = SIM_REPL_PLRU, .lat = 4},
+        .l2 = {.n_sets = 1024, .n_ways = 16, .repl = SIM_REPL_QLRU, .lat = 14},
+        .llc = {.n_sets = 2048, .n_ways = 11, .repl = SIM_REPL_QLRU, .lat = 70},
+        .sf = {.n_sets = 2048, .n_ways = SF_ASSOC, .repl = SIM_REPL_LRU,
+               .lat = 70},
+        .n_slices = n_slices,
+        .inclusive_llc = false,
+        .mem_lat = 250,
+        .page_shift = PAGE_SHIFT,
+        .seed = 1};
+}
+
+cache_sim *cache_sim_new(cache_sim_config *config) {
+    cache_sim *sim = _calloc(1, sizeof(*sim));
+    if (!sim) {
+        _error("Failed to allocate a cache simulator\n");
+        return NULL;
+    }
+
+    sim->cfg = *config;
+    sim->cfg.n_slices = _max(config->n_slices, 1);
+    for (u32 b = 0; b < SIM_MAX_SLICE_BITS; b++) {
+        sim->linear_hash |= config->slice_masks[b] != 0;
+    }
+
+    bool err = false;
+    for (u32 c = 0; c < SIM_MAX_CORES; c++) {
+        err = err || sim_cache_init(&sim->l1d[c], &config->l1d, 1) ||
+              sim_cache_init(&sim->l2[c], &config->l2, 1);
+    }
+    err = err || sim_cache_init(&sim->llc, &config->llc, sim->cfg.n_slices) ||
+          (has_sf(sim) &&
+           sim_cache_init(&sim->sf, &config->sf, sim->cfg.n_slices));
+    if (err) {
+        cache_sim_free(sim);
+        return NULL;
+    }
+
+    cache_sim_reset(sim);
+    return sim;
+}
+
+cache_sim *cache_sim_clone(cache_sim *sim) {
+    return cache_sim_new(&sim->cfg);
+}
+
+void cache_sim_free(cache_sim *sim) {
+    if (!sim) return;
+
+    for (u32 c = 0; c < SIM_MAX_CORES; c++) {
+        sim_cache_release(&sim->l1d[c]);
+        sim_cache_release(&sim->l2[c]);
+    }
+    sim_cache_release(&sim->llc);
+    sim_cache_release(&sim->sf);
+    _free(sim);
+}
+
+void cache_sim_reset(cache_sim *sim) {
+    for (u32 c = 0; c < SIM_MAX_CORES; c++) {
+        sim_cache_clear(&sim->l1d[c]);
+        sim_cache_clear(&sim->l2[c]);
+    }
+    sim_cache_clear(&sim->llc);
+    sim_cache_clear(&sim->sf);
+    sim->rng = mix64(sim->cfg.seed) | 1;
+}
+
+static sim_level_config *level_config(cache_sim *sim, u32 level) {
+    switch (level) {
+        case 1: return &sim->cfg.l1d;
+        case 2: return &sim->cfg.l2;
+        default: return &sim->cfg.llc;
+    }
+}
+
+u64 cache_sim_key(cache_sim *sim, u32 level, void *addr) {
+    u64 pa = cache_sim_pa(sim, addr);
+    u64 set = (pa >> CL_SHIFT) & (level_config(sim, level)->n_sets - 1);
+    return set << 32 | (level >= 3 ? slice_of(sim, pa) : 0);
+}
+
+void cache_sim_param(cache_sim *sim, u32 level, cache_param *param) {
+    sim_level_config *cfg = level_config(sim, level);
+    u32 n_slices = level >= 3 ? sim->cfg.n_slices : 1;
+    *param = (cache_param){
+        .level = level,
+        .type = level == 1 ? CACHE_DATA : CACHE_UNIF,
+        .inclusive = level >= 3 && sim->cfg.inclusive_llc,
+        .complex_idx = n_slices > 1,
+        .line_size = CL_SIZE,
+        .n_ways = cfg->n_ways,
+        .n_sets = cfg->n_sets,
+        .n_slices = n_slices,
+        .size = (u64)cfg->n_sets * cfg->n_ways * n_slices * CL_SIZE,
+        .num_cl_bits = CL_SHIFT,
+        .num_set_idx_bits = log2_ceil(cfg->n_sets)};
+}
+
+void cache_sim_latencies(cache_sim *sim, cache_latencies *lats) {
+    lats->l1d = sim->cfg.l1d.lat;
+    lats->l2 = sim->cfg.l2.lat;
+    lats->l3 = sim->cfg.llc.lat;
+    lats->dram = sim->cfg.mem_lat;
+    lats->l1d_thresh = calc_hit_threshold(lats->l1d, lats->l2);
+    lats->l2_thresh = calc_hit_threshold(lats->l2, lats->l3);
+    lats->l3_thresh = calc_hit_threshold(lats->l3, lats->dram);
+    lats->interrupt_thresh = lats->dram * 5;
+}
+
+void cache_sim_env_init(cache_sim *sim) {
+    detected_caches.num_caches = 3;
+    for (u32 i = 0; i < 3; i++) {
+        cache_sim_param(sim, i + 1, &detected_caches.caches[i]);
+    }
+
+    // there is no simulated L1i; it mirrors the L1d
+    detected_l1d = detected_l1i = &detected_caches.caches[0];
+    detected_l2 = &detected_caches.caches[1];
+    detected_l3 = &detected_caches.caches[2];
+    cache_sim_latencies(sim, &detected_cache_lats);
+
+    default_l1d_evset_build_config(&def_l1d_ev_config);
+    default_l2_evset_build_config(&def_l2_ev_config);
+    def_l1d_ev_config.test_config.sim = sim;
+    def_l2_ev_config.test_config.sim = sim;
+}
+
+/* Eviction trials */
+void cache_sim_traverse(cache_sim *sim, u32 core, u8 **cands, size_t cnt,
+                        EVTestConfig *tconf) {
+    for (u32 r = 0; r < _max(tconf->ev_repeat, 1); r++) {
+        for (size_t i = cnt; i-- > 0;) {
+            cache_sim_access(sim, core, cands[i]);
+        }
+    }
+}
+
+static void load_target(cache_sim *sim, u8 *target, EVTestConfig *tconf) {
+    cache_sim_access(sim, 0, target);
+    if (tconf->need_helper) {
+        cache_sim_access(sim, 1, target);
+        cache_sim_access(sim, 0, target);
+    }
+}
+
+// the helper thread traverses the candidates as well, which makes them shared
+// and so kept in the LLC. Like skx_sf_cands_traverse_mt(), fewer candidates
+// than L2 ways are pushed out of the L2 by the lower evset and accessed again
+static void traverse_cands(cache_sim *sim, u8 **cands, size_t cnt,
+                           EVTestConfig *tconf) {
+    u32 core = tconf->foreign_evictor ? 1 : 0;
+    cache_sim_traverse(sim, core, cands, cnt, tconf);
+    if (tconf->need_helper) {
+        cache_sim_traverse(sim, 1 - core, cands, cnt, tconf);
+    }
+
+    EVSet *lower = tconf->lower_ev;
+    if (lower && cnt < sim->cfg.l2.n_ways) {
+        cache_sim_traverse(sim, core, lower->addrs, lower->size,
+                           &lower->config->test_config);
+        cache_sim_traverse(sim, core, cands, cnt, tconf);
+    }
+}
+
+static void traverse_lower(cache_sim *sim, EVTestConfig *tconf) {
+    EVSet *lower = tconf->lower_ev;
+    if (lower) {
+        cache_sim_traverse(sim, 0, lower->addrs, lower->size,
+                           &lower->config->test_config);
+    }
+}
+
+u64 cache_sim_eviction_trial(cache_sim *sim, u8 *target, u8 **cands,
+                             size_t cnt, EVTestConfig *tconf, bool evict) {
+    cache_sim_flush(sim, target);
+    for (size_t i = 0; tconf->flush_cands && i < cnt; i++) {
+        cache_sim_flush(sim, cands[i]);
+    }
+
+    for (u32 j = 0; j < tconf->access_cnt; j++) {
+        traverse_lower(sim, tconf);
+        load_target(sim, target, tconf);
+    }
+
+    if (evict) {
+        cache_sim_flush(sim, target);
+    } else {
+        traverse_cands(sim, cands, cnt, tconf);
+    }
+    return cache_sim_time_access(sim, 0, target);
+}
+
+void cache_sim_batch_trial(cache_sim *sim, u8 **targets, u32 sz, u8 **addrs,
+                           size_t acc_cnt, EVTestConfig *tconf, u32 *otcs) {
+    for (u32 i = 0; i < sz; i++) {
+        cache_sim_flush(sim, targets[i]);
+    }
+    for (size_t i = 0; tconf->flush_cands && i < acc_cnt; i++) {
+        cache_sim_flush(sim, addrs[i]);
+    }
+
+    for (u32 j = 0; j < tconf->access_cnt; j++) {
+        traverse_lower(sim, tconf);
+        for (u32 i = 0; i < sz; i++) {
+            load_target(sim, targets[i], tconf);
+        }
+    }
+
+    traverse_cands(sim, addrs, acc_cnt, tconf);
+    for (u32 i = 0; i < sz; i++) {
+        otcs[i] += cache_sim_time_access(sim, 0, targets[i]) >=
+                   (u64)tconf->lat_thresh;
+    }
+}
@@ -0,0 +1,277 @@
+#include "cache/slice_model.h"
+#include "cache/oracle.h"
+#include "bitwise.h"
+#include "sugar.h"
+#include <stdio.h>
+#include <unistd.h>
+
+#define SLICE_MODEL_VARS (SLICE_MODEL_PA_BITS - CL_SHIFT)
+
+slice_model *cache_slice_model = NULL;
+
+static u32 cpu_signature() {
+    cpuid_query cpuid = {.eax = 1};
+    _cpuid(&cpuid);
+    return cpuid.eax;
+}
+
+slice_model *slice_model_new(u32 n_slices) {
+    slice_model *m = _calloc(1, sizeof(*m));
+    if (!m) {
+        _error("Failed to allocate slice model\n");
+        return NULL;
+    }
+
+    m->cpu_sig = cpu_signature();
+    m->n_slices = n_slices;
+    m->kind = check_power_of_two(n_slices) ? SLICE_MODEL_LINEAR
+                                           : SLICE_MODEL_TABLE;
+    m->n_bits = log2_ceil(n_slices);
+    if (m->n_bits > SLICE_MODEL_MAX_BITS) {
+        _error("Too many slices for a slice model: %u\n", n_slices);
+        _free(m);
+        return NULL;
+    }
+    return m;
+}
+
+void slice_model_free(slice_model *m) {
+    if (m) {
+        _free(m->ents);
+        _free(m);
+    }
+}
+
+static inline u64 parity(u64 val) {
+    return _count_ones(val) & 1;
+}
+
+// solve parity(pa & mask) == bit "bit" of the slice over all samples by
+// Gaussian elimination; free variables are 0. Returns true if inconsistent
+static bool solve_mask(u64 *pas, u32 *slices, size_t n, u32 bit, u64 *mask) {
+    u64 rows[SLICE_MODEL_VARS] = {0}, rhs[SLICE_MODEL_VARS] = {0};
+    for (size_t i = 0; i < n; i++) {
+        u64 row = (pas[i] >> CL_SHIFT) & _SHIFT_MASK(SLICE_MODEL_VARS);
+        u64 r = (slices[i] >> bit) & 1;
+        for (i32 b = SLICE_MODEL_VARS - 1; b >= 0 && row; b--) {
+            if (!_TEST_BIT(row, b)) continue;
+            if (!rows[b]) {
+                rows[b] = row;
+                rhs[b] = r;
+                row = 0;
+                r = 0;
+                break;
+            }
+            row ^= rows[b];
+            r ^= rhs[b];
+        }
+
+        if (r) {
+            return true;
+        }
+    }
+
+    // pivots only have lower bits set, so solve from the bottom up
+    u64 x = 0;
+    for (u32 b = 0; b < SLICE_MODEL_VARS; b++) {
+        if (rows[b] && (rhs[b] ^ parity(rows[b] & x & ~(1ull << b)))) {
+            x |= 1ull << b;
+        }
+    }
+    *mask = x << CL_SHIFT;
+    return false;
+}
+
+static int ent_cmp(const void *a, const void *b) {
+    u64 la = ((slice_model_ent *)a)->line, lb = ((slice_model_ent *)b)->line;
+    return la < lb ? -1 : la > lb;
+}
+
+static bool merge_table(slice_model *m, u64 *pas, u32 *slices, size_t n) {
+    if (m->n_ents + n > m->cap) {
+        size_t cap = _max(m->cap * 2, m->n_ents + n);
+        slice_model_ent *ents = realloc(m->ents, cap * sizeof(*ents));
+        if (!ents) {
+            _error("Failed to grow the slice table to %lu\n", cap);
+            return true;
+        }
+        m->ents = ents;
+        m->cap = cap;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        m->ents[m->n_ents++] =
+            (slice_model_ent){.line = pas[i] >> CL_SHIFT, .slice = slices[i]};
+    }
+
+    qsort(m->ents, m->n_ents, sizeof(*m->ents), ent_cmp);
+    size_t cnt = 0;
+    for (size_t i = 0; i < m->n_ents; i++) {
+        if (cnt && m->ents[cnt - 1].line == m->ents[i].line) {
+            m->ents[cnt - 1] = m->ents[i];
+        } else {
+            m->ents[cnt++] = m->ents[i];
+        }
+    }
+    m->n_ents = cnt;
+    return false;
+}
+
+bool slice_model_fit(slice_model *m, u64 *pas, u32 *slices, size_t n) {
+    if (m->kind == SLICE_MODEL_LINEAR) {
+        u64 masks[SLICE_MODEL_MAX_BITS] = {0};
+        bool linear = true;
+        for (u32 b = 0; b < m->n_bits && linear; b++) {
+            linear = !solve_mask(pas, slices, n, b, &masks[b]);
+        }
+
+        if (linear) {
+            memcpy(m->masks, masks, sizeof(masks));
+            return false;
+        }
+
+        // e.g., the CHA numbering is not the hash output
+        _warn("The slice hash is not XOR-linear, keeping a table instead\n");
+        m->kind = SLICE_MODEL_TABLE;
+    }
+    return merge_table(m, pas, slices, n);
+}
+
+bool slice_model_learn(slice_model *m, u8 *buf, size_t size, size_t n_samples) {
+    if (!cache_oracle_inited()) {
+        _error("Learning the slice hash needs the CHA oracle\n");
+        return true;
+    }
+
+    u64 *pas = _calloc(n_samples, sizeof(*pas));
+    u32 *slices = _calloc(n_samples, sizeof(*slices));
+    if (!pas || !slices) {
+        _error("Failed to allocate %lu slice samples\n", n_samples);
+        _free(pas);
+        _free(slices);
+        return true;
+    }
+
+    size_t n = 0, n_lines = size >> CL_SHIFT;
+    for (size_t i = 0; i < n_samples; i++) {
+        u8 *addr = buf + ((u64)rand() % n_lines << CL_SHIFT);
+        uintptr_t pa = cache_oracle_pa(addr);
+        i32 slice = cache_slice_idx(addr);
+        if (pa != (uintptr_t)-1 && slice >= 0 && (u32)slice < m->n_slices) {
+            pas[n] = pa;
+            slices[n++] = slice;
+        }
+    }
+    _info("Sampled the slices of %lu of %lu lines\n", n, n_samples);
+
+    bool err = !n || slice_model_fit(m, pas, slices, n);
+    _free(pas);
+    _free(slices);
+    return err;
+}
+
+i32 slice_model_lookup(slice_model *m, u64 pa) {
+    if (m->kind == SLICE_MODEL_LINEAR) {
+        u32 slice = 0;
+        for (u32 b = 0; b < m->n_bits; b++) {
+            slice |= parity(pa & m->masks[b]) << b;
+        }
+        return slice < m->n_slices ? (i32)slice : -1;
+    }
+
+    slice_model_ent key = {.line = pa >> CL_SHIFT};
+    slice_model_ent *ent =
+        bsearch(&key, m->ents, m->n_ents, sizeof(*m->ents), ent_cmp);
+    return ent ? (i32)ent->slice : -1;
+}
+
+void slice_model_path(char *path, size_t len, const char *dir, u32 n_slices) {
+    snprintf(path, len, "%s/slice-%08x-%u.model", dir, cpu_signature(),
+             n_slices);
+}
+
+bool slice_model_save(slice_model *m, const char *dir) {
+    char path[4096], tmp_path[4200];
+    slice_model_path(path, sizeof(path), dir, m->n_slices);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE *fp = fopen(tmp_path, "wb");
+    if (!fp) {
+        _error("Failed to open %s\n", tmp_path);
+        return true;
+    }
+
+    u32 hdr[6] = {SLICE_MODEL_MAGIC, SLICE_MODEL_VERSION, m->cpu_sig,
+                  m->n_slices, m->kind, m->n_bits};
+    u64 n_ents = m->n_ents;
+    bool err = fwrite(hdr, sizeof(hdr), 1, fp) != 1 ||
+               fwrite(m->masks, sizeof(m->masks), 1, fp) != 1 ||
+               fwrite(&n_ents, sizeof(n_ents), 1, fp) != 1 ||
+               fwrite(m->ents, sizeof(*m->ents), n_ents, fp) != n_ents;
+
+    err |= fclose(fp) != 0;
+    if (err || rename(tmp_path, path)) {
+        _error("Failed to write slice model %s\n", path);
+        unlink(tmp_path);
+        return true;
+    }
+    return false;
+}
+
+slice_model *slice_model_load(const char *dir, u32 n_slices) {
+    char path[4096];
+    slice_model_path(path, sizeof(path), dir, n_slices);
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        return NULL;
+    }
+
+    slice_model *m = NULL;
+    u32 hdr[6];
+    u64 n_ents;
+    if (fread(hdr, sizeof(hdr), 1, fp) != 1) {
+        goto corrupted;
+    }
+
+    if (hdr[0] != SLICE_MODEL_MAGIC || hdr[1] != SLICE_MODEL_VERSION ||
+        hdr[2] != cpu_signature() || hdr[3] != n_slices) {
+        _warn("%s is not a compatible slice model\n", path);
+        goto err;
+    }
+
+    m = slice_model_new(n_slices);
+    if (!m) goto err;
+
+    m->kind = hdr[4];
+    if (hdr[5] != m->n_bits ||
+        (m->kind != SLICE_MODEL_LINEAR && m->kind != SLICE_MODEL_TABLE) ||
+        fread(m->masks, sizeof(m->masks), 1, fp) != 1 ||
+        fread(&n_ents, sizeof(n_ents), 1, fp) != 1) {
+        goto corrupted;
+    }
+
+    // the entries must fit in the rest of the file before we allocate them
+    long pos = ftell(fp), end;
+    if (pos < 0 || fseek(fp, 0, SEEK_END) || (end = ftell(fp)) < pos ||
+        fseek(fp, pos, SEEK_SET) || n_ents > SLICE_MODEL_MAX_ENTS ||
+        n_ents * sizeof(*m->ents) > (u64)(end - pos)) {
+        goto corrupted;
+    }
+
+    m->ents = _calloc(_max(n_ents, 1), sizeof(*m->ents));
+    if (!m->ents) goto err;
+    m->cap = _max(n_ents, 1);
+    if (fread(m->ents, sizeof(*m->ents), n_ents, fp) != n_ents) {
+        goto corrupted;
+    }
+    m->n_ents = n_ents;
+
+    fclose(fp);
+    return m;
+
+corrupted:
+    _warn("%s is corrupted\n", path);
+err:
+    slice_model_free(m);
+    fclose(fp);
+    return NULL;
+}
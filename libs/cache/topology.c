@@ -0,0 +1,234 @@
+#include "cache/topology.h"
+#include "sugar.h"
+#include <pthread.h>
+#include <stdio.h>
+
+#define SYSFS_CPU "/sys/devices/system/cpu"
+
+static int read_int(const char *path) {
+    int val = -1;
+    FILE *fp = fopen(path, "r");
+    if (fp) {
+        if (fscanf(fp, "%d", &val) != 1) val = -1;
+        fclose(fp);
+    }
+    return val;
+}
+
+// the lowest CPU sharing the L3 (or the last level) with "cpu"
+static int read_llc(int cpu) {
+    char path[128];
+    int llc = -1, best = -1;
+    for (int idx = 0; idx < 16; idx++) {
+        snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/cache/index%d/level",
+                 cpu, idx);
+        int level = read_int(path);
+        if (level < 0) break;
+        if (level > best) {
+            snprintf(path, sizeof(path),
+                     SYSFS_CPU "/cpu%d/cache/index%d/shared_cpu_list", cpu, idx);
+            best = level;
+            llc = read_int(path);
+        }
+    }
+    return llc;
+}
+
+bool cpu_topology_detect(cpu_topology *topo) {
+    char path[128];
+    topo->n_cpus = 0;
+    topo->cpus = _calloc(CPU_SETSIZE, sizeof(*topo->cpus));
+    if (!topo->cpus) {
+        return true;
+    }
+
+    for (int c = 0; c < CPU_SETSIZE; c++) {
+        cpu_place *p = &topo->cpus[c];
+        snprintf(path, sizeof(path),
+                 SYSFS_CPU "/cpu%d/topology/physical_package_id", c);
+        p->pkg = read_int(path);
+        snprintf(path, sizeof(path),
+                 SYSFS_CPU "/cpu%d/topology/thread_siblings_list", c);
+        p->core = read_int(path); // cpu lists are sorted
+        p->l3 = read_llc(c);
+        if (p->pkg < 0 || p->core < 0) {
+            p->pkg = -1;
+            continue;
+        }
+        if (p->l3 < 0) {
+            p->l3 = p->pkg; // no cache info, assume one LLC per package
+        }
+        topo->n_cpus = c + 1;
+    }
+
+    if (!topo->n_cpus) {
+        cpu_topology_free(topo);
+        return true;
+    }
+    return false;
+}
+
+void cpu_topology_free(cpu_topology *topo) {
+    _free(topo->cpus);
+    topo->cpus = NULL;
+    topo->n_cpus = 0;
+}
+
+static cpu_topology _topo;
+static bool _topo_ok;
+static pthread_once_t _topo_once = PTHREAD_ONCE_INIT;
+
+static void topo_init() {
+    _topo_ok = !cpu_topology_detect(&_topo);
+    if (!_topo_ok) {
+        _warn("Failed to read the CPU topology from sysfs\n");
+    }
+}
+
+const cpu_topology *cpu_topology_get() {
+    pthread_once(&_topo_once, topo_init);
+    return _topo_ok ? &_topo : NULL;
+}
+
+// how many picked groups and helper pairs use each CPU
+static u32 _claims[CPU_SETSIZE];
+static pthread_mutex_t _claim_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static bool core_claimed(const cpu_topology *topo, int core) {
+    for (u32 c = 0; c < topo->n_cpus; c++) {
+        if (_claims[c] && topo->cpus[c].core == core) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// the first allowed, unclaimed CPU on a free core of LLC "l3" (any LLC if
+// negative), other than the core "skip_core"
+static int find_cpu(const cpu_topology *topo, const cpu_set_t *allowed,
+                    int l3, int skip_core) {
+    for (u32 c = 0; c < topo->n_cpus; c++) {
+        cpu_place *p = &topo->cpus[c];
+        if (p->pkg < 0 || !CPU_ISSET(c, allowed) || p->core == skip_core ||
+            (l3 >= 0 && p->l3 != l3) || core_claimed(topo, p->core)) {
+            continue;
+        }
+        return c;
+    }
+    return -1;
+}
+
+static bool pick_in_order(const cpu_set_t *allowed, u32 n, int *cores) {
+    u32 cnt = 0;
+    for (int c = 0; c < CPU_SETSIZE && cnt < n; c++) {
+        if (CPU_ISSET(c, allowed) && !_claims[c]) {
+            cores[cnt++] = c;
+        }
+    }
+    if (cnt < n) {
+        _error("%u cores are needed, but only %u are available\n", n, cnt);
+        return true;
+    }
+    for (u32 i = 0; i < n; i++) {
+        _claims[cores[i]] += 1;
+    }
+    return false;
+}
+
+bool cpu_topology_pick(u32 n_groups, u32 group_size, int *cores) {
+    const cpu_topology *topo = cpu_topology_get();
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed)) {
+        _error("Failed to get the CPU affinity\n");
+        return true;
+    }
+
+    pthread_mutex_lock(&_claim_lock);
+    bool err = false;
+    if (!topo) {
+        err = pick_in_order(&allowed, n_groups * group_size, cores);
+        goto out;
+    }
+
+    for (u32 g = 0; g < n_groups && !err; g++) {
+        int *group = &cores[g * group_size];
+        // try every LLC in turn, each by its lowest CPU
+        err = true;
+        for (u32 first = 0; first < topo->n_cpus && err; first++) {
+            cpu_place *p = &topo->cpus[first];
+            if (p->pkg < 0 || p->l3 != (int)first) {
+                continue;
+            }
+
+            u32 n = 0;
+            for (; n < group_size; n++) {
+                group[n] = find_cpu(topo, &allowed, p->l3, -1);
+                if (group[n] < 0) break;
+                _claims[group[n]] += 1;
+            }
+            err = n < group_size;
+            for (u32 i = 0; err && i < n; i++) {
+                _claims[group[i]] -= 1;
+            }
+        }
+
+        if (err) {
+            _error("No LLC has %u free physical cores for group %u; restrict "
+                   "the CPUs with taskset or use fewer threads\n",
+                   group_size, g);
+            for (u32 i = 0; i < g * group_size; i++) {
+                _claims[cores[i]] -= 1;
+            }
+        }
+    }
+
+out:
+    pthread_mutex_unlock(&_claim_lock);
+    return err;
+}
+
+int cpu_topology_claim_helper(int *main_cpu) {
+    const cpu_topology *topo = cpu_topology_get();
+    cpu_set_t allowed;
+    *main_cpu = sched_getcpu();
+    if (!cpu_topology_known(topo, *main_cpu) ||
+        sched_getaffinity(0, sizeof(allowed), &allowed)) {
+        return -1;
+    }
+
+    cpu_place *m = &topo->cpus[*main_cpu];
+    pthread_mutex_lock(&_claim_lock);
+    int helper = find_cpu(topo, &allowed, m->l3, m->core);
+    if (helper >= 0) {
+        _claims[helper] += 1;
+        _claims[*main_cpu] += 1;
+    }
+    pthread_mutex_unlock(&_claim_lock);
+
+    static bool warned = false;
+    if (helper < 0) {
+        if (!warned) {
+            _warn("No free core shares the LLC of CPU %d; the helper thread "
+                  "is not pinned\n", *main_cpu);
+            warned = true;
+        }
+        return -1;
+    }
+
+    // keep the main thread where the pair was picked
+    CPU_ZERO(&allowed);
+    CPU_SET(*main_cpu, &allowed);
+    if (sched_setaffinity(0, sizeof(allowed), &allowed)) {
+        _warn("Failed to pin the main thread to CPU %d\n", *main_cpu);
+    }
+    return helper;
+}
+
+void cpu_topology_release(int cpu) {
+    if (cpu < 0 || cpu >= CPU_SETSIZE) return;
+    pthread_mutex_lock(&_claim_lock);
+    if (_claims[cpu]) {
+        _claims[cpu] -= 1;
+    }
+    pthread_mutex_unlock(&_claim_lock);
+}
@@ -0,0 +1,193 @@
+#include "cache/trace.h"
+#include "cache/cache_param.h"
+#include "sugar.h"
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+volatile bool _evtrace_on = false;
+
+// a single-producer ring; only its owner thread writes events and head
+typedef struct _evtrace_ring {
+    evtrace_event *evs;
+    u64 mask;
+    volatile u64 head; // total events recorded
+    pid_t tid;
+    u32 gen; // rings of an older generation are no longer used or dumped
+    struct _evtrace_ring *next;
+} evtrace_ring;
+
+static __thread evtrace_ring *_ring;
+static __thread u32 _ring_gen;
+static evtrace_ring *_rings;
+static u32 _ring_cap, _gen = 1;
+static pthread_mutex_t _rings_lock = PTHREAD_MUTEX_INITIALIZER;
+
+bool evtrace_start(u32 cap) {
+    pthread_mutex_lock(&_rings_lock);
+    cap = 1u << log2_ceil(_max(cap, 16u));
+    if (cap != _ring_cap) {
+        // threads allocate new rings on their next event
+        _ring_cap = cap;
+        _gen += 1;
+    }
+    for (evtrace_ring *r = _rings; r; r = r->next) {
+        r->head = 0;
+    }
+    pthread_mutex_unlock(&_rings_lock);
+    _evtrace_on = true;
+    return false;
+}
+
+void evtrace_stop() {
+    _evtrace_on = false;
+}
+
+// the rings are freed without synchronizing with their owners, see trace.h
+void evtrace_cleanup() {
+    evtrace_stop();
+    pthread_mutex_lock(&_rings_lock);
+    for (evtrace_ring *r = _rings, *next; r; r = next) {
+        next = r->next;
+        _free(r->evs);
+        _free(r);
+    }
+    _rings = NULL;
+    _gen += 1;
+    pthread_mutex_unlock(&_rings_lock);
+}
+
+// the calling thread's ring, allocated and registered on first use
+static evtrace_ring *ring_get() {
+    // a ring of a stale generation may already have been freed
+    if (_ring && _ring_gen == _gen) {
+        return _ring;
+    }
+
+    evtrace_ring *r = _calloc(1, sizeof(*r));
+    if (!r) return NULL;
+
+    pthread_mutex_lock(&_rings_lock);
+    r->evs = _calloc(_ring_cap, sizeof(*r->evs));
+    if (!r->evs) {
+        pthread_mutex_unlock(&_rings_lock);
+        _free(r);
+        return NULL;
+    }
+    r->mask = _ring_cap - 1;
+    r->gen = _gen;
+    r->tid = syscall(SYS_gettid);
+    r->next = _rings;
+    _rings = r;
+    _ring_gen = r->gen;
+    pthread_mutex_unlock(&_rings_lock);
+    return _ring = r;
+}
+
+void _evtrace_record(evtrace_kind kind, evtrace_phase phase, u64 ts, u64 dur,
+                     u64 a0, u64 a1, u64 a2) {
+    evtrace_ring *r = ring_get();
+    if (!r) return;
+
+    u64 head = r->head;
+    r->evs[head & r->mask] = (evtrace_event){.ts = ts,
+                                             .dur = dur,
+                                             .kind = kind,
+                                             .phase = phase,
+                                             .core = sched_getcpu(),
+                                             .args = {a0, a1, a2}};
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
+
+u64 evtrace_count() {
+    u64 cnt = 0;
+    pthread_mutex_lock(&_rings_lock);
+    for (evtrace_ring *r = _rings; r; r = r->next) {
+        cnt += __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    }
+    pthread_mutex_unlock(&_rings_lock);
+    return cnt;
+}
+
+/* Chrome trace export */
+static const char *phase_names[] = {"alloc",   "population", "build",
+                                    "attempt", "pruning",    "extension"};
+// indexed by helper_thread_action
+static const char *helper_actions[] = {"stop", "read_single", "time_single",
+                                       "read_array", "traverse_cands",
+                                       "locate"};
+
+static void write_event(FILE *out, evtrace_event *ev, pid_t pid, pid_t tid) {
+    const char *name = "?";
+    u64 *a = ev->args;
+    switch (ev->kind) {
+        case EVTRACE_TEST: name = "test"; break;
+        case EVTRACE_HELPER:
+            name = a[0] < _array_size(helper_actions) ? helper_actions[a[0]]
+                                                      : "?";
+            break;
+        case EVTRACE_PHASE:
+            name = ev->phase < _array_size(phase_names)
+                       ? phase_names[ev->phase]
+                       : "?";
+            break;
+        case EVTRACE_BACKTRACK: name = "backtrack"; break;
+    }
+
+    fprintf(out, "{\"name\": \"%s\", \"cat\": \"evset\", ", name);
+    if (ev->kind != EVTRACE_BACKTRACK) {
+        fprintf(out, "\"ph\": \"X\", \"dur\": %.3f, ", ev->dur / 1e3);
+    } else {
+        fprintf(out, "\"ph\": \"i\", \"s\": \"t\", ");
+    }
+    fprintf(out, "\"ts\": %.3f, \"pid\": %d, \"tid\": %d, \"args\": {",
+            ev->ts / 1e3, pid, tid);
+
+    switch (ev->kind) {
+        case EVTRACE_TEST:
+            fprintf(out, "\"cands\": %lu, \"res\": %ld, \"otc\": %lu, ", a[0],
+                    (i64)a[1], a[2]);
+            break;
+        case EVTRACE_PHASE:
+            if (ev->phase == EVTRACE_PH_ATTEMPT) {
+                fprintf(out, "\"retry\": %lu, \"backtracks\": %lu, "
+                             "\"evicts\": %lu, ", a[0], a[1], a[2]);
+            } else if (a[0]) {
+                fprintf(out, "\"size\": %lu, ", a[0]);
+            }
+            break;
+        case EVTRACE_HELPER:
+            fprintf(out, "\"cnt\": %lu, \"helpers\": %lu, ", a[1],
+                    _max(a[2], 1ul));
+            break;
+        case EVTRACE_BACKTRACK:
+            fprintf(out, "\"upper\": %lu, \"evsz\": %lu, ", a[0], a[1]);
+            break;
+        default: break;
+    }
+    fprintf(out, "\"core\": %u}}", ev->core);
+}
+
+bool evtrace_write_chrome(FILE *out) {
+    pid_t pid = getpid();
+    bool first = true;
+    fprintf(out, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+
+    pthread_mutex_lock(&_rings_lock);
+    for (evtrace_ring *r = _rings; r; r = r->next) {
+        if (r->gen != _gen) continue;
+
+        u64 head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        u64 start = head > r->mask + 1 ? head - r->mask - 1 : 0;
+        for (u64 i = start; i < head; i++) {
+            fprintf(out, first ? "" : ",\n");
+            write_event(out, &r->evs[i & r->mask], pid, r->tid);
+            first = false;
+        }
+    }
+    pthread_mutex_unlock(&_rings_lock);
+
+    fprintf(out, "\n]}\n");
+    return ferror(out);
+}
@@ -6,6 +6,7 @@
 #include "osc-common.h"
 
 size_t max_num_recs = 1001, retry = 5;
+static u64 health_period_ms = 0;
 static helper_thread_ctrl hctrl;
 
 static inline void llc_evset_prime(EVSet *evset, u64 threshold) {
@@ -172,12 +173,31 @@ int monitor_l3_rate() {
     _info("EV Size: %u; EV Level: %d\n", llc_ev->size,
           generic_evset_test(target, llc_ev));
 
+    evset_health *health = NULL;
+    if (health_period_ms) {
+        health = evset_health_new(health_period_ms * 1000, 0.01);
+        if (!health || evset_health_watch(health, l2_evset, target, false) ||
+            evset_health_watch(health, llc_ev, target, false) ||
+            evset_health_start(health)) {
+            _error("Failed to start the evset health monitor\n");
+            evset_health_free(health);
+            ret = EXIT_FAILURE;
+            goto err;
+        }
+    }
+
     // to monitor
     u32 aux, last_aux;
     u64 iter = 0;
     _rdtscp_aux(&last_aux);
     llc_evset_prime(llc_ev, threshold);
     while (sz < max_num_recs) {
+        if (health && evset_health_poll(health)) {
+            llc_ev->size = _min(llc_ev->size, detected_l3->n_ways);
+            llc_evset_prime(llc_ev, threshold);
+            _rdtscp_aux(&last_aux);
+        }
+
         u64 begin = _timer_start();
         access_array(llc_ev->addrs, llc_ev->size);
         u64 end = _timer_end_aux(&aux);
@@ -198,6 +218,12 @@ int monitor_l3_rate() {
                iters[i] - iters[i - 1]);
     }
 
+    if (health) {
+        evset_health_stop(health);
+        pprint_evset_health(health);
+        evset_health_free(health);
+    }
+
 err:
     free(timestamps);
     free(iters);
@@ -213,13 +239,15 @@ int main(int argc, char **argv) {
     static struct option long_opts[] = {
         {"num-recs", required_argument, NULL, 'n'},
         {"retry", required_argument, NULL, 'r'},
+        {"health-period", required_argument, NULL, 'H'}, // in ms
         {0, 0, 0, 0}
     };
 
-    while ((opt = getopt_long(argc, argv, "n:r:", long_opts, &opt_idx)) != -1) {
+    while ((opt = getopt_long(argc, argv, "n:r:H:", long_opts, &opt_idx)) != -1) {
         switch (opt) {
             case 'n': max_num_recs = strtoull(optarg, NULL, 10) + 1; break;
             case 'r': retry = strtoull(optarg, NULL, 10); break;
+            case 'H': health_period_ms = strtoull(optarg, NULL, 10); break;
             default: _error("Unknown option %c\n", opt); return EXIT_FAILURE;
         }
     }
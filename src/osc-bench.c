@@ -0,0 +1,282 @@
+#include "core.h"
+#include "cache/cache.h"
+#include "cache/evset_bench.h"
+#include "sync.h"
+#include <math.h>
+#include <getopt.h>
+#include "osc-common.h"
+
+// Sweeps the eviction set algorithms and their knobs over fixed-seed
+// repetitions, and reports one row per configuration.
+
+#define MAX_SWEEP 16
+
+static bench_target target_cache;
+static const char *algo_names[MAX_SWEEP];
+static double scalings[MAX_SWEEP];
+static u32 backtracks[MAX_SWEEP], test_scales[MAX_SWEEP],
+    ev_repeats[MAX_SWEEP];
+static u32 n_algos, n_scalings, n_backtracks, n_test_scales, n_ev_repeats;
+static u32 reps = 10;
+static u64 seed = 1;
+static size_t max_tries = 10, max_timeout = 0;
+static bool l2_filter = true, use_sprt = false, json = false;
+static u32 sim_slices = 0;
+static const char *out_path = NULL;
+static cache_sim *sim = NULL;
+static helper_thread_ctrl hctrl;
+
+// split a comma-separated list of numbers into "vals"
+static u32 parse_list(char *arg, double *vals) {
+    u32 n = 0;
+    char *save = NULL;
+    for (char *tok = strtok_r(arg, ",", &save); tok && n < MAX_SWEEP;
+         tok = strtok_r(NULL, ",", &save)) {
+        vals[n++] = strtod(tok, NULL);
+    }
+    return n;
+}
+
+// the same for non-negative integers
+static u32 parse_uints(char *arg, u32 *vals) {
+    u32 n = 0;
+    char *save = NULL;
+    for (char *tok = strtok_r(arg, ",", &save); tok && n < MAX_SWEEP;
+         tok = strtok_r(NULL, ",", &save)) {
+        vals[n++] = strtoul(tok, NULL, 10);
+    }
+    return n;
+}
+
+static u32 parse_names(char *arg, const char **names) {
+    u32 n = 0;
+    char *save = NULL;
+    for (char *tok = strtok_r(arg, ",", &save); tok && n < MAX_SWEEP;
+         tok = strtok_r(NULL, ",", &save)) {
+        names[n++] = tok;
+    }
+    return n;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    u64 x = *(const u64 *)a, y = *(const u64 *)b;
+    return (x > y) - (x < y);
+}
+
+// nearest-rank percentile of sorted durations, in ms
+static double percentile_ms(u64 *sorted, u32 n, double p) {
+    u32 rank = (u32)ceil(p * n);
+    return sorted[_min(_max(rank, 1u), n) - 1] / 1e6;
+}
+
+static void emit_header(FILE *out) {
+    if (json) {
+        fprintf(out, "[\n");
+    } else {
+        fprintf(out, "target,algorithm,cands_scaling,max_backtrack,test_scale,"
+                     "ev_repeat,reps,success_rate,p50_ms,p90_ms,p99_ms,"
+                     "tests_per_evset,mem_accs_per_evset\n");
+    }
+}
+
+static void emit_row(FILE *out, bench_point *pt, bench_result *res,
+                     bool first) {
+    static const char *target_names[] = {"L2", "LLC", "SF"};
+    _sort(res->duras, reps, sizeof(*res->duras), cmp_u64);
+    double rate = (double)res->succ / reps,
+           p50 = percentile_ms(res->duras, reps, 0.5),
+           p90 = percentile_ms(res->duras, reps, 0.9),
+           p99 = percentile_ms(res->duras, reps, 0.99),
+           tests = (double)res->stats->cands_tests / reps,
+           accs = (double)res->stats->mem_accs / reps;
+
+    if (json) {
+        fprintf(out,
+                "%s  {\"target\": \"%s\", \"algorithm\": \"%s\", "
+                "\"cands_scaling\": %g, \"max_backtrack\": %u, "
+                "\"test_scale\": %u, \"ev_repeat\": %u, \"reps\": %u, "
+                "\"success_rate\": %.4f, \"p50_ms\": %.3f, \"p90_ms\": %.3f, "
+                "\"p99_ms\": %.3f, \"tests_per_evset\": %.1f, "
+                "\"mem_accs_per_evset\": %.1f}",
+                first ? "" : ",\n", target_names[target_cache], pt->algo_name,
+                pt->scaling, pt->max_backtrack, pt->test_scale, pt->ev_repeat,
+                reps, rate, p50, p90, p99, tests, accs);
+    } else {
+        fprintf(out, "%s,%s,%g,%u,%u,%u,%u,%.4f,%.3f,%.3f,%.3f,%.1f,%.1f\n",
+                target_names[target_cache], pt->algo_name, pt->scaling,
+                pt->max_backtrack, pt->test_scale, pt->ev_repeat, reps, rate,
+                p50, p90, p99, tests, accs);
+    }
+    fflush(out);
+}
+
+static int run_sweep(bench_config *bc, u8 *page, FILE *out) {
+    bench_result res = {.duras = _calloc(reps, sizeof(u64)),
+                        .stats = evset_stats_new()};
+    if (!res.duras || !res.stats) {
+        _error("Failed to allocate the results\n");
+        return EXIT_FAILURE;
+    }
+
+    bool first = true;
+    emit_header(out);
+    for (u32 a = 0; a < n_algos; a++)
+    for (u32 c = 0; c < n_scalings; c++)
+    for (u32 b = 0; b < n_backtracks; b++)
+    for (u32 t = 0; t < n_test_scales; t++)
+    for (u32 e = 0; e < n_ev_repeats; e++) {
+        bench_point pt = {.algo_name = algo_names[a],
+                          .algo = parse_evset_algo(algo_names[a]),
+                          .scaling = scalings[c],
+                          .max_backtrack = backtracks[b],
+                          .test_scale = test_scales[t],
+                          .ev_repeat = ev_repeats[e]};
+        bench_point_run(bc, page, &pt, &res);
+        emit_row(out, &pt, &res, first);
+        first = false;
+        _info("%s C=%g B=%u S=%u E=%u: %u/%u\n", pt.algo_name, pt.scaling,
+              pt.max_backtrack, pt.test_scale, pt.ev_repeat, res.succ, reps);
+    }
+    if (json) {
+        fprintf(out, "\n]\n");
+    }
+
+    _free(res.duras);
+    evset_stats_free(res.stats);
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        _error("./osc-bench <L2|LLC|SF> [options]\n");
+        return EXIT_FAILURE;
+    }
+
+    const char *action = argv[1];
+    if (strcmp(action, "L2") == 0) {
+        target_cache = BENCH_TARGET_L2;
+    } else if (strcmp(action, "LLC") == 0) {
+        target_cache = BENCH_TARGET_LLC;
+    } else if (strcmp(action, "SF") == 0) {
+        target_cache = BENCH_TARGET_SF;
+    } else {
+        _error("Unknown action!\n");
+        return EXIT_FAILURE;
+    }
+
+    int opt, opt_idx;
+    static struct option long_opts[] = {
+        {"algorithm", required_argument, NULL, 'A'},
+        {"cands-scale", required_argument, NULL, 'C'},
+        {"max-backtrack", required_argument, NULL, 'B'},
+        {"test-scale", required_argument, NULL, 't'},
+        {"ev-repeat", required_argument, NULL, 'e'},
+        {"reps", required_argument, NULL, 'n'},
+        {"seed", required_argument, NULL, 'x'},
+        {"max-tries", required_argument, NULL, 'R'},
+        {"timeout", required_argument, NULL, 'T'},
+        {"no-filter", no_argument, NULL, 'f'},
+        {"sprt", no_argument, NULL, 'P'},
+        {"sim", required_argument, NULL, 'm'},
+        {"json", no_argument, NULL, 'j'},
+        {"output", required_argument, NULL, 'o'},
+        {0, 0, 0, 0}
+    };
+
+    while ((opt = getopt_long(argc, argv, "A:C:B:t:e:n:x:R:T:fPm:jo:",
+                              long_opts, &opt_idx)) != -1) {
+        switch (opt) {
+            case 'A': n_algos = parse_names(optarg, algo_names); break;
+            case 'C': n_scalings = parse_list(optarg, scalings); break;
+            case 'B': n_backtracks = parse_uints(optarg, backtracks); break;
+            case 't': n_test_scales = parse_uints(optarg, test_scales); break;
+            case 'e': n_ev_repeats = parse_uints(optarg, ev_repeats); break;
+            case 'n': reps = strtoul(optarg, NULL, 10); break;
+            case 'x': seed = strtoull(optarg, NULL, 10); break;
+            case 'R': max_tries = strtoull(optarg, NULL, 10); break;
+            case 'T': max_timeout = strtoull(optarg, NULL, 10); break;
+            case 'f': l2_filter = false; break;
+            case 'P': use_sprt = true; break;
+            case 'm': sim_slices = strtoul(optarg, NULL, 10); break;
+            case 'j': json = true; break;
+            case 'o': out_path = optarg; break;
+            default: _error("Unknown option %c\n", opt); return EXIT_FAILURE;
+        }
+    }
+
+    if (!n_algos) {
+        algo_names[n_algos++] = "straw";
+    }
+    for (u32 a = 0; a < n_algos; a++) {
+        if (parse_evset_algo(algo_names[a]) == EVSET_ALGO_INVALID) {
+            _error("Invalid evset construction algorithm %s\n", algo_names[a]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (!reps) {
+        _error("At least one repetition is needed\n");
+        return EXIT_FAILURE;
+    }
+
+    if (cache_env_init(1)) {
+        _error("Failed to initialize cache env!\n");
+        return EXIT_FAILURE;
+    }
+
+    if (sim_slices) {
+        cache_sim_config sim_config;
+        cache_sim_config_skx(&sim_config, sim_slices);
+        sim_config.seed = seed;
+        if (!(sim = cache_sim_new(&sim_config))) {
+            return EXIT_FAILURE;
+        }
+        cache_sim_env_init(sim);
+        _info("Simulating a hierarchy with %u LLC slices\n", sim_slices);
+    }
+
+    // the defaults of the target's build config
+    EVBuildConfig def_config = def_l2_ev_config;
+    if (target_cache != BENCH_TARGET_L2) {
+        default_skx_sf_evset_build_config(&def_config, NULL, NULL, &hctrl);
+    }
+    if (!n_scalings) {
+        scalings[n_scalings++] = 3;
+    }
+    if (!n_backtracks) {
+        backtracks[n_backtracks++] = 20;
+    }
+    if (!n_test_scales) {
+        test_scales[n_test_scales++] = def_config.test_config.test_scale;
+    }
+    if (!n_ev_repeats) {
+        ev_repeats[n_ev_repeats++] = def_config.test_config.ev_repeat;
+    }
+
+    FILE *out = out_path ? fopen(out_path, "w") : stdout;
+    u8 *page = mmap_shared_init(NULL, PAGE_SIZE, 'a');
+    if (!out || !page) {
+        _error("Failed to open the output or allocate the target page\n");
+        return EXIT_FAILURE;
+    }
+
+    bench_config bc = {.target = target_cache,
+                       .reps = reps,
+                       .seed = seed,
+                       .max_tries = max_tries,
+                       .max_timeout = max_timeout,
+                       .l2_filter = l2_filter,
+                       .sim = sim,
+                       .hctrl = &hctrl,
+                       .tune_test = use_sprt ? enable_sprt : NULL};
+
+    // builds start the helper thread themselves when they need one
+    evset_stats_cur();
+    int ret = run_sweep(&bc, page, out);
+
+    if (out != stdout) {
+        fclose(out);
+    }
+    munmap(page, PAGE_SIZE);
+    cache_sim_free(sim);
+    return ret;
+}
@@ -1,4 +1,5 @@
 #include "cache/cache.h"
+#include "cache/trace.h"
 
 static struct {
     const char *s;
@@ -20,3 +21,34 @@ static inline evset_algorithm parse_evset_algo(const char * algo_name) {
     }
     return EVSET_ALGO_INVALID;
 }
+
+#define SPRT_ERROR_RATE 0.001
+#define SPRT_EV_RATE 0.9
+#define SPRT_CALI_SAMPLES 1000
+
+// switch a test config to the SPRT-based eviction test; may require the
+// helper thread to be running
+static inline bool enable_sprt(u8 *target, EVTestConfig *tconf) {
+    tconf->sprt_alpha = SPRT_ERROR_RATE;
+    tconf->sprt_beta = SPRT_ERROR_RATE;
+    if (sprt_calibrate(target, tconf, SPRT_CALI_SAMPLES, SPRT_EV_RATE)) {
+        return true;
+    }
+    tconf->test = sprt_test_eviction;
+    return false;
+}
+
+// save the recorded events in the Chrome trace format
+static inline void dump_trace(const char *path) {
+    FILE *fp = fopen(path, "w");
+    if (!fp) {
+        _error("Failed to open %s\n", path);
+        return;
+    }
+    if (evtrace_write_chrome(fp)) {
+        _error("Failed to write %s\n", path);
+    } else {
+        _info("Saved %lu trace events to %s\n", evtrace_count(), path);
+    }
+    fclose(fp);
+}
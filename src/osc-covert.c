@@ -15,6 +15,18 @@ static helper_thread_ctrl hctrl;
 static i64 para_threshold = 0, ptr_threshold = 0, spurious_cnt = 0;
 static EVSet *helper_sf_evset = NULL;
 static evchain *sf_chain1 = NULL, *sf_chain2 = NULL;
+static u64 health_period_ms = 0;
+static evset_health *health = NULL;
+static const char *kernel_name = "auto";
+static const probe_kernel *para_kernel = NULL;
+
+// (re)chain both SF evsets; the old chains are unlinked first
+static void build_sf_chains(EVSet *sf_evset) {
+    evchain_release(sf_chain1);
+    evchain_release(sf_chain2);
+    sf_chain1 = evchain_build(sf_evset->addrs, SF_ASSOC);
+    sf_chain2 = evchain_build(helper_sf_evset->addrs, SF_ASSOC);
+}
 
 static bool check_and_set_sf_evset(EVSet *evset) {
     if (!evset || evset->size < SF_ASSOC) {
@@ -46,7 +58,7 @@ int measure_performance(EVSet *evset) {
     prime_skx_sf_evset_para(evset, array_repeat, l2_repeat);
     start = _timer_start();
     for (u32 i = 0; i < n_repeat * 10; i++) {
-        probe_skx_sf_evset_para(evset, &end_tsc, &aux);
+        para_kernel->probe(evset, &end_tsc, &aux);
     }
     end = _timer_end();
     para_lat = (end - start) / n_repeat / 10;
@@ -88,7 +100,8 @@ EVSet *prepare_evsets() {
         return NULL;
     }
 
-    EVBuildConfig sf_config;
+    // evsets keep pointing to their config
+    static EVBuildConfig sf_config;
     default_skx_sf_evset_build_config(&sf_config, NULL, l2_evset, &hctrl);
     sf_config.algo_config.extra_cong = SF_ASSOC - detected_l3->n_ways;
 
@@ -104,11 +117,29 @@ EVSet *prepare_evsets() {
         _error("Failed to build the helper SF evset\n");
         return NULL;
     }
-    sf_chain1 = evchain_build(sf_evset->addrs, SF_ASSOC);
-    sf_chain2 = evchain_build(helper_sf_evset->addrs, SF_ASSOC);
+    build_sf_chains(sf_evset);
+
+    if (!strcmp(kernel_name, "auto")) {
+        para_kernel =
+            select_probe_kernel(sf_evset, SF_ASSOC, array_repeat, l2_repeat);
+    } else {
+        para_kernel = find_probe_kernel(kernel_name);
+        if (para_kernel && para_kernel->ways != SF_ASSOC) {
+            _error("Probe kernel %s is not for %u ways\n", kernel_name, SF_ASSOC);
+            return NULL;
+        }
+    }
 
-    para_threshold = calibrate_para_probe_lat(target, sf_evset, array_repeat,
-                                              l2_repeat, bad_threshold_ratio);
+    if (!para_kernel ||
+        (para_kernel->supported && !para_kernel->supported())) {
+        _error("Probe kernel %s is not available\n", kernel_name);
+        return NULL;
+    }
+    _info("Using probe kernel %s\n", para_kernel->name);
+
+    para_threshold =
+        calibrate_kernel_probe_lat(target, sf_evset, array_repeat, l2_repeat,
+                                   bad_threshold_ratio, para_kernel);
     if (para_threshold <= 0) {
         _error("Failed to calibrate grp access lat!\n");
         return NULL;
@@ -128,6 +159,16 @@ EVSet *prepare_evsets() {
         return NULL;
     }
 
+    if (health_period_ms) {
+        health = evset_health_new(health_period_ms * 1000, 0.01);
+        if (!health || evset_health_watch(health, l2_evset, target, false) ||
+            evset_health_watch(health, sf_evset, target, false) ||
+            evset_health_watch(health, helper_sf_evset, target, false)) {
+            _error("Failed to set up the evset health monitor\n");
+            return NULL;
+        }
+    }
+
     return sf_evset;
 }
 
@@ -184,6 +225,13 @@ static pthread_barrier_t barrier;
 static pthread_barrierattr_t battr;
 static u64 switched_thresh = 20000; // cycles
 
+// repaired evsets may have changed their members
+static void refresh_sf_evsets(EVSet *sf_evset) {
+    sf_evset->size = _min(sf_evset->size, SF_ASSOC);
+    helper_sf_evset->size = _min(helper_sf_evset->size, SF_ASSOC);
+    build_sf_chains(sf_evset);
+}
+
 static size_t monitor_para(EVSet *sf_evset, cache_acc_rec *recv_recs,
                            sender_switched_out *switch_recs, size_t max_recv) {
     u64 n_recvs = 0, iters = 0, end, n_switches = 0;
@@ -196,6 +244,13 @@ static size_t monitor_para(EVSet *sf_evset, cache_acc_rec *recv_recs,
     prime_skx_sf_evset_para(sf_evset, array_repeat, l2_repeat);
     u64 last_tsc = _rdtsc();
     while (n_recvs < max_recv) {
+        if (health && evset_health_poll(health)) {
+            refresh_sf_evsets(sf_evset);
+            prime_skx_sf_evset_para(sf_evset, array_repeat, l2_repeat);
+            _rdtscp_aux(&last_aux);
+            last_tsc = _rdtsc();
+        }
+
         u64 now_tsc = _rdtsc();
         bool switched_out = now_tsc - last_tsc > switched_thresh;
 
@@ -203,7 +258,7 @@ static size_t monitor_para(EVSet *sf_evset, cache_acc_rec *recv_recs,
         if (ptr_chase) {
             lat = probe_skx_sf_evset_ptr_chase(sf_evset, &end, &aux);
         } else {
-            lat = probe_skx_sf_evset_para(sf_evset, &end, &aux);
+            lat = para_kernel->probe(sf_evset, &end, &aux);
         }
         bool spurious =
             (aux != last_aux) || lat > detected_cache_lats.interrupt_thresh;
@@ -247,8 +302,7 @@ size_t monitor_ps(EVSet *sf_evset, cache_acc_rec *recv_recs,
 
     _rdtscp_aux(&last_aux);
 
-    sf_chain1 = evchain_build(sf_evset->addrs, SF_ASSOC);
-    sf_chain2 = evchain_build(helper_sf_evset->addrs, SF_ASSOC);
+    build_sf_chains(sf_evset);
     i64 threshold = detected_cache_lats.l2_thresh;
 
     flush_evset(sf_evset);
@@ -265,6 +319,21 @@ size_t monitor_ps(EVSet *sf_evset, cache_acc_rec *recv_recs,
     u64 last_tsc = _rdtsc();
     u8 *scope = sf_evset->addrs[0];
     while (n_recvs < max_recv) {
+        if (health && evset_health_poll(health)) {
+            refresh_sf_evsets(sf_evset);
+            if (use_sense) {
+                prime_sense = false;
+                prime_skx_sf_evset_ps_sense(sf_chain1, sf_chain2, true, NULL);
+                prime_skx_sf_evset_ps_sense(sf_chain1, sf_chain2, false, NULL);
+            } else {
+                prime_skx_sf_evset_ps_flush(sf_evset, sf_chain1, array_repeat,
+                                            l2_repeat);
+            }
+            scope = sf_evset->addrs[0];
+            _rdtscp_aux(&last_aux);
+            last_tsc = _rdtsc();
+        }
+
         u64 now_tsc = _rdtsc(), end;
         bool switched_out = now_tsc - last_tsc > switched_thresh;
 
@@ -325,7 +394,16 @@ int covert_recv() {
         ret = EXIT_FAILURE;
         goto err;
     }
-    stop_helper_thread(&hctrl);
+
+    // repairs need the helper thread
+    if (health) {
+        if (evset_health_start(health)) {
+            ret = EXIT_FAILURE;
+            goto err;
+        }
+    } else {
+        stop_helper_thread(&hctrl);
+    }
 
     u64 max_recv = n_emits * recv_scale;
     cache_acc_rec *recv_recs = calloc(max_recv, sizeof(*recv_recs));
@@ -375,6 +453,11 @@ int covert_recv() {
         n_recvs = monitor_para(sf_evset, recv_recs, switch_recs, max_recv);
     }
 
+    if (health) {
+        evset_health_stop(health);
+        pprint_evset_health(health);
+    }
+
     size_t n_switches = 0;
     for (n_switches = 0; n_switches < max_recv; n_switches++) {
         if (switch_recs[n_switches].start) {
@@ -435,6 +518,7 @@ int covert_recv() {
     _info("Spurious count: %ld\n", spurious_cnt);
 
 err:
+    evset_health_free(health);
     stop_helper_thread(&hctrl);
     return ret;
 }
@@ -451,10 +535,12 @@ int main(int argc, char **argv) {
         {"num-emits", required_argument, NULL, 'n'},
         {"rec-scale", required_argument, NULL, 'r'},
         {"secret-time-scale", required_argument, NULL, 't'},
+        {"health-period", required_argument, NULL, 'H'}, // in ms
+        {"probe-kernel", required_argument, NULL, 'k'},
         {0, 0, 0, 0}
     };
 
-    while ((opt = getopt_long(argc, argv, "apsmci:n:r:t:", long_opts, &opt_idx)) != -1) {
+    while ((opt = getopt_long(argc, argv, "apsmci:n:r:t:H:k:", long_opts, &opt_idx)) != -1) {
         switch (opt) {
             case 'a': secret_access = true; break;
             case 'p': use_prime_scope = true; break;
@@ -465,6 +551,8 @@ int main(int argc, char **argv) {
             case 'n': n_emits = strtoull(optarg, NULL, 10); break;
             case 'r': recv_scale = strtoull(optarg, NULL, 10); break;
             case 't': secret_timing_scale = strtod(optarg, NULL); break;
+            case 'H': health_period_ms = strtoull(optarg, NULL, 10); break;
+            case 'k': kernel_name = optarg; break;
             default: _error("Unknown option %c\n", opt); return EXIT_FAILURE;
         }
     }
@@ -1,6 +1,7 @@
 #include "core.h"
 #include "sync.h"
 #include "cache/cache.h"
+#include "cache/offset_queue.h"
 #include <getopt.h>
 #include "osc-common.h"
 #include <execinfo.h>
@@ -14,15 +15,52 @@ static size_t max_tries = 10, max_backtrack = 20, max_timeout = 0;
 static size_t total_runtime_limit = 0; // in minutes
 static bool l2_filter = true, single_thread = false;
 static size_t num_l2sets;
+static u32 n_workers = 1;
+static bool use_sprt = false, bulk = false, pa_assist = false;
+static i64 next_batch = -1; // negative: one less than the LLC associativity
+static u32 pipeline_depth = 0; // 0: workers prepare their own candidates
+static char *store_dir = NULL, *stats_path = NULL, *trace_path = NULL;
 static helper_thread_ctrl hctrl;
 
 #define NUM_OFFSETS (PAGE_SIZE / CL_SIZE)
 
-EVSet ***build_l2_evsets_all() {
+// save a snapshot of the aggregated stats, in binary if "path" ends in .bin
+static void dump_stats(const char *path) {
+    struct evset_stats agg;
+    FILE *fp = fopen(path, "w");
+    if (!fp) {
+        _error("Failed to open %s\n", path);
+        return;
+    }
+
+    size_t len = strlen(path);
+    evset_stats_snapshot(&agg, false);
+    if (len > 4 && strcmp(path + len - 4, ".bin") == 0) {
+        evset_stats_write_bin(&agg, fp);
+    } else if (evset_stats_write_json(&agg, fp)) {
+        _error("Failed to write %s\n", path);
+    }
+    fclose(fp);
+}
+
+// replicate the offset-0 L2 evsets to every page offset
+static EVSet ***shift_l2_evsets_all(EVSet **evsets, size_t l2_cnt) {
+    EVSet ***l2evset_complex = calloc(NUM_OFFSETS, sizeof(*l2evset_complex));
+    l2evset_complex[0] = evsets;
+    for (u32 n = 1; n < NUM_OFFSETS; n++) {
+        l2evset_complex[n] = calloc(l2_cnt, sizeof(EVSet *));
+        for (u32 i = 0; i < l2_cnt; i++) {
+            l2evset_complex[n][i] = evset_shift(evsets[i], CL_SIZE * n);
+        }
+    }
+    return l2evset_complex;
+}
+
+EVSet ***build_l2_evsets_all(EVBuffer *evb) {
     u64 start = time_ns();
     size_t l2_cnt;
     EVCands *l2_evcands =
-        evcands_new(detected_l2, &def_l2_ev_config.cands_config, NULL);
+        evcands_new(detected_l2, &def_l2_ev_config.cands_config, evb);
     if (!l2_evcands) {
         _error("Failed to allocate L2 evcands\n");
         return NULL;
@@ -55,7 +93,7 @@ EVSet ***build_l2_evsets_all() {
             l2_test += evset_self_test(evsets[i]) == EV_POS;
         }
 
-        if (l2_test != cache_uncertainty(detected_l2)) {
+        if (l2_test != l2_cnt) {
             goto l2_err;
         }
 
@@ -81,7 +119,7 @@ EVSet ***build_l2_evsets_all() {
         return NULL;
     }
 
-    if (cache_oracle_inited()) {
+    if (cache_oracle_pa_inited()) {
         u32 cnts[16] = {0};
         for (u32 i = 0; i < 16; i++) {
             u32 l2_set = cache_set_idx(evsets[i]->addrs[0], detected_l2) >> 6;
@@ -100,23 +138,37 @@ EVSet ***build_l2_evsets_all() {
         }
     }
 
-    EVSet ***l2evset_complex = calloc(NUM_OFFSETS, sizeof(*l2evset_complex));
-    l2evset_complex[0] = evsets;
-    for (u32 n = 1; n < NUM_OFFSETS; n++) {
-        l2evset_complex[n] = calloc(l2_cnt, sizeof(EVSet *));
-        for (u32 i = 0; i < l2_cnt; i++) {
-            l2evset_complex[n][i] = evset_shift(evsets[i], CL_SIZE * n);
-        }
-    }
+    EVSet ***l2evset_complex = shift_l2_evsets_all(evsets, l2_cnt);
     u64 end = time_ns();
     _info("L2 Complex: %luus;\n", (end - start) / 1000);
     return l2evset_complex;
 }
 
-EVCands ***build_evcands_all(EVBuildConfig *conf, EVSet ***l2evsets) {
+// classify the lines at offset 0 by L2 color, one slice per worker core;
+// L2s are private, so the slices do not disturb each other
+static bool populate_colors(EVBuildConfig *conf, EVCands **cands,
+                            EVSet **l2evsets) {
+    u32 n_threads = n_workers * (single_thread ? 1 : 2);
+    int cores[n_threads];
+    bool pinned = n_threads > 1 && !cpu_topology_pick(n_threads, 1, cores);
+    if (n_threads > 1 && !pinned) {
+        _warn("Classifying candidates with unpinned threads\n");
+    }
+
+    bool err = evcands_populate_colors(0x0, cands, l2evsets, num_l2sets,
+                                       &conf->cands_config, n_threads,
+                                       pinned ? cores : NULL);
+    for (u32 t = 0; pinned && t < n_threads; t++) {
+        cpu_topology_release(cores[t]);
+    }
+    return err;
+}
+
+EVCands ***build_evcands_all(EVBuildConfig *conf, EVSet ***l2evsets,
+                             EVBuffer *evb) {
     u64 start, end;
     start = time_ns();
-    EVCands *base_cands = evcands_new(detected_l3, &conf->cands_config, NULL);
+    EVCands *base_cands = evcands_new(detected_l3, &conf->cands_config, evb);
     if (!base_cands) {
         _error("Failed to allocate EVB\n");
         return NULL;
@@ -127,29 +179,33 @@ EVCands ***build_evcands_all(EVBuildConfig *conf, EVSet ***l2evsets) {
     start = time_ns();
     EVCands ***cands_complex = calloc(NUM_OFFSETS, sizeof(*cands_complex));
     for (u32 n = 0; n < NUM_OFFSETS; n++) {
-        u32 offset = n * CL_SIZE;
         cands_complex[n] = calloc(num_l2sets, sizeof(EVCands *));
-        for (u32 i = 0; i < num_l2sets; i++) {
-            if (n == 0) {
-                if (l2_filter) {
-                    conf->cands_config.filter_ev = l2evsets[n][i];
-                } else {
-                    conf->cands_config.filter_ev = NULL;
-                }
-                EVCands *cands = evcands_new(detected_l3, &conf->cands_config,
-                                             base_cands->evb);
-                if (!cands) {
-                    return NULL;
-                }
+    }
 
-                if (evcands_populate(offset, cands, &conf->cands_config)) {
-                    return NULL;
-                }
-                cands_complex[n][i] = cands;
-            } else {
-                cands_complex[n][i] =
-                    evcands_shift(cands_complex[0][i], offset);
-            }
+    conf->cands_config.filter_ev = NULL;
+    for (u32 i = 0; i < num_l2sets; i++) {
+        cands_complex[0][i] =
+            evcands_new(detected_l3, &conf->cands_config, base_cands->evb);
+        if (!cands_complex[0][i]) {
+            return NULL;
+        }
+        if (!l2_filter &&
+            evcands_populate(0x0, cands_complex[0][i], &conf->cands_config)) {
+            return NULL;
+        }
+    }
+    if (l2_filter && populate_colors(conf, cands_complex[0], l2evsets[0])) {
+        return NULL;
+    }
+    // any color tells the later builds how filtered the candidates are
+    if (l2_filter) {
+        conf->cands_config.filter_ev = l2evsets[0][num_l2sets - 1];
+    }
+
+    for (u32 n = 1; n < NUM_OFFSETS; n++) {
+        for (u32 i = 0; i < num_l2sets; i++) {
+            cands_complex[n][i] =
+                evcands_shift(cands_complex[0][i], n * CL_SIZE);
         }
     }
     end = time_ns();
@@ -157,6 +213,156 @@ EVCands ***build_evcands_all(EVBuildConfig *conf, EVSet ***l2evsets) {
     return cands_complex;
 }
 
+/* Persisted complex: buffer 0 holds the L2 evsets, buffer 1 the SF candidates
+ * and evsets. Records are keyed by {page offset index, L2 color, index}. */
+#define STORE_L2_BUF 0
+#define STORE_LLC_BUF 1
+
+static EVBuffer *store_bufs[2];
+
+static bool open_store_buffers(EVBuildConfig *sf_config, bool *reused) {
+    char path[4096];
+    bool l2_reused, llc_reused;
+    snprintf(path, sizeof(path), "%s/l2.buf", store_dir);
+    store_bufs[STORE_L2_BUF] = evbuffer_open(
+        path, detected_l2, &def_l2_ev_config.cands_config, &l2_reused);
+    snprintf(path, sizeof(path), "%s/llc.buf", store_dir);
+    store_bufs[STORE_LLC_BUF] = evbuffer_open(
+        path, detected_l3, &sf_config->cands_config, &llc_reused);
+    *reused = l2_reused && llc_reused;
+    return !store_bufs[STORE_L2_BUF] || !store_bufs[STORE_LLC_BUF];
+}
+
+static EVSet ***restore_l2_evsets_all(evstore *store) {
+    size_t l2_cnt = cache_uncertainty(detected_l2);
+    EVCands *owner = evcands_new(detected_l2, &def_l2_ev_config.cands_config,
+                                 store_bufs[STORE_L2_BUF]);
+    EVSet **evsets = calloc(l2_cnt, sizeof(*evsets));
+    if (!owner || !evsets) {
+        return NULL;
+    }
+
+    for (size_t r = 0; r < store->n_recs; r++) {
+        evstore_rec *rec = &store->recs[r];
+        if (rec->kind != EVSTORE_EVSET || rec->buf_id != STORE_L2_BUF ||
+            rec->key[1] >= l2_cnt) {
+            continue;
+        }
+
+        evsets[rec->key[1]] = evstore_rec_evset(store, rec, &def_l2_ev_config,
+                                                detected_l2, owner);
+    }
+
+    for (size_t i = 0; i < l2_cnt; i++) {
+        if (!evsets[i] || evset_self_test(evsets[i]) != EV_POS) {
+            _warn("Stored L2 evset %lu is no longer valid\n", i);
+            return NULL;
+        }
+    }
+    return shift_l2_evsets_all(evsets, l2_cnt);
+}
+
+static EVCands ***restore_evcands_all(evstore *store, EVBuildConfig *conf) {
+    EVCands ***cands_complex = calloc(NUM_OFFSETS, sizeof(*cands_complex));
+    for (u32 n = 0; n < NUM_OFFSETS; n++) {
+        cands_complex[n] = calloc(num_l2sets, sizeof(EVCands *));
+    }
+
+    for (size_t r = 0; r < store->n_recs; r++) {
+        evstore_rec *rec = &store->recs[r];
+        if (rec->kind == EVSTORE_CANDS && rec->key[0] == 0 &&
+            rec->key[1] < num_l2sets) {
+            cands_complex[0][rec->key[1]] = evstore_rec_cands(
+                store, rec, detected_l3, &conf->cands_config);
+        }
+    }
+
+    for (u32 i = 0; i < num_l2sets; i++) {
+        if (!cands_complex[0][i]) {
+            _warn("Stored SF candidates of L2 color %u are missing\n", i);
+            return NULL;
+        }
+    }
+
+    for (u32 n = 1; n < NUM_OFFSETS; n++) {
+        for (u32 i = 0; i < num_l2sets; i++) {
+            cands_complex[n][i] =
+                evcands_shift(cands_complex[0][i], n * CL_SIZE);
+        }
+    }
+    return cands_complex;
+}
+
+// restored evsets are rebound to a worker's config, then revalidated and
+// repaired by that worker. Their shifted candidates stay compact until
+// prepare_offset expands them for the repair
+static size_t restore_sf_evsets_all(evstore *store, EVBuildConfig *sf_config,
+                                    EVCands ***sf_cands,
+                                    EVSet ****sfevset_complex, size_t l3_cnt) {
+    size_t n_restored = 0;
+    for (size_t r = 0; r < store->n_recs; r++) {
+        evstore_rec *rec = &store->recs[r];
+        u32 n = rec->key[0], i = rec->key[1], j = rec->key[2];
+        if (rec->kind != EVSTORE_EVSET || rec->buf_id != STORE_LLC_BUF ||
+            n >= NUM_OFFSETS || i >= num_l2sets || j >= l3_cnt) {
+            continue;
+        }
+
+        if (!sfevset_complex[n][i]) {
+            sfevset_complex[n][i] = calloc(l3_cnt, sizeof(EVSet *));
+            if (!sfevset_complex[n][i]) {
+                _error("Failed to allocate restored SF evsets\n");
+                break;
+            }
+        }
+
+        sfevset_complex[n][i][j] = evstore_rec_evset(
+            store, rec, sf_config, detected_l3, sf_cands[n][i]);
+        n_restored += sfevset_complex[n][i][j] != NULL;
+    }
+    return n_restored;
+}
+
+static bool save_store(EVSet ***l2evsets, EVCands ***sf_cands,
+                       EVSet ****sfevset_complex, size_t l3_cnt) {
+    evstore *store = evstore_new(store_bufs, _array_size(store_bufs));
+    if (!store) {
+        return true;
+    }
+
+    bool err = false;
+    for (u32 i = 0; i < cache_uncertainty(detected_l2) && !err; i++) {
+        err = evstore_add_evset(store, STORE_L2_BUF, 0, i, 0, l2evsets[0][i]);
+    }
+
+    for (u32 i = 0; i < num_l2sets && !err; i++) {
+        err = evstore_add_cands(store, STORE_LLC_BUF, 0, i, 0, sf_cands[0][i]);
+    }
+
+    for (u32 n = 0; n < NUM_OFFSETS && !err; n++) {
+        for (u32 i = 0; i < num_l2sets && !err; i++) {
+            if (!sfevset_complex[n][i]) continue;
+
+            for (u32 j = 0; j < l3_cnt && !err; j++) {
+                EVSet *evset = sfevset_complex[n][i][j];
+                if (evset && evset->addrs) {
+                    err = evstore_add_evset(store, STORE_LLC_BUF, n, i, j,
+                                            evset);
+                }
+            }
+        }
+    }
+
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/index", store_dir);
+    err = err || evstore_save(store, path);
+    if (!err) {
+        _info("Saved %lu records to %s\n", store->n_recs, path);
+    }
+    evstore_free(store);
+    return err;
+}
+
 static void shuffle_index(u32 *idxs, u32 sz) {
     srand(time(NULL));
     for (u32 tail = sz - 1; tail > 0; tail--) {
@@ -166,14 +372,323 @@ static void shuffle_index(u32 *idxs, u32 sz) {
     }
 }
 
-int build_sf_evset_all(u32 n_offset) {
-    EVSet ***l2evsets = build_l2_evsets_all();
-    if (!l2evsets) {
-        _error("Failed to build L2 evset complex\n");
-        return EXIT_FAILURE;
+typedef struct {
+    u32 id;
+    int core, helper_core; // negative means unpinned
+    EVBuildConfig config;
+    helper_thread_ctrl hctrl;
+    pthread_t pid;
+    u32 n_taken; // offsets taken so far
+    size_t n_built, n_repaired;
+    u64 duration;
+} sf_worker;
+
+// shared, read-only state of the worker pool
+static EVSet ***pool_l2evsets;
+static EVCands ***pool_sf_cands;
+static EVSet ****pool_sfevset_complex;
+static u32 *pool_idxs, pool_n_offset;
+static size_t pool_l3_cnt;
+static cache_param *pool_lower_cache;
+static EVBuildConfig *pool_lower_conf;
+static size_t pool_n_lower_evsets;
+static u64 pool_start;
+static volatile bool pool_timeout = false;
+
+// per-offset verification results, each offset is owned by a single worker
+static size_t offset_succ[NUM_OFFSETS], offset_sf_succ[NUM_OFFSETS];
+static u32 offset_owner[NUM_OFFSETS];
+static u64 pool_first_done; // when the first offset was finished, 0 if none
+
+// prepared offsets, from the producer to the workers
+static offset_queue pool_queue;
+static pthread_t producer_pid;
+static int producer_core = -1;
+
+// pick (worker, helper) core pairs from the CPUs the process may run on;
+// each pair shares an LLC, and no two threads share a physical core. A
+// single worker stays where it is and gets a helper next to it, unless a
+// producer needs a core too
+static bool assign_worker_cores(sf_worker *workers, u32 n_workers) {
+    if (n_workers == 1 && !pipeline_depth) {
+        workers[0].core = -1;
+        workers[0].helper_core = -1;
+        return false;
+    }
+
+    u32 cpus_per_worker = single_thread ? 1 : 2;
+    int cpus[n_workers * cpus_per_worker];
+    if (cpu_topology_pick(n_workers, cpus_per_worker, cpus)) {
+        return true;
+    }
+
+    for (u32 w = 0; w < n_workers; w++) {
+        workers[w].core = cpus[w * cpus_per_worker];
+        workers[w].helper_core =
+            single_thread ? -1 : cpus[w * cpus_per_worker + 1];
+    }
+    return false;
+}
+
+static void verify_sf_evsets_at(u32 n) {
+    size_t succ = 0, sf_succ = 0;
+    for (u32 i = 0; i < num_l2sets; i++) {
+        if (!pool_sfevset_complex[n][i]) {
+            continue;
+        }
+
+        for (u32 j = 0; j < pool_l3_cnt; j++) {
+            EVSet *sf_evset = pool_sfevset_complex[n][i][j];
+            if (!sf_evset || !sf_evset->addrs) {
+                continue;
+            }
+
+            EVTestRes llc_test = evset_self_precise_test(sf_evset);
+            succ += llc_test == EV_POS;
+
+            sf_evset->config->test_config_alt.foreign_evictor = true;
+
+            if (sf_evset->size > SF_ASSOC + 1) {
+                sf_evset->size = SF_ASSOC + 1;
+            }
+
+            EVTestRes sf_test = evset_self_precise_test_alt(sf_evset);
+            sf_succ += sf_test == EV_POS;
+        }
+    }
+    offset_succ[n] = succ;
+    offset_sf_succ[n] = sf_succ;
+}
+
+// count the evsets whose lines the oracle puts in the same set and slice; the
+// lines of all evsets at an offset are resolved in one batch
+static size_t oracle_check_evsets_at(u32 n, size_t *n_checked) {
+    size_t n_lines = 0, n_congruent = 0;
+    for (u32 i = 0; i < num_l2sets; i++) {
+        for (u32 j = 0; pool_sfevset_complex[n][i] && j < pool_l3_cnt; j++) {
+            EVSet *evset = pool_sfevset_complex[n][i][j];
+            n_lines += evset && evset->addrs ? evset->size : 0;
+        }
+    }
+
+    u8 **lines = _calloc(_max(n_lines, 1), sizeof(*lines));
+    u64 *hashes = _calloc(_max(n_lines, 1), sizeof(*hashes));
+    if (!lines || !hashes) {
+        goto out;
+    }
+
+    size_t k = 0;
+    for (u32 i = 0; i < num_l2sets; i++) {
+        for (u32 j = 0; pool_sfevset_complex[n][i] && j < pool_l3_cnt; j++) {
+            EVSet *evset = pool_sfevset_complex[n][i][j];
+            if (evset && evset->addrs) {
+                memcpy(&lines[k], evset->addrs, evset->size * sizeof(*lines));
+                k += evset->size;
+            }
+        }
     }
+    llc_addr_hash_batch((void **)lines, n_lines, hashes);
 
-    u32 idxs[NUM_OFFSETS] = {0};
+    k = 0;
+    for (u32 i = 0; i < num_l2sets; i++) {
+        for (u32 j = 0; pool_sfevset_complex[n][i] && j < pool_l3_cnt; j++) {
+            EVSet *evset = pool_sfevset_complex[n][i][j];
+            if (!evset || !evset->addrs || !evset->size) continue;
+
+            bool congruent = hashes[k] != INVALID_ADDR_HASH;
+            for (u32 m = 1; m < evset->size; m++) {
+                congruent &= hashes[k + m] == hashes[k];
+            }
+            n_congruent += congruent;
+            *n_checked += 1;
+            k += evset->size;
+        }
+    }
+
+out:
+    _free(lines);
+    _free(hashes);
+    return n_congruent;
+}
+
+// expand the candidates and L2 evsets of offset "n" ahead of its build. The
+// candidates were classified once at offset 0 and shifted since, so each
+// color is re-checked against its own L2 evset at this offset, which drops
+// the lines misclassified then. Shuffling keeps every offset from starting
+// with targets on the same pages. The candidates of restored offsets are
+// only expanded, for the repair
+static bool prepare_offset(u32 n) {
+    for (u32 i = 0; i < cache_uncertainty(detected_l2); i++) {
+        if (evset_materialize(pool_l2evsets[n][i])) {
+            return true;
+        }
+    }
+
+    for (u32 i = 0; i < num_l2sets; i++) {
+        EVCands *cands = pool_sf_cands[n][i];
+        if (evcands_materialize(cands)) {
+            return true;
+        }
+        if (pool_sfevset_complex[n][i]) {
+            continue;
+        }
+
+        size_t n_cands = cands->size;
+        if (l2_filter && n && evcands_filter(cands, pool_l2evsets[n][i])) {
+            return true;
+        }
+        if (cands->size < n_cands / 2) {
+            _warn("Offset %#lx, color %u: %lu of %lu candidates left\n",
+                  n * CL_SIZE, i, cands->size, n_cands);
+        }
+        evcands_shuffle(cands);
+    }
+    return false;
+}
+
+// prepare the offsets in pool order, at most pipeline_depth of them ahead of
+// the workers
+static void *sf_producer_run(void *arg) {
+    if (producer_core >= 0 && !set_proc_affinity(producer_core)) {
+        _warn("Producer: failed to pin to core %d\n", producer_core);
+    }
+
+    for (u32 c = 0; c < pool_n_offset && !pool_timeout; c++) {
+        u32 n = pool_idxs[c];
+        if (prepare_offset(n)) {
+            _error("Producer: failed to prepare offset %#lx\n", n * CL_SIZE);
+            break;
+        }
+        if (offset_queue_push(&pool_queue, n)) {
+            break;
+        }
+    }
+    offset_queue_close(&pool_queue);
+    return NULL;
+}
+
+// the next prepared offset for a worker, from the producer when pipelined and
+// every n_workers-th one in pool order, prepared here, otherwise; true if
+// there is none left
+static bool next_offset(sf_worker *w, u32 *n) {
+    if (pipeline_depth) {
+        return offset_queue_pop(&pool_queue, n);
+    }
+
+    u32 c = w->id + w->n_taken * n_workers;
+    if (c >= pool_n_offset) {
+        return true;
+    }
+    *n = pool_idxs[c];
+    if (prepare_offset(*n)) {
+        _error("Worker %u: failed to prepare offset %#lx\n", w->id,
+               *n * CL_SIZE);
+        return true;
+    }
+    return false;
+}
+
+// point the evsets at "conf" before the worker configs they were built with
+// go away
+static void rebind_sf_evsets(EVBuildConfig *conf) {
+    for (u32 n = 0; n < NUM_OFFSETS; n++) {
+        for (u32 i = 0; i < num_l2sets; i++) {
+            for (u32 j = 0; pool_sfevset_complex[n][i] && j < pool_l3_cnt;
+                 j++) {
+                EVSet *evset = pool_sfevset_complex[n][i][j];
+                if (evset) evset->config = conf;
+            }
+        }
+    }
+}
+
+static void *sf_worker_run(void *arg) {
+    sf_worker *w = arg;
+    if (w->core >= 0 && !set_proc_affinity(w->core)) {
+        _warn("Worker %u: failed to pin to core %d\n", w->id, w->core);
+    }
+
+    EVBuildConfig *conf = &w->config;
+    conf->test_config.hctrl = &w->hctrl;
+    conf->test_config_alt.hctrl = &w->hctrl;
+    // an unassigned helper is placed next to the worker
+    if (!single_thread && (w->helper_core < 0
+                               ? start_helper_thread(&w->hctrl)
+                               : start_helper_thread_pinned(&w->hctrl,
+                                                            w->helper_core))) {
+        _error("Worker %u: failed to start the helper thread\n", w->id);
+        return NULL;
+    }
+
+    u64 start = time_ns();
+    size_t l3_cnt;
+    for (u32 n; !pool_timeout && !next_offset(w, &n); w->n_taken++) {
+        u32 offset = n * CL_SIZE;
+        offset_owner[n] = w->id;
+        for (u32 i = 0; i < num_l2sets; i++) {
+            conf->test_config.lower_ev = pool_l2evsets[n][i];
+            if (pool_sfevset_complex[n][i]) {
+                // restored from the store
+                EVSet **sf_evsets = pool_sfevset_complex[n][i];
+                for (size_t j = 0; j < pool_l3_cnt; j++) {
+                    if (sf_evsets[j]) sf_evsets[j]->config = conf;
+                }
+                w->n_repaired += repair_evsets_at(sf_evsets, pool_l3_cnt, conf,
+                                                  detected_l3,
+                                                  pool_sf_cands[n][i]);
+                evcands_release(pool_sf_cands[n][i]);
+                for (size_t j = 0; j < pool_l3_cnt; j++) {
+                    w->n_built += sf_evsets[j] != NULL;
+                }
+                continue;
+            }
+
+            EVSet **sf_evsets = build_evsets_at(
+                offset, conf, detected_l3, pool_sf_cands[n][i], &l3_cnt,
+                pool_lower_cache, pool_lower_conf, pool_l2evsets[n],
+                pool_n_lower_evsets);
+            // shifted candidates are only needed while building
+            evcands_release(pool_sf_cands[n][i]);
+            pool_sfevset_complex[n][i] = sf_evsets;
+            if (!sf_evsets) {
+                _error("No sf evsets are built!\n");
+                continue;
+            }
+
+            for (size_t j = 0; j < l3_cnt; j++) {
+                w->n_built += sf_evsets[j] != NULL;
+            }
+
+            if (total_runtime_limit &&
+                ((time_ns() - pool_start) / 1e9 >= total_runtime_limit * 60)) {
+                _error("Timeout break!\n");
+                pool_timeout = true;
+                offset_queue_close(&pool_queue);
+                break;
+            }
+        }
+        u64 none = 0;
+        __atomic_compare_exchange_n(&pool_first_done, &none, time_ns(), false,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+        _info("Worker %u: offset %#x finished\n", w->id, offset);
+    }
+    w->duration = time_ns() - start;
+
+    // verify while the helper thread is still around
+    for (u32 c = 0; c < pool_n_offset; c++) {
+        if (offset_owner[pool_idxs[c]] == w->id) {
+            verify_sf_evsets_at(pool_idxs[c]);
+        }
+    }
+
+    if (!single_thread) {
+        stop_helper_thread(&w->hctrl);
+    }
+    return NULL;
+}
+
+int build_sf_evset_all(u32 n_offset) {
+    static u32 idxs[NUM_OFFSETS] = {0};
     for (u32 i = 0; i < NUM_OFFSETS; i++) {
         idxs[i] = i;
     }
@@ -182,137 +697,244 @@ int build_sf_evset_all(u32 n_offset) {
         shuffle_index(idxs, NUM_OFFSETS);
     }
 
-    EVBuildConfig sf_config;
+    // outlives the workers, for the evsets they leave behind
+    static EVBuildConfig sf_config;
     default_skx_sf_evset_build_config(&sf_config, NULL, NULL, &hctrl);
     sf_config.algorithm = evalgo;
     sf_config.cands_config.scaling = cands_scaling;
+    sf_config.cands_config.pa_assist = pa_assist;
     sf_config.algo_config.verify_retry = max_tries;
     sf_config.algo_config.max_backtrack = max_backtrack;
     sf_config.algo_config.retry_timeout = max_timeout;
     sf_config.algo_config.ret_partial = true;
     sf_config.algo_config.prelim_test = true;
     sf_config.algo_config.extra_cong = extra_cong;
+    sf_config.algo_config.next_batch =
+        next_batch < 0 ? detected_l3->n_ways - 1 : next_batch;
+    sf_config.algo_config.bulk = bulk;
 
-    EVCands ***sf_cands = build_evcands_all(&sf_config, l2evsets);
-    if (!sf_cands) {
-        _error("Failed to allocate or filter SF candidates\n");
+    EVSet ****sfevset_complex = calloc(NUM_OFFSETS, sizeof(*sfevset_complex));
+    if (!sfevset_complex) {
+        _error("Failed to allocate SF complex\n");
         return EXIT_FAILURE;
     }
 
+    for (u32 n = 0; n < NUM_OFFSETS; n++) {
+        sfevset_complex[n] =
+            calloc(num_l2sets, sizeof(**sfevset_complex));
+        if (!sfevset_complex[n]) {
+            _error("Failed to allocate SF sub-complex\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    EVSet ***l2evsets = NULL;
+    EVCands ***sf_cands = NULL;
+    size_t l3_cnt = cache_uncertainty(detected_l3) / num_l2sets;
+    bool reused = false;
+    if (store_dir && open_store_buffers(&sf_config, &reused)) {
+        _error("Failed to open the buffers in %s\n", store_dir);
+        return EXIT_FAILURE;
+    }
+
+    evstore *store = NULL;
+    if (reused) {
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/index", store_dir);
+        store = evstore_load(path, store_bufs, _array_size(store_bufs));
+    }
+
+    if (store) {
+        u64 start = time_ns();
+        l2evsets = restore_l2_evsets_all(store);
+        if (l2evsets) {
+            sf_cands = restore_evcands_all(store, &sf_config);
+        }
+
+        if (sf_cands) {
+            size_t n_restored = restore_sf_evsets_all(
+                store, &sf_config, sf_cands, sfevset_complex, l3_cnt);
+            _info("Restored %lu SF evsets in %.3fms\n", n_restored,
+                  (time_ns() - start) / 1e6);
+        } else {
+            // L2 colors may have changed; start over
+            _warn("Failed to restore from %s; rebuilding\n", store_dir);
+            l2evsets = NULL;
+        }
+        evstore_free(store);
+    }
+
+    if (!l2evsets) {
+        l2evsets = build_l2_evsets_all(store_bufs[STORE_L2_BUF]);
+        if (!l2evsets) {
+            _error("Failed to build L2 evset complex\n");
+            return EXIT_FAILURE;
+        }
+
+        sf_cands = build_evcands_all(&sf_config, l2evsets,
+                                     store_bufs[STORE_LLC_BUF]);
+        if (!sf_cands) {
+            _error("Failed to allocate or filter SF candidates\n");
+            return EXIT_FAILURE;
+        }
+    }
+
     reset_evset_stats();
 
     if (single_thread) {
         sf_config.test_config.traverse = skx_sf_cands_traverse_st;
         sf_config.test_config.need_helper = false;
-    } else {
-        start_helper_thread(sf_config.test_config.hctrl);
+    }
+
+    if (use_sprt) {
+        // workers inherit the calibrated config
+        sf_config.test_config.lower_ev = l2evsets[0][0];
+        u8 *cali_target = sf_cands[0][0]->cands[0];
+        bool err = (!single_thread && start_helper_thread(&hctrl)) ||
+                   enable_sprt(cali_target, &sf_config.test_config);
+        stop_helper_thread(&hctrl);
+        if (err) {
+            _error("Failed to calibrate the SPRT test\n");
+            return EXIT_FAILURE;
+        }
     }
 
     n_offset = _min(n_offset, NUM_OFFSETS);
     if (n_offset == 0) {
         n_offset = NUM_OFFSETS;
     }
+    n_workers = _min(n_workers, n_offset);
 
-    EVSet ****sfevset_complex = calloc(NUM_OFFSETS, sizeof(*sfevset_complex));
-    if (!sfevset_complex) {
-        _error("Failed to allocate SF complex\n");
+    // keep the helper mailboxes cache-line aligned
+    sf_worker *workers = NULL;
+    if (!posix_memalign((void **)&workers, CL_SIZE,
+                        n_workers * sizeof(*workers))) {
+        memset(workers, 0, n_workers * sizeof(*workers));
+    }
+    if (!workers || assign_worker_cores(workers, n_workers)) {
+        _error("Failed to set up %u workers\n", n_workers);
         return EXIT_FAILURE;
     }
 
-    for (u32 n = 0; n < NUM_OFFSETS; n++) {
-        sfevset_complex[n] =
-            calloc(num_l2sets, sizeof(**sfevset_complex));
-        if (!sfevset_complex[n]) {
-            _error("Failed to allocate SF sub-complex\n");
-            return EXIT_FAILURE;
-        }
+    pool_l2evsets = l2evsets;
+    pool_sf_cands = sf_cands;
+    pool_sfevset_complex = sfevset_complex;
+    pool_idxs = idxs;
+    pool_n_offset = n_offset;
+    pool_l3_cnt = l3_cnt;
+    pool_lower_cache = NULL;
+    pool_lower_conf = NULL;
+    pool_n_lower_evsets = 0;
+    if (!l2_filter) {
+        pool_lower_cache = detected_l2;
+        pool_lower_conf = &def_l2_ev_config;
+        pool_n_lower_evsets = cache_uncertainty(detected_l2);
     }
 
-    _info("About to start evset construction\n");
-    size_t l3_cnt;
-
-    cache_param *lower_cache = NULL;
-    EVBuildConfig *lower_conf = NULL;
-    size_t n_lower_evsets = 0;
-    if (!l2_filter) {
-        lower_cache = detected_l2;
-        lower_conf = &def_l2_ev_config;
-        n_lower_evsets = cache_uncertainty(detected_l2);
+    memset(offset_owner, 0xff, sizeof(offset_owner));
+    offset_queue_init(&pool_queue, pipeline_depth);
+    if (pipeline_depth && cpu_topology_pick(1, 1, &producer_core)) {
+        _warn("Preparing candidates on an unpinned producer\n");
+        producer_core = -1;
     }
 
+    _info("About to start evset construction with %u worker(s)\n", n_workers);
     u64 start = time_ns(), end;
-    for (u32 c = 0; c < n_offset; c++) {
-        u32 n = idxs[c];
-        u32 offset = n * CL_SIZE;
-        for (u32 i = 0; i < num_l2sets; i++) {
-            sf_config.test_config.lower_ev = l2evsets[n][i];
-            EVSet **sf_evsets = build_evsets_at(
-                offset, &sf_config, detected_l3, sf_cands[n][i], &l3_cnt,
-                lower_cache, lower_conf, l2evsets[n], n_lower_evsets);
-            sfevset_complex[n][i] = sf_evsets;
-            if (!sf_evsets) {
-                _error("No sf evsets are built!\n");
-            }
+    pool_start = start;
+    pool_first_done = 0;
+    if (pipeline_depth &&
+        pthread_create(&producer_pid, NULL, sf_producer_run, NULL)) {
+        _error("Failed to start the candidate producer\n");
+        return EXIT_FAILURE;
+    }
+    for (u32 w = 0; w < n_workers; w++) {
+        workers[w].id = w;
+        memcpy(&workers[w].config, &sf_config, sizeof(sf_config));
+        workers[w].config.stats = evset_stats_new();
+        if (!workers[w].config.stats) {
+            return EXIT_FAILURE;
+        }
+        if (w == 0) continue; // the first worker runs on the main thread
 
-            if (total_runtime_limit &&
-                ((time_ns() - start) / 1e9 >= total_runtime_limit * 60)) {
-                _error("Timeout break!\n");
-                goto timeout_break;
-            }
+        if (pthread_create(&workers[w].pid, NULL, sf_worker_run, &workers[w])) {
+            _error("Failed to start worker %u\n", w);
+            return EXIT_FAILURE;
         }
-        _info("Offset %#x finished\n", offset);
+    }
+    sf_worker_run(&workers[0]);
+    for (u32 w = 1; w < n_workers; w++) {
+        pthread_join(workers[w].pid, NULL);
     }
 
-timeout_break:
     end = time_ns();
+    if (pipeline_depth) {
+        offset_queue_close(&pool_queue);
+        pthread_join(producer_pid, NULL);
+        cpu_topology_release(producer_core);
+        // offsets prepared but not taken before a timeout
+        for (u32 n; !offset_queue_pop(&pool_queue, &n);) {
+            for (u32 i = 0; i < num_l2sets; i++) {
+                evcands_release(pool_sf_cands[n][i]);
+            }
+        }
+    }
+    offset_queue_destroy(&pool_queue);
     _info("Finished evset construction\n");
     _info("L3 Duration: %.3fms\n", (end - start) / 1e6);
+    if (pool_first_done) {
+        _info("First offset: %.3fms\n", (pool_first_done - start) / 1e6);
+    }
+
+    size_t n_built = 0;
+    for (u32 w = 0; w < n_workers; w++) {
+        n_built += workers[w].n_built;
+        _info("Worker %u (core %d, helper %d): %lu evsets (%lu repaired) in "
+              "%.3fms; Tests: %lu; Mem Acc.: %lu\n", w, workers[w].core,
+              workers[w].helper_core, workers[w].n_built,
+              workers[w].n_repaired, workers[w].duration / 1e6,
+              workers[w].config.stats->cands_tests,
+              workers[w].config.stats->mem_accs);
+    }
+    _info("Throughput: %.2f evsets/s\n", n_built / ((end - start) / 1e9));
     pprint_evset_stats();
+    if (stats_path) {
+        dump_stats(stats_path);
+    }
+    if (trace_path) {
+        evtrace_stop();
+        dump_trace(trace_path);
+        evtrace_cleanup();
+    }
 
     size_t total_succ = 0, total_sf_succ = 0;
     for (u32 c = 0; c < n_offset; c++) {
         u32 n = idxs[c];
-        size_t offset_succ = 0, offset_sf_succ = 0;
-        for (u32 i = 0; i < num_l2sets; i++) {
-            if (!sfevset_complex[n][i]) {
-                continue;
-            }
-
-            for (u32 j = 0; j < l3_cnt; j++) {
-                EVSet *sf_evset = sfevset_complex[n][i][j];
-                if (!sf_evset || !sf_evset->addrs) {
-                    continue;
-                }
-
-                EVTestRes llc_test = evset_self_precise_test(sf_evset);
-                bool succ = llc_test == EV_POS;
-                offset_succ += succ;
-                total_succ += succ;
-
-                sf_evset->config->test_config_alt.foreign_evictor = true;
-
-                if (sf_evset->size > SF_ASSOC + 1) {
-                    sf_evset->size = SF_ASSOC + 1;
-                }
-
-                EVTestRes sf_test = evset_self_precise_test_alt(sf_evset);
-                bool sf_succ = sf_test == EV_POS;
-                offset_sf_succ += sf_succ;
-                total_sf_succ += sf_succ;
-            }
-        }
-
+        total_succ += offset_succ[n];
+        total_sf_succ += offset_sf_succ[n];
         _info("Offset %#5lx: %lu/%lu/%lu (LLC/SF/Expecting)\n", n * CL_SIZE,
-              offset_succ, offset_sf_succ, cache_uncertainty(detected_l3));
+              offset_succ[n], offset_sf_succ[n], cache_uncertainty(detected_l3));
     }
 
     _info("Aggregated: %lu/%lu/%lu (LLC/SF/Expecting)\n",
           total_succ, total_sf_succ, cache_uncertainty(detected_l3) * n_offset);
 
-    if (!single_thread) {
-        stop_helper_thread(sf_config.test_config.hctrl);
+    if (cache_oracle_inited()) {
+        size_t n_checked = 0, n_congruent = 0;
+        u64 oracle_start = time_ns();
+        for (u32 c = 0; c < n_offset; c++) {
+            n_congruent += oracle_check_evsets_at(idxs[c], &n_checked);
+        }
+        _info("Oracle: %lu/%lu evsets are congruent (%.3fms)\n", n_congruent,
+              n_checked, (time_ns() - oracle_start) / 1e6);
     }
 
+    if (store_dir &&
+        save_store(l2evsets, sf_cands, sfevset_complex, l3_cnt)) {
+        _warn("Failed to save evsets to %s\n", store_dir);
+    }
+
+    rebind_sf_evsets(&sf_config);
+    free(workers);
     return EXIT_SUCCESS;
 }
 
@@ -358,21 +980,39 @@ int main(int argc, char **argv) {
         {"timeout", required_argument, NULL, 'T'},
         {"algorithm", required_argument, NULL, 'A'},
         {"total-run-time-limit", required_argument, NULL, 'L'}, // in minutes
+        {"workers", required_argument, NULL, 'j'},
+        {"store", required_argument, NULL, 'S'},
+        {"sprt", no_argument, NULL, 'P'},
+        {"next-batch", required_argument, NULL, 'N'},
+        {"bulk", no_argument, NULL, 'K'},
+        {"stats", required_argument, NULL, 'J'},
+        {"trace", required_argument, NULL, 't'},
+        {"pipeline", required_argument, NULL, 'Q'},
+        {"pa-assist", no_argument, NULL, 'a'},
         {0, 0, 0, 0}
     };
 
     char *algo_name = "default";
-    while ((opt = getopt_long(argc, argv, "fsC:B:R:T:A:L:", long_opts,
-                              &opt_idx)) != -1) {
+    while ((opt = getopt_long(argc, argv, "fsPKaC:B:R:T:A:L:j:S:N:J:t:Q:",
+                              long_opts, &opt_idx)) != -1) {
         switch (opt) {
             case 'f': l2_filter = false; break;
             case 's': single_thread = true; break;
+            case 'P': use_sprt = true; break;
+            case 'K': bulk = true; break;
+            case 'a': pa_assist = true; break;
             case 'C': cands_scaling = strtod(optarg, NULL); break;
             case 'B': max_backtrack = strtoull(optarg, NULL, 10); break;
             case 'R': max_tries = strtoull(optarg, NULL, 10); break;
             case 'T': max_timeout = strtoull(optarg, NULL, 10); break;
             case 'A': algo_name = optarg; break;
             case 'L': total_runtime_limit = strtoull(optarg, NULL, 10); break;
+            case 'j': n_workers = _max(strtoul(optarg, NULL, 10), 1); break;
+            case 'S': store_dir = optarg; break;
+            case 'N': next_batch = strtoll(optarg, NULL, 10); break;
+            case 'J': stats_path = optarg; break;
+            case 't': trace_path = optarg; break;
+            case 'Q': pipeline_depth = strtoul(optarg, NULL, 10); break;
             default: _error("Unknown option %c\n", opt); return EXIT_FAILURE;
         }
     }
@@ -384,6 +1024,11 @@ int main(int argc, char **argv) {
 
     _info("Algorithm: %s\n", algo_name);
 
+    if (store_dir && !l2_filter) {
+        _error("--store requires the L2 filter\n");
+        return EXIT_FAILURE;
+    }
+
     if (cache_env_init(1)) {
         _error("Failed to initialize cache env!\n");
         return EXIT_FAILURE;
@@ -393,6 +1038,17 @@ int main(int argc, char **argv) {
 
     extra_cong = SF_ASSOC - detected_l3->n_ways;
     cache_oracle_init();
+    def_l2_ev_config.cands_config.pa_assist = pa_assist;
+    if (pa_assist && cache_oracle_pa_inited()) {
+        _info("PA assist: candidates are grouped by physical address, so the "
+              "oracle check is not independent\n");
+    } else if (pa_assist) {
+        _warn("PA assist needs physical addresses (root), building from "
+              "timing only\n");
+    }
+    if (trace_path) {
+        evtrace_start(1 << 16);
+    }
     int ret = build_sf_evset_all(n_offset);
     cache_oracle_cleanup();
     return ret;
@@ -9,8 +9,13 @@ static evset_algorithm evalgo = EVSET_ALGO_DEFAULT;
 static double cands_scaling = 3;
 static size_t extra_cong = 1;
 static size_t max_tries = 10, max_backtrack = 20, max_timeout = 0;
-static bool l2_filter = true, single_thread = false, has_hugepage = false;
+static bool l2_filter = true, single_thread = false, has_hugepage = false,
+            has_gigapage = false;
+static bool use_sprt = false, pa_assist = false;
+static const char *slice_model_dir = NULL;
 static helper_thread_ctrl hctrl;
+static helper_thread_pool hpool;
+static u32 n_helpers = 1;
 
 u8 *page, *target;
 
@@ -32,15 +37,28 @@ int test_page_continuity(u8 *hugepage) {
     return cnt;
 }
 
+// pin this thread and the helpers to distinct physical cores sharing an LLC
+static bool pin_helper_cores(int *cores) {
+    int cpus[n_helpers + 1];
+    if (cpu_topology_pick(1, n_helpers + 1, cpus)) {
+        return true;
+    }
+    memcpy(cores, cpus + 1, n_helpers * sizeof(*cores));
+    return !set_proc_affinity(cpus[0]);
+}
+
 int single_l2_evset() {
     def_l2_ev_config.algorithm = evalgo;
     def_l2_ev_config.cands_config.scaling = cands_scaling;
+    def_l2_ev_config.cands_config.pa_assist = pa_assist;
     def_l2_ev_config.algo_config.verify_retry = max_tries;
     def_l2_ev_config.algo_config.max_backtrack = max_backtrack;
     def_l2_ev_config.algo_config.retry_timeout = max_timeout;
     def_l2_ev_config.algo_config.ret_partial = true;
 
-    if (has_hugepage) {
+    if (has_gigapage) {
+        cache_use_gigapage();
+    } else if (has_hugepage) {
         cache_use_hugepage();
     }
 
@@ -56,7 +74,7 @@ int single_l2_evset() {
     _info("Duration: %.3fms; Size: %u; Candidates: %lu\n", (end - start) / 1e6,
           evset->size, evset->cands->size);
 
-    if (cache_oracle_inited()) {
+    if (cache_oracle_pa_inited()) {
         u32 target_set = cache_set_idx(target, detected_l2), match = 0;
         printf("Target: %p; set=%#x\n", target, target_set);
         for (u32 i = 0; i < evset->size; i++) {
@@ -90,7 +108,9 @@ int single_llc_evset() {
         return EXIT_FAILURE;
     }
 
-    if (has_hugepage) {
+    if (has_gigapage) {
+        cache_use_gigapage();
+    } else if (has_hugepage) {
         cache_use_hugepage();
     }
 
@@ -98,6 +118,7 @@ int single_llc_evset() {
     default_skx_sf_evset_build_config(&sf_config, NULL, l2_evset, &hctrl);
     sf_config.algorithm = evalgo;
     sf_config.cands_config.scaling = cands_scaling;
+    sf_config.cands_config.pa_assist = pa_assist;
     sf_config.algo_config.verify_retry = max_tries;
     sf_config.algo_config.max_backtrack = max_backtrack;
     sf_config.algo_config.retry_timeout = max_timeout;
@@ -128,6 +149,18 @@ int single_llc_evset() {
     if (single_thread) {
         sf_config.test_config.traverse = skx_sf_cands_traverse_st;
         sf_config.test_config.need_helper = false;
+    } else if (n_helpers > 1) {
+        int cores[n_helpers];
+        if (pin_helper_cores(cores) ||
+            start_helper_pool(&hpool, n_helpers, cores)) {
+            _error("Failed to start %u helpers\n", n_helpers);
+            return EXIT_FAILURE;
+        }
+        // the first helper also shares the target
+        sf_config.test_config.hctrl = &hpool.ctrls[0];
+        sf_config.test_config.hpool = &hpool;
+        sf_config.test_config_alt.hctrl = &hpool.ctrls[0];
+        sf_config.test_config_alt.hpool = &hpool;
     } else {
         start_helper_thread(sf_config.test_config.hctrl);
     }
@@ -138,6 +171,11 @@ int single_llc_evset() {
         return EXIT_FAILURE;
     }
 
+    if (use_sprt && enable_sprt(target, &sf_config.test_config)) {
+        _error("Failed to calibrate the SPRT test\n");
+        return EXIT_FAILURE;
+    }
+
     reset_evset_stats();
     start = time_ns();
     EVSet *sf_evset = build_skx_sf_EVSet(target, &sf_config, cands);
@@ -159,24 +197,69 @@ int single_llc_evset() {
     sf_config.test_config_alt.foreign_evictor = true;
     _info("SF EV Test Level: %d\n", precise_evset_test_alt(target, sf_evset));
 
-    if (!single_thread) {
+    if (hpool.n_helpers) {
+        stop_helper_pool(&hpool);
+    } else if (!single_thread) {
         stop_helper_thread(sf_config.test_config.hctrl);
     }
 
-    if (cache_oracle_inited()) {
+    u64 *hashes = NULL;
+    if (cache_oracle_inited() &&
+        (hashes = _calloc(sf_evset->size, sizeof(*hashes)))) {
         u64 target_hash = llc_addr_hash(target), match = 0;
+        llc_addr_hash_batch((void **)sf_evset->addrs, sf_evset->size, hashes);
         printf("Target: %p; hash=%#lx\n", target, target_hash);
         for (u32 i = 0; i < sf_evset->size; i++) {
-            u64 hash = llc_addr_hash(sf_evset->addrs[i]);
-            printf("%2u: %p (hash=%#lx)\n", i, sf_evset->addrs[i], hash);
-            match += hash == target_hash;
+            printf("%2u: %p (hash=%#lx)\n", i, sf_evset->addrs[i], hashes[i]);
+            match += hashes[i] == target_hash;
         }
         printf("Match: %lu\n", match);
     }
+    _free(hashes);
 
     return EXIT_SUCCESS;
 }
 
+#define SLICE_LEARN_BUF_SIZE (256ul << 20)
+#define SLICE_LEARN_SAMPLES 4096
+
+// sample lines of a large buffer through the CHA oracle, and merge them into
+// the slice model of this CPU model
+int learn_slice_model() {
+    const char *dir = slice_model_dir ? slice_model_dir : ".";
+    u8 *buf = mmap_shared_init(NULL, SLICE_LEARN_BUF_SIZE, 0);
+    slice_model *m = cache_slice_model;
+    if (!m) {
+        m = slice_model_new(detected_l3->n_slices);
+    }
+
+    int ret = EXIT_FAILURE;
+    if (!buf || !m) {
+        _error("Failed to allocate the slice model or its buffer\n");
+        goto err;
+    }
+
+    if (slice_model_learn(m, buf, SLICE_LEARN_BUF_SIZE, SLICE_LEARN_SAMPLES) ||
+        slice_model_save(m, dir)) {
+        goto err;
+    }
+
+    char path[4096];
+    slice_model_path(path, sizeof(path), dir, m->n_slices);
+    _info("Saved a %s slice model to %s\n",
+          m->kind == SLICE_MODEL_LINEAR ? "linear" : "table", path);
+    ret = EXIT_SUCCESS;
+
+err:
+    if (buf) {
+        munmap(buf, SLICE_LEARN_BUF_SIZE);
+    }
+    if (m != cache_slice_model) {
+        slice_model_free(m);
+    }
+    return ret;
+}
+
 int main(int argc, char **argv) {
     if (argc < 2) {
         _error("./osc-single-evset <action>");
@@ -190,26 +273,38 @@ int main(int argc, char **argv) {
         {"no-filter", no_argument, NULL, 'f'},
         {"single-thread", no_argument, NULL, 's'},
         {"hugepage", no_argument, NULL, 'H'},
+        {"gigapage", no_argument, NULL, 'G'},
         {"cands-scale", required_argument, NULL, 'C'},
         {"max-backtrack", required_argument, NULL, 'B'},
         {"max-tries", required_argument, NULL, 'R'},
         {"timeout", required_argument, NULL, 'T'},
         {"algorithm", required_argument, NULL, 'A'},
+        {"sprt", no_argument, NULL, 'P'},
+        {"slice-model", required_argument, NULL, 'S'},
+        {"trace", required_argument, NULL, 't'},
+        {"helpers", required_argument, NULL, 'k'},
+        {"pa-assist", no_argument, NULL, 'a'},
         {0, 0, 0, 0}
     };
 
-    char *algo_name = "default";
-    while ((opt = getopt_long(argc, argv, "fsHC:B:R:T:A:", long_opts,
+    char *algo_name = "default", *trace_path = NULL;
+    while ((opt = getopt_long(argc, argv, "fsHGPaC:B:R:T:A:S:t:k:", long_opts,
                               &opt_idx)) != -1) {
         switch (opt) {
             case 'f': l2_filter = false; break;
             case 's': single_thread = true; break;
             case 'H': has_hugepage = true; break;
+            case 'G': has_hugepage = has_gigapage = true; break;
+            case 'P': use_sprt = true; break;
+            case 'a': pa_assist = true; break;
             case 'C': cands_scaling = strtod(optarg, NULL); break;
             case 'B': max_backtrack = strtoull(optarg, NULL, 10); break;
             case 'R': max_tries = strtoull(optarg, NULL, 10); break;
             case 'T': max_timeout = strtoull(optarg, NULL, 10); break;
             case 'A': algo_name = optarg; break;
+            case 'S': slice_model_dir = optarg; break;
+            case 't': trace_path = optarg; break;
+            case 'k': n_helpers = _max(strtoul(optarg, NULL, 10), 1); break;
             default: _error("Unknown option %c\n", opt); return EXIT_FAILURE;
         }
     }
@@ -226,13 +321,51 @@ int main(int argc, char **argv) {
     }
     cache_oracle_init();
 
+    if (slice_model_dir && detected_l3) {
+        cache_slice_model =
+            slice_model_load(slice_model_dir, detected_l3->n_slices);
+        if (cache_slice_model && !slice_model_generalizes(cache_slice_model)) {
+            _warn("A table slice model (%u slices, not a power of two) only "
+                  "knows the lines it sampled, --slice-model has no effect\n",
+                  detected_l3->n_slices);
+        } else if (cache_slice_model) {
+            // the model only groups candidates along with their sets
+            pa_assist = true;
+        }
+    }
+
+    if (pa_assist && cache_oracle_pa_inited()) {
+        _info("PA assist: candidates are grouped by physical address%s, so "
+              "the oracle check is not independent\n",
+              slice_model_generalizes(cache_slice_model)
+                  ? " and modelled slice"
+                  : "");
+    } else if (pa_assist) {
+        _warn("PA assist needs physical addresses (root), building from "
+              "timing only\n");
+    }
+
+    hugepage_buf target_hp = {0};
     if (has_hugepage) {
-        page = mmap_huge_shared_init(NULL, PAGE_SIZE, 'a');
-        l2_filter = false;
-        _info("Disabling L2 filtering when using hugepages\n");
+        // candidates only share the target's bits below their congruent
+        // stride, which a 2MB page covers even in the 1GB mode
+        if (!hugepage_alloc(&target_hp, HUGE_PAGE_SIZE, HUGE_PAGE_SIZE,
+                            HUGE_PAGE_SHIFT) &&
+            !hugepage_region_huge(&target_hp, 0)) {
+            _warn("The target is not on a hugepage, disabling hugepages\n");
+            has_hugepage = has_gigapage = false;
+        }
+        if ((page = target_hp.buf)) {
+            memset(page, 'a', PAGE_SIZE);
+        }
     } else {
         page = mmap_shared_init(NULL, PAGE_SIZE, 'a');
     }
+
+    if (has_hugepage) {
+        l2_filter = false;
+        _info("Disabling L2 filtering when using hugepages\n");
+    }
     if (!page) {
         _error("Failed to allocate the target page\n");
         return EXIT_FAILURE;
@@ -243,6 +376,9 @@ int main(int argc, char **argv) {
     target = page + offset;
 
     int ret = EXIT_SUCCESS;
+    if (trace_path) {
+        evtrace_start(1 << 16);
+    }
 
     if (strcmp(action, "L2") == 0) {
         ret = single_l2_evset();
@@ -252,12 +388,21 @@ int main(int argc, char **argv) {
     } else if (strcmp(action, "SF") == 0) {
         extra_cong = SF_ASSOC - detected_l3->n_ways;
         ret = single_llc_evset();
+    } else if (strcmp(action, "HASH") == 0) {
+        ret = learn_slice_model();
     } else {
         _error("Unknown action!\n");
         ret = EXIT_FAILURE;
     }
 
+    if (trace_path) {
+        evtrace_stop();
+        dump_trace(trace_path);
+        evtrace_cleanup();
+    }
+
     munmap(page, PAGE_SIZE);
+    slice_model_free(cache_slice_model);
     cache_oracle_cleanup();
     return ret;
 }
@@ -1,12 +1,28 @@
 #include "tests.h"
 #include "cache/cache.h"
 #include "cache/evset.h"
+#include "cache/sim.h"
 
 unittest_res test_evcands() {
     if (cache_env_init(0)) {
         return UNITTEST_ERR;
     }
 
+    // 1GB pages only help caches whose set index reaches past 2MB, e.g.,
+    // one with 64K sets per slice
+    cache_param big = *detected_l3;
+    big.num_set_idx_bits = 16;
+    cache_param *caches[] = {detected_l2, detected_l3, &big};
+    for (u32 c = 0; c < _array_size(caches); c++) {
+        cache_param *p = caches[c];
+        size_t huge = cache_uncertainty_at(p, HUGE_PAGE_SHIFT);
+        size_t giga = cache_uncertainty_at(p, GIGA_PAGE_SHIFT);
+        bool fits = p->num_set_idx_bits + p->num_cl_bits <= HUGE_PAGE_SHIFT;
+        if (giga != p->n_slices || (fits ? huge != giga : huge <= giga)) {
+            return UNITTEST_FAIL;
+        }
+    }
+
     EVCandsConfig config = {2, NULL};
     EVCands *cands = evcands_new(detected_l2, &config, NULL);
     if (!cands) {
@@ -14,6 +30,8 @@ unittest_res test_evcands() {
     }
 
     unittest_res res = UNITTEST_FAIL;
+    EVCands *view = NULL;
+    EVSet *evset = NULL, *evset_view = NULL;
     if (cands->evb->n_pages !=
         cache_uncertainty(detected_l2) * detected_l2->n_ways * 2) {
         goto err;
@@ -28,9 +46,212 @@ unittest_res test_evcands() {
             goto err;
         }
     }
+
+    // shifted views are expanded from page indices on demand
+    view = evcands_shift(cands, 0x80);
+    if (!view || view->cands || evcands_materialize(view) ||
+        view->size != cands->size) {
+        goto err;
+    }
+
+    for (size_t n = 0; n < view->size; n++) {
+        if (view->cands[n] != cands->evb->buf + 0x80 + n * PAGE_SIZE) {
+            goto err;
+        }
+    }
+
+    evset = evset_new(0x400, &def_l2_ev_config, detected_l2, cands);
+    if (!evset) {
+        goto err;
+    }
+    evset->addrs[0] = cands->cands[3];
+    evset->addrs[1] = cands->cands[1];
+    evset->size = 2;
+
+    evset_view = evset_shift(evset, 0xc0);
+    if (!evset_view || evset_view->addrs || evset_materialize(evset_view) ||
+        evset_view->size != 2 ||
+        evset_view->addrs[0] != cands->evb->buf + 0xc0 + 3 * PAGE_SIZE ||
+        evset_view->addrs[1] != cands->evb->buf + 0xc0 + PAGE_SIZE) {
+        goto err;
+    }
+
+    // views expand the current lines of their base, which they outlive
+    evset_free(evset_view);
+    evset_view = evset_shift(evset, 0x100);
+    evset->addrs[1] = cands->cands[2];
+    evset_free(evset);
+    evset = NULL;
+    if (!evset_view || evset_materialize(evset_view) ||
+        evset_view->addrs[1] != cands->evb->buf + 0x100 + 2 * PAGE_SIZE) {
+        goto err;
+    }
+
+    // candidates with views cannot be repopulated, but are re-snapshotted
+    // once the views are gone
+    if (!evcands_populate(0x400, cands, &config)) {
+        goto err;
+    }
+    evcands_free(view);
+    view = NULL;
+    if (evcands_populate(0x800, cands, &config) ||
+        !(view = evcands_shift(cands, 0x40)) || evcands_materialize(view) ||
+        view->cands[0] != cands->evb->buf + 0x40) {
+        goto err;
+    }
     res = UNITTEST_PASS;
 
 err:
+    evset_free(evset_view);
+    evset_free(evset);
+    evcands_free(view);
+    evcands_free(cands);
+    return res;
+}
+
+static int line_cmp(const void *a, const void *b) {
+    uintptr_t la = *(const uintptr_t *)a, lb = *(const uintptr_t *)b;
+    return (la > lb) - (la < lb);
+}
+
+// classify the lines at "offset" with the L2 evsets, whose tests run on
+// "test_sim", in "n_threads" slices, and check the merged colors against the
+// true ones "sim" gives; "n_classified" counts the lines of both colors
+static unittest_res colors_classified(cache_sim *sim, cache_sim *test_sim,
+                                      EVSet **l2_evsets, u64 *keys,
+                                      EVBuffer *evb, u32 offset,
+                                      u32 n_threads, size_t *n_classified) {
+    unittest_res res = UNITTEST_FAIL;
+    EVCandsConfig cands_config = {1, NULL};
+    EVCands *cands[2] = {NULL, NULL};
+    u8 **all = NULL;
+    cands[0] = evcands_new(detected_l3, &cands_config, evb);
+    cands[1] = evcands_new(detected_l3, &cands_config, evb);
+    if (!cands[0] || !cands[1]) {
+        res = UNITTEST_ERR;
+        goto err;
+    }
+
+    def_l2_ev_config.test_config.sim = test_sim;
+    for (u32 c = 0; c < 2; c++) {
+        l2_evsets[c]->config->test_config.sim = test_sim;
+    }
+    if (evcands_populate_colors(offset, cands, l2_evsets, 2, &cands_config,
+                                n_threads, NULL)) {
+        goto err;
+    }
+
+    for (u32 c = 0; c < 2; c++) {
+        if (!cands[c]->size || cands[c]->offset != offset) {
+            goto err;
+        }
+        for (size_t i = 0; i < cands[c]->size; i++) {
+            if (cache_sim_key(sim, 2, cands[c]->cands[i]) != keys[c]) {
+                _error("Line %lu of color %u is misclassified\n", i, c);
+                goto err;
+            }
+        }
+    }
+
+    // no line is merged twice
+    *n_classified = cands[0]->size + cands[1]->size;
+    all = _calloc(*n_classified, sizeof(*all));
+    if (!all) {
+        res = UNITTEST_ERR;
+        goto err;
+    }
+    memcpy(all, cands[0]->cands, cands[0]->size * sizeof(*all));
+    memcpy(all + cands[0]->size, cands[1]->cands,
+           cands[1]->size * sizeof(*all));
+    qsort(all, *n_classified, sizeof(*all), line_cmp);
+    for (size_t i = 1; i < *n_classified; i++) {
+        if (all[i] == all[i - 1]) {
+            _error("Line %p is classified twice\n", all[i]);
+            goto err;
+        }
+    }
+    res = UNITTEST_PASS;
+
+err:
+    _free(all);
+    evcands_free(cands[1]);
+    evcands_free(cands[0]);
+    return res;
+}
+
+// every line is classified to the color of the L2 evset that evicts it, also
+// when latency noise lets some tests of other colors pass; the simulator
+// tells the true color
+unittest_res test_evcands_colors() {
+    cache_sim *sim = small_sim_new(0), *noisy = small_sim_new(0.4);
+    if (!sim || !noisy) {
+        if (sim) cache_sim_free(sim);
+        if (noisy) cache_sim_free(noisy);
+        return UNITTEST_ERR;
+    }
+    cache_sim_env_init(sim);
+
+    unittest_res res = UNITTEST_FAIL;
+    EVCandsConfig cands_config = {1, NULL};
+    EVCands *cands = NULL;
+    EVSet *l2_evsets[2] = {NULL, NULL};
+    u64 keys[2];
+    u32 offset = 5 * CL_SIZE;
+    cands = evcands_new(detected_l3, &cands_config, NULL);
+    if (!cands) {
+        res = UNITTEST_ERR;
+        goto err;
+    }
+
+    // two targets of different colors in the candidate buffer
+    u8 *buf = cands->evb->buf + offset, *targets[2] = {buf, NULL};
+    keys[0] = cache_sim_key(sim, 2, targets[0]);
+    for (size_t n = 1; n < cands->evb->n_pages && !targets[1]; n++) {
+        if (cache_sim_key(sim, 2, buf + n * PAGE_SIZE) != keys[0]) {
+            targets[1] = buf + n * PAGE_SIZE;
+        }
+    }
+    if (!targets[1]) {
+        goto err;
+    }
+    keys[1] = cache_sim_key(sim, 2, targets[1]);
+
+    for (u32 c = 0; c < 2; c++) {
+        l2_evsets[c] = build_l2_EVSet(targets[c], &def_l2_ev_config, NULL);
+        if (!l2_evsets[c]) {
+            _error("Failed to build a simulated l2 eviction set\n");
+            goto err;
+        }
+    }
+
+    // without noise, slicing the lines over threads, each testing in a clone
+    // of the simulator, classifies about as many lines as a single thread;
+    // single tests, as on ICELAKE, depend on what the clones have cached. The
+    // noisy simulator maps the buffer the same way, having the same seed
+    size_t n_single, n_sliced, n_noisy;
+    res = colors_classified(sim, sim, l2_evsets, keys, cands->evb, offset, 1,
+                            &n_single);
+    if (res == UNITTEST_PASS) {
+        res = colors_classified(sim, sim, l2_evsets, keys, cands->evb, offset,
+                                3, &n_sliced);
+    }
+    if (res == UNITTEST_PASS && n_sliced * 4 < n_single * 3) {
+        _error("%lu lines classified in slices, %lu in one\n", n_sliced,
+               n_single);
+        res = UNITTEST_FAIL;
+    }
+    if (res == UNITTEST_PASS) {
+        res = colors_classified(sim, noisy, l2_evsets, keys, cands->evb,
+                                offset, 3, &n_noisy);
+    }
+
+err:
+    for (u32 c = 0; c < 2; c++) {
+        evset_free(l2_evsets[c]);
+    }
     evcands_free(cands);
+    cache_sim_free(noisy);
+    cache_sim_free(sim);
+    cache_env_init(0); // back to the detected hierarchy
     return res;
 }
@@ -54,3 +54,69 @@ unittest_res test_evchain() {
     munmap(pages, n_addrs * PAGE_SIZE);
     return UNITTEST_PASS;
 }
+
+#define N_LINKED 40
+
+unittest_res test_cand_links() {
+    if (cache_env_init(0)) {
+        return UNITTEST_ERR;
+    }
+
+    EVCandsConfig config = {.scaling = 1, .filter_ev = NULL};
+    EVBuffer *evb = evbuffer_new(detected_l2, &config);
+    u8 **addrs = calloc(N_LINKED, sizeof(u8 *));
+    u8 *foreign = mmap_private_init(NULL, PAGE_SIZE, 0);
+    if (!evb || !addrs || !foreign || evb->n_pages < N_LINKED) {
+        return UNITTEST_ERR;
+    }
+
+    unittest_res res = UNITTEST_FAIL;
+    // the link never overlaps the evchain pointers, at any offset
+    for (uintptr_t off = 0; off < PAGE_SIZE; off++) {
+        u8 *addr = (u8 *)evb->buf + off;
+        uintptr_t slot = (uintptr_t)_cand_link_slot(addr);
+        if ((slot >> CL_SHIFT) != ((uintptr_t)addr >> CL_SHIFT) ||
+            slot % sizeof(u8 *) ||
+            (slot < (uintptr_t)addr + sizeof(evchain) &&
+             slot + sizeof(u8 *) > (uintptr_t)addr)) {
+            goto err;
+        }
+    }
+
+    for (u32 i = 0; i < N_LINKED; i++) {
+        // an unaligned offset, whose link wraps around within its line
+        addrs[i] = (u8 *)evb->buf + (N_LINKED - 1 - i) * PAGE_SIZE + 0x430;
+    }
+
+    cand_links saved;
+    if (!cand_links_begin(addrs, N_LINKED, &saved) ||
+        !cand_links_active(&addrs[3], N_LINKED - 3)) {
+        goto err;
+    }
+
+    for (u32 i = 0; i < N_LINKED; i++) {
+        u8 *prev = i >= CAND_LINK_WAYS ? addrs[i - CAND_LINK_WAYS] : addrs[i];
+        if (((uintptr_t)_cand_link_slot(addrs[i]) >> CL_SHIFT) !=
+                ((uintptr_t)addrs[i] >> CL_SHIFT) ||
+            _cand_link(addrs[i]) != prev) {
+            goto err;
+        }
+    }
+    access_links_bwd(addrs, N_LINKED);
+    cand_links_end(&saved);
+
+    // lines outside EVBuffers are never written
+    addrs[N_LINKED / 2] = foreign;
+    if (cand_links_active(addrs, N_LINKED) ||
+        cand_links_begin(addrs, N_LINKED, &saved) ||
+        cand_links_active(addrs, N_LINKED) || *_cand_link_slot(foreign)) {
+        goto err;
+    }
+    res = UNITTEST_PASS;
+
+err:
+    munmap(foreign, PAGE_SIZE);
+    free(addrs);
+    evbuffer_free(evb);
+    return res;
+}
@@ -1,4 +1,5 @@
 #include "cache/cache.h"
+#include "cache/pagemap.h"
 #include "core.h"
 #include "tests.h"
 
@@ -61,3 +62,87 @@ unittest_res test_evset_l2() {
     evset_free(l2_evset);
     return res;
 }
+
+unittest_res test_evset_l2_sprt() {
+    if (cache_env_init(0)) {
+        _error("Failed to initialize cache env!\n");
+        return UNITTEST_ERR;
+    }
+
+    u8 *target = calloc(PAGE_SIZE, 1);
+    if (!target) {
+        return UNITTEST_ERR;
+    }
+
+    EVBuildConfig config = def_l2_ev_config;
+    config.test_config.sprt_alpha = 0.001;
+    config.test_config.sprt_beta = 0.001;
+    if (sprt_calibrate(target, &config.test_config, 1000, 0.9)) {
+        free(target);
+        return UNITTEST_FAIL;
+    }
+    config.test_config.test = sprt_test_eviction;
+
+    EVSet *l2_evset = build_l2_EVSet(target, &config, NULL);
+    if (!l2_evset) {
+        free(target);
+        _error("Failed to build an l2 eviction set with SPRT\n");
+        return UNITTEST_FAIL;
+    }
+
+    // verify with the classic test
+    unittest_res res = UNITTEST_FAIL;
+    l2_evset->config = &def_l2_ev_config;
+    if (precise_evset_test(target, l2_evset) == EV_POS) {
+        res = UNITTEST_PASS;
+    }
+
+    free(target);
+    evset_free(l2_evset);
+    return res;
+}
+
+unittest_res test_evset_l2_pa() {
+    if (cache_env_init(0)) {
+        _error("Failed to initialize cache env!\n");
+        return UNITTEST_ERR;
+    }
+
+    if (pagemap_init()) {
+        return UNITTEST_SKIP; // not root
+    }
+
+    u8 *target = calloc(PAGE_SIZE, 1);
+    if (!target) {
+        pagemap_cleanup();
+        return UNITTEST_ERR;
+    }
+    *target = 1;
+
+    // the candidates are narrowed to the target's set before any timing
+    unittest_res res = UNITTEST_FAIL;
+    EVBuildConfig conf = def_l2_ev_config;
+    conf.cands_config.pa_assist = true;
+    EVSet *l2_evset = build_l2_EVSet(target, &conf, NULL);
+    if (!l2_evset) {
+        _error("Failed to build an l2 eviction set from physical addresses\n");
+        goto err;
+    }
+
+    i32 set = cache_set_idx(target, detected_l2);
+    for (u32 i = 0; i < l2_evset->size; i++) {
+        if (cache_set_idx(l2_evset->addrs[i], detected_l2) != set) {
+            goto err;
+        }
+    }
+
+    if (precise_evset_test(target, l2_evset) == EV_POS) {
+        res = UNITTEST_PASS;
+    }
+
+err:
+    free(target);
+    evset_free(l2_evset);
+    pagemap_cleanup();
+    return res;
+}
@@ -0,0 +1,70 @@
+#include "tests.h"
+#include "cache/cache.h"
+#include "cache/evset_health.h"
+#include "sync.h"
+
+unittest_res test_evset_health() {
+    if (cache_env_init(0)) {
+        _error("Failed to initialize cache env!\n");
+        return UNITTEST_ERR;
+    }
+
+    u8 *target = calloc(PAGE_SIZE, 1);
+    if (!target) {
+        return UNITTEST_ERR;
+    }
+
+    unittest_res res = UNITTEST_FAIL;
+    evset_health *health = NULL;
+    EVSet *l2_evset = NULL;
+    for (u32 i = 0; i < 5 && !l2_evset; i++) {
+        l2_evset = build_l2_EVSet(target, &def_l2_ev_config, NULL);
+        if (l2_evset && generic_evset_test(target, l2_evset) != EV_POS) {
+            evset_free(l2_evset);
+            l2_evset = NULL;
+        }
+    }
+
+    if (!l2_evset) {
+        goto err;
+    }
+
+    health = evset_health_new(1000, 0.5);
+    if (!health || evset_health_watch(health, l2_evset, target, false)) {
+        res = UNITTEST_ERR;
+        goto err;
+    }
+
+    // emulate migrated pages: lines at another set index never conflict
+    for (u32 i = 0; i < l2_evset->size; i++) {
+        l2_evset->addrs[i] += CL_SIZE;
+    }
+
+    // a successful repair has been verified by the check itself
+    if (!evset_health_check(health, &health->ents[0]) ||
+        health->ents[0].broken) {
+        goto err;
+    }
+
+    // the monitor thread only checks while the loop below is parked
+    if (evset_health_start(health)) {
+        res = UNITTEST_ERR;
+        goto err;
+    }
+
+    u64 start = time_ns();
+    while (health->ents[0].n_checks < 3 && time_ns() - start < 2000000000ul) {
+        evset_health_poll(health);
+    }
+    evset_health_stop(health);
+
+    if (health->ents[0].n_checks >= 3) {
+        res = UNITTEST_PASS;
+    }
+
+err:
+    evset_health_free(health);
+    evset_free(l2_evset);
+    free(target);
+    return res;
+}
@@ -0,0 +1,141 @@
+#include "tests.h"
+#include "cache/evset_stats.h"
+#include <pthread.h>
+
+#define N_THREADS 4
+#define N_INCS 1000
+
+static void *record_stats(void *arg) {
+    struct evset_stats *stats = evset_stats_cur();
+    for (u32 i = 0; i < N_INCS; i++) {
+        stats->cands_tests += 1;
+        inc_retry(stats, i % 3);
+    }
+    return NULL;
+}
+
+unittest_res test_evset_stats() {
+    reset_evset_stats();
+
+    pthread_t pids[N_THREADS];
+    for (u32 t = 0; t < N_THREADS; t++) {
+        if (pthread_create(&pids[t], NULL, record_stats, NULL)) {
+            return UNITTEST_ERR;
+        }
+    }
+
+    // an explicit context bound by the main thread
+    struct evset_stats *ctx = evset_stats_new();
+    if (!ctx) {
+        return UNITTEST_ERR;
+    }
+    struct evset_stats *prev = evset_stats_bind(ctx);
+    record_stats(NULL);
+    evset_stats_bind(prev);
+
+    for (u32 t = 0; t < N_THREADS; t++) {
+        pthread_join(pids[t], NULL);
+    }
+
+    unittest_res res = UNITTEST_FAIL;
+    if (ctx->cands_tests != N_INCS || evset_stats_cur()->cands_tests != 0) {
+        goto err;
+    }
+
+    struct evset_stats agg;
+    evset_stats_aggregate(&agg);
+    if (agg.cands_tests != (N_THREADS + 1) * N_INCS) {
+        goto err;
+    }
+
+    u32 retries = 0;
+    for (u32 i = 0; i < MAX_RETRY_REC; i++) {
+        retries += agg.retry_dist[i];
+    }
+    if (retries != (N_THREADS + 1) * N_INCS || agg.retry_dist[3] != 0) {
+        goto err;
+    }
+
+    reset_evset_stats();
+    evset_stats_aggregate(&agg);
+    if (agg.cands_tests != 0) {
+        goto err;
+    }
+    res = UNITTEST_PASS;
+
+err:
+    evset_stats_free(ctx);
+    return res;
+}
+
+unittest_res test_evset_stats_export() {
+    // every value lies in its bucket, which is at most 1/HIST_SUB wide
+    for (u64 v = 1; v >> HIST_MAX_BITS == 0; v = v * 3 + 1) {
+        u32 b = hist_bucket(v);
+        if (v < hist_bucket_low(b) || v > hist_bucket_high(b) ||
+            (hist_bucket_high(b) - hist_bucket_low(b)) * HIST_SUB > v) {
+            return UNITTEST_FAIL;
+        }
+    }
+
+    struct evset_stats stats, copy;
+    memset(&stats, 0, sizeof(stats));
+    for (u64 i = 1; i <= 1000; i++) {
+        hist_record(&stats.build_hist, i * 1000);
+    }
+    stats.cands_tests = 42;
+    inc_bctr(&stats, 7);
+
+    u64 p50 = hist_quantile(&stats.build_hist, 0.5),
+        p99 = hist_quantile(&stats.build_hist, 0.99);
+    if (p50 < 500000 || p50 > 500000 + 500000 / HIST_SUB || p99 < 990000 ||
+        p99 > 1000000 || hist_quantile(&stats.build_hist, 1) != 1000000) {
+        return UNITTEST_FAIL;
+    }
+
+    FILE *fp = tmpfile();
+    if (!fp) {
+        return UNITTEST_ERR;
+    }
+
+    unittest_res res = UNITTEST_FAIL;
+    if (evset_stats_write_bin(&stats, fp)) {
+        goto err;
+    }
+    rewind(fp);
+    if (evset_stats_read_bin(&copy, fp) ||
+        memcmp(&stats, &copy, sizeof(stats))) {
+        goto err;
+    }
+
+    // a truncated snapshot is rejected
+    char buf[64];
+    rewind(fp);
+    FILE *trunc = NULL;
+    if (fread(buf, sizeof(buf), 1, fp) != 1 ||
+        !(trunc = fmemopen(buf, sizeof(buf), "r"))) {
+        goto err;
+    }
+    bool rejected = evset_stats_read_bin(&copy, trunc);
+    fclose(trunc);
+    if (!rejected) {
+        goto err;
+    }
+
+    fclose(fp);
+    if (!(fp = tmpfile()) || evset_stats_write_json(&stats, fp)) {
+        goto err;
+    }
+    rewind(fp);
+    char json[8192] = {0};
+    if (!fread(json, 1, sizeof(json) - 1, fp) ||
+        !strstr(json, "\"cands_tests\": 42") ||
+        !strstr(json, "\"build\": {\"count\": 1000")) {
+        goto err;
+    }
+    res = UNITTEST_PASS;
+
+err:
+    if (fp) fclose(fp);
+    return res;
+}
@@ -0,0 +1,120 @@
+#include "tests.h"
+#include "cache/cache.h"
+#include "cache/evset_store.h"
+
+#define N_EVSET_ADDRS 4
+
+unittest_res test_evset_store() {
+    if (cache_env_init(0)) {
+        return UNITTEST_ERR;
+    }
+
+    // hugepage buffers must live on hugetlbfs, which may not be mounted
+    if (__has_hugepage) {
+        return UNITTEST_SKIP;
+    }
+
+    char dir[] = "/tmp/evstore-XXXXXX";
+    if (!mkdtemp(dir)) {
+        return UNITTEST_ERR;
+    }
+
+    char buf_path[64], idx_path[64];
+    snprintf(buf_path, sizeof(buf_path), "%s/l2.buf", dir);
+    snprintf(idx_path, sizeof(idx_path), "%s/index", dir);
+
+    unittest_res res = UNITTEST_FAIL;
+    EVBuildConfig config;
+    default_l2_evset_build_config(&config);
+    EVCands *cands = NULL, *restored = NULL, *view = NULL;
+    evstore *st = NULL;
+    EVSet *evset = NULL, *view_evset = NULL;
+
+    bool reused;
+    EVBuffer *evb =
+        evbuffer_open(buf_path, detected_l2, &config.cands_config, &reused);
+    if (!evb || reused) {
+        goto err;
+    }
+
+    cands = evcands_new(detected_l2, &config.cands_config, evb);
+    if (!cands || evcands_populate(0x400, cands, &config.cands_config)) {
+        goto err;
+    }
+
+    evset = evset_new(0x400, &config, detected_l2, cands);
+    if (!evset) {
+        goto err;
+    }
+
+    for (u32 i = 0; i < N_EVSET_ADDRS; i++) {
+        evset->addrs[i] = cands->cands[i * 3];
+    }
+    evset->size = N_EVSET_ADDRS;
+
+    st = evstore_new(&evb, 1);
+    if (!st || evstore_add_evset(st, 0, 1, 2, 3, evset) ||
+        evstore_add_cands(st, 0, 4, 5, 6, cands) ||
+        evstore_save(st, idx_path)) {
+        goto err;
+    }
+    evstore_free(st);
+    st = NULL;
+    evset_free(evset);
+    evcands_free(cands);
+    cands = NULL;
+    evset = NULL;
+
+    // map the same file again; records are relative to the buffer
+    evb = evbuffer_open(buf_path, detected_l2, &config.cands_config, &reused);
+    if (!evb || !reused) {
+        goto err;
+    }
+
+    st = evstore_load(idx_path, &evb, 1);
+    if (!st || st->n_recs != 2 || st->recs[0].kind != EVSTORE_EVSET ||
+        st->recs[0].key[2] != 3 || st->recs[1].kind != EVSTORE_CANDS) {
+        goto err;
+    }
+
+    restored = evstore_rec_cands(st, &st->recs[1], detected_l2,
+                                 &config.cands_config);
+    if (!restored) {
+        goto err;
+    }
+
+    evset = evstore_rec_evset(st, &st->recs[0], &config, detected_l2, restored);
+    if (!evset || evset->size != N_EVSET_ADDRS) {
+        goto err;
+    }
+
+    for (u32 i = 0; i < N_EVSET_ADDRS; i++) {
+        if (evset->addrs[i] != restored->cands[i * 3] ||
+            restored->cands[i * 3] != evb->buf + 0x400 + i * 3 * PAGE_SIZE) {
+            goto err;
+        }
+    }
+
+    // an evset restored on a view leaves the view compact
+    view = evcands_shift(restored, 0x400 + CL_SIZE);
+    view_evset = view ? evstore_rec_evset(st, &st->recs[0], &config,
+                                          detected_l2, view)
+                      : NULL;
+    if (!view_evset || view->cands ||
+        view_evset->addrs[0] != evset->addrs[0]) {
+        goto err;
+    }
+    res = UNITTEST_PASS;
+
+err:
+    evset_free(view_evset);
+    evcands_free(view);
+    evset_free(evset);
+    evstore_free(st);
+    evcands_free(cands);
+    evcands_free(restored);
+    unlink(buf_path);
+    unlink(idx_path);
+    rmdir(dir);
+    return res;
+}
@@ -0,0 +1,93 @@
+#include "cache/cache.h"
+#include "cache/helper_thread.h"
+#include "tests.h"
+
+static u32 n_traversed;
+
+static void count_traverse(u8 **cands, size_t cnt, struct _evtest_config *c) {
+    for (size_t i = 0; i < cnt; i++) {
+        _maccess(cands[i]);
+    }
+    n_traversed += cnt;
+}
+
+unittest_res test_helper_thread() {
+    u32 n_lines = 3 * HELPER_MAX_BATCH + 1;
+    u8 *buf = mmap_shared_init(NULL, n_lines * CL_SIZE, 0);
+    static helper_thread_ctrl ctrl;
+    if (!buf) {
+        return UNITTEST_ERR;
+    }
+
+    unittest_res res = UNITTEST_FAIL;
+    u8 *lines[n_lines];
+    for (u32 i = 0; i < n_lines; i++) {
+        lines[i] = buf + i * CL_SIZE;
+    }
+
+    if (start_helper_thread(&ctrl)) {
+        munmap(buf, n_lines * CL_SIZE);
+        return UNITTEST_ERR;
+    }
+
+    // batches larger than the mailbox are split
+    helper_thread_read_batch(lines, n_lines, &ctrl);
+    if (ctrl.req.seq != ctrl.resp.done || ctrl.batch.n_cmds != 0) {
+        _error("Batch not completed\n");
+        goto err;
+    }
+
+    // the helper runs the commands of a batch in order
+    n_traversed = 0;
+    for (u32 i = 0; i < 3; i++) {
+        helper_thread_push(&ctrl, TRAVERSE_CANDS)->trav =
+            (struct helper_thread_traverse_cands){.traverse = count_traverse,
+                                                  .cands = lines,
+                                                  .cnt = n_lines};
+    }
+    helper_thread_push(&ctrl, TIME_SINGLE)->addr = lines[0];
+    helper_thread_flush(&ctrl);
+    if (n_traversed != 3 * n_lines) {
+        _error("Traversed %u lines, expecting %u\n", n_traversed, 3 * n_lines);
+        goto err;
+    }
+
+    u64 lat = helper_thread_time_single(lines[1], &ctrl);
+    if (lat == 0 || ctrl.req.seq != ctrl.resp.done) {
+        _error("Bad timed read: %lu\n", lat);
+        goto err;
+    }
+
+    // the stripes of a pool cover every candidate once
+    helper_thread_pool pool;
+    if (start_helper_pool(&pool, 3, NULL)) {
+        res = UNITTEST_ERR;
+        goto err;
+    }
+    size_t next = 0;
+    for (u32 h = 0; h < pool.n_helpers; h++) {
+        size_t lo, hi;
+        helper_pool_stripe(&pool, h, n_lines, &lo, &hi);
+        if (lo != next) break;
+        next = hi;
+    }
+
+    EVTestConfig tconf = {.ev_repeat = 1, .block = 4, .stride = 2,
+                          .hpool = &pool};
+    skx_sf_cands_traverse_mt(lines, n_lines, &tconf);
+    bool done = true;
+    for (u32 h = 0; h < pool.n_helpers; h++) {
+        done = done && pool.ctrls[h].req.seq == pool.ctrls[h].resp.done;
+    }
+    stop_helper_pool(&pool);
+    if (next != n_lines || !done || pool.ctrls) {
+        _error("Bad helper pool traversal\n");
+        goto err;
+    }
+    res = UNITTEST_PASS;
+
+err:
+    stop_helper_thread(&ctrl);
+    munmap(buf, n_lines * CL_SIZE);
+    return res;
+}
@@ -0,0 +1,53 @@
+#include "tests.h"
+#include "cache/cache.h"
+
+#define OFFSET 0x400
+
+unittest_res test_hugepage() {
+    if (cache_env_init(0)) {
+        return UNITTEST_ERR;
+    }
+
+    // works without reserved hugepages: THP or 4KB pages are the fallback
+    bool hugepage = __has_hugepage;
+    u32 shift = __hugepage_shift;
+    cache_use_hugepage();
+    EVCandsConfig config = {2, NULL};
+    EVCands *cands = evcands_new(detected_l2, &config, NULL);
+    __has_hugepage = hugepage;
+    __hugepage_shift = shift;
+    if (!cands) {
+        return UNITTEST_FAIL;
+    }
+
+    unittest_res res = UNITTEST_FAIL;
+    hugepage_buf *hp = &cands->evb->hp;
+    if (hp->backing != HUGEPAGE_NONE && !_ALIGNED(hp->buf, hp->page_shift)) {
+        goto err;
+    }
+
+    if (evcands_populate(OFFSET, cands, &config) || !cands->size) {
+        goto err;
+    }
+
+    // candidates on hugepages share all bits below the stride with the target
+    bool huge = cands->ctrl_bits > PAGE_SHIFT;
+    u64 stride = huge ? cache_congruent_stride(detected_l2) : PAGE_SIZE;
+    for (size_t i = 0; i < cands->size; i++) {
+        u64 off = cands->cands[i] - (u8 *)hp->buf;
+        if (off % stride != OFFSET ||
+            (huge && !hugepage_region_huge(hp, off >> hp->page_shift))) {
+            goto err;
+        }
+    }
+
+    if (evcands_uncertainty(cands, detected_l2) !=
+        cache_uncertainty_at(detected_l2, cands->ctrl_bits)) {
+        goto err;
+    }
+    res = UNITTEST_PASS;
+
+err:
+    evcands_free(cands);
+    return res;
+}
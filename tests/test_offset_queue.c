@@ -0,0 +1,70 @@
+#include "cache/offset_queue.h"
+#include "tests.h"
+
+#define N_PUSHED 100
+
+static void *push_all(void *arg) {
+    offset_queue *q = arg;
+    for (u32 n = 0; n < N_PUSHED; n++) {
+        if (offset_queue_push(q, n)) {
+            break;
+        }
+    }
+    offset_queue_close(q);
+    return NULL;
+}
+
+unittest_res test_offset_queue() {
+    static offset_queue q;
+    unittest_res res = UNITTEST_FAIL;
+    u32 n;
+
+    // first in, first out, also after the slots wrap around
+    offset_queue_init(&q, 2);
+    for (u32 r = 0; r < 3; r++) {
+        if (offset_queue_push(&q, 2 * r) || offset_queue_push(&q, 2 * r + 1)) {
+            goto err;
+        }
+        for (u32 i = 0; i < 2; i++) {
+            if (offset_queue_pop(&q, &n) || n != 2 * r + i) {
+                goto err;
+            }
+        }
+    }
+
+    // a closed queue takes no more offsets but drains the ones it holds
+    if (offset_queue_push(&q, 7)) {
+        goto err;
+    }
+    offset_queue_close(&q);
+    if (!offset_queue_push(&q, 8) || offset_queue_pop(&q, &n) || n != 7 ||
+        !offset_queue_pop(&q, &n)) {
+        goto err;
+    }
+    offset_queue_destroy(&q);
+
+    // a producer blocked on the full queue hands over every offset in order
+    pthread_t pid;
+    offset_queue_init(&q, 2);
+    if (pthread_create(&pid, NULL, push_all, &q)) {
+        offset_queue_destroy(&q);
+        return UNITTEST_ERR;
+    }
+    u32 n_popped = 0;
+    while (!offset_queue_pop(&q, &n)) {
+        if (n != n_popped) {
+            _error("Popped %u, expected %u\n", n, n_popped);
+            offset_queue_close(&q);
+            break;
+        }
+        n_popped += 1;
+    }
+    pthread_join(pid, NULL);
+    if (n_popped == N_PUSHED) {
+        res = UNITTEST_PASS;
+    }
+
+err:
+    offset_queue_destroy(&q);
+    return res;
+}
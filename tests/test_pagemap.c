@@ -0,0 +1,54 @@
+#include "tests.h"
+#include "cache/cache.h"
+#include "cache/pagemap.h"
+
+#define N_PAGES 256
+
+// the entry of "addr" read directly, bypassing the cache
+static uintptr_t uncached_pa(int fd, u8 *addr) {
+    u64 ent;
+    off_t off = ((uintptr_t)addr >> PAGE_SHIFT) * sizeof(ent);
+    if (pread(fd, &ent, sizeof(ent), off) != sizeof(ent) ||
+        !(ent & PAGEMAP_PRESENT)) {
+        return -1;
+    }
+    return ((ent & PAGEMAP_PFN_MASK) << PAGE_SHIFT) |
+           ((uintptr_t)addr & (PAGE_SIZE - 1));
+}
+
+unittest_res test_pagemap() {
+    if (pagemap_init()) {
+        return UNITTEST_SKIP; // not root
+    }
+
+    int fd = open("/proc/self/pagemap", O_RDONLY);
+    u8 *buf = mmap_shared_init(NULL, N_PAGES * PAGE_SIZE, 1);
+    unittest_res res = UNITTEST_ERR;
+    if (fd < 0 || !buf || pagemap_cache_range(buf, N_PAGES * PAGE_SIZE)) {
+        goto err;
+    }
+
+    res = UNITTEST_FAIL;
+    for (u32 i = 0; i < N_PAGES; i++) {
+        u8 *addr = buf + i * PAGE_SIZE + (i * CL_SIZE) % PAGE_SIZE;
+        uintptr_t pa = pagemap_pa(addr);
+        if (pa == (uintptr_t)-1 || pa != uncached_pa(fd, addr)) {
+            goto err_uncache;
+        }
+    }
+
+    // not cached, resolved page by page
+    u64 probe = 0;
+    if (pagemap_pa(&probe) != uncached_pa(fd, (u8 *)&probe)) {
+        goto err_uncache;
+    }
+    res = UNITTEST_PASS;
+
+err_uncache:
+    pagemap_uncache_range(buf);
+err:
+    if (buf) munmap(buf, N_PAGES * PAGE_SIZE);
+    if (fd >= 0) close(fd);
+    pagemap_cleanup();
+    return res;
+}
@@ -0,0 +1,188 @@
+#include "cache/cache.h"
+#include "cache/evset_bench.h"
+#include "cache/sim.h"
+#include "tests.h"
+
+// a small hierarchy keeps the candidate buffers short
+static void small_sim_config(cache_sim_config *config) {
+    cache_sim_config_skx(config, 4);
+    config->l2.n_sets = 256;
+    config->l2.n_ways = 8;
+    config->llc.n_sets = 512;
+    config->sf.n_sets = 512;
+}
+
+struct _cache_sim *small_sim_new(double lat_noise) {
+    cache_sim_config config;
+    small_sim_config(&config);
+    config.lat_noise = lat_noise;
+    return cache_sim_new(&config);
+}
+
+// n_ways L2-congruent lines evict the target under every policy
+static bool policy_evicts(sim_repl_policy repl, u8 *buf, size_t n_pages) {
+    cache_sim_config config;
+    small_sim_config(&config);
+    config.l2.repl = repl;
+    cache_sim *sim = cache_sim_new(&config);
+    if (!sim) {
+        return false;
+    }
+
+    u8 *target = buf, *cong[16];
+    u32 n_cong = 0;
+    u64 key = cache_sim_key(sim, 2, target);
+    for (size_t i = 1; i < n_pages && n_cong < config.l2.n_ways; i++) {
+        if (cache_sim_key(sim, 2, buf + i * PAGE_SIZE) == key) {
+            cong[n_cong++] = buf + i * PAGE_SIZE;
+        }
+    }
+
+    bool ok = n_cong == config.l2.n_ways &&
+              cache_sim_access(sim, 0, target) == config.mem_lat &&
+              cache_sim_access(sim, 0, target) == config.l1d.lat;
+    for (u32 r = 0; ok && r < 8; r++) {
+        for (u32 i = 0; i < n_cong; i++) {
+            cache_sim_access(sim, 0, cong[i]);
+        }
+    }
+    ok = ok && cache_sim_access(sim, 0, target) > config.l2.lat;
+    cache_sim_free(sim);
+    return ok;
+}
+
+// lines both cores access are kept in the LLC, which back-invalidates them:
+// a target loaded and traversed past by both cores is evicted by n_ways lines
+// of its LLC set, while the same traversal from one core leaves it in its L2
+static bool shared_lines_evict(u8 *buf, size_t n_pages) {
+    cache_sim_config config;
+    small_sim_config(&config);
+    // only the slice is unknown, and the LLC and SF sets keep their order
+    config.llc.n_sets = config.sf.n_sets = 64;
+    config.llc.repl = SIM_REPL_LRU;
+    cache_sim *sim = cache_sim_new(&config);
+    if (!sim) {
+        return false;
+    }
+
+    // outside the target's L2 set, so only the LLC can evict it
+    u8 *target = buf, *cands[16];
+    u32 n_cands = 0;
+    u64 llc_key = cache_sim_key(sim, 3, target),
+        l2_key = cache_sim_key(sim, 2, target);
+    for (size_t i = 1; i < n_pages && n_cands < config.llc.n_ways; i++) {
+        u8 *line = buf + i * PAGE_SIZE;
+        if (cache_sim_key(sim, 3, line) == llc_key &&
+            cache_sim_key(sim, 2, line) != l2_key) {
+            cands[n_cands++] = line;
+        }
+    }
+
+    EVTestConfig tconf = {.ev_repeat = 1, .access_cnt = 1};
+    bool ok = n_cands == config.llc.n_ways &&
+              cache_sim_eviction_trial(sim, target, cands, n_cands, &tconf,
+                                       false) < config.mem_lat;
+
+    cache_sim_reset(sim);
+    tconf.need_helper = true;
+    ok = ok && cache_sim_eviction_trial(sim, target, cands, n_cands, &tconf,
+                                        false) == config.mem_lat;
+    cache_sim_free(sim);
+    return ok;
+}
+
+// one osc-bench sweep point in the simulator: every repetition succeeds and
+// is accounted for
+static bool bench_point_succeeds(cache_sim *sim, u8 *page) {
+    u64 duras[4];
+    bench_config bc = {.target = BENCH_TARGET_L2,
+                       .reps = _array_size(duras),
+                       .seed = 1,
+                       .max_tries = 10,
+                       .l2_filter = true,
+                       .sim = sim};
+    bench_point pt = {.algo_name = "straw",
+                      .algo = EVSET_ALGO_LAST_STRAW,
+                      .scaling = 3,
+                      .max_backtrack = 20,
+                      .test_scale = def_l2_ev_config.test_config.test_scale,
+                      .ev_repeat = def_l2_ev_config.test_config.ev_repeat};
+    bench_result res = {.duras = duras, .stats = evset_stats_new()};
+    if (!res.stats) {
+        return false;
+    }
+
+    bench_point_run(&bc, page, &pt, &res);
+    bool ok = res.succ == bc.reps && res.stats->cands_tests > 0;
+    for (u32 r = 0; r < bc.reps; r++) {
+        ok = ok && duras[r] > 0;
+    }
+    evset_stats_free(res.stats);
+    return ok;
+}
+
+unittest_res test_sim() {
+    size_t n_pages = 512;
+    u8 *buf = mmap_shared_init(NULL, n_pages * PAGE_SIZE, 0);
+    if (!buf) {
+        return UNITTEST_ERR;
+    }
+
+    unittest_res res = UNITTEST_FAIL;
+    sim_repl_policy policies[] = {SIM_REPL_LRU, SIM_REPL_PLRU, SIM_REPL_QLRU,
+                                  SIM_REPL_RANDOM};
+    for (u32 i = 0; i < _array_size(policies); i++) {
+        if (!policy_evicts(policies[i], buf, n_pages)) {
+            _error("Policy %u does not evict the target\n", policies[i]);
+            goto err;
+        }
+    }
+
+    if (!shared_lines_evict(buf, n_pages)) {
+        _error("Shared lines are not back-invalidated by the LLC\n");
+        goto err;
+    }
+
+    // the builders run unchanged against the model, and its ground truth
+    // checks the result
+    cache_sim_config config;
+    small_sim_config(&config);
+    cache_sim *sim = small_sim_new(0);
+    if (!sim) {
+        res = UNITTEST_ERR;
+        goto err;
+    }
+    cache_sim_env_init(sim);
+
+    u8 *target = buf + 5 * CL_SIZE;
+    EVSet *l2_evset = build_l2_EVSet(target, &def_l2_ev_config, NULL);
+    if (!l2_evset || l2_evset->size < config.l2.n_ways) {
+        _error("Failed to build a simulated l2 eviction set\n");
+        goto err_sim;
+    }
+
+    u64 key = cache_sim_key(sim, 2, target);
+    for (u32 i = 0; i < l2_evset->size; i++) {
+        if (cache_sim_key(sim, 2, l2_evset->addrs[i]) != key) {
+            goto err_sim;
+        }
+    }
+
+    if (precise_evset_test(target, l2_evset) != EV_POS) {
+        goto err_sim;
+    }
+
+    if (!bench_point_succeeds(sim, buf)) {
+        _error("A simulated sweep point failed\n");
+        goto err_sim;
+    }
+    res = UNITTEST_PASS;
+
+err_sim:
+    evset_free(l2_evset);
+    cache_sim_free(sim);
+    cache_env_init(0); // back to the detected hierarchy
+err:
+    munmap(buf, n_pages * PAGE_SIZE);
+    return res;
+}
@@ -0,0 +1,108 @@
+#include "tests.h"
+#include "cache/slice_model.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define N_SAMPLES 512
+
+// a made-up XOR-linear hash of 8 slices
+static const u64 hash_masks[3] = {0x1b5f575440ull, 0x2eb5faa880ull,
+                                  0x3cccc93100ull};
+
+static u32 ref_slice(u64 pa) {
+    u32 slice = 0;
+    for (u32 b = 0; b < 3; b++) {
+        slice |= (_count_ones(pa & hash_masks[b]) & 1) << b;
+    }
+    return slice;
+}
+
+static u64 rand_pa() {
+    return (((u64)rand() << 31) | rand()) & ((1ull << 40) - 1) & ~CL_MASK;
+}
+
+unittest_res test_slice_model() {
+    u64 pas[N_SAMPLES];
+    u32 slices[N_SAMPLES];
+    for (u32 i = 0; i < N_SAMPLES; i++) {
+        pas[i] = rand_pa();
+        slices[i] = ref_slice(pas[i]);
+    }
+
+    char dir[] = "/tmp/slice-model-XXXXXX";
+    if (!mkdtemp(dir)) {
+        return UNITTEST_ERR;
+    }
+
+    unittest_res res = UNITTEST_FAIL;
+    slice_model *m = slice_model_new(8), *loaded = NULL, *tbl = NULL;
+    if (!m || slice_model_fit(m, pas, slices, N_SAMPLES) ||
+        m->kind != SLICE_MODEL_LINEAR || slice_model_save(m, dir)) {
+        goto err;
+    }
+
+    loaded = slice_model_load(dir, 8);
+    if (!loaded || loaded->kind != SLICE_MODEL_LINEAR ||
+        !slice_model_generalizes(loaded)) {
+        goto err;
+    }
+
+    // the hash generalizes to lines that have not been sampled
+    for (u32 i = 0; i < N_SAMPLES; i++) {
+        u64 pa = rand_pa();
+        if (slice_model_lookup(loaded, pa) != (i32)ref_slice(pa)) {
+            goto err;
+        }
+    }
+
+    // a non-power-of-two count only remembers the sampled lines
+    tbl = slice_model_new(6);
+    for (u32 i = 0; i < N_SAMPLES; i++) {
+        slices[i] %= 6;
+    }
+    if (!tbl || slice_model_fit(tbl, pas, slices, N_SAMPLES / 2) ||
+        slice_model_fit(tbl, pas + N_SAMPLES / 2, slices + N_SAMPLES / 2,
+                        N_SAMPLES / 2) ||
+        tbl->kind != SLICE_MODEL_TABLE || slice_model_generalizes(tbl)) {
+        goto err;
+    }
+
+    for (u32 i = 0; i < N_SAMPLES; i++) {
+        if (slice_model_lookup(tbl, pas[i]) != (i32)slices[i]) {
+            goto err;
+        }
+    }
+
+    // a table whose entry count runs past the end of the file is refused
+    char tbl_path[4096];
+    slice_model_path(tbl_path, sizeof(tbl_path), dir, 6);
+    if (slice_model_save(tbl, dir)) {
+        goto err;
+    }
+    FILE *fp = fopen(tbl_path, "r+b");
+    u64 bogus = 1ull << 40;
+    long n_ents_off = 6 * sizeof(u32) + sizeof(tbl->masks);
+    bool written = fp && !fseek(fp, n_ents_off, SEEK_SET) &&
+                   fwrite(&bogus, sizeof(bogus), 1, fp) == 1;
+    if (fp) fclose(fp);
+    slice_model *bad = written ? slice_model_load(dir, 6) : NULL;
+    unlink(tbl_path);
+    if (!written || bad) {
+        slice_model_free(bad);
+        goto err;
+    }
+    res = UNITTEST_PASS;
+
+err:
+    if (m) {
+        char path[4096];
+        slice_model_path(path, sizeof(path), dir, 8);
+        unlink(path);
+    }
+    rmdir(dir);
+    slice_model_free(m);
+    slice_model_free(loaded);
+    slice_model_free(tbl);
+    return res;
+}
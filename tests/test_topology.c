@@ -0,0 +1,73 @@
+#include "cache/helper_thread.h"
+#include "cache/topology.h"
+#include "tests.h"
+
+unittest_res test_topology() {
+    const cpu_topology *topo = cpu_topology_get();
+    if (!topo) {
+        return UNITTEST_SKIP;
+    }
+
+    int cpu;
+    if (cpu_topology_pick(1, 1, &cpu) || !cpu_topology_known(topo, cpu)) {
+        return UNITTEST_FAIL;
+    }
+
+    cpu_set_t old, set;
+    sched_getaffinity(0, sizeof(old), &old);
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set)) {
+        cpu_topology_release(cpu);
+        return UNITTEST_ERR;
+    }
+
+    // rdtscp reports the CPU we are pinned to, and no CPU pairs with its
+    // own core
+    unittest_res res = UNITTEST_FAIL;
+    u32 aux;
+    _rdtscp_aux(&aux);
+    const cpu_place *p = &topo->cpus[cpu];
+    if (tsc_aux_cpu(aux) != cpu || cpu_topology_pair_ok(topo, cpu, cpu) ||
+        !cpu_topology_known(topo, p->core) ||
+        topo->cpus[p->core].core != p->core) {
+        goto out;
+    }
+
+    // a helper goes to another core of the LLC, or stays unpinned if there
+    // is none; the placement check agrees
+    helper_thread_ctrl *ctrl = NULL;
+    if (posix_memalign((void **)&ctrl, CL_SIZE, sizeof(*ctrl))) {
+        res = UNITTEST_ERR;
+        goto out;
+    }
+    memset(ctrl, 0, sizeof(*ctrl));
+    if (start_helper_thread(ctrl)) {
+        free(ctrl);
+        res = UNITTEST_ERR;
+        goto out;
+    }
+    int helper_cpu = helper_thread_cpu(ctrl);
+    bool ok = ctrl->core < 0 || (ctrl->core == helper_cpu &&
+                                 cpu_topology_pair_ok(topo, cpu, helper_cpu) &&
+                                 !helper_thread_check_placement(ctrl));
+    stop_helper_thread(ctrl);
+
+    // stopping the helper hands the caller its affinity back
+    cpu_set_t cur;
+    sched_setaffinity(0, sizeof(old), &old);
+    memset(ctrl, 0, sizeof(*ctrl));
+    ok = ok && !start_helper_thread(ctrl);
+    stop_helper_thread(ctrl);
+    ok = ok && !sched_getaffinity(0, sizeof(cur), &cur) &&
+         CPU_EQUAL(&cur, &old);
+    free(ctrl);
+    if (ok) {
+        res = UNITTEST_PASS;
+    }
+
+out:
+    sched_setaffinity(0, sizeof(old), &old);
+    cpu_topology_release(cpu);
+    return res;
+}
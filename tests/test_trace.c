@@ -0,0 +1,82 @@
+#include "cache/cache.h"
+#include "cache/sim.h"
+#include "cache/trace.h"
+#include "tests.h"
+
+static bool file_has(FILE *fp, const char *needle) {
+    char line[512];
+    rewind(fp);
+    while (fgets(line, sizeof(line), fp)) {
+        if (strstr(line, needle)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+unittest_res test_trace() {
+    size_t n_pages = 512;
+    u8 *buf = mmap_shared_init(NULL, n_pages * PAGE_SIZE, 0);
+    if (!buf) {
+        return UNITTEST_ERR;
+    }
+
+    // the simulator makes the recorded tests deterministic
+    cache_sim *sim = small_sim_new(0);
+    FILE *fp = tmpfile();
+    if (!sim || !fp) {
+        if (sim) cache_sim_free(sim);
+        munmap(buf, n_pages * PAGE_SIZE);
+        return UNITTEST_ERR;
+    }
+    cache_sim_env_init(sim);
+
+    unittest_res res = UNITTEST_FAIL;
+    u8 *target = buf + 5 * CL_SIZE;
+    EVSet *evset = build_l2_EVSet(target, &def_l2_ev_config, NULL);
+    if (evtrace_count() != 0) {
+        _error("Events recorded while tracing is off\n");
+        goto err;
+    }
+    evset_free(evset);
+
+    evtrace_start(64);
+    evset = build_l2_EVSet(target, &def_l2_ev_config, NULL);
+    evtrace_stop();
+    u64 cnt = evtrace_count();
+    if (!evset || cnt == 0) {
+        _error("No events recorded\n");
+        goto err;
+    }
+
+    // a stopped trace stays unchanged
+    evset_free(evset);
+    evset = build_l2_EVSet(target, &def_l2_ev_config, NULL);
+    if (evtrace_count() != cnt) {
+        _error("Events recorded after stopping\n");
+        goto err;
+    }
+
+    // the build phase ends last, so it survives the ring wrapping around
+    if (evtrace_write_chrome(fp) || !file_has(fp, "\"traceEvents\"") ||
+        !file_has(fp, "\"name\": \"build\"")) {
+        _error("Malformed trace\n");
+        goto err;
+    }
+
+    // a restart drops the earlier events
+    evtrace_start(64);
+    evtrace_stop();
+    if (evtrace_count() == 0) {
+        res = UNITTEST_PASS;
+    }
+
+err:
+    evtrace_cleanup();
+    evset_free(evset);
+    fclose(fp);
+    cache_sim_free(sim);
+    cache_env_init(0); // back to the detected hierarchy
+    munmap(buf, n_pages * PAGE_SIZE);
+    return res;
+}
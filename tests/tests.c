@@ -19,9 +19,25 @@ unittest_case TESTS[] = {
     {test_bitwise_complex, "Test complex bitwise operations", 0},
     {test_cache_latency, "Test cache latency invariants", 1},
     {test_evchain, "Test evchain structure", 0},
+    {test_cand_links, "Test intrusive candidate links", 0},
+    {test_helper_thread, "Test helper thread mailbox", 0},
+    {test_topology, "Test CPU topology and pinning", 0},
+    {test_offset_queue, "Test offset queue ordering", 0},
     {test_evcands, "Test eviction candidates", 0},
+    {test_hugepage, "Test hugepage fallback", 0},
+    {test_pagemap, "Test pagemap physical addresses", 0},
     {test_evset_l1d, "Test L1d eviction set", 3},
-    {test_evset_l2, "Test L2 eviction set", 3}};
+    {test_evset_l2, "Test L2 eviction set", 3},
+    {test_evset_l2_sprt, "Test L2 eviction set with SPRT", 3},
+    {test_evset_l2_pa, "Test L2 eviction set by physical address", 3},
+    {test_evset_stats, "Test evset stats contexts", 0},
+    {test_evset_stats_export, "Test evset stats export", 0},
+    {test_evset_store, "Test evset store", 0},
+    {test_evset_health, "Test evset health monitor", 3},
+    {test_slice_model, "Test slice hash model", 0},
+    {test_sim, "Test cache simulator", 0},
+    {test_evcands_colors, "Test L2 color classification", 0},
+    {test_trace, "Test event tracing", 0}};
 
 void print_time_diff(struct timespec *tstart, struct timespec *tend) {
     assert(tstart && tend);
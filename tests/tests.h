@@ -10,12 +10,33 @@ typedef enum {
     UNITTEST_SKIP
 } unittest_res;
 
+struct _cache_sim;
+
+// a small Skylake-SP-like simulated hierarchy, see test_sim.c
+struct _cache_sim *small_sim_new(double lat_noise);
+
 unittest_res test_bitwise_basic();
 unittest_res test_bitwise_complex();
 unittest_res test_cache_latency();
 unittest_res test_evchain();
+unittest_res test_cand_links();
+unittest_res test_helper_thread();
+unittest_res test_topology();
+unittest_res test_offset_queue();
 unittest_res test_evcands();
+unittest_res test_evcands_colors();
+unittest_res test_hugepage();
+unittest_res test_pagemap();
 unittest_res test_evset_l1d();
 unittest_res test_evset_l2();
+unittest_res test_evset_l2_sprt();
+unittest_res test_evset_l2_pa();
+unittest_res test_evset_stats();
+unittest_res test_evset_stats_export();
+unittest_res test_evset_store();
+unittest_res test_evset_health();
+unittest_res test_slice_model();
+unittest_res test_sim();
+unittest_res test_trace();
 
 #endif // TESTS_H